@@ -9,23 +9,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
-#include "../pt2_header.h"
-#include "../pt2_config.h"
-#include "../pt2_structs.h"
-#include "../pt2_replayer.h"
-#include "../pt2_textout.h"
-#include "../pt2_visuals.h"
+#include "../pt2_replay_header.h"
+#include "../pt2_module.h"
 
-static int32_t realSampleLengths[15];
-
-module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
+module_t *loadMod15(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg)
 {
 	(void)filesize;
 
-	module_t *m = createEmptyMod();
+	int32_t realSampleLengths[15];
+
+	module_t *m = moduleCreate(maxSampleLength);
 	if (m == NULL)
 	{
-		statusOutOfMemory();
+		*errorMsg = "OUT OF MEMORY !!!";
 		goto loadError;
 	}
 
@@ -42,7 +38,7 @@ module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
 		memcpy(s->text, p, 22); p += 22;
 
 		realSampleLengths[i] = ((p[0] << 8) | p[1]) * 2; p += 2;
-		s->length = (realSampleLengths[i] > config.maxSampleLength) ? config.maxSampleLength : realSampleLengths[i];
+		s->length = (realSampleLengths[i] > maxSampleLength) ? maxSampleLength : realSampleLengths[i];
 
 		/* Only late versions of Ultimate SoundTracker can have samples larger than 9999 bytes.
 		** If detected, we know for sure that this is a late STK module.
@@ -62,14 +58,14 @@ module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
 
 	if (m->header.songLength == 0 || m->header.songLength > 128)
 	{
-		displayErrorMsg("NOT A MOD FILE !");
+		*errorMsg = "NOT A MOD FILE !";
 		goto loadError;
 	}
 
 	uint8_t initTempo = *p++;
 	if (initTempo > 220)
 	{
-		displayErrorMsg("NOT A MOD FILE !");
+		*errorMsg = "NOT A MOD FILE !";
 		goto loadError;
 	}
 
@@ -107,7 +103,7 @@ module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
 
 	if (numPatterns > MAX_PATTERNS)
 	{
-		displayErrorMsg("UNSUPPORTED MOD !");
+		*errorMsg = "UNSUPPORTED MOD !";
 		goto loadError;
 	}
 
@@ -230,8 +226,8 @@ module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
 		}
 
 		int32_t bytesToSkip = 0;
-		if (realSampleLengths[i] > config.maxSampleLength)
-			bytesToSkip = realSampleLengths[i] - config.maxSampleLength;
+		if (realSampleLengths[i] > maxSampleLength)
+			bytesToSkip = realSampleLengths[i] - maxSampleLength;
 
 		// for Ultimate SoundTracker modules, don't load sample data after loop end
 		int32_t loopEnd = s->loopStart + s->loopLength;
@@ -249,19 +245,6 @@ module_t *loadMod15(uint8_t *buffer, uint32_t filesize)
 	return m;
 
 loadError:
-	if (m != NULL)
-	{
-		for (int32_t i = 0; i < MAX_PATTERNS; i++)
-		{
-			if (m->patterns[i] != NULL)
-				free(m->patterns[i]);
-		}
-
-		if (m->sampleData != NULL)
-			free(m->sampleData);
-
-		free(m);
-	}
-
+	moduleFree(m);
 	return NULL;
 }
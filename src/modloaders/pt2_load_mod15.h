@@ -2,6 +2,6 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "../pt2_structs.h"
+#include "../pt2_module.h"
 
-module_t *loadMod15(uint8_t *buffer, uint32_t filesize);
+module_t *loadMod15(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg); // errorMsg is set on failure
@@ -10,13 +10,8 @@
 #include <ctype.h> // isdigit()
 #include <stdint.h>
 #include <stdbool.h>
-#include "../pt2_header.h"
-#include "../pt2_paula.h" // PAULA_VOICES
-#include "../pt2_config.h"
-#include "../pt2_structs.h"
-#include "../pt2_replayer.h"
-#include "../pt2_textout.h"
-#include "../pt2_visuals.h"
+#include "../pt2_replay_header.h"
+#include "../pt2_module.h"
 
 enum // 31-sample .MOD types
 {
@@ -29,17 +24,17 @@ enum // 31-sample .MOD types
 	FORMAT_HMNT // His Master's NoiseTracker (special one)
 };
 
-static int32_t realSampleLengths[MOD_SAMPLES];
-
 static uint8_t getMod31Type(uint8_t *buffer, uint32_t filesize, uint8_t *numChannels); // 0 = not detected
 bool detectMod31(uint8_t *buffer, uint32_t filesize);
 
-module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
+module_t *loadMod31(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg)
 {
-	module_t *m = createEmptyMod();
+	int32_t realSampleLengths[MOD_SAMPLES];
+
+	module_t *m = moduleCreate(maxSampleLength);
 	if (m == NULL)
 	{
-		statusOutOfMemory();
+		*errorMsg = "OUT OF MEMORY !!!";
 		goto loadError;
 	}
 
@@ -47,7 +42,7 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 	uint8_t modFormat = getMod31Type(buffer, filesize, &numChannels);
 	if (modFormat == FORMAT_UNKNOWN || numChannels > PAULA_VOICES)
 	{
-		displayErrorMsg("UNSUPPORTED MOD !");
+		*errorMsg = "UNSUPPORTED MOD !";
 		goto loadError;
 	}
 
@@ -62,7 +57,7 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 		memcpy(s->text, p, 22); p += 22;
 
 		realSampleLengths[i] = ((p[0] << 8) | p[1]) * 2; p += 2;
-		s->length = (realSampleLengths[i] > config.maxSampleLength) ? config.maxSampleLength : realSampleLengths[i];
+		s->length = (realSampleLengths[i] > maxSampleLength) ? maxSampleLength : realSampleLengths[i];
 
 		s->fineTune = *p++ & 0xF;
 		s->volume = *p++;
@@ -86,7 +81,7 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 
 	if (m->header.songLength == 0 || m->header.songLength > 129)
 	{
-		displayErrorMsg("NOT A MOD FILE !");
+		*errorMsg = "NOT A MOD FILE !";
 		goto loadError;
 	}
 
@@ -102,7 +97,7 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 
 	if (numPatterns > MAX_PATTERNS)
 	{
-		displayErrorMsg("UNSUPPORTED MOD !");
+		*errorMsg = "UNSUPPORTED MOD !";
 		goto loadError;
 	}
 
@@ -179,8 +174,8 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 	for (int32_t i = 0; i < MOD_SAMPLES; i++, s++)
 	{
 		int32_t bytesToSkip = 0;
-		if (realSampleLengths[i] > config.maxSampleLength)
-			bytesToSkip = realSampleLengths[i] - config.maxSampleLength;
+		if (realSampleLengths[i] > maxSampleLength)
+			bytesToSkip = realSampleLengths[i] - maxSampleLength;
 
 		memcpy(&m->sampleData[s->offset], p, s->length); p += s->length;
 		if (bytesToSkip > 0)
@@ -191,20 +186,7 @@ module_t *loadMod31(uint8_t *buffer, uint32_t filesize)
 	return m;
 
 loadError:
-	if (m != NULL)
-	{
-		for (int32_t i = 0; i < MAX_PATTERNS; i++)
-		{
-			if (m->patterns[i] != NULL)
-				free(m->patterns[i]);
-		}
-
-		if (m->sampleData != NULL)
-			free(m->sampleData);
-
-		free(m);
-	}
-
+	moduleFree(m);
 	return NULL;
 }
 
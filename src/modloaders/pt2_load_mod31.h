@@ -2,7 +2,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "../pt2_structs.h"
+#include "../pt2_module.h"
 
 bool detectMod31(uint8_t *buffer, uint32_t filesize);
-module_t *loadMod31(uint8_t *buffer, uint32_t filesize);
+module_t *loadMod31(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg); // errorMsg is set on failure
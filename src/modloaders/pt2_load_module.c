@@ -0,0 +1,192 @@
+// for finding memory leaks in debug mode with Visual Studio 
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../pt2_replay_header.h"
+#include "../pt2_module.h"
+#include "pt2_load_mod15.h"
+#include "pt2_load_mod31.h"
+#include "pt2_xpk_unpack.h"
+#include "pt2_pp_unpack.h"
+#include "pt2_load_module.h"
+
+static void fixZeroesInString(char *str, uint32_t maxLength); // converts zeroes to spaces in a string, up until the last zero found
+
+module_t *moduleLoadFile(FILE *f, int32_t maxSampleLength, const char **errorMsg)
+{
+	uint32_t powerPackerID;
+	uint8_t *modBuffer = NULL;
+
+	fseek(f, 0, SEEK_END);
+	uint32_t filesize = ftell(f);
+	rewind(f);
+
+	// check if mod is a powerpacker mod
+	if (fread(&powerPackerID, 1, 4, f) != 4)
+	{
+		*errorMsg = "FILE I/O ERROR !";
+		return NULL;
+	}
+
+	if (powerPackerID == 0x30325850) // "PX20"
+	{
+		*errorMsg = "ENCRYPTED MOD !";
+		return NULL;
+	}
+	else if (powerPackerID == 0x30325050) // "PP20"
+	{
+		modBuffer = unpackPP(f, &filesize);
+		if (modBuffer == NULL)
+		{
+			*errorMsg = "PP UNPACK ERROR !";
+			return NULL;
+		}
+	}
+	else
+	{
+		if (detectXPK(f))
+		{
+			if (!unpackXPK(f, &filesize, &modBuffer))
+			{
+				*errorMsg = "XPK UNPACK ERROR";
+				return NULL;
+			}
+
+			if (modBuffer == NULL)
+			{
+				*errorMsg = "OUT OF MEMORY !!!";
+				return NULL;
+			}
+		}
+		else
+		{
+			modBuffer = (uint8_t *)malloc(filesize);
+			if (modBuffer == NULL)
+			{
+				*errorMsg = "OUT OF MEMORY !!!";
+				return NULL;
+			}
+
+			rewind(f);
+			fread(modBuffer, 1, filesize, f);
+		}
+	}
+
+	module_t *m = moduleLoadMemory(modBuffer, filesize, maxSampleLength, errorMsg);
+
+	free(modBuffer);
+	return m;
+}
+
+module_t *moduleLoadMemory(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg)
+{
+	module_t *m;
+
+	if (detectMod31(buffer, filesize))
+		m = loadMod31(buffer, filesize, maxSampleLength, errorMsg);
+	else
+		m = loadMod15(buffer, filesize, maxSampleLength, errorMsg);
+
+	if (m == NULL)
+		return NULL; // error message is set in the mod loader
+
+	// module is loaded, do some sanitation...
+
+	m->header.name[20] = '\0';
+
+	// convert illegal song name characters to space
+	for (int32_t i = 0; i < 20; i++)
+	{
+		char tmpChar = m->header.name[i];
+		if ((tmpChar < ' ' || tmpChar > '~') && tmpChar != '\0')
+			tmpChar = ' ';
+
+		m->header.name[i] = tmpChar;
+	}
+
+	fixZeroesInString(m->header.name, 20);
+
+	moduleSample_t *s = m->samples;
+	for (int32_t i = 0; i < MOD_SAMPLES; i++, s++)
+	{
+		s->text[22] = '\0';
+
+		// convert illegal sample name characters to space
+		for (int32_t j = 0; j < 22; j++)
+		{
+			char tmpChar = s->text[j];
+			if ((tmpChar < ' ' || tmpChar > '~') && tmpChar != '\0')
+				tmpChar = ' ';
+
+			s->text[j] = tmpChar;
+		}
+
+		fixZeroesInString(s->text, 22);
+
+		if (s->length > maxSampleLength)
+			s->length = maxSampleLength;
+
+		if ((uint8_t)s->volume > 64)
+			s->volume = 64;
+
+		if (s->loopLength < 2)
+			s->loopLength = 2;
+
+		// we don't support samples bigger than 65534 (or 128kB) bytes, disable uncompatible loops
+		if (s->loopStart > maxSampleLength || s->loopStart+s->loopLength > maxSampleLength)
+		{
+			s->loopStart = 0;
+			s->loopLength = 2;
+		}
+
+		// some modules are broken like this, adjust sample length if possible (this is ok if we have room)
+		if (s->length > 0 && s->loopLength > 2 && s->loopStart+s->loopLength > s->length)
+		{
+			int32_t loopOverflowVal = (s->loopStart + s->loopLength) - s->length;
+			if (s->length+loopOverflowVal <= maxSampleLength)
+			{
+				s->length += loopOverflowVal; // this is safe, we're allocating 65534 bytes per sample slot
+			}
+			else
+			{
+				s->loopStart = 0;
+				s->loopLength = 2;
+			}
+		}
+
+		// clear first two bytes of non-looping samples to prevent beep after sample has been played
+		if (s->length >= 2 && s->loopStart+s->loopLength <= 2)
+		{
+			m->sampleData[s->offset+0] = 0;
+			m->sampleData[s->offset+1] = 0;
+		}
+	}
+
+	return m;
+}
+
+static void fixZeroesInString(char *str, uint32_t maxLength)
+{
+	int32_t i;
+
+	for (i = maxLength-1; i >= 0; i--)
+	{
+		if (str[i] != '\0')
+			break;
+	}
+
+	// convert zeroes to spaces
+	if (i > 0)
+	{
+		for (int32_t j = 0; j < i; j++)
+		{
+			if (str[j] == '\0')
+				str[j] = ' ';
+		}
+	}
+}
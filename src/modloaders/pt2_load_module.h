@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../pt2_module.h"
+
+/* Loads a .MOD (15/31 samples, can be PowerPacker or XPK packed) without touching any tracker state.
+** maxSampleLength is the sample slot size (65534 or 131070). On failure, NULL is returned and
+** *errorMsg points to a (static) error message.
+*/
+module_t *moduleLoadFile(FILE *f, int32_t maxSampleLength, const char **errorMsg); // doesn't close f
+module_t *moduleLoadMemory(uint8_t *buffer, uint32_t filesize, int32_t maxSampleLength, const char **errorMsg);
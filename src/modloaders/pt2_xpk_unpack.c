@@ -10,7 +10,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include "../pt2_header.h"
+#include "../pt2_replay_header.h"
 #include "../pt2_helpers.h"
 
 typedef struct XPKFILEHEADER
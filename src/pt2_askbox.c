@@ -6,6 +6,7 @@
 #include "pt2_mouse.h"
 #include "pt2_structs.h"
 #include "pt2_visuals_sync.h"
+#include "pt2_scopes.h"
 #include "pt2_keyboard.h"
 #include "pt2_diskop.h"
 #include "pt2_mod2wav.h"
@@ -119,7 +120,7 @@ void removeAskBox(void)
 	{
 		if (ui.visualizerMode == VISUAL_QUADRASCOPE)
 			renderQuadrascopeBg();
-		else if (ui.visualizerMode == VISUAL_SPECTRUM)
+		else
 			renderSpectrumAnalyzerBg();
 
 		updateVisualizer(); // will draw one frame of the visualizer in use
@@ -310,6 +311,8 @@ uint32_t askBox(uint32_t dialogType, const char *statusText)
 		beginFPSCounter();
 		sinkVisualizerBars();
 		updateChannelSyncBuffer();
+		updateScopes();
+		updateFFTSpectrumAnalyzer();
 		readMouseXY();
 
 		while (SDL_PollEvent(&event))
@@ -0,0 +1,44 @@
+#pragma once
+
+/* Minimal atomic 32-bit integer (acquire loads, release stores) for the lock-free queues,
+** so that code in the replay library doesn't need SDL_atomic.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+typedef struct atomic32_t
+{
+	volatile int32_t value;
+} atomic32_t;
+
+static inline int32_t atomic32Load(atomic32_t *a)
+{
+#ifdef _MSC_VER
+	return (int32_t)_InterlockedCompareExchange((volatile long *)&a->value, 0, 0); // (full memory barrier)
+#else
+	return __atomic_load_n(&a->value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline bool atomic32CompareExchange(atomic32_t *a, int32_t expected, int32_t desired) // (full memory barrier)
+{
+#ifdef _MSC_VER
+	return _InterlockedCompareExchange((volatile long *)&a->value, (long)desired, (long)expected) == (long)expected;
+#else
+	return __atomic_compare_exchange_n(&a->value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic32Store(atomic32_t *a, int32_t value)
+{
+#ifdef _MSC_VER
+	_InterlockedExchange((volatile long *)&a->value, (long)value); // (full memory barrier)
+#else
+	__atomic_store_n(&a->value, value, __ATOMIC_RELEASE);
+#endif
+}
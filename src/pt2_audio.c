@@ -25,21 +25,43 @@
 #include "pt2_textout.h"
 #include "pt2_scopes.h"
 #include "pt2_visuals_sync.h"
-#include "pt2_downsample2x.h"
+#include "pt2_mixer.h"
 #include "pt2_replayer.h"
 #include "pt2_paula.h"
-
-// cumulative mid/side normalization factor (1/sqrt(2))*(1/sqrt(2))
-#define STEREO_NORM_FACTOR 0.5f
-
-#define INITIAL_DITHER_SEED 0x12345000
+#include "pt2_hpc.h"
+#include "pt2_fft_analyzer.h"
+#if defined HAS_SSE2
+#include <emmintrin.h>
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
 
 static uint8_t panningMode;
 static int32_t stereoSeparation = 100;
-static uint32_t randSeed = INITIAL_DITHER_SEED;
-static float *fMixBufferL, *fMixBufferR, fSideFactor, fPrngStateL, fPrngStateR;
+static mixer_t mixer; // for the audio device (live playback)
 static SDL_AudioDeviceID dev;
 
+// for queued (lock-free) Paula writes from the main thread
+static bool queueingPaulaWrites, lockedForPaulaWrites;
+static uint64_t paulaWriteTimestamp;
+static SDL_threadID mainThreadID;
+static SDL_atomic_t ditherResetPending; // see resetAudioDither()
+static SDL_atomic_t callbackClockSeq; // odd while the values below are being updated
+static volatile uint64_t callbackPaulaClock, callbackTime64;
+
+// for the optional render-ahead thread (see renderThreadFunc())
+#define RENDER_CHUNK_FRAMES 256
+static volatile bool renderThreadRunning;
+static uint8_t *renderRing;
+static uint32_t renderRingFrames, renderRingMask, renderTargetFrames;
+static uint64_t renderedFrames64, consumedFrames64;
+static SDL_atomic_t ringClockSeq; // odd while ringPaulaClockBase is being updated (it's 64-bit)
+static volatile uint64_t ringPaulaClockBase; // Paula sample clock at ring position 0
+static SDL_atomic_t ringReadPos, ringWritePos; // in frames (wrapping)
+static SDL_Thread *renderThread;
+static SDL_mutex *renderMutex;
+static SDL_sem *renderSem;
+
 audio_t audio; // globalized
 
 void setAmigaFilterModel(uint8_t model)
@@ -54,7 +76,7 @@ void setAmigaFilterModel(uint8_t model)
 	audio.amigaModel = model;
 
 	const int32_t paulaMixFrequency = audio.oversamplingFlag ? audio.outputRate*2 : audio.outputRate;
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
+	paulaSetup(audio.paula, paulaMixFrequency, audio.amigaModel);
 
 	if (audioWasntLocked)
 		unlockAudio();
@@ -69,7 +91,7 @@ void toggleAmigaFilterModel(void)
 	audio.amigaModel ^= 1;
 
 	const int32_t paulaMixFrequency = audio.oversamplingFlag ? audio.outputRate*2 : audio.outputRate;
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
+	paulaSetup(audio.paula, paulaMixFrequency, audio.amigaModel);
 
 	if (audioWasntLocked)
 		unlockAudio();
@@ -90,7 +112,7 @@ void setLEDFilter(bool state)
 		lockAudio();
 
 	audio.ledFilterEnabled = state;
-	paulaWriteByte(0xBFE001, (uint8_t)audio.ledFilterEnabled << 1);
+	paulaWriteByte(audio.paula, 0xBFE001, (uint8_t)audio.ledFilterEnabled << 1);
 
 	if (audioWasntLocked)
 		unlockAudio();
@@ -103,253 +125,269 @@ void toggleLEDFilter(void)
 		lockAudio();
 
 	audio.ledFilterEnabled ^= 1;
-	paulaWriteByte(0xBFE001, (uint8_t)audio.ledFilterEnabled << 1);
+	paulaWriteByte(audio.paula, 0xBFE001, (uint8_t)audio.ledFilterEnabled << 1);
 
 	if (audioWasntLocked)
 		unlockAudio();
 }
 
+static uint32_t getBytesPerFrame(void)
+{
+	return (audio.outputFormat == OUTPUT_FORMAT_FLOAT) ? sizeof (float) * 2 : sizeof (int16_t) * 2;
+}
+
 void lockAudio(void)
 {
-	if (dev != 0)
+	if (renderThread != NULL)
+		SDL_LockMutex(renderMutex); // render-ahead mode, the audio device only reads from the ring
+	else if (dev != 0)
 		SDL_LockAudioDevice(dev);
 
+	// do queued writes now, so that they can't end up after direct writes done while locked
+	if (audio.paula != NULL)
+		paulaFlushQueuedWrites(audio.paula);
+
+	doQueuedChannelCmds();
+
 	audio.locked = true;
 
-	audio.resetSyncTickTimeFlag = true;
 	resetChSyncQueue();
 }
 
 void unlockAudio(void)
 {
-	if (dev != 0)
+	if (renderThread != NULL)
+		SDL_UnlockMutex(renderMutex);
+	else if (dev != 0)
 		SDL_UnlockAudioDevice(dev);
 
-	audio.resetSyncTickTimeFlag = true;
 	resetChSyncQueue();
 
 	audio.locked = false;
 }
 
-void resetAudioDither(void)
+/* Reads the Paula clock of the audio that the last callback sent, and how many Paula samples have
+** been played since then (from the time passed, max one buffer).
+*/
+static void getCallbackPaulaClock(uint64_t *paulaClock, uint64_t *samplesPassed)
 {
-	randSeed = INITIAL_DITHER_SEED;
-	fPrngStateL = fPrngStateR = 0.0f;
+	uint64_t time64;
+	int32_t seq;
+
+	do
+	{
+		seq = SDL_AtomicGet(&callbackClockSeq);
+		*paulaClock = callbackPaulaClock;
+		time64 = callbackTime64;
+	}
+	while ((seq & 1) || seq != SDL_AtomicGet(&callbackClockSeq));
+
+	const uint64_t bufferSamples = audio.audioBufferSize * (audio.oversamplingFlag ? 2 : 1);
+
+	*samplesPassed = bufferSamples;
+	if (time64 != 0)
+	{
+		const double dTimePassed = (double)(SDL_GetPerformanceCounter() - time64) / hpcFreq.freq64;
+		const double dSamplesPassed = dTimePassed * audio.paula->dOutputFreq;
+
+		if (dSamplesPassed < (double)bufferSamples)
+			*samplesPassed = (uint64_t)dSamplesPassed;
+	}
 }
 
-static inline int32_t random32(void)
+/* Returns the audio.paula sample position that corresponds to "now" on the main thread.
+** The callback mixes one buffer ahead of what is heard, so a write that is timestamped one
+** buffer after the last callback start (plus the time passed since then) is always done in
+** the next callback, with a constant latency instead of landing on a callback boundary.
+*/
+static uint64_t getPaulaWriteTimestamp(void)
 {
-	// LCG 32-bit random
-	randSeed *= 134775813;
-	randSeed++;
+	uint64_t paulaClock, samplesPassed;
+	getCallbackPaulaClock(&paulaClock, &samplesPassed);
+
+	const uint64_t paulaSamplesPerFrame = audio.oversamplingFlag ? 2 : 1;
+	const uint64_t bufferSamples = audio.audioBufferSize * paulaSamplesPerFrame;
 
-	return (int32_t)randSeed;
+	// in render-ahead mode, the mixing can be up to a full ring ahead of what the callback sends
+	const uint64_t renderAheadSamples = (renderThread != NULL) ? renderTargetFrames * paulaSamplesPerFrame : 0;
+
+	return paulaClock + bufferSamples + renderAheadSamples + samplesPassed;
 }
 
-/* So yeah, the audio may be a little quiet in some cases, but
-** the output can already clip quite a bit in extreme cases due
-** to the ~5Hz high-pass filter, so think twice before changing
-** this...
+/* Returns the audio.paula sample position that is heard right now. What the last callback sent
+** starts playing when the buffer before it is done, so this is one buffer behind the callback's
+** Paula clock (plus the time passed since then). Both sides of the visuals sync use this clock,
+** so it can't drift from the audio, no matter how long a song plays.
 */
-#define AUDIO_GAIN 2.0
+uint64_t getAudiblePaulaClock(void)
+{
+	if (audio.paula == NULL)
+		return 0;
 
-#define NORMALIZE_VALUE (float)(AUDIO_GAIN * ((INT16_MAX+1.0) / PAULA_VOICES))
+	uint64_t paulaClock, samplesPassed;
+	getCallbackPaulaClock(&paulaClock, &samplesPassed);
 
-static inline void processMixedSamplesAmigaPanning(int32_t i, int16_t *out)
-{
-	int32_t out32;
-	float fOut, fPrng;
+	const uint64_t bufferSamples = audio.audioBufferSize * (audio.oversamplingFlag ? 2 : 1);
+	if (paulaClock + samplesPassed < bufferSamples)
+		return 0;
 
-	float fL = fMixBufferL[i];
-	float fR = fMixBufferR[i];
+	return (paulaClock + samplesPassed) - bufferSamples;
+}
 
-	fL *= NORMALIZE_VALUE;
-	fR *= NORMALIZE_VALUE;
+bool canQueueAudioWrites(void)
+{
+	return !audio.locked && dev != 0 && SDL_ThreadID() == mainThreadID;
+}
 
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+/* Register writes from the main thread to a Paula that may be mixing right now. For audio.paula
+** they are queued with a sample timestamp (no audio locking), and done by the mixer at that exact
+** sample. All writes between beginPaulaWrites() and endPaulaWrites() get the same timestamp.
+** 'immediately' means that the writes are done on the next mixed sample instead (for stopping
+** voices before sample data is modified, etc.).
+** If the audio is already locked, the Paula isn't audio.paula, or we're on another thread (replayer),
+** the writes are done directly.
+*/
+void beginPaulaWrites(paula_t *p, bool immediately)
+{
+	ASSERT(!queueingPaulaWrites && !lockedForPaulaWrites);
 
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
-}
+	queueingPaulaWrites = (p == audio.paula && p != NULL && canQueueAudioWrites());
+	if (queueingPaulaWrites)
+		paulaWriteTimestamp = immediately ? 0 : getPaulaWriteTimestamp();
+}
 
-static inline void processMixedSamples(int32_t i, int16_t *out)
+static void stopQueueingPaulaWrites(paula_t *p) // queue is full, lock the audio and write directly instead
 {
-	int32_t out32;
-	float fOut, fPrng;
+	paulaCommitQueuedWrites(p);
+	lockAudio(); // (also does the queued writes)
 
-	float fL = fMixBufferL[i];
-	float fR = fMixBufferR[i];
+	queueingPaulaWrites = false;
+	lockedForPaulaWrites = true;
+}
 
-	// apply stereo separation
-	const float fOldL = fL;
-	const float fOldR = fR;
-	float fMid  = (fOldL + fOldR) * STEREO_NORM_FACTOR;
-	float fSide = (fOldL - fOldR) * fSideFactor;
-	fL = fMid + fSide;
-	fR = fMid - fSide;
+void queuePaulaWriteWord(paula_t *p, uint32_t address, uint16_t data16)
+{
+	if (queueingPaulaWrites && !paulaQueueWriteWord(p, paulaWriteTimestamp, address, data16))
+		stopQueueingPaulaWrites(p);
 
-	fL *= NORMALIZE_VALUE;
-	fR *= NORMALIZE_VALUE;
+	if (!queueingPaulaWrites)
+		paulaWriteWord(p, address, data16);
+}
 
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+void queuePaulaWritePtr(paula_t *p, uint32_t address, const int8_t *ptr)
+{
+	if (queueingPaulaWrites && !paulaQueueWritePtr(p, paulaWriteTimestamp, address, ptr))
+		stopQueueingPaulaWrites(p);
 
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+	if (!queueingPaulaWrites)
+		paulaWritePtr(p, address, ptr);
 }
 
-static inline void processMixedSamplesAmigaPanning_2x(int32_t i, int16_t *out) // 2x oversampling
+void endPaulaWrites(paula_t *p)
 {
-	int32_t out32;
-	float fL, fR, fOut, fPrng;
+	if (queueingPaulaWrites)
+	{
+		paulaCommitQueuedWrites(p);
+		queueingPaulaWrites = false;
+	}
 
-	// 2x downsampling
-	const uint32_t offset1 = (i << 1) + 0;
-	const uint32_t offset2 = (i << 1) + 1;
-	fL = downsample2x_L(fMixBufferL[offset1], fMixBufferL[offset2]);
-	fR = downsample2x_R(fMixBufferR[offset1], fMixBufferR[offset2]);
+	if (lockedForPaulaWrites)
+	{
+		unlockAudio();
+		lockedForPaulaWrites = false;
+	}
+}
 
-	fL *= NORMALIZE_VALUE;
-	fR *= NORMALIZE_VALUE;
+/* For when the writes must have been done before we go on, e.g. voices that must be stopped before
+** their sample data is changed. Writes that weren't queued were done right away. Immediate writes
+** are done at the start of the next mixed block, but they are behind any timestamped writes that
+** are still waiting in the queue, so this can take up to the audio latency.
+*/
+void waitForPaulaWrites(paula_t *p)
+{
+	if (p != audio.paula || p == NULL || !canQueueAudioWrites())
+		return;
 
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+	const uint64_t timeoutTime64 = SDL_GetPerformanceCounter() + hpcFreq.freq64; // one second
+	while (!paulaQueuedWritesDone(p))
+	{
+		if (SDL_GetPerformanceCounter() >= timeoutTime64)
+		{
+			// the audio device has stopped asking for audio, do them here instead
+			lockAudio(); // (does the queued writes)
+			unlockAudio();
+			break;
+		}
 
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+		SDL_Delay(1);
+	}
 }
 
-static inline void processMixedSamples_2x(int32_t i, int16_t *out) // 2x oversampling
+void audioLoadMixerState(const audioMixerState_t *s)
 {
-	int32_t out32;
-	float fL, fR, fOut, fPrng;
+	audio.tickSampleCounter = s->tickSampleCounter;
+	audio.tickSampleCounterFrac = s->tickSampleCounterFrac;
+	audio.samplesPerTickInt = s->samplesPerTickInt;
+	audio.samplesPerTickFrac = s->samplesPerTickFrac;
+	audio.ledFilterEnabled = s->ledFilterEnabled;
 
-	// 2x downsampling
-	const uint32_t offset1 = (i << 1) + 0;
-	const uint32_t offset2 = (i << 1) + 1;
-	fL = downsample2x_L(fMixBufferL[offset1], fMixBufferL[offset2]);
-	fR = downsample2x_R(fMixBufferR[offset1], fMixBufferR[offset2]);
+	mixerLoadState(&mixer, &s->mixer);
+}
 
-	// apply stereo separation
-	const float fOldL = fL;
-	const float fOldR = fR;
-	float fMid  = (fOldL + fOldR) * STEREO_NORM_FACTOR;
-	float fSide = (fOldL - fOldR) * fSideFactor;
-	fL = fMid + fSide;
-	fR = fMid - fSide;
-
-	fL *= NORMALIZE_VALUE;
-	fR *= NORMALIZE_VALUE;
-
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+void resetAudioDither(void) // done by renderAudio() before it mixes the next block
+{
+	SDL_AtomicSet(&ditherResetPending, 1);
+}
 
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+void outputAudio(paula_t *p, int16_t *target, int32_t numSamples)
+{
+	mixerOutput(&mixer, p, target, numSamples);
 }
 
-void outputAudio(int16_t *target, int32_t numSamples)
-{
-	if (audio.oversamplingFlag) // 2x oversampling
-	{
-		paulaGenerateSamples(fMixBufferL, fMixBufferR, numSamples*2);
-
-		// downsample and normalize
-		int16_t out[2];
-		int16_t *outStream = target;
-		if (stereoSeparation == 100)
-		{
-			for (int32_t i = 0; i < numSamples; i++)
-			{
-				processMixedSamplesAmigaPanning_2x(i, out);
-				*outStream++ = out[0];
-				*outStream++ = out[1];
-			}
-		}
-		else
-		{
-			for (int32_t i = 0; i < numSamples; i++)
-			{
-				processMixedSamples_2x(i, out);
-				*outStream++ = out[0];
-				*outStream++ = out[1];
-			}
-		}
-	}
-	else
-	{
-		paulaGenerateSamples(fMixBufferL, fMixBufferR, numSamples);
+void outputAudioFloat(paula_t *p, float *target, int32_t numSamples)
+{
+	mixerOutputFloat(&mixer, p, target, numSamples);
+}
 
-		// normalize
-		int16_t out[2];
-		int16_t *outStream = target;
-		if (stereoSeparation == 100)
-		{
-			for (int32_t i = 0; i < numSamples; i++)
-			{
-				processMixedSamplesAmigaPanning(i, out);
-				*outStream++ = out[0];
-				*outStream++ = out[1];
-			}
-		}
-		else
-		{
-			for (int32_t i = 0; i < numSamples; i++)
-			{
-				processMixedSamples(i, out);
-				*outStream++ = out[0];
-				*outStream++ = out[1];
-			}
-		}
-	}
+static void setCallbackPaulaClock(uint64_t paulaClock)
+{
+	// for timestamping queued Paula writes (see getPaulaWriteTimestamp())
+	SDL_AtomicAdd(&callbackClockSeq, 1);
+	callbackPaulaClock = paulaClock;
+	callbackTime64 = SDL_GetPerformanceCounter();
+	SDL_AtomicAdd(&callbackClockSeq, 1);
 }
 
-static void audioCallback(void *userdata, Uint8 *stream, int len)
+static void renderAudio(uint8_t *streamOut, uint32_t numFrames)
 {
+	const uint32_t bytesPerFrame = getBytesPerFrame();
+
 	if (editor.mod2WavOngoing || editor.pat2SmpOngoing) // send silence to sound output device
 	{
-		memset(stream, 0, len);
+		memset(streamOut, 0, numFrames * bytesPerFrame);
+
+		// audio.paula isn't mixed now, but waitForPaulaWrites() expects the queued writes to be done
+		paulaFlushQueuedWrites(audio.paula);
 		return;
 	}
 
 	audio.callbackOngoing = true;
 
-	int16_t *streamOut = (int16_t *)stream;
+	if (SDL_AtomicSet(&ditherResetPending, 0) != 0)
+		mixerResetDither(&mixer);
 
-	uint32_t samplesLeft = (uint32_t)len / 4;
+	doQueuedChannelCmds(); // jamming etc. from the main thread
+
+	if (renderRing == NULL)
+		setCallbackPaulaClock(audio.paula->sampleClock);
+
+	const bool floatOutput = (audio.outputFormat == OUTPUT_FORMAT_FLOAT);
+	audioCallbackStats_t *stats = &audio.callbackStats;
+
+	uint64_t time64 = SDL_GetPerformanceCounter();
+	uint64_t replayerTime64 = 0, mixerTime64 = 0;
+
+	uint32_t samplesLeft = numFrames;
 	while (samplesLeft > 0)
 	{
 		if (audio.tickSampleCounter <= 0) // new replayer tick
@@ -358,10 +396,15 @@ static void audioCallback(void *userdata, Uint8 *stream, int len)
 			{
 				tickReplayer(); // (sets audio.samplesPerTickInt and audio.samplesPerTickFrac)
 
-				if (audio.samplesPerTickInt != 0)
-					fillVisualsSyncBuffer();
+				const uint64_t newTime64 = SDL_GetPerformanceCounter();
+				replayerTime64 += newTime64 - time64;
+				time64 = newTime64;
 			}
 
+			// also when the song is stopped, for the real VU-meters of jammed notes
+			if (audio.samplesPerTickInt != 0)
+				fillVisualsSyncBuffer();
+
 			audio.tickSampleCounter = audio.samplesPerTickInt;
 
 			audio.tickSampleCounterFrac += audio.samplesPerTickFrac;
@@ -376,24 +419,344 @@ static void audioCallback(void *userdata, Uint8 *stream, int len)
 		if (audio.tickSampleCounter > 0 && samplesToMix > audio.tickSampleCounter)
 			samplesToMix = audio.tickSampleCounter;
 
-		outputAudio(streamOut, samplesToMix);
-		streamOut += samplesToMix * 2; // *2 for stereo
+		const uint64_t paulaClock = audio.paula->sampleClock;
+
+		if (floatOutput)
+			outputAudioFloat(audio.paula, (float *)streamOut, samplesToMix);
+		else
+			outputAudio(audio.paula, (int16_t *)streamOut, samplesToMix);
+
+		if (ui.visualizerMode == VISUAL_FFT_SPECTRUM)
+			fftAnalyzerFeed(streamOut, floatOutput, samplesToMix, paulaClock, audio.paula->sampleClock);
+
+		const uint64_t newTime64 = SDL_GetPerformanceCounter();
+		mixerTime64 += newTime64 - time64;
+		time64 = newTime64;
+
+		streamOut += samplesToMix * bytesPerFrame;
 
 		audio.tickSampleCounter -= samplesToMix;
 		samplesLeft -= samplesToMix;
 	}
 
+	SDL_AtomicAdd(&stats->renderTimeSeq, 1);
+	stats->replayerTime64 += replayerTime64;
+	stats->mixerTime64 += mixerTime64;
+	SDL_AtomicAdd(&stats->renderTimeSeq, 1);
+
 	audio.callbackOngoing = false;
+}
+
+/* Render-ahead mode (RENDERAHEAD in protracker.ini): A high-priority thread runs the replayer and
+** mixer, and keeps the ring buffer filled with one audio buffer plus the render-ahead time. The
+** audio callback then only has to copy from the ring, so CPU spikes in the replayer/mixer don't
+** cause dropouts as long as they are shorter than the render-ahead time.
+** The ring is lock-free (one writer, one reader). The render thread holds renderMutex while
+** rendering, and lockAudio() locks that mutex instead of the audio device.
+*/
+static void setRingPaulaClockBase(uint64_t paulaClock) // render thread
+{
+	SDL_AtomicAdd(&ringClockSeq, 1);
+	ringPaulaClockBase = paulaClock;
+	SDL_AtomicAdd(&ringClockSeq, 1);
+}
+
+static uint64_t getRingPaulaClockBase(void) // audio callback
+{
+	uint64_t paulaClock;
+	int32_t seq;
+
+	do
+	{
+		seq = SDL_AtomicGet(&ringClockSeq);
+		paulaClock = ringPaulaClockBase;
+	}
+	while ((seq & 1) || seq != SDL_AtomicGet(&ringClockSeq));
+
+	return paulaClock;
+}
+
+static int32_t renderThreadFunc(void *ptr)
+{
+	// this thread does what the audio callback normally does
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	const uint32_t bytesPerFrame = getBytesPerFrame();
+	const uint64_t paulaSamplesPerFrame = audio.oversamplingFlag ? 2 : 1;
+
+	while (renderThreadRunning)
+	{
+		const uint32_t writePos = (uint32_t)SDL_AtomicGet(&ringWritePos);
+		const uint32_t fill = writePos - (uint32_t)SDL_AtomicGet(&ringReadPos);
+
+		if (fill >= renderTargetFrames)
+		{
+			SDL_SemWaitTimeout(renderSem, 10); // posted by the audio callback
+			continue;
+		}
+
+		uint32_t framesToRender = renderTargetFrames - fill;
+		if (framesToRender > RENDER_CHUNK_FRAMES)
+			framesToRender = RENDER_CHUNK_FRAMES;
+
+		const uint32_t ringOffset = writePos & renderRingMask;
+		if (framesToRender > renderRingFrames-ringOffset)
+			framesToRender = renderRingFrames-ringOffset; // don't cross the end of the ring
+
+		SDL_LockMutex(renderMutex);
+
+		renderAudio(&renderRing[ringOffset * bytesPerFrame], framesToRender);
+
+		renderedFrames64 += framesToRender;
+		setRingPaulaClockBase(audio.paula->sampleClock - (renderedFrames64 * paulaSamplesPerFrame));
+
+		SDL_UnlockMutex(renderMutex);
+
+		SDL_AtomicSet(&ringWritePos, (int32_t)(writePos + framesToRender));
+	}
+
+	(void)ptr;
+	return true;
+}
+
+static void readRenderRing(uint8_t *streamOut, uint32_t numFrames)
+{
+	const uint32_t bytesPerFrame = getBytesPerFrame();
+	const uint32_t readPos = (uint32_t)SDL_AtomicGet(&ringReadPos);
+	const uint32_t fill = (uint32_t)SDL_AtomicGet(&ringWritePos) - readPos;
+
+	// the Paula clock for the audio we send now (see getPaulaWriteTimestamp())
+	setCallbackPaulaClock((consumedFrames64 * (audio.oversamplingFlag ? 2 : 1)) + getRingPaulaClockBase());
+
+	audio.renderFillFrames = fill;
+	if (fill < (uint32_t)SDL_AtomicGet(&audio.renderFillMinFrames))
+		SDL_AtomicSet(&audio.renderFillMinFrames, (int32_t)fill);
+
+	uint32_t framesToCopy = numFrames;
+	if (framesToCopy > fill)
+	{
+		framesToCopy = fill;
+		SDL_AtomicIncRef(&audio.renderUnderruns);
+	}
+
+	// copy in up to two parts (the ring may wrap)
+	const uint32_t ringOffset = readPos & renderRingMask;
+
+	uint32_t framesToCopy1 = framesToCopy;
+	if (framesToCopy1 > renderRingFrames-ringOffset)
+		framesToCopy1 = renderRingFrames-ringOffset;
+
+	memcpy(streamOut, &renderRing[ringOffset * bytesPerFrame], framesToCopy1 * bytesPerFrame);
+	memcpy(&streamOut[framesToCopy1 * bytesPerFrame], renderRing, (framesToCopy - framesToCopy1) * bytesPerFrame);
+
+	if (framesToCopy < numFrames) // underrun, send silence for the rest
+		memset(&streamOut[framesToCopy * bytesPerFrame], 0, (numFrames - framesToCopy) * bytesPerFrame);
+
+	consumedFrames64 += framesToCopy;
+	SDL_AtomicSet(&ringReadPos, (int32_t)(readPos + framesToCopy));
+
+	SDL_SemPost(renderSem); // wake up the render thread
+}
+
+static void updateCallbackStats(uint64_t startTime64, uint32_t numFrames)
+{
+	audioCallbackStats_t *stats = &audio.callbackStats;
+
+	const uint64_t durationTime64 = SDL_GetPerformanceCounter() - startTime64;
+	const uint64_t bufferTime64 = (numFrames * hpcFreq.freq64) / audio.outputRate; // the deadline
+	if (bufferTime64 == 0)
+		return;
+
+	const uint32_t loadPermille = (uint32_t)((durationTime64 * 1000) / bufferTime64);
+
+	int32_t bin = loadPermille / 100;
+	if (bin >= CALLBACK_LOAD_BINS-1)
+	{
+		bin = CALLBACK_LOAD_BINS-1;
+		SDL_AtomicIncRef(&stats->lateCallbacks);
+	}
+
+	SDL_AtomicIncRef(&stats->loadHistogram[bin]);
+	SDL_AtomicIncRef(&stats->numCallbacks);
+
+	SDL_AtomicAdd(&stats->callbackTimeSeq, 1);
+
+	if (loadPermille > stats->maxLoadPermille)
+		stats->maxLoadPermille = loadPermille;
+
+	stats->callbackTime64 += durationTime64;
+	stats->bufferTime64 += bufferTime64;
+
+	SDL_AtomicAdd(&stats->callbackTimeSeq, 1);
+}
+
+void audioGetCallbackTimes(audioCallbackTimes_t *t)
+{
+	audioCallbackStats_t *stats = &audio.callbackStats;
+	int32_t seq;
+
+	do
+	{
+		seq = SDL_AtomicGet(&stats->callbackTimeSeq);
+		t->maxLoadPermille = stats->maxLoadPermille;
+		t->callbackTime64 = stats->callbackTime64;
+		t->bufferTime64 = stats->bufferTime64;
+	}
+	while ((seq & 1) || seq != SDL_AtomicGet(&stats->callbackTimeSeq));
+
+	do
+	{
+		seq = SDL_AtomicGet(&stats->renderTimeSeq);
+		t->replayerTime64 = stats->replayerTime64;
+		t->mixerTime64 = stats->mixerTime64;
+	}
+	while ((seq & 1) || seq != SDL_AtomicGet(&stats->renderTimeSeq));
+}
+
+static void audioCallback(void *userdata, Uint8 *stream, int len)
+{
+	const uint64_t startTime64 = SDL_GetPerformanceCounter();
+	const uint32_t numFrames = (uint32_t)len / getBytesPerFrame();
+
+	if (renderRing != NULL)
+		readRenderRing((uint8_t *)stream, numFrames);
+	else
+		renderAudio((uint8_t *)stream, numFrames);
+
+	updateCallbackStats(startTime64, numFrames);
 
 	(void)userdata;
 }
 
-void audioSetStereoSeparation(uint8_t percentage) // 0..100 (percentage)
+static void dumpCallbackStats(void)
+{
+	audioCallbackStats_t *stats = &audio.callbackStats;
+
+	audioCallbackTimes_t t;
+	audioGetCallbackTimes(&t);
+
+	const int32_t numCallbacks = SDL_AtomicGet(&stats->numCallbacks);
+	if (numCallbacks == 0 || t.bufferTime64 == 0)
+		return;
+
+	SDL_Log("Audio callback stats (buffer size: %u, rate: %uHz, render-ahead: %ums):",
+		audio.audioBufferSize, audio.outputRate, audio.renderAheadFlag ? config.renderAheadMs : 0);
+
+	for (int32_t i = 0; i < CALLBACK_LOAD_BINS; i++)
+	{
+		const int32_t count = SDL_AtomicGet(&stats->loadHistogram[i]);
+		const double dPercent = (count * 100.0) / numCallbacks;
+
+		if (i == CALLBACK_LOAD_BINS-1)
+			SDL_Log("  load >= %3d%% (late): %10d (%.3f%%)", i * 10, count, dPercent);
+		else
+			SDL_Log("  load %3d..%3d%%:      %10d (%.3f%%)", i * 10, (i * 10) + 9, count, dPercent);
+	}
+
+	SDL_Log("  callbacks: %d, late: %d, avg. load: %.2f%%, max. load: %.1f%%", numCallbacks,
+		SDL_AtomicGet(&stats->lateCallbacks), (t.callbackTime64 * 100.0) / t.bufferTime64,
+		t.maxLoadPermille / 10.0);
+
+	SDL_Log("  time used (of audio time): replayer %.3f%%, mixer %.3f%%",
+		(t.replayerTime64 * 100.0) / t.bufferTime64, (t.mixerTime64 * 100.0) / t.bufferTime64);
+
+	if (audio.renderAheadFlag)
+		SDL_Log("  render-ahead underruns: %d", SDL_AtomicGet(&audio.renderUnderruns));
+}
+
+static bool startRenderThread(void)
+{
+	const uint32_t renderAheadFrames = (uint32_t)(((uint64_t)config.renderAheadMs * audio.outputRate) / 1000);
+
+	renderTargetFrames = audio.audioBufferSize + renderAheadFrames;
+
+	renderRingFrames = RENDER_CHUNK_FRAMES;
+	while (renderRingFrames < renderTargetFrames)
+		renderRingFrames <<= 1;
+	renderRingMask = renderRingFrames - 1;
+
+	renderRing = (uint8_t *)calloc(renderRingFrames, getBytesPerFrame());
+	renderMutex = SDL_CreateMutex();
+	renderSem = SDL_CreateSemaphore(0);
+
+	if (renderRing == NULL || renderMutex == NULL || renderSem == NULL)
+	{
+		// these are free'd later
+		showErrorMsgBox("Out of memory!");
+		return false;
+	}
+
+	SDL_AtomicSet(&ringReadPos, 0);
+	SDL_AtomicSet(&ringWritePos, 0);
+	SDL_AtomicSet(&audio.renderUnderruns, 0);
+	SDL_AtomicSet(&audio.renderFillMinFrames, INT32_MAX);
+	renderedFrames64 = consumedFrames64 = 0;
+	setRingPaulaClockBase(0);
+
+	audio.renderAheadFrames = renderAheadFrames;
+	audio.renderTargetFrames = renderTargetFrames;
+	audio.renderFillFrames = 0;
+
+	renderThreadRunning = true;
+	renderThread = SDL_CreateThread(renderThreadFunc, "audio render thread", NULL);
+	if (renderThread == NULL)
+	{
+		renderThreadRunning = false;
+		showErrorMsgBox("Couldn't create audio render thread!");
+		return false;
+	}
+
+	// let the thread fill the ring before the audio device is started (max one second)
+	for (int32_t i = 0; i < 1000; i++)
+	{
+		if ((uint32_t)SDL_AtomicGet(&ringWritePos) >= renderTargetFrames)
+			break;
+
+		SDL_Delay(1);
+	}
+
+	SDL_AtomicSet(&audio.renderFillMinFrames, INT32_MAX);
+	return true;
+}
+
+static void stopRenderThread(void)
 {
-	ASSERT(percentage <= 100);
+	if (renderThread != NULL)
+	{
+		renderThreadRunning = false;
+		SDL_SemPost(renderSem);
+		SDL_WaitThread(renderThread, NULL);
+		renderThread = NULL;
+	}
 
+	if (renderSem != NULL)
+	{
+		SDL_DestroySemaphore(renderSem);
+		renderSem = NULL;
+	}
+
+	if (renderMutex != NULL)
+	{
+		SDL_DestroyMutex(renderMutex);
+		renderMutex = NULL;
+	}
+
+	if (renderRing != NULL)
+	{
+		free(renderRing);
+		renderRing = NULL;
+	}
+}
+
+void audioSetStereoSeparation(uint8_t percentage) // 0..100 (percentage)
+{
 	stereoSeparation = percentage;
-	fSideFactor = (percentage / 100.0f) * STEREO_NORM_FACTOR;
+	mixerSetStereoSeparation(&mixer, percentage);
+}
+
+uint8_t audioGetStereoSeparation(void) // (can differ from config.stereoSeparation, see toggleAmigaPanMode())
+{
+	return (uint8_t)stereoSeparation;
 }
 
 void generateBpmTable(double dAudioFreq, bool vblankTimingFlag)
@@ -404,14 +767,8 @@ void generateBpmTable(double dAudioFreq, bool vblankTimingFlag)
 
 	for (int32_t bpm = MIN_BPM; bpm <= MAX_BPM; bpm++)
 	{
-		const double dHz = vblankTimingFlag ? AMIGA_PAL_VBLANK_HZ : ciaBpm2Hz(bpm);
-
-		const double dSamplesPerTick = dAudioFreq / dHz;
-		double dSamplesPerTickInt, dSamplesPerTickFrac = modf(dSamplesPerTick, &dSamplesPerTickInt);
-
 		const int32_t i = bpm - MIN_BPM;
-		audio.samplesPerTickIntTab[i] = (uint32_t)dSamplesPerTickInt;
-		audio.samplesPerTickFracTab[i] = (uint64_t)(dSamplesPerTickFrac * BPM_FRAC_SCALE);
+		getSamplesPerTick(dAudioFreq, bpm, vblankTimingFlag, &audio.samplesPerTickIntTab[i], &audio.samplesPerTickFracTab[i]);
 	}
 
 	audio.tickSampleCounter = 0;
@@ -421,21 +778,6 @@ void generateBpmTable(double dAudioFreq, bool vblankTimingFlag)
 		unlockAudio();
 }
 
-static void generateTickLengthTable(bool vblankTimingFlag) // for performance counter (syncing visuals to audio)
-{
-	for (int32_t bpm = MIN_BPM; bpm <= MAX_BPM; bpm++)
-	{
-		double dHz = vblankTimingFlag ? AMIGA_PAL_VBLANK_HZ : ciaBpm2Hz(bpm);
-
-		const double dTickTime = (double)hpcFreq.freq64 / dHz;
-		double dTickTimeInt, dTickTimeFrac = modf(dTickTime, &dTickTimeInt);
-
-		const int32_t i = bpm - MIN_BPM;
-		audio.tickTimeIntTab[i] = (uint32_t)dTickTimeInt;
-		audio.tickTimeFracTab[i] = (uint64_t)(dTickTimeFrac * TICK_TIME_FRAC_SCALE);
-	}
-}
-
 void updateReplayerTimingMode(void)
 {
 	const bool audioWasntLocked = !audio.locked;
@@ -444,7 +786,6 @@ void updateReplayerTimingMode(void)
 
 	const bool vblankTimingMode = (editor.timingMode == TEMPO_MODE_VBLANK);
 	generateBpmTable(audio.outputRate, vblankTimingMode);
-	generateTickLengthTable(vblankTimingMode);
 
 	if (audioWasntLocked)
 		unlockAudio();
@@ -455,10 +796,12 @@ bool setupAudio(void)
 	SDL_AudioSpec want, have;
 
 	audio.callbackOngoing = false;
+	mainThreadID = SDL_ThreadID();
+	memset(&audio.callbackStats, 0, sizeof (audio.callbackStats));
 
 	want.freq = config.soundFrequency;
 	want.samples = (uint16_t)config.soundBufferSize;
-	want.format = AUDIO_S16;
+	want.format = (config.audioOutputFormat == OUTPUT_FORMAT_FLOAT) ? AUDIO_F32SYS : AUDIO_S16;
 	want.channels = 2;
 	want.callback = audioCallback;
 	want.userdata = NULL;
@@ -478,38 +821,30 @@ bool setupAudio(void)
 		return false;
 	}
 
+	audio.outputFormat = (have.format == AUDIO_F32SYS) ? OUTPUT_FORMAT_FLOAT : OUTPUT_FORMAT_16BIT;
 	audio.outputRate = have.freq;
 	audio.audioBufferSize = have.samples;
 	audio.oversamplingFlag = (audio.outputRate < 96000); // we do 2x oversampling if the audio output rate is below 96kHz
 	audio.amigaModel = config.amigaModel;
 
-	uint32_t maxFrequency = audio.outputRate;
-	if (maxFrequency < config.mod2WavOutputFreq)
-		maxFrequency = config.mod2WavOutputFreq;
-
-	maxFrequency *= 2; // oversampling
-
 	const int32_t paulaMixFrequency = audio.oversamplingFlag ? audio.outputRate*2 : audio.outputRate;
-	int32_t maxSamplesPerTick = (int32_t)ceil(maxFrequency / (MIN_BPM / 2.5)) + 1;
+	const int32_t maxSamplesPerTick = (int32_t)ceil(paulaMixFrequency / (MIN_BPM / 2.5)) + 1;
 
-	fMixBufferL = (float *)malloc(maxSamplesPerTick * sizeof (float));
-	fMixBufferR = (float *)malloc(maxSamplesPerTick * sizeof (float));
+	const bool mixerOK = mixerInit(&mixer, maxSamplesPerTick, audio.oversamplingFlag);
+	audio.paula = paulaCreate(paulaMixFrequency, audio.amigaModel);
 
-	if (fMixBufferL == NULL || fMixBufferR == NULL)
+	if (!mixerOK || audio.paula == NULL)
 	{
-		// these two are free'd later
+		// these are free'd later
 		showErrorMsgBox("Out of memory!");
 		return false;
 	}
 
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
+	setReplayerPaula(audio.paula);
+	paulaEnableVoiceMeters(audio.paula, true);
 	audioSetStereoSeparation(config.stereoSeparation);
 	updateReplayerTimingMode(); // also generates the BPM table (audio.samplesPerTickIntTab & audio.samplesPerTickFracTab)
 	setLEDFilter(false);
-	calcAudioLatencyVars(audio.audioBufferSize, audio.outputRate);
-
-	clearDownsample2xStates();
-	audio.resetSyncTickTimeFlag = true;
 
 	audio.samplesPerTickInt = audio.samplesPerTickIntTab[125-MIN_BPM]; // BPM 125
 	audio.samplesPerTickFrac = audio.samplesPerTickFracTab[125-MIN_BPM]; // BPM 125
@@ -517,6 +852,28 @@ bool setupAudio(void)
 	audio.tickSampleCounter = 0; // zero tick sample counter so that it will instantly initiate a tick
 	audio.tickSampleCounterFrac = 0;
 
+	/* The visuals are synced to what is audible, so the sync queue, scope snapshots and FFT bars must
+	** hold the audio latency. This is done before the render-ahead thread starts, since it fills them too.
+	*/
+	const int32_t renderAheadFrames = (int32_t)(((uint64_t)config.renderAheadMs * audio.outputRate) / 1000);
+	const int32_t latencyFrames = audio.audioBufferSize + renderAheadFrames;
+	const double dVisualsLatencySecs = (latencyFrames / (double)audio.outputRate) + VISUALS_STALL_SECS;
+
+	if (!allocChSyncQueue(latencyFrames, audio.outputRate) ||
+		!paulaEnableScopeTap(audio.paula, SCOPE_SNAPSHOT_HZ, dVisualsLatencySecs) ||
+		!fftAnalyzerInit(audio.outputRate, dVisualsLatencySecs))
+	{
+		showErrorMsgBox("Out of memory!");
+		return false;
+	}
+
+	audio.renderAheadFlag = (config.renderAheadMs > 0);
+	if (audio.renderAheadFlag)
+	{
+		if (!startRenderThread())
+			return false;
+	}
+
 	SDL_PauseAudioDevice(dev, false);
 	return true;
 }
@@ -530,18 +887,20 @@ void audioClose(void)
 		dev = 0;
 	}
 
+	stopRenderThread();
+	dumpCallbackStats();
+	freeChSyncQueue();
+	fftAnalyzerFree();
+
 	audio.callbackOngoing = false;
 
-	if (fMixBufferL != NULL)
-	{
-		free(fMixBufferL);
-		fMixBufferL = NULL;
-	}
+	mixerFree(&mixer);
 
-	if (fMixBufferR != NULL)
+	if (audio.paula != NULL)
 	{
-		free(fMixBufferR);
-		fMixBufferR = NULL;
+		setReplayerPaula(NULL);
+		paulaDestroy(audio.paula);
+		audio.paula = NULL;
 	}
 }
 
@@ -3,19 +3,40 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "pt2_replayer.h"
+#include "pt2_downsample2x.h"
+#include "pt2_mixer.h"
 
 // for the low-pass/high-pass filters in the SAMPLER screen
 #define FILTERS_BASE_FREQ (PAULA_PAL_CLK / 214.0)
 
-// too many bits makes little sense here
+#define CALLBACK_LOAD_BINS 11 // 10% wide bins of the buffer period, the last one is 100% and above (late)
 
-#define BPM_FRAC_BITS 52
-#define BPM_FRAC_SCALE (1ULL << BPM_FRAC_BITS)
-#define BPM_FRAC_MASK (BPM_FRAC_SCALE-1)
+typedef struct audioCallbackStats_t // single writer (audio thread), read by the main thread
+{
+	SDL_atomic_t numCallbacks, lateCallbacks, loadHistogram[CALLBACK_LOAD_BINS];
+
+	// the times are 64-bit (can tear on 32-bit CPUs), so read them with audioGetCallbackTimes()
+	SDL_atomic_t callbackTimeSeq, renderTimeSeq; // odd while the values below are being updated
+	volatile uint32_t maxLoadPermille;
+	volatile uint64_t callbackTime64, bufferTime64; // written by the audio callback
+	volatile uint64_t replayerTime64, mixerTime64; // written by the audio callback or the render-ahead thread
+} audioCallbackStats_t;
 
-#define TICK_TIME_FRAC_BITS 52
-#define TICK_TIME_FRAC_SCALE (1ULL << TICK_TIME_FRAC_BITS)
-#define TICK_TIME_FRAC_MASK (TICK_TIME_FRAC_SCALE-1)
+typedef struct audioCallbackTimes_t
+{
+	uint32_t maxLoadPermille;
+	uint64_t callbackTime64, bufferTime64, replayerTime64, mixerTime64; // in perf. counter units
+} audioCallbackTimes_t;
+
+// mixer state outside of Paula (for replayer snapshots, see pt2_snapshot.c)
+typedef struct audioMixerState_t
+{
+	bool ledFilterEnabled;
+	int32_t tickSampleCounter;
+	uint32_t samplesPerTickInt;
+	uint64_t tickSampleCounterFrac, samplesPerTickFrac;
+	mixerState_t mixer;
+} audioMixerState_t;
 
 typedef struct audio_t
 {
@@ -23,19 +44,26 @@ typedef struct audio_t
 
 	bool ledFilterEnabled, oversamplingFlag;
 	
+	uint8_t outputFormat; // OUTPUT_FORMAT_16BIT or OUTPUT_FORMAT_FLOAT (audio device)
 	uint32_t amigaModel, outputRate, audioBufferSize;
 
+	paula_t *paula; // Paula instance for the audio device (live playback)
+
 	int32_t tickSampleCounter;
 	uint32_t samplesPerTickInt, samplesPerTickIntTab[(MAX_BPM-MIN_BPM)+1];
 	uint64_t tickSampleCounterFrac, samplesPerTickFrac, samplesPerTickFracTab[(MAX_BPM-MIN_BPM)+1];
 
+	// for the optional render-ahead thread (RENDERAHEAD in protracker.ini)
+	bool renderAheadFlag;
+	uint32_t renderAheadFrames, renderTargetFrames; // target = audio buffer size + render-ahead
+	volatile uint32_t renderFillFrames; // ring fill level at the last audio callback
+	SDL_atomic_t renderUnderruns, renderFillMinFrames;
+
+	// audio callback instrumentation (shown in the debug box, dumped on exit)
+	audioCallbackStats_t callbackStats;
+
 	// for audio sampling
 	bool rescanAudioDevicesSupported;
-
-	// for audio/video syncing
-	bool resetSyncTickTimeFlag;
-	uint32_t tickTimeIntTab[(MAX_BPM-MIN_BPM)+1];
-	uint64_t tickTimeFracTab[(MAX_BPM-MIN_BPM)+1];
 } audio_t;
 
 void setAmigaFilterModel(uint8_t model);
@@ -57,8 +85,25 @@ void toggleAmigaPanMode(void);
 void lockAudio(void);
 void unlockAudio(void);
 void resetAudioDither(void);
+void audioLoadMixerState(const audioMixerState_t *s);
+void audioGetCallbackTimes(audioCallbackTimes_t *t); // main thread
+
+// lock-free register writes to the live Paula from the main thread (see pt2_audio.c)
+bool canQueueAudioWrites(void); // main thread, audio device running and not locked
+void beginPaulaWrites(paula_t *p, bool immediately);
+void queuePaulaWriteWord(paula_t *p, uint32_t address, uint16_t data16);
+void queuePaulaWritePtr(paula_t *p, uint32_t address, const int8_t *ptr);
+void endPaulaWrites(paula_t *p);
+void waitForPaulaWrites(paula_t *p); // until the mixer has done the writes queued so far
+
+uint64_t getAudiblePaulaClock(void); // audio.paula sample position that is heard right now (for syncing visuals)
+
 void audioSetStereoSeparation(uint8_t percentage);
-void outputAudio(int16_t *target, int32_t numSamples);
+uint8_t audioGetStereoSeparation(void);
+
+// these use the mixer of the audio device (see pt2_mixer.h)
+void outputAudio(paula_t *p, int16_t *target, int32_t numSamples);
+void outputAudioFloat(paula_t *p, float *target, int32_t numSamples); // no dithering/clamping
 bool setupAudio(void);
 void audioClose(void);
 
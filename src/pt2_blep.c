@@ -1,9 +1,36 @@
 // these BLEP routines are based on code by aciddose (written for this project)
 
 #include <stdint.h>
-#include "pt2_header.h" // ASSERT()
+#include <string.h>
+#include "pt2_replay_header.h" // ASSERT()
+#include "pt2_atomic.h"
 #include "pt2_blep.h"
 
+#if defined HAS_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC/Clang need the AVX2 kernel to be explicitly compiled for AVX2 (for portable builds)
+#if defined HAS_SSE2 && (defined __GNUC__ || defined __clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+#ifdef _MSC_VER
+#define ALIGN32 __declspec(align(32))
+#else
+#define ALIGN32 __attribute__((aligned(32)))
+#endif
+
+typedef void (*blepAddKernel_t)(float *fDst, const float *fTable, const float fFrac, const float fAmplitude);
+typedef void (*blepMixKernel_t)(float *fOut, const float *fBuffer, const float fInput, const int32_t numSamples);
+
 static const float fMinBlepData[256+1] = // zero-crossings = 16, oversampling = 16
 {
 	 1.0000477302613517416f, 1.0000703265259194286f, 1.0000262954869634235f, 0.9999104247733368034f,
@@ -74,38 +101,256 @@ static const float fMinBlepData[256+1] = // zero-crossings = 16, oversampling =
 	 0.0000000000000000000f // copy of last point required for interpolation
 };
 
-// linear interpolation macro
-#define LERP(p1, p2, frac) ((p1) + (((p2) - (p1)) * (frac)))
+/* fMinBlepData pre-arranged per BLEP phase: BLEP_NS values followed by BLEP_NS deltas (next-this),
+** so that the interpolated taps for a phase are simply value+(delta*frac) over two contiguous rows.
+*/
+static ALIGN32 float fBlepTable[BLEP_SP][BLEP_NS*2];
+
+enum
+{
+	BLEP_INIT_NOT_DONE = 0,
+	BLEP_INIT_ONGOING = 1,
+	BLEP_INIT_DONE = 2
+};
+
+static atomic32_t blepInitState;
+
+static void blepAddKernel_C(float *fDst, const float *fTable, const float fFrac, const float fAmplitude)
+{
+	for (int32_t n = 0; n < BLEP_NS; n++)
+		fDst[n] += fAmplitude * (fTable[n] + (fTable[BLEP_NS+n] * fFrac));
+}
+
+static void blepMixKernel_C(float *fOut, const float *fBuffer, const float fInput, const int32_t numSamples)
+{
+	for (int32_t n = 0; n < numSamples; n++)
+		fOut[n] += fInput + fBuffer[n];
+}
+
+#if defined HAS_SSE2
+static void blepAddKernel_SSE2(float *fDst, const float *fTable, const float fFrac, const float fAmplitude)
+{
+	const __m128 vFrac = _mm_set1_ps(fFrac);
+	const __m128 vAmplitude = _mm_set1_ps(fAmplitude);
+
+	for (int32_t n = 0; n < BLEP_NS; n += 4)
+	{
+		const __m128 vTap = _mm_add_ps(_mm_load_ps(&fTable[n]), _mm_mul_ps(_mm_load_ps(&fTable[BLEP_NS+n]), vFrac));
+		_mm_storeu_ps(&fDst[n], _mm_add_ps(_mm_loadu_ps(&fDst[n]), _mm_mul_ps(vAmplitude, vTap)));
+	}
+}
+
+static void blepMixKernel_SSE2(float *fOut, const float *fBuffer, const float fInput, const int32_t numSamples)
+{
+	const __m128 vInput = _mm_set1_ps(fInput);
+
+	int32_t n = 0;
+	for (; n+4 <= numSamples; n += 4)
+		_mm_storeu_ps(&fOut[n], _mm_add_ps(_mm_loadu_ps(&fOut[n]), _mm_add_ps(vInput, _mm_loadu_ps(&fBuffer[n]))));
+
+	for (; n < numSamples; n++)
+		fOut[n] += fInput + fBuffer[n];
+}
+
+// no FMA here on purpose, the output should be identical no matter what kernel is used
+static TARGET_AVX2 void blepAddKernel_AVX2(float *fDst, const float *fTable, const float fFrac, const float fAmplitude)
+{
+	const __m256 vFrac = _mm256_set1_ps(fFrac);
+	const __m256 vAmplitude = _mm256_set1_ps(fAmplitude);
+
+	for (int32_t n = 0; n < BLEP_NS; n += 8)
+	{
+		const __m256 vTap = _mm256_add_ps(_mm256_load_ps(&fTable[n]), _mm256_mul_ps(_mm256_load_ps(&fTable[BLEP_NS+n]), vFrac));
+		_mm256_storeu_ps(&fDst[n], _mm256_add_ps(_mm256_loadu_ps(&fDst[n]), _mm256_mul_ps(vAmplitude, vTap)));
+	}
+}
+
+static TARGET_AVX2 void blepMixKernel_AVX2(float *fOut, const float *fBuffer, const float fInput, const int32_t numSamples)
+{
+	const __m256 vInput = _mm256_set1_ps(fInput);
+
+	int32_t n = 0;
+	for (; n+8 <= numSamples; n += 8)
+		_mm256_storeu_ps(&fOut[n], _mm256_add_ps(_mm256_loadu_ps(&fOut[n]), _mm256_add_ps(vInput, _mm256_loadu_ps(&fBuffer[n]))));
+
+	for (; n < numSamples; n++)
+		fOut[n] += fInput + fBuffer[n];
+}
+#elif defined HAS_NEON
+static void blepAddKernel_NEON(float *fDst, const float *fTable, const float fFrac, const float fAmplitude)
+{
+	const float32x4_t vFrac = vdupq_n_f32(fFrac);
+	const float32x4_t vAmplitude = vdupq_n_f32(fAmplitude);
+
+	for (int32_t n = 0; n < BLEP_NS; n += 4)
+	{
+		// vmulq+vaddq instead of vmlaq (fused on AArch64), to match the other kernels
+		const float32x4_t vTap = vaddq_f32(vld1q_f32(&fTable[n]), vmulq_f32(vld1q_f32(&fTable[BLEP_NS+n]), vFrac));
+		vst1q_f32(&fDst[n], vaddq_f32(vld1q_f32(&fDst[n]), vmulq_f32(vAmplitude, vTap)));
+	}
+}
+
+static void blepMixKernel_NEON(float *fOut, const float *fBuffer, const float fInput, const int32_t numSamples)
+{
+	const float32x4_t vInput = vdupq_n_f32(fInput);
+
+	int32_t n = 0;
+	for (; n+4 <= numSamples; n += 4)
+		vst1q_f32(&fOut[n], vaddq_f32(vld1q_f32(&fOut[n]), vaddq_f32(vInput, vld1q_f32(&fBuffer[n]))));
+
+	for (; n < numSamples; n++)
+		fOut[n] += fInput + fBuffer[n];
+}
+#endif
+
+static blepAddKernel_t blepAddKernel = blepAddKernel_C;
+static blepMixKernel_t blepMixKernel = blepMixKernel_C;
+
+#if defined HAS_SSE2
+static bool cpuHasAVX2(void) // (SDL_HasAVX2() without SDL, so that this file can be used headless)
+{
+#ifdef _MSC_VER
+	int32_t info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // the OS must save the YMM registers
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+void blepInit(void)
+{
+	if (atomic32Load(&blepInitState) == BLEP_INIT_DONE)
+		return;
+
+	// only one thread builds the table, the others wait for it (it takes a few microseconds)
+	if (!atomic32CompareExchange(&blepInitState, BLEP_INIT_NOT_DONE, BLEP_INIT_ONGOING))
+	{
+		while (atomic32Load(&blepInitState) != BLEP_INIT_DONE);
+		return;
+	}
+
+	for (int32_t phase = 0; phase < BLEP_SP; phase++)
+	{
+		const float *fBlepSrc = fMinBlepData + phase;
+		for (int32_t n = 0; n < BLEP_NS; n++)
+		{
+			fBlepTable[phase][n] = fBlepSrc[0];
+			fBlepTable[phase][BLEP_NS+n] = fBlepSrc[1] - fBlepSrc[0];
+			fBlepSrc += BLEP_SP;
+		}
+	}
+
+	// pick kernels at runtime, so that portable builds can still use the best instruction set
+#if defined HAS_SSE2
+	if (cpuHasAVX2())
+	{
+		blepAddKernel = blepAddKernel_AVX2;
+		blepMixKernel = blepMixKernel_AVX2;
+	}
+	else
+	{
+		blepAddKernel = blepAddKernel_SSE2;
+		blepMixKernel = blepMixKernel_SSE2;
+	}
+#elif defined HAS_NEON
+	blepAddKernel = blepAddKernel_NEON;
+	blepMixKernel = blepMixKernel_NEON;
+#endif
+
+	atomic32Store(&blepInitState, BLEP_INIT_DONE); // (release, the table and kernels are set up)
+}
+
+const char *blepGetKernelName(void)
+{
+#if defined HAS_SSE2
+	if (blepAddKernel == blepAddKernel_AVX2)
+		return "AVX2";
+	if (blepAddKernel == blepAddKernel_SSE2)
+		return "SSE2";
+#elif defined HAS_NEON
+	if (blepAddKernel == blepAddKernel_NEON)
+		return "NEON";
+#endif
+	return "C";
+}
+
+static inline void blepAdvance(blep_t *b, const int32_t numSamples)
+{
+	b->index += numSamples;
+	if (b->index == BLEP_NS)
+	{
+		// move the pending half down, so that the next BLEP_NS samples are contiguous again
+		memcpy(&b->fBuffer[0], &b->fBuffer[BLEP_NS], BLEP_NS * sizeof (float));
+		memset(&b->fBuffer[BLEP_NS], 0, BLEP_NS * sizeof (float));
+		b->index = 0;
+	}
+}
 
 void blepAdd(blep_t *b, const float fOffset, const float fAmplitude)
 {
 	ASSERT(fOffset >= 0.0f && fOffset < 1.0f);
 
 	float f = fOffset * BLEP_SP;
-
 	const int32_t fInt = (int32_t)f; // get integer part of f
-	const float *fBlepSrc = fMinBlepData + fInt;
 	f -= fInt; // remove integer part from f
 
-	int32_t i = b->index;
-	for (int32_t n = 0; n < BLEP_NS; n++)
+	blepAddKernel(&b->fBuffer[b->index], fBlepTable[fInt], f, fAmplitude);
+	b->samplesLeft = BLEP_NS;
+}
+
+float blepRun(blep_t *b, const float fInput)
+{
+	const float fBlepOutput = fInput + b->fBuffer[b->index];
+	blepAdvance(b, 1);
+	b->samplesLeft--;
+
+	return fBlepOutput;
+}
+
+void blepRunMix(blep_t *b, const float fInput, float *fOut, int32_t numSamples)
+{
+	ASSERT(numSamples <= b->samplesLeft);
+
+	b->samplesLeft -= numSamples;
+	while (numSamples > 0)
 	{
-		b->fBuffer[i] += fAmplitude * LERP(fBlepSrc[0], fBlepSrc[1], f);
-		fBlepSrc += BLEP_SP;
+		int32_t samplesTodo = BLEP_NS - b->index;
+		if (samplesTodo > numSamples)
+			samplesTodo = numSamples;
 
-		i = (i + 1) & BLEP_RNS;
-	}
+		blepMixKernel(fOut, &b->fBuffer[b->index], fInput, samplesTodo);
+		blepAdvance(b, samplesTodo);
 
-	b->samplesLeft = BLEP_NS;
+		fOut += samplesTodo;
+		numSamples -= samplesTodo;
+	}
 }
 
-float blepRun(blep_t *b, const float fInput)
+void blepSkip(blep_t *b, int32_t numSamples)
 {
-	float fBlepOutput = fInput + b->fBuffer[b->index];
-	b->fBuffer[b->index] = 0.0f;
+	ASSERT(numSamples <= b->samplesLeft);
 
-	b->index = (b->index + 1) & BLEP_RNS;
+	b->samplesLeft -= numSamples;
+	while (numSamples > 0)
+	{
+		int32_t samplesTodo = BLEP_NS - b->index;
+		if (samplesTodo > numSamples)
+			samplesTodo = numSamples;
 
-	b->samplesLeft--;
-	return fBlepOutput;
+		blepAdvance(b, samplesTodo);
+		numSamples -= samplesTodo;
+	}
 }
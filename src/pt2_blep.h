@@ -11,11 +11,10 @@
 ** OS = oversampling, how many samples per zero crossing are taken
 ** SP = step size per output sample, used to lower the cutoff (play the impulse slower)
 ** NS = number of samples of impulse to insert
-** RNS = the lowest power of two greater than NS, minus one (used to wrap output buffer)
 **
 ** ZC and OS are here only for reference, they depend upon the data in the table and can't be changed.
 ** SP, the step size can be any number lower or equal to OS, as long as the result NS remains an integer.
-** for example, if ZC=8,OS=5, you can set SP=1, the result is NS=40, and RNS must then be 63.
+** for example, if ZC=8,OS=5, you can set SP=1, the result is NS=40.
 ** the result of that is the filter cutoff is set at nyquist * (SP/OS), in this case nyquist/5.
 */
 
@@ -23,13 +22,20 @@
 #define BLEP_OS 16
 #define BLEP_SP 16
 #define BLEP_NS (BLEP_ZC * BLEP_OS / BLEP_SP)
-#define BLEP_RNS 31 // RNS = (2^ > NS) - 1
 
+/* fBuffer is not a ring buffer: the BLEP_NS upcoming samples are always at fBuffer[index..index+BLEP_NS-1],
+** and the upper half is moved down when index reaches BLEP_NS. This makes blepAdd()/blepRunMix() SIMD-friendly.
+*/
 typedef struct blep_t
 {
 	int32_t index, samplesLeft;
-	float fBuffer[BLEP_RNS+1], fLastValue;
+	float fBuffer[BLEP_NS*2], fLastValue;
 } blep_t;
 
+void blepInit(void); // sets up the BLEP table and picks SIMD kernels for this CPU (thread-safe, done once, paulaSetup() calls it)
+const char *blepGetKernelName(void);
+
 void blepAdd(blep_t *b, const float fOffset, const float fAmplitude);
 float blepRun(blep_t *b, const float fInput);
+void blepRunMix(blep_t *b, const float fInput, float *fOut, int32_t numSamples); // fOut[x] += blepRun(), numSamples <= samplesLeft
+void blepSkip(blep_t *b, int32_t numSamples); // blepRunMix() without output (same state afterwards)
@@ -0,0 +1,615 @@
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+/* Command-line rendering (MOD2WAV without video/audio):
+**
+** pt2-clone --render in.mod out.wav|out.flac [--threads n] [options]
+** pt2-clone --render-batch <list.txt|directory> <output directory> [--threads n] [options]
+**
+** Batch rendering renders several modules at once (one per worker thread), each with its
+** own module, replayer, Paula and mixer (see mod2WavRenderHeadless()). A single render
+** splits long songs into segments that are rendered in parallel instead.
+**
+** The output is FLAC if the filename ends in ".flac" (--format FLAC for batch rendering).
+** protracker.ini is not read, so the output only depends on the arguments.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_MEAN_AND_LEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+#include "pt2_header.h"
+#include "pt2_helpers.h"
+#include "pt2_structs.h"
+#include "pt2_config.h"
+#include "pt2_blep.h"
+#include "pt2_hpc.h"
+#include "pt2_mod2wav.h"
+#include "pt2_cmdline.h"
+#include "modloaders/pt2_load_module.h"
+
+#define MAX_BATCH_THREADS 64
+
+#ifdef _WIN32
+#define DIR_SEPARATOR '\\'
+#else
+#define DIR_SEPARATOR '/'
+#endif
+
+typedef struct batchJob_t
+{
+	char *inputFilename, *outputFilename;
+	bool ok;
+	mod2WavStats_t stats;
+	double dRenderSecs;
+} batchJob_t;
+
+static int32_t numBatchJobs, numBatchJobsAllocated, numJobsDone;
+static batchJob_t *batchJobs;
+static SDL_atomic_t nextBatchJob;
+static SDL_mutex *printMutex;
+
+static void printUsage(void)
+{
+	fprintf(stderr,
+		"Usage: pt2-clone --render <in.mod> <out.wav|out.flac> [--threads <n>] [options]\n"
+		"       pt2-clone --render-batch <list.txt|directory> <output directory> [--threads <n>] [options]\n"
+		"\n"
+		"Options:\n"
+		"  --rate <hz>            output rate, %d..%d (default 44100)\n"
+		"  --loops <n>            extra song loops, 0..50 (default 0)\n"
+		"  --fadeout <seconds>    fade out the end, 0..60 (default 0 = off)\n"
+		"  --model <A500|A1200>   Amiga filter model (default A1200)\n"
+		"  --stereo-sep <percent> stereo separation, 0..100 (default 20)\n"
+		"  --threads <n>          worker threads, 1..%d (default: number of CPU cores)\n"
+		"  --format <WAV|FLAC>    batch output format (default WAV)\n",
+		MIN_AUDIO_FREQUENCY, MAX_AUDIO_FREQUENCY, MAX_BATCH_THREADS);
+}
+
+static bool getNumArg(const char *arg, int32_t min, int32_t max, int32_t *value)
+{
+	char *end;
+
+	const long num = strtol(arg, &end, 10);
+	if (end == arg || *end != '\0' || num < min || num > max)
+		return false;
+
+	*value = (int32_t)num;
+	return true;
+}
+
+static bool parseArgs(int32_t argc, char **argv, int32_t *numThreads)
+{
+	// same as the defaults in loadConfig()
+	config.mod2WavOutputFreq = 44100;
+	config.mod2WavOutputFormat = OUTPUT_FORMAT_16BIT;
+	config.mod2WavStems = false;
+	config.mod2WavFlac = false;
+	config.amigaModel = MODEL_A1200;
+	config.stereoSeparation = 20;
+	config.maxSampleLength = 65534;
+	config.enableE8xEffect = false;
+
+	editor.mod2WavNumLoops = 0;
+	editor.mod2WavFadeOut = false;
+	editor.mod2WavFadeOutSeconds = 0;
+
+	for (int32_t i = 4; i < argc; i += 2)
+	{
+		const char *option = argv[i];
+		if (i+1 >= argc)
+		{
+			fprintf(stderr, "Error: Option \"%s\" needs a value\n", option);
+			return false;
+		}
+
+		const char *value = argv[i+1];
+		int32_t num;
+
+		if (!strcmp(option, "--rate"))
+		{
+			if (!getNumArg(value, MIN_AUDIO_FREQUENCY, MAX_AUDIO_FREQUENCY, &num))
+			{
+				fprintf(stderr, "Error: The rate must be %d..%d\n", MIN_AUDIO_FREQUENCY, MAX_AUDIO_FREQUENCY);
+				return false;
+			}
+
+			config.mod2WavOutputFreq = num;
+		}
+		else if (!strcmp(option, "--loops"))
+		{
+			if (!getNumArg(value, 0, 50, &num))
+			{
+				fprintf(stderr, "Error: The loop count must be 0..50\n");
+				return false;
+			}
+
+			editor.mod2WavNumLoops = (int8_t)num;
+		}
+		else if (!strcmp(option, "--fadeout"))
+		{
+			if (!getNumArg(value, 0, 60, &num))
+			{
+				fprintf(stderr, "Error: The fadeout length must be 0..60 seconds\n");
+				return false;
+			}
+
+			editor.mod2WavFadeOut = (num > 0);
+			editor.mod2WavFadeOutSeconds = (int8_t)num;
+		}
+		else if (!strcmp(option, "--model"))
+		{
+			if (!_stricmp(value, "A500"))
+			{
+				config.amigaModel = MODEL_A500;
+			}
+			else if (!_stricmp(value, "A1200"))
+			{
+				config.amigaModel = MODEL_A1200;
+			}
+			else
+			{
+				fprintf(stderr, "Error: The model must be A500 or A1200\n");
+				return false;
+			}
+		}
+		else if (!strcmp(option, "--stereo-sep"))
+		{
+			if (!getNumArg(value, 0, 100, &num))
+			{
+				fprintf(stderr, "Error: The stereo separation must be 0..100\n");
+				return false;
+			}
+
+			config.stereoSeparation = (int8_t)num;
+		}
+		else if (!strcmp(option, "--threads"))
+		{
+			if (!getNumArg(value, 1, MAX_BATCH_THREADS, &num))
+			{
+				fprintf(stderr, "Error: The thread count must be 1..%d\n", MAX_BATCH_THREADS);
+				return false;
+			}
+
+			*numThreads = num;
+		}
+		else if (!strcmp(option, "--format"))
+		{
+			if (!_stricmp(value, "WAV"))
+			{
+				config.mod2WavFlac = false;
+			}
+			else if (!_stricmp(value, "FLAC"))
+			{
+				config.mod2WavFlac = true;
+			}
+			else
+			{
+				fprintf(stderr, "Error: The format must be WAV or FLAC\n");
+				return false;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Error: Unknown option \"%s\"\n", option);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static module_t *loadModule(const char *filename, const char **errorMsg)
+{
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+	{
+		*errorMsg = "Couldn't open the file";
+		return NULL;
+	}
+
+	module_t *m = moduleLoadFile(f, config.maxSampleLength, errorMsg);
+	fclose(f);
+
+	if (m == NULL && *errorMsg == NULL)
+		*errorMsg = "Unknown error";
+
+	return m;
+}
+
+static void formatSeconds(char *out, double dSecs)
+{
+	const int32_t mins = (int32_t)(dSecs / 60.0);
+	sprintf(out, "%d:%04.1f", mins, dSecs - (mins * 60.0));
+}
+
+// single file
+
+static int32_t renderOneFile(const char *inputFilename, const char *outputFilename, int32_t numThreads)
+{
+	const char *errorMsg = NULL;
+
+	song = loadModule(inputFilename, &errorMsg);
+	if (song == NULL)
+	{
+		fprintf(stderr, "Error: Couldn't load \"%s\": %s\n", inputFilename, errorMsg);
+		return 1;
+	}
+
+	const bool renderOK = mod2WavRenderHeadless(song, outputFilename, numThreads, NULL, &errorMsg);
+
+	moduleFree(song);
+	song = NULL;
+
+	if (!renderOK)
+	{
+		fprintf(stderr, "Error: %s\n", errorMsg);
+		return 1;
+	}
+
+	return 0;
+}
+
+// batch
+
+static bool isModuleFilename(const char *name) // (same naming rules as in Disk Op.)
+{
+	static const char *typeNames[] = { "MOD", "STK", "M15", "NST", "UST", "PP", "NT" };
+
+	const int32_t nameLen = (int32_t)strlen(name);
+	for (int32_t i = 0; i < (int32_t)(sizeof (typeNames) / sizeof (typeNames[0])); i++)
+	{
+		const int32_t typeLen = (int32_t)strlen(typeNames[i]);
+		if (nameLen <= typeLen+1)
+			continue;
+
+		if ((!_strnicmp(name, typeNames[i], typeLen) && name[typeLen] == '.') ||
+			(name[nameLen-typeLen-1] == '.' && !_strnicmp(&name[nameLen-typeLen], typeNames[i], typeLen)))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool addBatchJob(const char *inputFilename, const char *outputDir)
+{
+	if (numBatchJobs == numBatchJobsAllocated)
+	{
+		const int32_t newSize = (numBatchJobsAllocated == 0) ? 256 : numBatchJobsAllocated * 2;
+
+		batchJob_t *newJobs = (batchJob_t *)realloc(batchJobs, newSize * sizeof (batchJob_t));
+		if (newJobs == NULL)
+			return false;
+
+		batchJobs = newJobs;
+		numBatchJobsAllocated = newSize;
+	}
+
+	// "dir/name.mod" -> "outputDir/name.wav" ("mod.name" -> "mod.name.wav"), or .flac
+	const char *name = inputFilename;
+	for (const char *p = inputFilename; *p != '\0'; p++)
+	{
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+
+	int32_t nameLen = (int32_t)strlen(name);
+	if (nameLen > 4 && !_stricmp(&name[nameLen-4], ".mod"))
+		nameLen -= 4;
+
+	const int32_t outputDirLen = (int32_t)strlen(outputDir);
+
+	batchJob_t *job = &batchJobs[numBatchJobs];
+	memset(job, 0, sizeof (batchJob_t));
+
+	job->inputFilename = strdup(inputFilename);
+	const char *ext = config.mod2WavFlac ? ".flac" : ".wav";
+	job->outputFilename = (char *)malloc(outputDirLen + 1 + nameLen + strlen(ext) + 1);
+
+	if (job->inputFilename == NULL || job->outputFilename == NULL)
+	{
+		if (job->inputFilename != NULL) free(job->inputFilename);
+		if (job->outputFilename != NULL) free(job->outputFilename);
+		return false;
+	}
+
+	memcpy(job->outputFilename, outputDir, outputDirLen);
+	job->outputFilename[outputDirLen] = DIR_SEPARATOR;
+	memcpy(&job->outputFilename[outputDirLen+1], name, nameLen);
+	strcpy(&job->outputFilename[outputDirLen+1+nameLen], ext);
+
+	numBatchJobs++;
+	return true;
+}
+
+static void freeBatchJobs(void)
+{
+	for (int32_t i = 0; i < numBatchJobs; i++)
+	{
+		free(batchJobs[i].inputFilename);
+		free(batchJobs[i].outputFilename);
+	}
+
+	if (batchJobs != NULL)
+	{
+		free(batchJobs);
+		batchJobs = NULL;
+	}
+
+	numBatchJobs = numBatchJobsAllocated = 0;
+}
+
+static bool addJobsFromDir(const char *dir, const char *outputDir)
+{
+	char path[PATH_MAX + 1];
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA fData;
+
+	snprintf(path, sizeof (path), "%s\\*", dir);
+	HANDLE hFind = FindFirstFileA(path, &fData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if ((fData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !isModuleFilename(fData.cFileName))
+			continue;
+
+		snprintf(path, sizeof (path), "%s\\%s", dir, fData.cFileName);
+		if (!addBatchJob(path, outputDir))
+		{
+			FindClose(hFind);
+			return false;
+		}
+	}
+	while (FindNextFileA(hFind, &fData));
+
+	FindClose(hFind);
+#else
+	struct stat statBuffer;
+	struct dirent *fData;
+
+	DIR *hFind = opendir(dir);
+	if (hFind == NULL)
+		return false;
+
+	while ((fData = readdir(hFind)) != NULL)
+	{
+		if (!isModuleFilename(fData->d_name))
+			continue;
+
+		snprintf(path, sizeof (path), "%s/%s", dir, fData->d_name);
+		if (stat(path, &statBuffer) != 0 || !(statBuffer.st_mode & S_IFREG))
+			continue;
+
+		if (!addBatchJob(path, outputDir))
+		{
+			closedir(hFind);
+			return false;
+		}
+	}
+
+	closedir(hFind);
+#endif
+
+	return true;
+}
+
+static bool addJobsFromList(const char *listFilename, const char *outputDir)
+{
+	char line[PATH_MAX + 1];
+
+	FILE *f = fopen(listFilename, "r");
+	if (f == NULL)
+		return false;
+
+	while (fgets(line, sizeof (line), f) != NULL)
+	{
+		int32_t lineLen = (int32_t)strlen(line);
+		while (lineLen > 0 && (line[lineLen-1] == '\n' || line[lineLen-1] == '\r'))
+			line[--lineLen] = '\0';
+
+		if (lineLen == 0)
+			continue;
+
+		if (!addBatchJob(line, outputDir))
+		{
+			fclose(f);
+			return false;
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+static int32_t SDLCALL batchWorkerThreadFunc(void *ptr)
+{
+	char lengthText[32];
+
+	while (true)
+	{
+		const int32_t jobIndex = SDL_AtomicAdd(&nextBatchJob, 1);
+		if (jobIndex >= numBatchJobs)
+			break;
+
+		batchJob_t *job = &batchJobs[jobIndex];
+		const char *errorMsg = NULL;
+
+		const uint64_t startTime64 = SDL_GetPerformanceCounter();
+
+		module_t *m = loadModule(job->inputFilename, &errorMsg);
+		if (m != NULL)
+		{
+			job->ok = mod2WavRenderHeadless(m, job->outputFilename, 1, &job->stats, &errorMsg); // (the files are rendered in parallel)
+			moduleFree(m);
+		}
+
+		job->dRenderSecs = (double)(SDL_GetPerformanceCounter() - startTime64) / hpcFreq.freq64;
+
+		SDL_LockMutex(printMutex);
+		numJobsDone++;
+
+		if (job->ok)
+		{
+			const double dAudioSecs = (double)job->stats.framesRendered / config.mod2WavOutputFreq;
+			formatSeconds(lengthText, dAudioSecs);
+
+			printf("[%d/%d] %s: %s in %.2fs (%.1fx real-time, %.2fs waiting for disk writes)\n", numJobsDone, numBatchJobs,
+				job->inputFilename, lengthText, job->dRenderSecs, (job->dRenderSecs > 0.0) ? (dAudioSecs / job->dRenderSecs) : 0.0,
+				job->stats.dWriteWaitSecs);
+			fflush(stdout);
+		}
+		else
+		{
+			fprintf(stderr, "[%d/%d] %s: Error: %s\n", numJobsDone, numBatchJobs, job->inputFilename, errorMsg);
+		}
+
+		SDL_UnlockMutex(printMutex);
+	}
+
+	(void)ptr;
+	return 0;
+}
+
+static int32_t renderBatch(const char *input, const char *outputDir, int32_t numThreads)
+{
+	struct stat statBuffer;
+	SDL_Thread *threads[MAX_BATCH_THREADS];
+
+	if (stat(outputDir, &statBuffer) != 0 || !(statBuffer.st_mode & S_IFDIR))
+	{
+		fprintf(stderr, "Error: The output directory \"%s\" doesn't exist\n", outputDir);
+		return 1;
+	}
+
+	bool listOK;
+	if (stat(input, &statBuffer) == 0 && (statBuffer.st_mode & S_IFDIR))
+		listOK = addJobsFromDir(input, outputDir);
+	else
+		listOK = addJobsFromList(input, outputDir);
+
+	if (!listOK)
+	{
+		fprintf(stderr, "Error: Couldn't read the module list/directory \"%s\"\n", input);
+		freeBatchJobs();
+		return 1;
+	}
+
+	if (numBatchJobs == 0)
+	{
+		fprintf(stderr, "Error: No modules found in \"%s\"\n", input);
+		freeBatchJobs();
+		return 1;
+	}
+
+	if (numThreads > numBatchJobs)
+		numThreads = numBatchJobs;
+
+	printMutex = SDL_CreateMutex();
+	if (printMutex == NULL)
+	{
+		fprintf(stderr, "Error: Couldn't create mutex\n");
+		freeBatchJobs();
+		return 1;
+	}
+
+	printf("Rendering %d modules with %d threads...\n", numBatchJobs, numThreads);
+	fflush(stdout);
+
+	SDL_AtomicSet(&nextBatchJob, 0);
+	numJobsDone = 0;
+
+	const uint64_t startTime64 = SDL_GetPerformanceCounter();
+
+	int32_t numThreadsStarted = 0;
+	for (int32_t i = 0; i < numThreads; i++)
+	{
+		threads[i] = SDL_CreateThread(batchWorkerThreadFunc, "MOD2WAV batch thread", NULL);
+		if (threads[i] == NULL)
+			break;
+
+		numThreadsStarted++;
+	}
+
+	if (numThreadsStarted == 0)
+		batchWorkerThreadFunc(NULL); // couldn't create any threads, render on this one
+
+	for (int32_t i = 0; i < numThreadsStarted; i++)
+		SDL_WaitThread(threads[i], NULL);
+
+	const double dWallSecs = (double)(SDL_GetPerformanceCounter() - startTime64) / hpcFreq.freq64;
+
+	SDL_DestroyMutex(printMutex);
+	printMutex = NULL;
+
+	// summary
+
+	int32_t numFailed = 0;
+	double dTotalAudioSecs = 0.0, dTotalRenderSecs = 0.0, dTotalWriteWaitSecs = 0.0;
+
+	for (int32_t i = 0; i < numBatchJobs; i++)
+	{
+		const batchJob_t *job = &batchJobs[i];
+		if (job->ok)
+		{
+			dTotalAudioSecs += (double)job->stats.framesRendered / config.mod2WavOutputFreq;
+			dTotalRenderSecs += job->dRenderSecs;
+			dTotalWriteWaitSecs += job->stats.dWriteWaitSecs;
+		}
+		else
+		{
+			numFailed++;
+		}
+	}
+
+	char lengthText[32];
+	formatSeconds(lengthText, dTotalAudioSecs);
+
+	printf("Rendered %d of %d modules (%s of audio) in %.2fs wall time, %.1fx real-time (%.1fx per thread)\n",
+		numBatchJobs - numFailed, numBatchJobs, lengthText, dWallSecs,
+		(dWallSecs > 0.0) ? (dTotalAudioSecs / dWallSecs) : 0.0,
+		(dTotalRenderSecs > 0.0) ? (dTotalAudioSecs / dTotalRenderSecs) : 0.0);
+	printf("Render threads waited %.2fs in total for disk writes\n", dTotalWriteWaitSecs);
+
+	freeBatchJobs();
+	return (numFailed > 0) ? 1 : 0;
+}
+
+bool isCmdLineRender(int32_t argc, char **argv)
+{
+	return argc >= 2 && (!strcmp(argv[1], "--render") || !strcmp(argv[1], "--render-batch"));
+}
+
+int32_t cmdLineRender(int32_t argc, char **argv)
+{
+	const bool batchMode = !strcmp(argv[1], "--render-batch");
+	int32_t numThreads = CLAMP(SDL_GetCPUCount(), 1, MAX_BATCH_THREADS);
+
+	if (argc < 4 || !parseArgs(argc, argv, &numThreads))
+	{
+		printUsage();
+		return 1;
+	}
+
+	hpc_Init();
+	blepInit();
+
+	if (batchMode)
+		return renderBatch(argv[2], argv[3], numThreads);
+	else
+		return renderOneFile(argv[2], argv[3], numThreads);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool isCmdLineRender(int32_t argc, char **argv); // "--render" as the first argument
+int32_t cmdLineRender(int32_t argc, char **argv); // returns the program's exit code (0 = success)
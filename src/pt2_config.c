@@ -58,6 +58,7 @@ void loadConfig(void)
 	config.blankZeroFlag = false;
 	config.compoMode = false;
 	config.soundBufferSize = 1024;
+	config.renderAheadMs = 0; // off
 	config.autoCloseDiskOp = true;
 	config.vsyncOff = false;
 	config.hwMouse = true;
@@ -66,6 +67,10 @@ void loadConfig(void)
 	config.integerScaling = true;
 	config.audioInputFrequency = 44100;
 	config.mod2WavOutputFreq = 44100;
+	config.audioOutputFormat = OUTPUT_FORMAT_16BIT;
+	config.mod2WavOutputFormat = OUTPUT_FORMAT_16BIT;
+	config.mod2WavStems = false;
+	config.mod2WavFlac = false;
 	config.keepEditModeAfterStepPlay = false;
 	config.maxSampleLength = 65534;
 	config.restrictedPattEditClick = false;
@@ -462,6 +467,35 @@ static bool loadProTrackerDotIni(FILE *f)
 			}
 		}
 
+		// MOD2WAVFORMAT
+		else if (!_strnicmp(configLine, "MOD2WAVFORMAT=", 14))
+		{
+			     if (!_strnicmp(&configLine[14], "16BIT", 5)) config.mod2WavOutputFormat = OUTPUT_FORMAT_16BIT;
+			else if (!_strnicmp(&configLine[14], "24BIT", 5)) config.mod2WavOutputFormat = OUTPUT_FORMAT_24BIT;
+			else if (!_strnicmp(&configLine[14], "FLOAT", 5)) config.mod2WavOutputFormat = OUTPUT_FORMAT_FLOAT;
+		}
+
+		// MOD2WAVSTEMS
+		else if (!_strnicmp(configLine, "MOD2WAVSTEMS=", 13))
+		{
+			     if (!_strnicmp(&configLine[13], "TRUE",  4)) config.mod2WavStems = true;
+			else if (!_strnicmp(&configLine[13], "FALSE", 5)) config.mod2WavStems = false;
+		}
+
+		// MOD2WAVFLAC
+		else if (!_strnicmp(configLine, "MOD2WAVFLAC=", 12))
+		{
+			     if (!_strnicmp(&configLine[12], "TRUE",  4)) config.mod2WavFlac = true;
+			else if (!_strnicmp(&configLine[12], "FALSE", 5)) config.mod2WavFlac = false;
+		}
+
+		// AUDIOFORMAT
+		else if (!_strnicmp(configLine, "AUDIOFORMAT=", 12))
+		{
+			     if (!_strnicmp(&configLine[12], "16BIT", 5)) config.audioOutputFormat = OUTPUT_FORMAT_16BIT;
+			else if (!_strnicmp(&configLine[12], "FLOAT", 5)) config.audioOutputFormat = OUTPUT_FORMAT_FLOAT;
+		}
+
 		// FREQUENCY
 		else if (!_strnicmp(configLine, "FREQUENCY=", 10))
 		{
@@ -482,6 +516,16 @@ static bool loadProTrackerDotIni(FILE *f)
 			}
 		}
 
+		// RENDERAHEAD
+		else if (!_strnicmp(configLine, "RENDERAHEAD=", 12))
+		{
+			if (configLine[12] != '\0')
+			{
+				const int32_t num = atoi(&configLine[12]);
+				config.renderAheadMs = CLAMP(num, 0, 500);
+			}
+		}
+
 		// STEREOSEPARATION
 		else if (!_strnicmp(configLine, "STEREOSEPARATION=", 17))
 		{
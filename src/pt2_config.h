@@ -10,20 +10,27 @@ enum
 	PIXELFILTER_BEST = 2
 };
 
+enum
+{
+	OUTPUT_FORMAT_16BIT = 0,
+	OUTPUT_FORMAT_24BIT = 1, // MOD2WAV only
+	OUTPUT_FORMAT_FLOAT = 2
+};
+
 typedef struct config_t
 {
 	char *defModulesDir, *defSamplesDir;
 	bool waveformCenterLine, pattDots, compoMode, autoCloseDiskOp, hideDiskOpDates, hwMouse;
 	bool transDel, fullScreenStretch, vsyncOff, modDot, blankZeroFlag, realVuMeters, rememberPlayMode;
 	bool startInFullscreen, integerScaling, enableE8xEffect, noDownsampleOnSmpLoad, keepEditModeAfterStepPlay;
-	bool restrictedPattEditClick;
+	bool restrictedPattEditClick, mod2WavStems, mod2WavFlac;
 	int8_t stereoSeparation, accidental;
 	bool autoFitVideoScale;
 	int8_t videoScaleFactor;
-	uint8_t pixelFilter, amigaModel;
+	uint8_t pixelFilter, amigaModel, audioOutputFormat, mod2WavOutputFormat;
 	uint16_t quantizeValue;
 	int32_t maxSampleLength;
-	uint32_t soundFrequency, soundBufferSize, audioInputFrequency, mod2WavOutputFreq;
+	uint32_t soundFrequency, soundBufferSize, renderAheadMs, audioInputFrequency, mod2WavOutputFreq;
 } config_t;
 
 extern config_t config; // pt2_config.c
@@ -1,8 +1,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "pt2_config.h" // config.maxSampleLength
+#include "pt2_downsample2x.h"
 
 #define NUM_TAPS 59 /* should be 4m+3 (3, 7, 11, 15, 19, ...) */
 #define CENTER_TAP ((NUM_TAPS - 1) / 2)
@@ -40,25 +42,26 @@
 */
 
 // ----------------------------------------------------------
-// 2x downsampler for main audio mixer (simpler/faster, but has output sample delay)
+// 2x downsampler for the audio mixers (simpler/faster, but has output sample delay)
 // ----------------------------------------------------------
 
-static float t01_L,t02_L,t03_L,t04_L,t05_L,t06_L,t07_L,t08_L,t09_L,t10_L,t11_L,t12_L,t13_L,t14_L;
-static float t15_L,t16_L,t17_L,t18_L,t19_L,t20_L,t21_L,t22_L,t23_L,t24_L,t25_L,t26_L,t27_L,t28_L,t29_L;
-static float t01_R,t02_R,t03_R,t04_R,t05_R,t06_R,t07_R,t08_R,t09_R,t10_R,t11_R,t12_R,t13_R,t14_R;
-static float t15_R,t16_R,t17_R,t18_R,t19_R,t20_R,t21_R,t22_R,t23_R,t24_R,t25_R,t26_R,t27_R,t28_R,t29_R;
+static downsample2xState_t stateL, stateR; // PAT2SMP
 
-void clearDownsample2xStates(void)
+void clearDownsample2xState(downsample2xState_t *s)
 {
-	t01_L=t02_L=t03_L=t04_L=t05_L=t06_L=t07_L=t08_L=t09_L=t10_L=t11_L=t12_L=t13_L=t14_L=
-	t15_L=t16_L=t17_L=t18_L=t19_L=t20_L=t21_L=t22_L=t23_L=t24_L=t25_L=t26_L=t27_L=t28_L=t29_L = 0.0f;
+	memset(s, 0, sizeof (downsample2xState_t));
+}
 
-	t01_R=t02_R=t03_R=t04_R=t05_R=t06_R=t07_R=t08_R=t09_R=t10_R=t11_R=t12_R=t13_R=t14_R=
-	t15_R=t16_R=t17_R=t18_R=t19_R=t20_R=t21_R=t22_R=t23_R=t24_R=t25_R=t26_R=t27_R=t28_R=t29_R = 0.0f;
+void clearDownsample2xStates(void)
+{
+	clearDownsample2xState(&stateL);
+	clearDownsample2xState(&stateR);
 }
 
-float downsample2x_L(float sample1, float sample2)
+float downsample2x(downsample2xState_t *s, float sample1, float sample2)
 {
+	float *t = s->t; // t[0] is unused, so that the indexes match the coefficient names
+
 	const float x00 = sample2 * C00, x01 = sample1 * C01;
 	const float x03 = sample1 * C03, x05 = sample1 * C05;
 	const float x07 = sample1 * C07, x09 = sample1 * C09;
@@ -68,85 +71,66 @@ float downsample2x_L(float sample1, float sample2)
 	const float x23 = sample1 * C23, x25 = sample1 * C25;
 	const float x27 = sample1 * C27, x29 = sample1 * C29;
 
-	const float out = t29_L + x29;
-
-	t29_L = t28_L + x27;
-	t28_L = t27_L + x25;
-	t27_L = t26_L + x23;
-	t26_L = t25_L + x21;
-	t25_L = t24_L + x19;
-	t24_L = t23_L + x17;
-	t23_L = t22_L + x15;
-	t22_L = t21_L + x13;
-	t21_L = t20_L + x11;
-	t20_L = t19_L + x09;
-	t19_L = t18_L + x07;
-	t18_L = t17_L + x05;
-	t17_L = t16_L + x03;
-	t16_L = t15_L + x01;
-	t15_L = t14_L + x01 + x00;
-	t14_L = t13_L + x03;
-	t13_L = t12_L + x05;
-	t12_L = t11_L + x07;
-	t11_L = t10_L + x09;
-	t10_L = t09_L + x11;
-	t09_L = t08_L + x13;
-	t08_L = t07_L + x15;
-	t07_L = t06_L + x17;
-	t06_L = t05_L + x19;
-	t05_L = t04_L + x21;
-	t04_L = t03_L + x23;
-	t03_L = t02_L + x25;
-	t02_L = t01_L + x27;
-	t01_L =         x29;
+	const float out = t[29] + x29;
+
+	t[29] = t[28] + x27;
+	t[28] = t[27] + x25;
+	t[27] = t[26] + x23;
+	t[26] = t[25] + x21;
+	t[25] = t[24] + x19;
+	t[24] = t[23] + x17;
+	t[23] = t[22] + x15;
+	t[22] = t[21] + x13;
+	t[21] = t[20] + x11;
+	t[20] = t[19] + x09;
+	t[19] = t[18] + x07;
+	t[18] = t[17] + x05;
+	t[17] = t[16] + x03;
+	t[16] = t[15] + x01;
+	t[15] = t[14] + x01 + x00;
+	t[14] = t[13] + x03;
+	t[13] = t[12] + x05;
+	t[12] = t[11] + x07;
+	t[11] = t[10] + x09;
+	t[10] = t[ 9] + x11;
+	t[ 9] = t[ 8] + x13;
+	t[ 8] = t[ 7] + x15;
+	t[ 7] = t[ 6] + x17;
+	t[ 6] = t[ 5] + x19;
+	t[ 5] = t[ 4] + x21;
+	t[ 4] = t[ 3] + x23;
+	t[ 3] = t[ 2] + x25;
+	t[ 2] = t[ 1] + x27;
+	t[ 1] =         x29;
 
 	return out;
 }
 
+float downsample2x_L(float sample1, float sample2)
+{
+	return downsample2x(&stateL, sample1, sample2);
+}
+
 float downsample2x_R(float sample1, float sample2)
 {
-	const float x00 = sample2 * C00, x01 = sample1 * C01;
-	const float x03 = sample1 * C03, x05 = sample1 * C05;
-	const float x07 = sample1 * C07, x09 = sample1 * C09;
-	const float x11 = sample1 * C11, x13 = sample1 * C13;
-	const float x15 = sample1 * C15, x17 = sample1 * C17;
-	const float x19 = sample1 * C19, x21 = sample1 * C21;
-	const float x23 = sample1 * C23, x25 = sample1 * C25;
-	const float x27 = sample1 * C27, x29 = sample1 * C29;
+	return downsample2x(&stateR, sample1, sample2);
+}
 
-	const float out = t29_R + x29;
-
-	t29_R = t28_R + x27;
-	t28_R = t27_R + x25;
-	t27_R = t26_R + x23;
-	t26_R = t25_R + x21;
-	t25_R = t24_R + x19;
-	t24_R = t23_R + x17;
-	t23_R = t22_R + x15;
-	t22_R = t21_R + x13;
-	t21_R = t20_R + x11;
-	t20_R = t19_R + x09;
-	t19_R = t18_R + x07;
-	t18_R = t17_R + x05;
-	t17_R = t16_R + x03;
-	t16_R = t15_R + x01;
-	t15_R = t14_R + x01 + x00;
-	t14_R = t13_R + x03;
-	t13_R = t12_R + x05;
-	t12_R = t11_R + x07;
-	t11_R = t10_R + x09;
-	t10_R = t09_R + x11;
-	t09_R = t08_R + x13;
-	t08_R = t07_R + x15;
-	t07_R = t06_R + x17;
-	t06_R = t05_R + x19;
-	t05_R = t04_R + x21;
-	t04_R = t03_R + x23;
-	t03_R = t02_R + x25;
-	t02_R = t01_R + x27;
-	t01_R =         x29;
+// in-place, the output (numOutputSamples) overwrites the start of the buffers
+void downsample2xStereo(downsample2xState_t *sL, downsample2xState_t *sR, float *fBufferL, float *fBufferR, int32_t numOutputSamples)
+{
+	for (int32_t i = 0; i < numOutputSamples; i++)
+	{
+		fBufferL[i] = downsample2x(sL, fBufferL[(i << 1) + 0], fBufferL[(i << 1) + 1]);
+		fBufferR[i] = downsample2x(sR, fBufferR[(i << 1) + 0], fBufferR[(i << 1) + 1]);
+	}
+}
 
-	return out;
+// fOut can be the same buffer as fIn (in-place)
+void downsample2xMono(downsample2xState_t *s, const float *fIn, float *fOut, int32_t numOutputSamples)
+{
+	for (int32_t i = 0; i < numOutputSamples; i++)
+		fOut[i] = downsample2x(s, fIn[(i << 1) + 0], fIn[(i << 1) + 1]);
 }
 
 // ----------------------------------------------------------
@@ -2,7 +2,18 @@
 
 #include <stdint.h>
 
-// reserved for main audio channel mixer, PAT2SMP and MOD2WAV
+typedef struct downsample2xState_t
+{
+	float t[30];
+} downsample2xState_t;
+
+// for any number of independent channels (mixers, MOD2WAV stems)
+void clearDownsample2xState(downsample2xState_t *s);
+float downsample2x(downsample2xState_t *s, float sample1, float sample2);
+void downsample2xMono(downsample2xState_t *s, const float *fIn, float *fOut, int32_t numOutputSamples);
+void downsample2xStereo(downsample2xState_t *sL, downsample2xState_t *sR, float *fBufferL, float *fBufferR, int32_t numOutputSamples);
+
+// reserved for PAT2SMP
 void clearDownsample2xStates(void);
 float downsample2x_L(float sample1, float sample2);
 float downsample2x_R(float sample1, float sample2);
@@ -67,7 +67,7 @@ static uint8_t quantizeCheck(uint8_t row)
 		}
 		else if (quantize == 1)
 		{
-			if (song->tick > song->speed>>1)
+			if (replayer.tick > replayer.speed>>1)
 			{
 				row = (row + 1) & 63;
 				editor.didQuantize = true;
@@ -91,7 +91,7 @@ static void jamAndPlaceSample(SDL_Scancode scancode, bool normalMode)
 	uint8_t chNum = cursor.channel;
 	ASSERT(chNum < PAULA_VOICES);
 
-	moduleChannel_t *ch = &song->channels[chNum];
+	moduleChannel_t *ch = &replayer.channels[chNum];
 	note_t *note = &song->patterns[song->currPattern][(quantizeCheck(song->currRow) * PAULA_VOICES) + chNum];
 
 	int8_t noteVal = normalMode ? keyToNote(scancode) : pNoteTable[editor.currSample];
@@ -109,50 +109,33 @@ static void jamAndPlaceSample(SDL_Scancode scancode, bool normalMode)
 		// don't play sample if we quantized to another row (will be played in modplayer instead)
 		if (editor.currMode != MODE_RECORD || !editor.didQuantize)
 		{
-			lockAudio();
+			int8_t *n_start = &song->sampleData[s->offset];
+			int8_t *n_loopstart = &song->sampleData[s->offset + s->loopStart];
+			uint16_t n_length = (uint16_t)((s->loopStart > 0) ? (s->loopStart + s->loopLength) >> 1 : s->length >> 1);
+			uint16_t n_replen = (uint16_t)(s->loopLength >> 1);
 
-			ch->n_samplenum = editor.currSample;
-			ch->n_volume = s->volume;
-			ch->n_period = tempPeriod;
-			ch->n_start = &song->sampleData[s->offset];
-			ch->n_length = (uint16_t)((s->loopStart > 0) ? (s->loopStart + s->loopLength) >> 1 : s->length >> 1);
-			ch->n_loopstart = &song->sampleData[s->offset + s->loopStart];
-			ch->n_replen = (uint16_t)(s->loopLength >> 1);
+			if (n_length == 0)
+				n_length = 1;
 
-			if (ch->n_length == 0)
-				ch->n_length = 1;
+			setChannelSample(chNum, (uint8_t)editor.currSample, s->volume, tempPeriod, n_start, n_length, n_loopstart, n_replen);
 
 			const uint32_t voiceAddr = 0xDFF0A0 + (chNum * 16);
-			paulaWriteWord(voiceAddr + 8, ch->n_volume);
-			paulaWriteWord(voiceAddr + 6, ch->n_period);
-			paulaWritePtr(voiceAddr + 0, ch->n_start);
-			paulaWriteWord(voiceAddr + 4, ch->n_length);
 
-			if (!editor.muted[chNum])
-				paulaWriteWord(0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
-			else
-				paulaWriteWord(0xDFF096, ch->n_dmabit); // voice DMA off
-
-			// these take effect after the current DMA cycle is done
-			paulaWritePtr(voiceAddr + 0, ch->n_loopstart);
-			paulaWriteWord(voiceAddr + 4, ch->n_replen);
-
-			// update tracker visuals
-
-			setVisualsVolume(chNum, ch->n_volume);
-			setVisualsPeriod(chNum, ch->n_period);
-			setVisualsDataPtr(chNum, ch->n_start);
-			setVisualsLength(chNum, ch->n_length);
+			beginPaulaWrites(audio.paula, false);
+			queuePaulaWriteWord(audio.paula, voiceAddr + 8, s->volume);
+			queuePaulaWriteWord(audio.paula, voiceAddr + 6, tempPeriod);
+			queuePaulaWritePtr(audio.paula, voiceAddr + 0, n_start);
+			queuePaulaWriteWord(audio.paula, voiceAddr + 4, n_length);
 
 			if (!editor.muted[chNum])
-				setVisualsDMACON(0x8000 | ch->n_dmabit);
+				queuePaulaWriteWord(audio.paula, 0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
 			else
-				setVisualsDMACON(ch->n_dmabit);
-
-			setVisualsDataPtr(chNum, ch->n_loopstart);
-			setVisualsLength(chNum, ch->n_replen);
+				queuePaulaWriteWord(audio.paula, 0xDFF096, ch->n_dmabit); // voice DMA off
 
-			unlockAudio();
+			// these take effect after the current DMA cycle is done
+			queuePaulaWritePtr(audio.paula, voiceAddr + 0, n_loopstart);
+			queuePaulaWriteWord(audio.paula, voiceAddr + 4, n_replen);
+			endPaulaWrites(audio.paula);
 		}
 
 		// normalMode = normal keys, or else keypad keys (in jam mode)
@@ -456,48 +439,32 @@ void handleSampleJamming(SDL_Scancode scancode) // used for the sampling feature
 	if (s->length <= 1)
 		return;
 
-	moduleChannel_t *ch = &song->channels[chNum];
+	moduleChannel_t *ch = &replayer.channels[chNum];
 
 	int8_t *n_start = &song->sampleData[s->offset];
 	int8_t vol = 64;
 	uint16_t n_length = (uint16_t)(s->length >> 1);
 	uint16_t period = periodTable[((s->fineTune & 0xF) * 37) + noteVal];
 
-	lockAudio();
-
-	ch->n_samplenum = editor.currSample; // needed for sample playback/sampling line
+	setChannelSampleNum(chNum, (uint8_t)editor.currSample); // needed for sample playback/sampling line
 
 	const uint32_t voiceAddr = 0xDFF0A0 + (chNum * 16);
-	paulaWriteWord(voiceAddr +  8, vol);
-	paulaWriteWord(voiceAddr + 6, period);
-	paulaWritePtr(voiceAddr + 0, n_start);
-	paulaWriteWord(voiceAddr + 4, n_length);
 
-	if (!editor.muted[chNum])
-		paulaWriteWord(0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
-	else
-		paulaWriteWord(0xDFF096, ch->n_dmabit); // voice DMA off
-
-	// these take effect after the current DMA cycle is done
-	paulaWritePtr(voiceAddr + 0, NULL); // data
-	paulaWriteWord(voiceAddr + 4, 1); // length
-
-	// update tracker visuals
-
-	setVisualsVolume(chNum, vol);
-	setVisualsPeriod(chNum, period);
-	setVisualsDataPtr(chNum, n_start);
-	setVisualsLength(chNum, n_length);
+	beginPaulaWrites(audio.paula, false);
+	queuePaulaWriteWord(audio.paula, voiceAddr +  8, vol);
+	queuePaulaWriteWord(audio.paula, voiceAddr + 6, period);
+	queuePaulaWritePtr(audio.paula, voiceAddr + 0, n_start);
+	queuePaulaWriteWord(audio.paula, voiceAddr + 4, n_length);
 
 	if (!editor.muted[chNum])
-		setVisualsDMACON(0x8000 | ch->n_dmabit);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
 	else
-		setVisualsDMACON(ch->n_dmabit);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, ch->n_dmabit); // voice DMA off
 
-	setVisualsDataPtr(chNum, NULL);
-	setVisualsLength(chNum, 1);
-
-	unlockAudio();
+	// these take effect after the current DMA cycle is done
+	queuePaulaWritePtr(audio.paula, voiceAddr + 0, NULL); // data
+	queuePaulaWriteWord(audio.paula, voiceAddr + 4, 1); // length
+	endPaulaWrites(audio.paula);
 }
 
 void saveUndo(void)
@@ -0,0 +1,396 @@
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pt2_header.h"
+#include "pt2_helpers.h"
+#include "pt2_atomic.h"
+#include "pt2_fft_analyzer.h"
+#if defined HAS_SSE2
+#include <emmintrin.h>
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
+
+#define FFT_WINDOW_SECS 0.04 // rounded up to a power of two (2048 samples at 44.1kHz/48kHz)
+#define BARS_MIN_HZ 50.0
+#define BARS_MAX_HZ 16000.0
+#define BARS_DB_RANGE 60.0f // bar height 0..SPECTRUM_BAR_HEIGHT is -60..0 dBFS
+
+typedef struct fftAnalyzerBars_t
+{
+	uint64_t sampleClock; // audio.paula sample clock at the end of the analyzed samples
+	uint8_t height[SPECTRUM_BAR_NUM];
+} fftAnalyzerBars_t;
+
+typedef struct fftAnalyzer_t
+{
+	int32_t fftLength, interval, framesToNextFFT, ringPos;
+	uint64_t nextPaulaClock; // to find gaps in the input (the analyzer was turned off for a while)
+
+	float *fRing; // mono input, fftLength samples
+	float *fWindow; // Hann, fftLength samples
+	float *fRe, *fIm; // complex FFT of fftLength/2 points (the even/odd input samples as real/imaginary)
+	float *fTwiddleRe, *fTwiddleIm; // fftLength/4 points
+	float *fSplitCos, *fSplitSin; // for getting the real FFT from the complex one, fftLength/2+1 points
+	float *fBinRe, *fBinIm, *fBinPower; // fftLength/2+1 bins (+3 for padding)
+	int32_t *bitReverse;
+	int32_t barFirstBin[SPECTRUM_BAR_NUM], barLastBin[SPECTRUM_BAR_NUM];
+	float fPowerScale;
+
+	// the bars queue, only the producer writes writePos and only the consumer writes readPos
+	atomic32_t readPos, writePos;
+	int32_t mask;
+	fftAnalyzerBars_t *bars;
+} fftAnalyzer_t;
+
+static fftAnalyzer_t analyzer;
+
+void fftAnalyzerFree(void)
+{
+	fftAnalyzer_t *a = &analyzer;
+
+	if (a->fRing != NULL)
+		free(a->fRing); // (one block for all float buffers)
+
+	if (a->bitReverse != NULL)
+		free(a->bitReverse);
+
+	if (a->bars != NULL)
+		free(a->bars);
+
+	memset(a, 0, sizeof (fftAnalyzer_t));
+}
+
+bool fftAnalyzerInit(int32_t audioFreq, double dMaxLatencySecs)
+{
+	fftAnalyzer_t *a = &analyzer;
+
+	fftAnalyzerFree();
+
+	int32_t n = 64;
+	while (n < audioFreq * FFT_WINDOW_SECS)
+		n <<= 1;
+
+	const int32_t halfN = n / 2;
+	const int32_t numBins = halfN + 1;
+	const int32_t numBinsPadded = (numBins + 3) & ~3;
+
+	int32_t numBars = (int32_t)ceil(dMaxLatencySecs * FFT_ANALYZER_HZ) + 1;
+	int32_t length = 16;
+	while (length < numBars)
+		length <<= 1;
+
+	const size_t numFloats = n + n + halfN + halfN + (n / 4) + (n / 4) + numBins + numBins + (numBinsPadded * 3);
+	a->fRing = (float *)calloc(numFloats, sizeof (float));
+	a->bitReverse = (int32_t *)malloc(halfN * sizeof (int32_t));
+	a->bars = (fftAnalyzerBars_t *)calloc(length, sizeof (fftAnalyzerBars_t));
+
+	if (a->fRing == NULL || a->bitReverse == NULL || a->bars == NULL)
+	{
+		fftAnalyzerFree();
+		return false;
+	}
+
+	a->fWindow = a->fRing + n;
+	a->fRe = a->fWindow + n;
+	a->fIm = a->fRe + halfN;
+	a->fTwiddleRe = a->fIm + halfN;
+	a->fTwiddleIm = a->fTwiddleRe + (n / 4);
+	a->fSplitCos = a->fTwiddleIm + (n / 4);
+	a->fSplitSin = a->fSplitCos + numBins;
+	a->fBinRe = a->fSplitSin + numBins;
+	a->fBinIm = a->fBinRe + numBinsPadded;
+	a->fBinPower = a->fBinIm + numBinsPadded;
+
+	a->fftLength = n;
+	a->interval = (int32_t)round(audioFreq / (double)FFT_ANALYZER_HZ);
+	a->framesToNextFFT = a->interval;
+	a->mask = length - 1;
+
+	for (int32_t i = 0; i < n; i++)
+		a->fWindow[i] = (float)(0.5 - (0.5 * cos((2.0 * PI * i) / n)));
+
+	for (int32_t i = 0; i < n/4; i++)
+	{
+		a->fTwiddleRe[i] = (float)cos((2.0 * PI * i) / halfN);
+		a->fTwiddleIm[i] = (float)-sin((2.0 * PI * i) / halfN);
+	}
+
+	for (int32_t i = 0; i < numBins; i++)
+	{
+		a->fSplitCos[i] = (float)cos((2.0 * PI * i) / n);
+		a->fSplitSin[i] = (float)sin((2.0 * PI * i) / n);
+	}
+
+	int32_t bits = 0;
+	while ((1 << bits) < halfN)
+		bits++;
+
+	for (int32_t i = 0; i < halfN; i++)
+	{
+		int32_t r = 0;
+		for (int32_t b = 0; b < bits; b++)
+		{
+			if (i & (1 << b))
+				r |= 1 << (bits - 1 - b);
+		}
+
+		a->bitReverse[i] = r;
+	}
+
+	/* Log-spaced bars from BARS_MIN_HZ to BARS_MAX_HZ (or Nyquist). The lowest bars are narrower than
+	** an FFT bin, so they get the bin closest to their center.
+	*/
+	const double dBinHz = audioFreq / (double)n;
+	double dMaxHz = audioFreq * 0.5;
+	if (dMaxHz > BARS_MAX_HZ)
+		dMaxHz = BARS_MAX_HZ;
+
+	const double dBarRatio = pow(dMaxHz / BARS_MIN_HZ, 1.0 / SPECTRUM_BAR_NUM);
+	for (int32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
+	{
+		const double dLowHz = BARS_MIN_HZ * pow(dBarRatio, i);
+		const double dHighHz = dLowHz * dBarRatio;
+
+		int32_t firstBin = (int32_t)ceil(dLowHz / dBinHz);
+		int32_t lastBin = (int32_t)ceil(dHighHz / dBinHz) - 1;
+		if (lastBin < firstBin)
+			firstBin = lastBin = (int32_t)round(sqrt(dLowHz * dHighHz) / dBinHz);
+
+		if (lastBin > halfN)
+			lastBin = halfN;
+
+		a->barFirstBin[i] = firstBin;
+		a->barLastBin[i] = lastBin;
+	}
+
+	// a full scale sine wave is 0dBFS (the Hann window has a gain of 0.5)
+	a->fPowerScale = 16.0f / ((float)n * n);
+
+	return true;
+}
+
+static void fftComplex(fftAnalyzer_t *a) // radix-2, in place, the input is in bit-reversed order
+{
+	const int32_t m = a->fftLength / 2;
+	float *fRe = a->fRe, *fIm = a->fIm;
+
+	for (int32_t size = 2; size <= m; size <<= 1)
+	{
+		const int32_t halfSize = size >> 1;
+		const int32_t twiddleStep = m / size;
+
+		for (int32_t i = 0; i < m; i += size)
+		{
+			for (int32_t j = 0; j < halfSize; j++)
+			{
+				const float fWr = a->fTwiddleRe[j * twiddleStep];
+				const float fWi = a->fTwiddleIm[j * twiddleStep];
+				const int32_t p = i + j;
+				const int32_t q = p + halfSize;
+
+				const float fTr = (fRe[q] * fWr) - (fIm[q] * fWi);
+				const float fTi = (fRe[q] * fWi) + (fIm[q] * fWr);
+
+				fRe[q] = fRe[p] - fTr;
+				fIm[q] = fIm[p] - fTi;
+				fRe[p] += fTr;
+				fIm[p] += fTi;
+			}
+		}
+	}
+}
+
+static void getBinPowers(fftAnalyzer_t *a, int32_t numBins)
+{
+	const float *fRe = a->fBinRe, *fIm = a->fBinIm;
+	float *fPower = a->fBinPower;
+
+	int32_t i = 0;
+#if defined HAS_SSE2
+	for (; i+4 <= numBins; i += 4)
+	{
+		const __m128 vRe = _mm_loadu_ps(&fRe[i]);
+		const __m128 vIm = _mm_loadu_ps(&fIm[i]);
+		_mm_storeu_ps(&fPower[i], _mm_add_ps(_mm_mul_ps(vRe, vRe), _mm_mul_ps(vIm, vIm)));
+	}
+#elif defined HAS_NEON
+	for (; i+4 <= numBins; i += 4)
+	{
+		const float32x4_t vRe = vld1q_f32(&fRe[i]);
+		const float32x4_t vIm = vld1q_f32(&fIm[i]);
+		vst1q_f32(&fPower[i], vaddq_f32(vmulq_f32(vRe, vRe), vmulq_f32(vIm, vIm)));
+	}
+#endif
+	for (; i < numBins; i++)
+		fPower[i] = (fRe[i] * fRe[i]) + (fIm[i] * fIm[i]);
+}
+
+static void analyze(fftAnalyzer_t *a, uint64_t sampleClock)
+{
+	const int32_t writePos = atomic32Load(&a->writePos);
+	const int32_t newWritePos = (writePos + 1) & a->mask;
+	if (newWritePos == atomic32Load(&a->readPos))
+		return; // the queue is full (the main thread is stalling), skip it
+
+	const int32_t n = a->fftLength;
+	const int32_t m = n / 2;
+
+	// window the last n samples (oldest first) and load them as m complex points, in bit-reversed order
+	int32_t ringPos = a->ringPos; // (the oldest sample)
+	for (int32_t i = 0; i < m; i++)
+	{
+		const int32_t r = a->bitReverse[i];
+
+		a->fRe[r] = a->fRing[ringPos] * a->fWindow[(i*2)+0];
+		ringPos = (ringPos + 1) & (n - 1);
+
+		a->fIm[r] = a->fRing[ringPos] * a->fWindow[(i*2)+1];
+		ringPos = (ringPos + 1) & (n - 1);
+	}
+
+	fftComplex(a);
+
+	// get the n/2+1 bins of the real FFT from the complex FFT of the even/odd samples
+	for (int32_t k = 0; k <= m; k++)
+	{
+		const int32_t k1 = k & (m - 1);
+		const int32_t k2 = (m - k) & (m - 1);
+
+		const float fEvenRe = 0.5f * (a->fRe[k1] + a->fRe[k2]);
+		const float fEvenIm = 0.5f * (a->fIm[k1] - a->fIm[k2]);
+		const float fOddRe  = 0.5f * (a->fIm[k1] + a->fIm[k2]);
+		const float fOddIm  = 0.5f * (a->fRe[k2] - a->fRe[k1]);
+
+		const float fCos = a->fSplitCos[k];
+		const float fSin = a->fSplitSin[k];
+
+		a->fBinRe[k] = fEvenRe + (fCos * fOddRe) + (fSin * fOddIm);
+		a->fBinIm[k] = fEvenIm + (fCos * fOddIm) - (fSin * fOddRe);
+	}
+
+	getBinPowers(a, m + 1);
+
+	fftAnalyzerBars_t *bars = &a->bars[writePos];
+	for (int32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
+	{
+		float fMaxPower = 0.0f;
+		for (int32_t bin = a->barFirstBin[i]; bin <= a->barLastBin[i]; bin++)
+		{
+			if (a->fBinPower[bin] > fMaxPower)
+				fMaxPower = a->fBinPower[bin];
+		}
+
+		int32_t height = 0;
+
+		fMaxPower *= a->fPowerScale;
+		if (fMaxPower > 1e-12f)
+		{
+			const float fDb = 10.0f * log10f(fMaxPower);
+			height = (int32_t)((fDb + BARS_DB_RANGE) * (SPECTRUM_BAR_HEIGHT / BARS_DB_RANGE));
+
+			height = CLAMP(height, 0, SPECTRUM_BAR_HEIGHT);
+		}
+
+		bars->height[i] = (uint8_t)height;
+	}
+
+	bars->sampleClock = sampleClock;
+	atomic32Store(&a->writePos, newWritePos); // (release, the bars are visible before the new position)
+}
+
+void fftAnalyzerFeed(const void *stream, bool floatOutput, int32_t numFrames, uint64_t paulaClockStart, uint64_t paulaClockEnd)
+{
+	fftAnalyzer_t *a = &analyzer;
+	if (a->bars == NULL || numFrames <= 0)
+		return;
+
+	const int32_t ringMask = a->fftLength - 1;
+
+	if (paulaClockStart != a->nextPaulaClock) // don't analyze old audio after a gap
+	{
+		memset(a->fRing, 0, a->fftLength * sizeof (float));
+		a->framesToNextFFT = a->interval;
+	}
+
+	a->nextPaulaClock = paulaClockEnd;
+
+	const int16_t *streamInt16 = (const int16_t *)stream;
+	const float *streamFloat = (const float *)stream;
+	const uint64_t paulaClocks = paulaClockEnd - paulaClockStart;
+
+	int32_t framesDone = 0;
+	while (framesDone < numFrames)
+	{
+		int32_t framesToCopy = numFrames - framesDone;
+		if (framesToCopy > a->framesToNextFFT)
+			framesToCopy = a->framesToNextFFT;
+
+		// mix to mono
+		if (floatOutput)
+		{
+			for (int32_t i = 0; i < framesToCopy; i++, streamFloat += 2)
+			{
+				a->fRing[a->ringPos] = (streamFloat[0] + streamFloat[1]) * 0.5f;
+				a->ringPos = (a->ringPos + 1) & ringMask;
+			}
+		}
+		else
+		{
+			for (int32_t i = 0; i < framesToCopy; i++, streamInt16 += 2)
+			{
+				a->fRing[a->ringPos] = (streamInt16[0] + streamInt16[1]) * (0.5f / 32768.0f);
+				a->ringPos = (a->ringPos + 1) & ringMask;
+			}
+		}
+
+		framesDone += framesToCopy;
+
+		a->framesToNextFFT -= framesToCopy;
+		if (a->framesToNextFFT == 0)
+		{
+			a->framesToNextFFT = a->interval;
+			analyze(a, paulaClockStart + ((paulaClocks * framesDone) / numFrames));
+		}
+	}
+}
+
+bool fftAnalyzerGetBars(uint64_t sampleClock, uint8_t *bars)
+{
+	fftAnalyzer_t *a = &analyzer;
+	bool barsFound = false;
+
+	if (a->bars == NULL)
+		return false;
+
+	memset(bars, 0, SPECTRUM_BAR_NUM);
+
+	const int32_t writePos = atomic32Load(&a->writePos); // (acquire, the bars up to here are complete)
+	int32_t readPos = atomic32Load(&a->readPos);
+
+	while (readPos != writePos)
+	{
+		const fftAnalyzerBars_t *b = &a->bars[readPos];
+		if (sampleClock < b->sampleClock)
+			break; // not heard yet
+
+		for (int32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
+		{
+			if (b->height[i] > bars[i])
+				bars[i] = b->height[i];
+		}
+
+		barsFound = true;
+		readPos = (readPos + 1) & a->mask;
+	}
+
+	atomic32Store(&a->readPos, readPos);
+	return barsFound;
+}
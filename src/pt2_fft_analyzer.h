@@ -0,0 +1,25 @@
+#pragma once
+
+/* FFT spectrum analyzer (the third visualizer mode). The audio thread feeds it the mixed output,
+** and every 1/FFT_ANALYZER_HZ seconds it runs a Hann-windowed real FFT over the last ~40ms and
+** bins the result into SPECTRUM_BAR_NUM log-spaced bars. The bars are queued with their Paula
+** sample clock (lock-free, one writer and one reader), so the main thread can show them when
+** they are heard.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_header.h"
+
+#define FFT_ANALYZER_HZ 60
+
+bool fftAnalyzerInit(int32_t audioFreq, double dMaxLatencySecs); // the queue holds dMaxLatencySecs of bars
+void fftAnalyzerFree(void);
+
+// audio thread, stream is interleaved stereo (int16_t or float) that covers paulaClockStart..paulaClockEnd
+void fftAnalyzerFeed(const void *stream, bool floatOutput, int32_t numFrames, uint64_t paulaClockStart, uint64_t paulaClockEnd);
+
+/* Main thread. Pops the bars that are due at sampleClock, and gets the highest of each bar in them
+** (in 0..SPECTRUM_BAR_HEIGHT). Returns false if there were none.
+*/
+bool fftAnalyzerGetBars(uint64_t sampleClock, uint8_t *bars);
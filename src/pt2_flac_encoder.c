@@ -0,0 +1,838 @@
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pt2_flac_encoder.h"
+
+#define PI 3.14159265358979323846264338327950288
+
+#define BLOCK_SIZE 4096
+#define MAX_FIXED_ORDER 4
+#define MAX_LPC_ORDER 8
+#define MAX_PARTITION_ORDER 6
+#define NUM_SUBFRAMES 3 /* two channels + one to try things in */
+
+// frame header channel assignment
+enum
+{
+	CHANNELS_INDEPENDENT = 1, // (2 channels - 1)
+	CHANNELS_LEFT_SIDE = 8,
+	CHANNELS_RIGHT_SIDE = 9,
+	CHANNELS_MID_SIDE = 10
+};
+
+enum
+{
+	SUBFRAME_CONSTANT = 0,
+	SUBFRAME_VERBATIM = 1,
+	SUBFRAME_FIXED = 8, // | order
+	SUBFRAME_LPC = 32 // | (order-1)
+};
+
+typedef struct bitWriter_t
+{
+	uint8_t *buffer;
+	uint32_t pos; // in bytes
+	uint64_t acc;
+	int32_t accBits;
+} bitWriter_t;
+
+typedef struct subframe_t
+{
+	uint8_t type;
+	int32_t order, shift, bps;
+	int32_t coeffs[MAX_LPC_ORDER];
+	int32_t partitionOrder;
+	uint8_t riceParams[1 << MAX_PARTITION_ORDER];
+	uint64_t bits; // size of the coded subframe
+	int32_t residual[BLOCK_SIZE];
+} subframe_t;
+
+struct flacEncoder_t
+{
+	FILE *f;
+	uint32_t sampleRate;
+	int32_t bitsPerSample, lpcPrecision, riceParamBits, maxRiceParam;
+	uint64_t totalSamples, samplesEncoded;
+	uint32_t frameNumber;
+	bool writeError;
+
+	int32_t numBuffered;
+	int32_t left[BLOCK_SIZE], right[BLOCK_SIZE], mid[BLOCK_SIZE], side[BLOCK_SIZE];
+	double dWindow[BLOCK_SIZE], dWindowed[BLOCK_SIZE];
+	int32_t windowLength;
+
+	subframe_t subframe[NUM_SUBFRAMES];
+
+	uint8_t crc8Table[256];
+	uint16_t crc16Table[256];
+
+	bitWriter_t bw;
+	uint32_t frameBufferSize;
+};
+
+static void putBits(bitWriter_t *w, uint32_t value, int32_t numBits) // numBits = 1..32
+{
+	w->acc = (w->acc << numBits) | (value & (uint32_t)(0xFFFFFFFFULL >> (32 - numBits)));
+	w->accBits += numBits;
+
+	while (w->accBits >= 8)
+	{
+		w->accBits -= 8;
+		w->buffer[w->pos++] = (uint8_t)(w->acc >> w->accBits);
+	}
+}
+
+static void putUnary(bitWriter_t *w, uint32_t zeros) // zeros, then a one
+{
+	while (zeros >= 32)
+	{
+		putBits(w, 0, 32);
+		zeros -= 32;
+	}
+
+	putBits(w, 1, zeros + 1);
+}
+
+static void alignToByte(bitWriter_t *w)
+{
+	if (w->accBits > 0)
+		putBits(w, 0, 8 - w->accBits);
+}
+
+static void putUTF8(bitWriter_t *w, uint32_t value) // (frame numbers are UTF-8 coded)
+{
+	if (value < 0x80)
+	{
+		putBits(w, value, 8);
+		return;
+	}
+
+	int32_t numBytes = 2;
+	while (numBytes < 6 && value >= (1UL << ((numBytes * 5) + 1)))
+		numBytes++;
+
+	putBits(w, (0xFF00 >> numBytes) | (value >> ((numBytes - 1) * 6)), 8);
+	for (int32_t i = numBytes - 2; i >= 0; i--)
+		putBits(w, 0x80 | ((value >> (i * 6)) & 0x3F), 8);
+}
+
+static void makeCRCTables(flacEncoder_t *e)
+{
+	for (int32_t i = 0; i < 256; i++)
+	{
+		uint8_t crc8 = (uint8_t)i;
+		uint16_t crc16 = (uint16_t)(i << 8);
+
+		for (int32_t j = 0; j < 8; j++)
+		{
+			crc8 = (crc8 & 0x80) ? (uint8_t)((crc8 << 1) ^ 0x07) : (uint8_t)(crc8 << 1);
+			crc16 = (crc16 & 0x8000) ? (uint16_t)((crc16 << 1) ^ 0x8005) : (uint16_t)(crc16 << 1);
+		}
+
+		e->crc8Table[i] = crc8;
+		e->crc16Table[i] = crc16;
+	}
+}
+
+static uint8_t getCRC8(flacEncoder_t *e, const uint8_t *data, uint32_t length)
+{
+	uint8_t crc = 0;
+	for (uint32_t i = 0; i < length; i++)
+		crc = e->crc8Table[crc ^ data[i]];
+
+	return crc;
+}
+
+static uint16_t getCRC16(flacEncoder_t *e, const uint8_t *data, uint32_t length)
+{
+	uint16_t crc = 0;
+	for (uint32_t i = 0; i < length; i++)
+		crc = (uint16_t)(crc << 8) ^ e->crc16Table[(crc >> 8) ^ data[i]];
+
+	return crc;
+}
+
+// Tukey(0.5) window for the LPC analysis
+static void makeWindow(flacEncoder_t *e, int32_t length)
+{
+	const int32_t taperLength = length / 4; // (each side)
+
+	for (int32_t i = 0; i < length; i++)
+		e->dWindow[i] = 1.0;
+
+	if (taperLength > 1)
+	{
+		for (int32_t i = 0; i < taperLength; i++)
+		{
+			const double dVal = 0.5 - (0.5 * cos((PI * i) / taperLength));
+			e->dWindow[i] = dVal;
+			e->dWindow[length-1-i] = dVal;
+		}
+	}
+
+	e->windowLength = length;
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/*                                          RICE CODING                                             */
+/* ------------------------------------------------------------------------------------------------ */
+
+static uint32_t foldResidual(int32_t r) // 0, -1, 1, -2, 2, ... -> 0, 1, 2, 3, 4, ...
+{
+	return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+/* Picks the partition order and the Rice parameters for the residual in s (from sample s->order on),
+** and returns the size of the coded residual in bits. The sizes are an upper bound (sum of u >> k is
+** at most the sum of u, shifted), so the coded subframe is never larger than what is estimated here.
+*/
+static uint64_t chooseRiceParams(flacEncoder_t *e, subframe_t *s, int32_t n)
+{
+	uint64_t partitionSums[1 << MAX_PARTITION_ORDER];
+
+	int32_t maxOrder = MAX_PARTITION_ORDER;
+	while (maxOrder > 0 && ((n & ((1 << maxOrder) - 1)) != 0 || (n >> maxOrder) <= s->order))
+		maxOrder--;
+
+	const int32_t partitionLength = n >> maxOrder;
+	for (int32_t p = 0; p < (1 << maxOrder); p++)
+	{
+		const int32_t start = (p == 0) ? s->order : p * partitionLength;
+		const int32_t end = (p + 1) * partitionLength;
+
+		uint64_t sum = 0;
+		for (int32_t i = start; i < end; i++)
+			sum += foldResidual(s->residual[i]);
+
+		partitionSums[p] = sum;
+	}
+
+	uint64_t bestBits = UINT64_MAX;
+
+	for (int32_t order = maxOrder; order >= 0; order--)
+	{
+		const int32_t numPartitions = 1 << order;
+
+		uint8_t params[1 << MAX_PARTITION_ORDER];
+		uint64_t bits = 2 + 4; // coding method, partition order
+
+		for (int32_t p = 0; p < numPartitions; p++)
+		{
+			const uint64_t count = (n >> order) - ((p == 0) ? s->order : 0);
+			const uint64_t sum = partitionSums[p];
+
+			uint64_t bestPartitionBits = UINT64_MAX;
+			int32_t bestParam = 0;
+
+			for (int32_t k = 0; k <= e->maxRiceParam; k++)
+			{
+				const uint64_t partitionBits = (count * (k + 1)) + (sum >> k);
+				if (partitionBits < bestPartitionBits)
+				{
+					bestPartitionBits = partitionBits;
+					bestParam = k;
+				}
+				else
+				{
+					break; // the sizes only get bigger from here
+				}
+			}
+
+			params[p] = (uint8_t)bestParam;
+			bits += e->riceParamBits + bestPartitionBits;
+		}
+
+		if (bits < bestBits)
+		{
+			bestBits = bits;
+			s->partitionOrder = order;
+			memcpy(s->riceParams, params, numPartitions);
+		}
+
+		// merge partition sums pairwise for the next lower order
+		for (int32_t p = 0; p < numPartitions / 2; p++)
+			partitionSums[p] = partitionSums[(p*2)+0] + partitionSums[(p*2)+1];
+	}
+
+	return bestBits;
+}
+
+static void writeResidual(flacEncoder_t *e, const subframe_t *s, int32_t n)
+{
+	bitWriter_t *w = &e->bw;
+
+	putBits(w, (e->riceParamBits == 5) ? 1 : 0, 2); // coding method (4-bit or 5-bit Rice parameters)
+	putBits(w, s->partitionOrder, 4);
+
+	const int32_t numPartitions = 1 << s->partitionOrder;
+	const int32_t partitionLength = n >> s->partitionOrder;
+
+	for (int32_t p = 0; p < numPartitions; p++)
+	{
+		const int32_t k = s->riceParams[p];
+		putBits(w, k, e->riceParamBits);
+
+		const int32_t start = (p == 0) ? s->order : p * partitionLength;
+		const int32_t end = (p + 1) * partitionLength;
+
+		for (int32_t i = start; i < end; i++)
+		{
+			const uint32_t u = foldResidual(s->residual[i]);
+
+			putUnary(w, u >> k);
+			if (k > 0)
+				putBits(w, u, k);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/*                                           PREDICTION                                             */
+/* ------------------------------------------------------------------------------------------------ */
+
+static void getFixedResidual(const int32_t *x, int32_t n, int32_t order, int32_t *residual)
+{
+	switch (order)
+	{
+		case 0:
+			for (int32_t i = 0; i < n; i++)
+				residual[i] = x[i];
+			break;
+
+		case 1:
+			for (int32_t i = 1; i < n; i++)
+				residual[i] = x[i] - x[i-1];
+			break;
+
+		case 2:
+			for (int32_t i = 2; i < n; i++)
+				residual[i] = x[i] - (2 * x[i-1]) + x[i-2];
+			break;
+
+		case 3:
+			for (int32_t i = 3; i < n; i++)
+				residual[i] = x[i] - (3 * x[i-1]) + (3 * x[i-2]) - x[i-3];
+			break;
+
+		default:
+			for (int32_t i = 4; i < n; i++)
+				residual[i] = x[i] - (4 * x[i-1]) + (6 * x[i-2]) - (4 * x[i-3]) + x[i-4];
+			break;
+	}
+}
+
+// returns the fixed predictor order with the smallest residual (sum of absolute values), as libFLAC does
+static int32_t getBestFixedOrder(const int32_t *x, int32_t n, uint64_t *residualSum)
+{
+	uint64_t sum[MAX_FIXED_ORDER+1] = { 0 };
+
+	int32_t maxOrder = MAX_FIXED_ORDER;
+	if (maxOrder > n-1)
+		maxOrder = (n > 0) ? n-1 : 0;
+
+	for (int32_t i = maxOrder; i < n; i++)
+	{
+		int64_t e0 = x[i];
+		int64_t e1 = (i >= 1) ? e0 - x[i-1] : 0;
+		int64_t e2 = (i >= 2) ? e1 - (x[i-1] - (int64_t)x[i-2]) : 0;
+		int64_t e3 = (i >= 3) ? e2 - (x[i-1] - (2 * (int64_t)x[i-2]) + x[i-3]) : 0;
+		int64_t e4 = (i >= 4) ? e3 - (x[i-1] - (3 * (int64_t)x[i-2]) + (3 * (int64_t)x[i-3]) - x[i-4]) : 0;
+
+		sum[0] += (e0 < 0) ? -e0 : e0;
+		sum[1] += (e1 < 0) ? -e1 : e1;
+		sum[2] += (e2 < 0) ? -e2 : e2;
+		sum[3] += (e3 < 0) ? -e3 : e3;
+		sum[4] += (e4 < 0) ? -e4 : e4;
+	}
+
+	int32_t bestOrder = 0;
+	for (int32_t order = 1; order <= maxOrder; order++)
+	{
+		if (sum[order] < sum[bestOrder])
+			bestOrder = order;
+	}
+
+	if (residualSum != NULL)
+		*residualSum = sum[bestOrder];
+
+	return bestOrder;
+}
+
+// Levinson-Durbin recursion, dLPC[order-1][0..order-1] are the predictor coefficients for each order
+static int32_t computeLPC(const double *dAutoc, int32_t maxOrder, double dLPC[MAX_LPC_ORDER][MAX_LPC_ORDER])
+{
+	double dCoeffs[MAX_LPC_ORDER];
+	double dErr = dAutoc[0];
+
+	for (int32_t i = 0; i < maxOrder; i++)
+	{
+		double r = -dAutoc[i+1];
+		for (int32_t j = 0; j < i; j++)
+			r -= dCoeffs[j] * dAutoc[i-j];
+		r /= dErr;
+
+		dCoeffs[i] = r;
+
+		int32_t j;
+		for (j = 0; j < (i >> 1); j++)
+		{
+			const double dTmp = dCoeffs[j];
+			dCoeffs[j] += r * dCoeffs[i-1-j];
+			dCoeffs[i-1-j] += r * dTmp;
+		}
+
+		if (i & 1)
+			dCoeffs[j] += dCoeffs[j] * r;
+
+		for (j = 0; j <= i; j++)
+			dLPC[i][j] = -dCoeffs[j];
+
+		dErr *= 1.0 - (r * r);
+		if (dErr <= 0.0)
+			return i+1;
+	}
+
+	return maxOrder;
+}
+
+// returns false if the coefficients can't be quantized with a non-negative shift
+static bool quantizeLPC(const double *dLPC, int32_t order, int32_t precision, int32_t *coeffs, int32_t *shift)
+{
+	double dMax = 0.0;
+	for (int32_t i = 0; i < order; i++)
+	{
+		if (fabs(dLPC[i]) > dMax)
+			dMax = fabs(dLPC[i]);
+	}
+
+	if (dMax <= 0.0)
+		return false;
+
+	int32_t log2Max;
+	frexp(dMax, &log2Max);
+	log2Max--;
+
+	precision--; // (sign bit)
+	const int32_t qMax = (1 << precision) - 1;
+	const int32_t qMin = -(1 << precision);
+
+	int32_t s = precision - log2Max - 1;
+	if (s > 15)
+		s = 15;
+	else if (s < 0)
+		return false;
+
+	double dError = 0.0;
+	for (int32_t i = 0; i < order; i++)
+	{
+		dError += dLPC[i] * (1 << s);
+
+		int32_t q = (int32_t)lrint(dError);
+		if (q > qMax) q = qMax;
+		if (q < qMin) q = qMin;
+
+		dError -= q;
+		coeffs[i] = q;
+	}
+
+	*shift = s;
+	return true;
+}
+
+// returns false if a residual doesn't fit in 32 bits
+static bool getLPCResidual(const int32_t *x, int32_t n, const int32_t *coeffs, int32_t order, int32_t shift, int32_t *residual)
+{
+	for (int32_t i = order; i < n; i++)
+	{
+		int64_t sum = 0;
+		for (int32_t j = 0; j < order; j++)
+			sum += (int64_t)coeffs[j] * x[i-j-1];
+
+		const int64_t r = x[i] - (sum >> shift);
+		if (r < INT32_MIN || r > INT32_MAX)
+			return false;
+
+		residual[i] = (int32_t)r;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/*                                            SUBFRAMES                                             */
+/* ------------------------------------------------------------------------------------------------ */
+
+static void swapSubframes(subframe_t **a, subframe_t **b)
+{
+	subframe_t *tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/* Finds the smallest coding for one channel. *best gets the result, *spare is used for the candidates
+** (the two pointers may be swapped).
+*/
+static void encodeChannel(flacEncoder_t *e, const int32_t *x, int32_t n, int32_t bps, subframe_t **best, subframe_t **spare)
+{
+	subframe_t *s;
+
+	// verbatim (or constant)
+	s = *best;
+	s->bps = bps;
+	s->order = 0;
+
+	bool constant = true;
+	for (int32_t i = 1; i < n; i++)
+	{
+		if (x[i] != x[0])
+		{
+			constant = false;
+			break;
+		}
+	}
+
+	if (constant)
+	{
+		s->type = SUBFRAME_CONSTANT;
+		s->bits = 8 + bps;
+		s->residual[0] = x[0];
+		return;
+	}
+
+	s->type = SUBFRAME_VERBATIM;
+	s->bits = 8 + ((uint64_t)n * bps);
+
+	// fixed predictor
+	if (n > MAX_FIXED_ORDER)
+	{
+		s = *spare;
+		s->type = SUBFRAME_FIXED;
+		s->bps = bps;
+		s->order = getBestFixedOrder(x, n, NULL);
+
+		getFixedResidual(x, n, s->order, s->residual);
+		s->bits = 8 + (s->order * bps) + chooseRiceParams(e, s, n);
+
+		if (s->bits < (*best)->bits)
+			swapSubframes(best, spare);
+	}
+
+	// LPC
+	if (n > MAX_LPC_ORDER * 2)
+	{
+		if (e->windowLength != n)
+			makeWindow(e, n);
+
+		for (int32_t i = 0; i < n; i++)
+			e->dWindowed[i] = x[i] * e->dWindow[i];
+
+		double dAutoc[MAX_LPC_ORDER+1];
+		for (int32_t lag = 0; lag <= MAX_LPC_ORDER; lag++)
+		{
+			double dSum = 0.0;
+			for (int32_t i = lag; i < n; i++)
+				dSum += e->dWindowed[i] * e->dWindowed[i-lag];
+
+			dAutoc[lag] = dSum;
+		}
+
+		if (dAutoc[0] > 0.0)
+		{
+			double dLPC[MAX_LPC_ORDER][MAX_LPC_ORDER];
+			const int32_t maxOrder = computeLPC(dAutoc, MAX_LPC_ORDER, dLPC);
+
+			for (int32_t order = 1; order <= maxOrder; order++)
+			{
+				s = *spare;
+				s->type = SUBFRAME_LPC;
+				s->bps = bps;
+				s->order = order;
+
+				if (!quantizeLPC(dLPC[order-1], order, e->lpcPrecision, s->coeffs, &s->shift))
+					continue;
+
+				if (!getLPCResidual(x, n, s->coeffs, order, s->shift, s->residual))
+					continue;
+
+				s->bits = 8 + (order * bps) + 4 + 5 + (order * e->lpcPrecision) + chooseRiceParams(e, s, n);
+				if (s->bits < (*best)->bits)
+					swapSubframes(best, spare);
+			}
+		}
+	}
+
+	// the warm-up samples are taken from the input when written
+}
+
+static void writeSubframe(flacEncoder_t *e, const subframe_t *s, const int32_t *x, int32_t n)
+{
+	bitWriter_t *w = &e->bw;
+
+	const uint8_t type = s->type;
+
+	putBits(w, 0, 1); // zero padding bit
+	if (type == SUBFRAME_FIXED)
+		putBits(w, SUBFRAME_FIXED | s->order, 6);
+	else if (type == SUBFRAME_LPC)
+		putBits(w, SUBFRAME_LPC | (s->order - 1), 6);
+	else
+		putBits(w, type, 6);
+	putBits(w, 0, 1); // no wasted bits
+
+	if (type == SUBFRAME_CONSTANT)
+	{
+		putBits(w, x[0], s->bps);
+	}
+	else if (type == SUBFRAME_VERBATIM)
+	{
+		for (int32_t i = 0; i < n; i++)
+			putBits(w, x[i], s->bps);
+	}
+	else
+	{
+		for (int32_t i = 0; i < s->order; i++) // warm-up samples
+			putBits(w, x[i], s->bps);
+
+		if (type == SUBFRAME_LPC)
+		{
+			putBits(w, e->lpcPrecision - 1, 4);
+			putBits(w, s->shift, 5);
+
+			for (int32_t i = 0; i < s->order; i++)
+				putBits(w, s->coeffs[i], e->lpcPrecision);
+		}
+
+		writeResidual(e, s, n);
+	}
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/*                                             FRAMES                                               */
+/* ------------------------------------------------------------------------------------------------ */
+
+static void encodeFrame(flacEncoder_t *e, int32_t n)
+{
+	const int32_t bps = e->bitsPerSample;
+
+	// pick the stereo mode from the fixed predictor residuals (cheap estimate, like libFLAC)
+	for (int32_t i = 0; i < n; i++)
+	{
+		e->mid[i] = (e->left[i] + e->right[i]) >> 1;
+		e->side[i] = e->left[i] - e->right[i];
+	}
+
+	uint64_t sumL, sumR, sumM, sumS;
+	getBestFixedOrder(e->left, n, &sumL);
+	getBestFixedOrder(e->right, n, &sumR);
+	getBestFixedOrder(e->mid, n, &sumM);
+	getBestFixedOrder(e->side, n, &sumS);
+
+	uint8_t channelMode = CHANNELS_INDEPENDENT;
+	uint64_t bestSum = sumL + sumR;
+
+	if (sumL + sumS < bestSum) { bestSum = sumL + sumS; channelMode = CHANNELS_LEFT_SIDE; }
+	if (sumS + sumR < bestSum) { bestSum = sumS + sumR; channelMode = CHANNELS_RIGHT_SIDE; }
+	if (sumM + sumS < bestSum) { bestSum = sumM + sumS; channelMode = CHANNELS_MID_SIDE; }
+
+	const int32_t *ch[2];
+	int32_t chBps[2] = { bps, bps };
+
+	switch (channelMode)
+	{
+		default:
+		case CHANNELS_INDEPENDENT: ch[0] = e->left; ch[1] = e->right; break;
+		case CHANNELS_LEFT_SIDE:   ch[0] = e->left; ch[1] = e->side;  chBps[1]++; break;
+		case CHANNELS_RIGHT_SIDE:  ch[0] = e->side; ch[1] = e->right; chBps[0]++; break;
+		case CHANNELS_MID_SIDE:    ch[0] = e->mid;  ch[1] = e->side;  chBps[1]++; break;
+	}
+
+	subframe_t *sub[2] = { &e->subframe[0], &e->subframe[1] };
+	subframe_t *spare = &e->subframe[2];
+
+	encodeChannel(e, ch[0], n, chBps[0], &sub[0], &spare);
+	encodeChannel(e, ch[1], n, chBps[1], &sub[1], &spare);
+
+	// frame header
+	bitWriter_t *w = &e->bw;
+	w->pos = 0;
+	w->acc = 0;
+	w->accBits = 0;
+
+	int32_t blockSizeCode;
+	if (n == BLOCK_SIZE)
+		blockSizeCode = 12; // 256 * 2^(12-8)
+	else if (n <= 256)
+		blockSizeCode = 6; // 8-bit (blocksize-1) at the end of the header
+	else
+		blockSizeCode = 7; // 16-bit (blocksize-1) at the end of the header
+
+	putBits(w, 0xFFF8, 16); // sync code, fixed block size
+	putBits(w, blockSizeCode, 4);
+	putBits(w, 0, 4); // sample rate from STREAMINFO
+	putBits(w, channelMode, 4);
+	putBits(w, (bps == 24) ? 6 : 4, 3); // sample size
+	putBits(w, 0, 1);
+	putUTF8(w, e->frameNumber);
+
+	if (blockSizeCode == 6)
+		putBits(w, n-1, 8);
+	else if (blockSizeCode == 7)
+		putBits(w, n-1, 16);
+
+	putBits(w, getCRC8(e, w->buffer, w->pos), 8);
+
+	writeSubframe(e, sub[0], ch[0], n);
+	writeSubframe(e, sub[1], ch[1], n);
+
+	alignToByte(w);
+	putBits(w, getCRC16(e, w->buffer, w->pos), 16);
+
+	if (fwrite(w->buffer, 1, w->pos, e->f) != w->pos)
+		e->writeError = true;
+
+	e->frameNumber++;
+	e->samplesEncoded += n;
+}
+
+static void writeStreamHeader(flacEncoder_t *e, uint64_t totalSamples)
+{
+	uint8_t header[4 + 4 + 34];
+	bitWriter_t w;
+
+	memset(&w, 0, sizeof (w));
+	w.buffer = header;
+
+	putBits(&w, 0x664C6143, 32); // "fLaC"
+
+	// metadata block header (last block, type 0 = STREAMINFO, 34 bytes)
+	putBits(&w, 1, 1);
+	putBits(&w, 0, 7);
+	putBits(&w, 34, 24);
+
+	putBits(&w, BLOCK_SIZE, 16); // min. block size (the last block can be shorter)
+	putBits(&w, BLOCK_SIZE, 16); // max. block size
+	putBits(&w, 0, 24); // min. frame size (unknown)
+	putBits(&w, 0, 24); // max. frame size (unknown)
+	putBits(&w, e->sampleRate, 20);
+	putBits(&w, 2-1, 3); // channels
+	putBits(&w, e->bitsPerSample-1, 5);
+	putBits(&w, (uint32_t)(totalSamples >> 32) & 0xF, 4);
+	putBits(&w, (uint32_t)totalSamples, 32);
+
+	for (int32_t i = 0; i < 4; i++)
+		putBits(&w, 0, 32); // MD5 (not computed)
+
+	if (fwrite(header, 1, sizeof (header), e->f) != sizeof (header))
+		e->writeError = true;
+}
+
+flacEncoder_t *flacEncoderCreate(FILE *f, uint32_t sampleRate, int32_t bitsPerSample)
+{
+	if (bitsPerSample != 16 && bitsPerSample != 24)
+		return NULL;
+
+	flacEncoder_t *e = (flacEncoder_t *)calloc(1, sizeof (flacEncoder_t));
+	if (e == NULL)
+		return NULL;
+
+	// a frame is never bigger than the verbatim coding (see chooseRiceParams()), plus the headers
+	e->frameBufferSize = (BLOCK_SIZE * 2 * ((bitsPerSample+1+7) / 8)) + 64;
+	e->bw.buffer = (uint8_t *)malloc(e->frameBufferSize);
+	if (e->bw.buffer == NULL)
+	{
+		free(e);
+		return NULL;
+	}
+
+	e->f = f;
+	e->sampleRate = sampleRate;
+	e->bitsPerSample = bitsPerSample;
+
+	if (bitsPerSample == 24)
+	{
+		e->lpcPrecision = 15;
+		e->riceParamBits = 5; // (parameter 31 is the escape code)
+		e->maxRiceParam = 30;
+	}
+	else
+	{
+		e->lpcPrecision = 12;
+		e->riceParamBits = 4; // (parameter 15 is the escape code)
+		e->maxRiceParam = 14;
+	}
+
+	makeCRCTables(e);
+	makeWindow(e, BLOCK_SIZE);
+
+	return e;
+}
+
+void flacEncoderStart(flacEncoder_t *e, uint64_t totalSamples)
+{
+	e->totalSamples = totalSamples;
+	writeStreamHeader(e, totalSamples);
+}
+
+bool flacEncoderWrite(flacEncoder_t *e, const uint8_t *pcm, uint32_t numFrames)
+{
+	const bool is24Bit = (e->bitsPerSample == 24);
+
+	for (uint32_t i = 0; i < numFrames; i++)
+	{
+		if (is24Bit)
+		{
+			e->left[e->numBuffered]  = (int32_t)(((uint32_t)pcm[0] << 8) | ((uint32_t)pcm[1] << 16) | ((uint32_t)pcm[2] << 24)) >> 8;
+			e->right[e->numBuffered] = (int32_t)(((uint32_t)pcm[3] << 8) | ((uint32_t)pcm[4] << 16) | ((uint32_t)pcm[5] << 24)) >> 8;
+			pcm += 6;
+		}
+		else
+		{
+			e->left[e->numBuffered]  = (int16_t)(pcm[0] | (pcm[1] << 8));
+			e->right[e->numBuffered] = (int16_t)(pcm[2] | (pcm[3] << 8));
+			pcm += 4;
+		}
+
+		if (++e->numBuffered == BLOCK_SIZE)
+		{
+			encodeFrame(e, BLOCK_SIZE);
+			e->numBuffered = 0;
+		}
+	}
+
+	return !e->writeError;
+}
+
+bool flacEncoderFinish(flacEncoder_t *e)
+{
+	if (e->numBuffered > 0)
+	{
+		encodeFrame(e, e->numBuffered);
+		e->numBuffered = 0;
+	}
+
+	if (e->samplesEncoded != e->totalSamples) // aborted render, fix up the length in the header
+	{
+		fseek(e->f, 0, SEEK_SET);
+		writeStreamHeader(e, e->samplesEncoded);
+		fseek(e->f, 0, SEEK_END);
+	}
+
+	return !e->writeError;
+}
+
+void flacEncoderFree(flacEncoder_t *e)
+{
+	if (e == NULL)
+		return;
+
+	free(e->bw.buffer);
+	free(e);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/* FLAC encoder for MOD2WAV (stereo, 16-bit or 24-bit).
+**
+** Each subframe is coded with the smallest of constant, verbatim, fixed (order 0..4) and LPC
+** (order 1..8) prediction, and the residual is coded with partitioned Rice codes. The stereo
+** mode (independent, left/side, right/side or mid/side) is picked per frame.
+**
+** All state is in flacEncoder_t, so several encoders can run at once (one per thread).
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct flacEncoder_t flacEncoder_t;
+
+flacEncoder_t *flacEncoderCreate(FILE *f, uint32_t sampleRate, int32_t bitsPerSample); // 16 or 24 bits
+
+/* Writes the stream header, so the total length must be known beforehand. The file is then written
+** from start to end (flacEncoderFinish() only goes back if the number of samples written differs from
+** totalSamples, e.g. on abort).
+*/
+void flacEncoderStart(flacEncoder_t *e, uint64_t totalSamples);
+
+// pcm is interleaved stereo in WAV layout (little-endian 16-bit or packed 24-bit)
+bool flacEncoderWrite(flacEncoder_t *e, const uint8_t *pcm, uint32_t numFrames);
+
+bool flacEncoderFinish(flacEncoder_t *e); // encodes the last (short) block, returns false if there were write errors
+void flacEncoderFree(flacEncoder_t *e);
@@ -3,9 +3,6 @@
 #include <SDL2/SDL.h>
 #include <stdint.h>
 #include <stdbool.h>
-#ifdef _DEBUG
-#include <assert.h>
-#endif
 #ifdef _WIN32
 #define WIN32_MEAN_AND_LEAN
 #include <windows.h> // MAX_PATH
@@ -13,19 +10,12 @@
 #include <limits.h> // PATH_MAX
 #endif
 #include <stdint.h>
+#include "pt2_replay_header.h"
 #include "pt2_unicode.h"
 #include "pt2_palette.h"
 
 #define PROG_VER_STR "1.92"
 
-#ifndef ASSERT
-#ifdef _DEBUG
-#define ASSERT(x) assert(x)
-#else
-#define ASSERT(x)
-#endif
-#endif
-
 #ifdef _WIN32
 #define DIR_DELIMITER '\\'
 #define PATH_MAX MAX_PATH
@@ -44,36 +34,19 @@
 #define MIN_AUDIO_FREQUENCY 44100
 #define MAX_AUDIO_FREQUENCY 192000
 
-// main crystal oscillator for PAL Amiga systems
-#define AMIGA_PAL_XTAL_HZ 28375160
-#define AMIGA_PAL_CCK_HZ (AMIGA_PAL_XTAL_HZ/8.0)
-#define CIA_PAL_CLK (AMIGA_PAL_CCK_HZ / 5.0)
-
-// nominal framerate in normal PAL videomodes (~49.92Hz)
-#define AMIGA_PAL_VBLANK_HZ (AMIGA_PAL_CCK_HZ / (double)(313*227))
-
 /* "60Hz" ranges everywhere from 59..61Hz depending on the monitor, so with
 ** no vsync we will get stuttering because the rate is not perfect...
 */
 #define VBLANK_HZ 60
 
-/* Scopes are clocked at 64Hz instead of 60Hz to prevent the small +/- Hz
-** interference from monitors not being exactly 60Hz (and unstable non-vsync mode).
-** Sadly, the scopes might mildly flicker from this in some cases.
+/* Scope snapshots per second from the mixer (see paulaEnableScopeTap()). A few per video
+** frame, so that the shown snapshot is never more than ~4ms away from what is audible.
 */
-#define SCOPE_HZ 64
-
-#ifndef PI
-#define PI 3.14159265358979323846264338327950288
-#endif
+#define SCOPE_SNAPSHOT_HZ 240
 
 #define FONT_CHAR_W 8 // actual data length is 7, includes right spacing (1px column)
 #define FONT_CHAR_H 5
 
-#define MOD_ROWS 64
-#define MOD_SAMPLES 31
-#define MAX_PATTERNS 100
-
 #define SCOPE_WIDTH 40
 #define SCOPE_HEIGHT 33
 #define SPECTRUM_BAR_NUM 23
@@ -140,6 +113,7 @@ enum
 
 	VISUAL_QUADRASCOPE = 0,
 	VISUAL_SPECTRUM = 1,
+	VISUAL_FFT_SPECTRUM = 2,
 
 	MODE_IDLE = 0,
 	MODE_EDIT = 1,
@@ -12,6 +12,8 @@
 #include <ctype.h> // toupper()
 #include "pt2_structs.h"
 #include "pt2_config.h"
+#include "pt2_songduration.h"
+#include "pt2_snapshot.h"
 
 void showErrorMsgBox(const char *fmt, ...)
 {
@@ -82,9 +84,15 @@ void updateWindowTitle(bool modified)
 		strcpy(editStr, "[EDITING] ");
 
 	if (modified)
+	{
 		song->modified = true;
+		invalidateSongDuration(); // song data may have been edited
+		invalidateSnapshotIndex();
+	}
 	else
+	{
 		song->modified = false;
+	}
 
 	if (song->header.name[0] != '\0')
 	{
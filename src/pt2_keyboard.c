@@ -2948,14 +2948,7 @@ void keyDownHandler(SDL_Scancode scancode, SDL_Keycode keycode)
 						modSetTempo(125, true);
 						modSetSpeed(6);
 
-						moduleChannel_t *ch = song->channels;
-						for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
-						{
-							ch->n_wavecontrol = 0;
-							ch->n_glissfunk = 0;
-							ch->n_finetune = 0;
-							ch->n_loopcount = 0;
-						}
+						replayerResetEffectModes(&replayer);
 
 						displayMsg("EFX RESTORED !");
 					}
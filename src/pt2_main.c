@@ -36,6 +36,8 @@
 #include "pt2_askbox.h"
 #include "pt2_replayer.h"
 #include "pt2_textedit.h"
+#include "pt2_snapshot.h"
+#include "pt2_cmdline.h"
 
 #define CRASH_TEXT "Oh no! The ProTracker 2 clone has crashed...\nA backup .mod was hopefully " \
                    "saved to the current module directory.\n\nPlease report this bug if you can.\n" \
@@ -145,6 +147,10 @@ int main(int argc, char *argv[])
 
 	clearStructs();
 
+	// headless rendering, no window or audio device (see pt2_cmdline.c)
+	if (isCmdLineRender(argc, argv))
+		return cmdLineRender(argc, argv);
+
 	// set up crash handler
 #ifndef _DEBUG
 #ifdef _WIN32
@@ -216,6 +222,7 @@ int main(int argc, char *argv[])
 	}
 
 	hpc_Init();
+	blepInit();
 
 	/* Text input is started by default in SDL2, turn it off to remove ~2ms spikes per key press.
 	** We manuallay start it again when someone clicks on a text edit box, and stop it when done.
@@ -276,6 +283,8 @@ int main(int argc, char *argv[])
 
 	hpc_SetDurationInHz(&video.vblankHpc, VBLANK_HZ);
 
+	initReplayer(); // before setupAudio()
+
 	if (!setupAudio() || !unpackBMPs())
 	{
 		cleanUp();
@@ -300,13 +309,6 @@ int main(int argc, char *argv[])
 	editor.currPosEdPattDisp = &song->header.patternTable[0];
 	editor.currLengthDisp = &song->header.songLength;
 
-	if (!initScopes())
-	{
-		cleanUp();
-		SDL_Quit();
-		return 1;
-	}
-
 	modSetTempo(editor.initialTempo, false);
 	modSetSpeed(editor.initialSpeed);
 
@@ -358,6 +360,8 @@ int main(int argc, char *argv[])
 		handleThreadedAskBox();
 		sinkVisualizerBars();
 		updateChannelSyncBuffer();
+		updateScopes();
+		updateFFTSpectrumAnalyzer();
 		readMouseXY();
 		readKeyModifiers(); // set/clear CTRL/ALT/SHIFT/AMIGA key states
 		handleInput();
@@ -367,6 +371,7 @@ int main(int argc, char *argv[])
 		if (!mouse.buttonWaiting && ui.sampleMarkingPos == -1 && !ui.forceSampleDrag && !ui.forceVolDrag && !ui.forceSampleEdit)
 			handleGUIButtonRepeat();
 
+		updateSnapshotIndex(); // builds the seek index in small steps when the song is stopped
 		renderFrame();
 		flipFrame();
 		endFPSCounter();
@@ -507,8 +512,6 @@ static bool initializeVars(void)
 	if (config.defModulesDir == NULL || config.defSamplesDir == NULL)
 		goto oom;
 
-	turnOffVoices();
-
 	// set various non-zero values
 	
 	editor.vol1 = 100;
@@ -931,6 +934,7 @@ static void cleanUp(void) // never call this inside the main loop!
 {
 	modStop();
 	modFree();
+	freeSnapshotIndex();
 	audioClose();
 	deAllocSamplerVars();
 	freeDiskOpMem();
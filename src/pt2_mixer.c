@@ -0,0 +1,411 @@
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pt2_helpers.h"
+#include "pt2_mixer.h"
+#if defined HAS_SSE2
+#include <emmintrin.h>
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
+
+// cumulative mid/side normalization factor (1/sqrt(2))*(1/sqrt(2))
+#define STEREO_NORM_FACTOR 0.5f
+
+/* The dither PRNG is four independent xorshift32 lanes (DITHER_LANES) so that it can be vectorized.
+** Lanes 0/1 are used for L/R of even frames, and lanes 2/3 for L/R of odd frames.
+*/
+static const uint32_t initialDitherSeed[DITHER_LANES] = { 0x12345000, 0x9E3779B9, 0x7F4A7C15, 0x2545F491 };
+
+bool mixerInit(mixer_t *m, int32_t maxSamplesPerTick, bool oversampling)
+{
+	memset(m, 0, sizeof (mixer_t));
+
+	m->oversampling = oversampling;
+	m->mixBufferLength = maxSamplesPerTick;
+	m->fMixBufferL = (float *)malloc(maxSamplesPerTick * sizeof (float));
+	m->fMixBufferR = (float *)malloc(maxSamplesPerTick * sizeof (float));
+
+	mixerSetStereoSeparation(m, 100);
+	mixerResetDither(m);
+
+	return m->fMixBufferL != NULL && m->fMixBufferR != NULL;
+}
+
+void mixerFree(mixer_t *m)
+{
+	if (m->fMixBufferL != NULL)
+	{
+		free(m->fMixBufferL);
+		m->fMixBufferL = NULL;
+	}
+
+	if (m->fMixBufferR != NULL)
+	{
+		free(m->fMixBufferR);
+		m->fMixBufferR = NULL;
+	}
+
+	mixerFreeStems(m);
+}
+
+void mixerSetStereoSeparation(mixer_t *m, int32_t percentage) // 0..100 (percentage)
+{
+	ASSERT(percentage >= 0 && percentage <= 100);
+	m->fSideFactor = (percentage / 100.0f) * STEREO_NORM_FACTOR;
+}
+
+void mixerClearDownsampleStates(mixer_t *m)
+{
+	clearDownsample2xState(&m->downsampleStateL);
+	clearDownsample2xState(&m->downsampleStateR);
+}
+
+void mixerResetDither(mixer_t *m)
+{
+	for (int32_t i = 0; i < DITHER_LANES; i++)
+		m->ditherSeed[i] = initialDitherSeed[i];
+
+	m->fPrngStateL = m->fPrngStateR = 0.0f;
+}
+
+void mixerSaveState(mixer_t *m, mixerState_t *s)
+{
+	memcpy(s->ditherSeed, m->ditherSeed, sizeof (s->ditherSeed));
+	s->fPrngStateL = m->fPrngStateL;
+	s->fPrngStateR = m->fPrngStateR;
+	s->downsampleStateL = m->downsampleStateL;
+	s->downsampleStateR = m->downsampleStateR;
+}
+
+void mixerLoadState(mixer_t *m, const mixerState_t *s)
+{
+	memcpy(m->ditherSeed, s->ditherSeed, sizeof (m->ditherSeed));
+	m->fPrngStateL = s->fPrngStateL;
+	m->fPrngStateR = s->fPrngStateR;
+	m->downsampleStateL = s->downsampleStateL;
+	m->downsampleStateR = s->downsampleStateR;
+}
+
+static inline uint32_t xorshift32(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x <<  5;
+
+	return x;
+}
+
+/* So yeah, the audio may be a little quiet in some cases, but
+** the output can already clip quite a bit in extreme cases due
+** to the ~5Hz high-pass filter, so think twice before changing
+** this...
+*/
+#define AUDIO_GAIN 2.0
+
+#define NORMALIZE_VALUE (float)(AUDIO_GAIN * ((INT16_MAX+1.0) / PAULA_VOICES))
+
+#define PRNG_SCALE (1.0f / ((float)UINT32_MAX+1.0f)) // int32 -> -0.5f .. 0.5f
+
+static inline int16_t ditherAndClamp(float fOut, float fPrng, float *fPrngState)
+{
+	// 1-bit triangular dithering
+	fOut = (fOut + fPrng) - *fPrngState;
+	*fPrngState = fPrng;
+
+	fOut = CLAMP(fOut, (float)INT16_MIN, (float)INT16_MAX);
+	return (int16_t)fOut;
+}
+
+static void processMixedSamples(mixer_t *m, int16_t *target, int32_t numSamples)
+{
+	/* Stereo separation as L/R gains (same as mid/side), with the normalization
+	** folded in. At 100% separation fGainB is zero, which is the Amiga panning.
+	*/
+	const float fGainA = NORMALIZE_VALUE * (STEREO_NORM_FACTOR + m->fSideFactor);
+	const float fGainB = NORMALIZE_VALUE * (STEREO_NORM_FACTOR - m->fSideFactor);
+
+	int32_t i = 0;
+
+#if defined HAS_SSE2
+	// four frames (two L/R/L/R vectors) per iteration
+
+	if (numSamples >= 4)
+	{
+		const __m128 vGainA = _mm_set1_ps(fGainA), vGainB = _mm_set1_ps(fGainB);
+		const __m128 vPrngScale = _mm_set1_ps(PRNG_SCALE);
+		const __m128 vMin = _mm_set1_ps((float)INT16_MIN), vMax = _mm_set1_ps((float)INT16_MAX);
+
+		__m128i vSeed = _mm_loadu_si128((const __m128i *)m->ditherSeed);
+		__m128 vPrngState = _mm_setr_ps(0.0f, 0.0f, m->fPrngStateL, m->fPrngStateR);
+
+		for (; i+4 <= numSamples; i += 4)
+		{
+			const __m128 vL = _mm_loadu_ps(&m->fMixBufferL[i]);
+			const __m128 vR = _mm_loadu_ps(&m->fMixBufferR[i]);
+			__m128 vOut0 = _mm_unpacklo_ps(vL, vR);
+			__m128 vOut1 = _mm_unpackhi_ps(vL, vR);
+
+			// stereo separation and normalization
+			vOut0 = _mm_add_ps(_mm_mul_ps(vOut0, vGainA), _mm_mul_ps(_mm_shuffle_ps(vOut0, vOut0, _MM_SHUFFLE(2,3,0,1)), vGainB));
+			vOut1 = _mm_add_ps(_mm_mul_ps(vOut1, vGainA), _mm_mul_ps(_mm_shuffle_ps(vOut1, vOut1, _MM_SHUFFLE(2,3,0,1)), vGainB));
+
+			// 1-bit triangular dithering
+			vSeed = _mm_xor_si128(vSeed, _mm_slli_epi32(vSeed, 13));
+			vSeed = _mm_xor_si128(vSeed, _mm_srli_epi32(vSeed, 17));
+			vSeed = _mm_xor_si128(vSeed, _mm_slli_epi32(vSeed,  5));
+			const __m128 vPrng0 = _mm_mul_ps(_mm_cvtepi32_ps(vSeed), vPrngScale);
+
+			vSeed = _mm_xor_si128(vSeed, _mm_slli_epi32(vSeed, 13));
+			vSeed = _mm_xor_si128(vSeed, _mm_srli_epi32(vSeed, 17));
+			vSeed = _mm_xor_si128(vSeed, _mm_slli_epi32(vSeed,  5));
+			const __m128 vPrng1 = _mm_mul_ps(_mm_cvtepi32_ps(vSeed), vPrngScale);
+
+			vOut0 = _mm_sub_ps(_mm_add_ps(vOut0, vPrng0), _mm_shuffle_ps(vPrngState, vPrng0, _MM_SHUFFLE(1,0,3,2)));
+			vOut1 = _mm_sub_ps(_mm_add_ps(vOut1, vPrng1), _mm_shuffle_ps(vPrng0, vPrng1, _MM_SHUFFLE(1,0,3,2)));
+			vPrngState = vPrng1;
+
+			// clamp, truncate and interleave straight into the output stream
+			vOut0 = _mm_min_ps(_mm_max_ps(vOut0, vMin), vMax);
+			vOut1 = _mm_min_ps(_mm_max_ps(vOut1, vMin), vMax);
+			_mm_storeu_si128((__m128i *)&target[i*2], _mm_packs_epi32(_mm_cvttps_epi32(vOut0), _mm_cvttps_epi32(vOut1)));
+		}
+
+		float fState[4];
+		_mm_storeu_ps(fState, vPrngState);
+		m->fPrngStateL = fState[2];
+		m->fPrngStateR = fState[3];
+
+		_mm_storeu_si128((__m128i *)m->ditherSeed, vSeed);
+	}
+#elif defined HAS_NEON
+	// four frames (two L/R/L/R vectors) per iteration
+
+	if (numSamples >= 4)
+	{
+		const float32x4_t vGainA = vdupq_n_f32(fGainA), vGainB = vdupq_n_f32(fGainB);
+		const float32x4_t vMin = vdupq_n_f32((float)INT16_MIN), vMax = vdupq_n_f32((float)INT16_MAX);
+
+		uint32x4_t vSeed = vld1q_u32(m->ditherSeed);
+		float32x4_t vPrngState = vsetq_lane_f32(m->fPrngStateR, vsetq_lane_f32(m->fPrngStateL, vdupq_n_f32(0.0f), 2), 3);
+
+		for (; i+4 <= numSamples; i += 4)
+		{
+			const float32x4x2_t vLR = vzipq_f32(vld1q_f32(&m->fMixBufferL[i]), vld1q_f32(&m->fMixBufferR[i]));
+			float32x4_t vOut0 = vLR.val[0];
+			float32x4_t vOut1 = vLR.val[1];
+
+			// stereo separation and normalization
+			vOut0 = vaddq_f32(vmulq_f32(vOut0, vGainA), vmulq_f32(vrev64q_f32(vOut0), vGainB));
+			vOut1 = vaddq_f32(vmulq_f32(vOut1, vGainA), vmulq_f32(vrev64q_f32(vOut1), vGainB));
+
+			// 1-bit triangular dithering
+			vSeed = veorq_u32(vSeed, vshlq_n_u32(vSeed, 13));
+			vSeed = veorq_u32(vSeed, vshrq_n_u32(vSeed, 17));
+			vSeed = veorq_u32(vSeed, vshlq_n_u32(vSeed,  5));
+			const float32x4_t vPrng0 = vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(vSeed)), PRNG_SCALE);
+
+			vSeed = veorq_u32(vSeed, vshlq_n_u32(vSeed, 13));
+			vSeed = veorq_u32(vSeed, vshrq_n_u32(vSeed, 17));
+			vSeed = veorq_u32(vSeed, vshlq_n_u32(vSeed,  5));
+			const float32x4_t vPrng1 = vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(vSeed)), PRNG_SCALE);
+
+			vOut0 = vsubq_f32(vaddq_f32(vOut0, vPrng0), vextq_f32(vPrngState, vPrng0, 2));
+			vOut1 = vsubq_f32(vaddq_f32(vOut1, vPrng1), vextq_f32(vPrng0, vPrng1, 2));
+			vPrngState = vPrng1;
+
+			// clamp, truncate and interleave straight into the output stream
+			vOut0 = vminq_f32(vmaxq_f32(vOut0, vMin), vMax);
+			vOut1 = vminq_f32(vmaxq_f32(vOut1, vMin), vMax);
+			vst1q_s16(&target[i*2], vcombine_s16(vqmovn_s32(vcvtq_s32_f32(vOut0)), vqmovn_s32(vcvtq_s32_f32(vOut1))));
+		}
+
+		m->fPrngStateL = vgetq_lane_f32(vPrngState, 2);
+		m->fPrngStateR = vgetq_lane_f32(vPrngState, 3);
+
+		vst1q_u32(m->ditherSeed, vSeed);
+	}
+#endif
+
+	// remaining frames (or all of them, if no SIMD). Lane usage matches the SIMD path.
+
+	for (; i < numSamples; i++)
+	{
+		int32_t lane = 2;
+		if (!(i & 1)) // start of a frame pair, step the PRNG lanes
+		{
+			const int32_t lanesToStep = (i+1 < numSamples) ? DITHER_LANES : 2; // a lone last frame only uses lanes 0/1
+			for (int32_t j = 0; j < lanesToStep; j++)
+				m->ditherSeed[j] = xorshift32(m->ditherSeed[j]);
+
+			lane = 0;
+		}
+
+		const float fL = m->fMixBufferL[i];
+		const float fR = m->fMixBufferR[i];
+
+		target[(i*2)+0] = ditherAndClamp((fL * fGainA) + (fR * fGainB), (int32_t)m->ditherSeed[lane+0] * PRNG_SCALE, &m->fPrngStateL);
+		target[(i*2)+1] = ditherAndClamp((fR * fGainA) + (fL * fGainB), (int32_t)m->ditherSeed[lane+1] * PRNG_SCALE, &m->fPrngStateR);
+	}
+}
+
+// float output: no dithering or clamping, +-1.0 is 16-bit full scale (can go beyond)
+static void processMixedSamplesFloat(mixer_t *m, float *target, int32_t numSamples)
+{
+	const float fGainA = (NORMALIZE_VALUE / (INT16_MAX+1.0f)) * (STEREO_NORM_FACTOR + m->fSideFactor);
+	const float fGainB = (NORMALIZE_VALUE / (INT16_MAX+1.0f)) * (STEREO_NORM_FACTOR - m->fSideFactor);
+
+	int32_t i = 0;
+
+#if defined HAS_SSE2
+	const __m128 vGainA = _mm_set1_ps(fGainA), vGainB = _mm_set1_ps(fGainB);
+	for (; i+4 <= numSamples; i += 4)
+	{
+		const __m128 vL = _mm_loadu_ps(&m->fMixBufferL[i]);
+		const __m128 vR = _mm_loadu_ps(&m->fMixBufferR[i]);
+		const __m128 vOut0 = _mm_unpacklo_ps(vL, vR);
+		const __m128 vOut1 = _mm_unpackhi_ps(vL, vR);
+
+		_mm_storeu_ps(&target[(i*2)+0], _mm_add_ps(_mm_mul_ps(vOut0, vGainA), _mm_mul_ps(_mm_shuffle_ps(vOut0, vOut0, _MM_SHUFFLE(2,3,0,1)), vGainB)));
+		_mm_storeu_ps(&target[(i*2)+4], _mm_add_ps(_mm_mul_ps(vOut1, vGainA), _mm_mul_ps(_mm_shuffle_ps(vOut1, vOut1, _MM_SHUFFLE(2,3,0,1)), vGainB)));
+	}
+#elif defined HAS_NEON
+	const float32x4_t vGainA = vdupq_n_f32(fGainA), vGainB = vdupq_n_f32(fGainB);
+	for (; i+4 <= numSamples; i += 4)
+	{
+		const float32x4x2_t vLR = vzipq_f32(vld1q_f32(&m->fMixBufferL[i]), vld1q_f32(&m->fMixBufferR[i]));
+
+		vst1q_f32(&target[(i*2)+0], vaddq_f32(vmulq_f32(vLR.val[0], vGainA), vmulq_f32(vrev64q_f32(vLR.val[0]), vGainB)));
+		vst1q_f32(&target[(i*2)+4], vaddq_f32(vmulq_f32(vLR.val[1], vGainA), vmulq_f32(vrev64q_f32(vLR.val[1]), vGainB)));
+	}
+#endif
+
+	for (; i < numSamples; i++)
+	{
+		const float fL = m->fMixBufferL[i];
+		const float fR = m->fMixBufferR[i];
+
+		target[(i*2)+0] = (fL * fGainA) + (fR * fGainB);
+		target[(i*2)+1] = (fR * fGainA) + (fL * fGainB);
+	}
+}
+
+static void mixPaula(mixer_t *m, paula_t *p, int32_t numSamples)
+{
+	if (m->oversampling) // 2x oversampling
+	{
+		paulaGenerateSamples(p, m->fMixBufferL, m->fMixBufferR, numSamples*2);
+		downsample2xStereo(&m->downsampleStateL, &m->downsampleStateR, m->fMixBufferL, m->fMixBufferR, numSamples); // in-place
+	}
+	else
+	{
+		paulaGenerateSamples(p, m->fMixBufferL, m->fMixBufferR, numSamples);
+	}
+}
+
+void mixerOutput(mixer_t *m, paula_t *p, int16_t *target, int32_t numSamples)
+{
+	mixPaula(m, p, numSamples);
+	processMixedSamples(m, target, numSamples);
+}
+
+void mixerOutputFloat(mixer_t *m, paula_t *p, float *target, int32_t numSamples)
+{
+	mixPaula(m, p, numSamples);
+	processMixedSamplesFloat(m, target, numSamples);
+}
+
+void mixerSkip(mixer_t *m, paula_t *p, int32_t numSamples, bool dither)
+{
+	if (numSamples <= 0)
+		return;
+
+	paulaSkipSamples(p, m->oversampling ? numSamples*2 : numSamples);
+
+	if (!dither)
+		return;
+
+	/* Step the PRNG lanes like processMixedSamples() does: all lanes once per frame pair, and
+	** lanes 0/1 once more for a lone last frame. The last frame's values are the new states.
+	*/
+	for (int32_t i = 0; i < numSamples/2; i++)
+	{
+		for (int32_t j = 0; j < DITHER_LANES; j++)
+			m->ditherSeed[j] = xorshift32(m->ditherSeed[j]);
+	}
+
+	int32_t lane = 2;
+	if (numSamples & 1)
+	{
+		m->ditherSeed[0] = xorshift32(m->ditherSeed[0]);
+		m->ditherSeed[1] = xorshift32(m->ditherSeed[1]);
+		lane = 0;
+	}
+
+	m->fPrngStateL = (int32_t)m->ditherSeed[lane+0] * PRNG_SCALE;
+	m->fPrngStateR = (int32_t)m->ditherSeed[lane+1] * PRNG_SCALE;
+}
+
+bool mixerAllocStems(mixer_t *m)
+{
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		m->fStemBuffer[i] = (float *)malloc(m->mixBufferLength * sizeof (float));
+		if (m->fStemBuffer[i] == NULL)
+		{
+			mixerFreeStems(m);
+			return false;
+		}
+
+		clearDownsample2xState(&m->stemDownsampleState[i]);
+	}
+
+	return true;
+}
+
+void mixerFreeStems(mixer_t *m)
+{
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		if (m->fStemBuffer[i] != NULL)
+		{
+			free(m->fStemBuffer[i]);
+			m->fStemBuffer[i] = NULL;
+		}
+	}
+}
+
+/* Mixes each voice on its own (with its own Amiga filters) and outputs them to one buffer each,
+** panned like in the normal mix. Summing the outputs gives the normal mix (minus dithering).
+*/
+void mixerOutputStems(mixer_t *m, paula_t *p, uint8_t *target[PAULA_VOICES], bool floatOutput, int32_t numSamples)
+{
+	ASSERT(m->fStemBuffer[0] != NULL);
+
+	paulaGenerateVoiceSamples(p, m->fStemBuffer, m->oversampling ? numSamples*2 : numSamples);
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		// voice 0/3 is left, voice 1/2 is right
+		float *fVoiceOut = (i == 0 || i == 3) ? m->fMixBufferL : m->fMixBufferR;
+		float *fSilentOut = (i == 0 || i == 3) ? m->fMixBufferR : m->fMixBufferL;
+
+		if (m->oversampling)
+			downsample2xMono(&m->stemDownsampleState[i], m->fStemBuffer[i], fVoiceOut, numSamples);
+		else
+			memcpy(fVoiceOut, m->fStemBuffer[i], numSamples * sizeof (float));
+
+		memset(fSilentOut, 0, numSamples * sizeof (float));
+
+		if (floatOutput)
+			processMixedSamplesFloat(m, (float *)target[i], numSamples);
+		else
+			processMixedSamples(m, (int16_t *)target[i], numSamples);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/* Output stage after Paula: 2x downsampling, stereo separation, normalization and dithering.
+** All state is in mixer_t, so several mixers can run at once (live audio, MOD2WAV, batch rendering).
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_paula.h"
+#include "pt2_downsample2x.h"
+
+#define DITHER_LANES 4
+
+typedef struct mixer_t
+{
+	bool oversampling; // Paula runs at twice the output rate (2x downsampled in the mixer)
+	int32_t mixBufferLength; // in Paula samples
+	float *fMixBufferL, *fMixBufferR, *fStemBuffer[PAULA_VOICES];
+	float fSideFactor;
+
+	// state that carries over between output calls
+	uint32_t ditherSeed[DITHER_LANES];
+	float fPrngStateL, fPrngStateR;
+	downsample2xState_t downsampleStateL, downsampleStateR, stemDownsampleState[PAULA_VOICES];
+} mixer_t;
+
+// the part of mixer_t that changes while mixing (for replayer snapshots and segment rendering)
+typedef struct mixerState_t
+{
+	uint32_t ditherSeed[DITHER_LANES];
+	float fPrngStateL, fPrngStateR;
+	downsample2xState_t downsampleStateL, downsampleStateR;
+} mixerState_t;
+
+bool mixerInit(mixer_t *m, int32_t maxSamplesPerTick, bool oversampling); // maxSamplesPerTick is at the Paula rate
+void mixerFree(mixer_t *m); // also frees the stem buffers
+bool mixerAllocStems(mixer_t *m);
+void mixerFreeStems(mixer_t *m);
+
+void mixerSetStereoSeparation(mixer_t *m, int32_t percentage); // 0..100
+void mixerClearDownsampleStates(mixer_t *m);
+void mixerResetDither(mixer_t *m);
+void mixerSaveState(mixer_t *m, mixerState_t *s); // (the stem downsampler states are not included)
+void mixerLoadState(mixer_t *m, const mixerState_t *s);
+
+void mixerOutput(mixer_t *m, paula_t *p, int16_t *target, int32_t numSamples);
+void mixerOutputFloat(mixer_t *m, paula_t *p, float *target, int32_t numSamples); // no dithering/clamping
+void mixerOutputStems(mixer_t *m, paula_t *p, uint8_t *target[PAULA_VOICES], bool floatOutput, int32_t numSamples);
+
+/* Advances Paula and the dither exactly like mixerOutput() (dither = true) or mixerOutputFloat()
+** would, without mixing anything. The Paula filter and downsampler states are left as they are.
+*/
+void mixerSkip(mixer_t *m, paula_t *p, int32_t numSamples, bool dither);
@@ -5,6 +5,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -17,18 +18,101 @@
 #include "pt2_textout.h"
 #include "pt2_visuals.h"
 #include "pt2_mod2wav.h"
-#include "pt2_downsample2x.h"
+#include "pt2_mixer.h"
 #include "pt2_config.h"
 #include "pt2_askbox.h"
 #include "pt2_replayer.h"
+#include "pt2_helpers.h"
+#include "pt2_songduration.h"
+#include "pt2_hpc.h"
+#include "pt2_flac_encoder.h"
 
-#define FADEOUT_CHUNK_SAMPLES 16384
 #define TICKS_PER_RENDER_CHUNK 64
+#define WRITE_BUFFERS 2 /* chunk buffer sets, one is rendered to while the writer thread writes the other */
 
-static int16_t *mod2WavBuffer, fadeOutBuffer[FADEOUT_CHUNK_SAMPLES * 2];
-static char lastFilename[PATH_MAX + 1];
+#define MAX_OUTPUT_FILES PAULA_VOICES /* one per voice when rendering stems */
 
-static void calcMod2WavTotalRows(void);
+#define MAX_RENDER_SEGMENTS 32
+#define MIN_SEGMENT_SECONDS 20 /* songs shorter than two segments are rendered in one go */
+#define SEGMENT_PREROLL_SECONDS 2 /* for the filters to settle, see renderInSegments() */
+
+// copied when the render starts
+typedef struct renderSettings_t
+{
+	bool stems, flac, fadeOut, ledFilter, enableE8xEffect, vblankTiming, muted[PAULA_VOICES];
+	uint8_t outputFormat, amigaModel, stereoSeparation;
+	int8_t numLoops;
+	uint16_t metroChannel, metroSpeed; // (only for the render's own replayer)
+	int32_t fadeOutSeconds;
+	uint32_t outputRate;
+} renderSettings_t;
+
+// everything renderTicks() needs to continue from a given tick (for segment rendering)
+typedef struct renderState_t
+{
+	uint64_t tickCounter, samplesToMixFrac;
+	uint32_t sampleCounter;
+	int8_t numLoopsLeft;
+	bool renderDone;
+	replayerState_t replayer;
+	bool rowVisitTable[128 * MOD_ROWS];
+	paulaState_t paula;
+	mixerState_t mixer;
+} renderState_t;
+
+// everything a render needs, so that several renders can run at once (batch and segment rendering)
+typedef struct mod2WavRender_t
+{
+	replayer_t *replayer; // the tracker's replayer (MOD2WAV in the GUI) or ownReplayer
+	replayer_t ownReplayer; // for headless rendering and segments (has no UI callbacks)
+	bool trackerRender; // ticked with tickReplayer()
+	bool abortable; // can be aborted from the GUI
+	struct mod2WavRender_t *parent; // for segments, the progress is counted in the parent render
+	paula_t *paula; // separate Paula instance, the live one is left untouched
+	mixer_t mixer;
+
+	renderSettings_t settings;
+
+	int32_t numOutputFiles;
+	char filename[MAX_OUTPUT_FILES][PATH_MAX + 1];
+	FILE *file[MAX_OUTPUT_FILES];
+	flacEncoder_t *flac[MAX_OUTPUT_FILES]; // for FLAC output (encoded on the writer thread)
+	uint8_t *buffer[WRITE_BUFFERS][MAX_OUTPUT_FILES]; // one per output file in each set
+
+	// writer thread (see startWriter())
+	SDL_Thread *writerThread;
+	SDL_sem *freeBuffers, *fullBuffers;
+	int32_t fillBuffer, writeBuffer; // buffer sets in use by the renderer and the writer thread
+	uint32_t writeBytes[WRITE_BUFFERS]; // per output file (0 = stop the writer thread)
+	uint64_t writeWaitTime64; // time the render thread was blocked by output writes (in HPC ticks)
+
+	uint32_t samplesPerTickIntTab[(MAX_BPM-MIN_BPM)+1];
+	uint64_t samplesPerTickFracTab[(MAX_BPM-MIN_BPM)+1];
+
+	// render position
+	uint64_t tickCounter, samplesToMixFrac;
+	uint32_t sampleCounter;
+	int8_t numLoopsLeft;
+	bool renderDone;
+
+	SDL_atomic_t samplesRendered; // for the progress bar
+	uint32_t totalSamples; // exact output length, known before rendering (0 = unknown)
+	bool lengthMismatch; // the render didn't end at totalSamples (the output header is fixed up)
+} mod2WavRender_t;
+
+// one part of the song, rendered on its own thread (see renderInSegments())
+typedef struct renderSegment_t
+{
+	mod2WavRender_t r;
+	SDL_Thread *thread;
+	uint64_t startTick, endTick; // output is written from startTick on, the ticks before that are pre-roll
+	renderState_t checkpoint, startState, endState;
+} renderSegment_t;
+
+static mod2WavRender_t guiRender;
+static uint64_t renderStartTime64;
+static mod2WavStats_t lastGuiStats; // shown in the debug box (CTRL+SHIFT+F)
+static bool lastGuiStatsValid;
 
 void mod2WavDrawFadeoutToggle(void)
 {
@@ -105,14 +189,17 @@ void drawMod2WavProgressDialog(void)
 
 static void showMod2WavProgress(void)
 {
-	char percText[16];
+	char percText[32];
 
-	if (song->rowsInTotal == 0)
+	const uint32_t totalSamples = guiRender.totalSamples;
+	if (totalSamples == 0)
 		return;
 
 	// render progress bar
 
-	int32_t percent = (song->rowsCounter * 100) / song->rowsInTotal;
+	const uint32_t samplesDone = (uint32_t)SDL_AtomicGet(&guiRender.samplesRendered);
+
+	int32_t percent = (int32_t)(((uint64_t)samplesDone * 100) / totalSamples);
 	if (percent > 100)
 		percent = 100;
 
@@ -131,30 +218,62 @@ static void showMod2WavProgress(void)
 	if (bgWidth > 0)
 		fillRect(x+progressBarWidth, y, bgWidth, h, video.palette[PAL_BORDER]);
 
-	// draw percentage text
-	sprintf(percText, "%d%%", percent);
+	// draw percentage text (and estimated time left, once we have something to base it on)
+	const double dElapsedSecs = (double)(SDL_GetPerformanceCounter() - renderStartTime64) / hpcFreq.freq64;
+	if (samplesDone > 0 && samplesDone < totalSamples && dElapsedSecs >= 0.5)
+	{
+		int32_t etaSecs = (int32_t)ceil((dElapsedSecs * (totalSamples - samplesDone)) / samplesDone);
+		if (etaSecs > (99*60)+59)
+			etaSecs = (99*60)+59;
+
+		// (narrow types, so that the compiler can see that the text fits)
+		const uint8_t etaMins = (uint8_t)(etaSecs / 60), etaSecsLeft = (uint8_t)(etaSecs % 60);
+		snprintf(percText, sizeof (percText), "%d%% - ETA %d:%02d", (uint8_t)percent, etaMins, etaSecsLeft);
+	}
+	else
+	{
+		snprintf(percText, sizeof (percText), "%d%%", (uint8_t)percent);
+	}
+
 	const int32_t percTextW = (int32_t)strlen(percText) * (FONT_CHAR_W-1);
 	textOutTight(x + ((w - percTextW) / 2), y + ((h - FONT_CHAR_H) / 2), percText, video.palette[PAL_GENTXT]);
 }
 
+static void freeRender(mod2WavRender_t *c);
+
 static void resetAudio(void)
 {
-	audio.oversamplingFlag = (audio.outputRate < 96000);
-	const int32_t paulaMixFrequency = audio.oversamplingFlag ? audio.outputRate*2 : audio.outputRate;
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
-	generateBpmTable(audio.outputRate, editor.timingMode == TEMPO_MODE_VBLANK);
-	clearDownsample2xStates();
-	modSetTempo(song->currBPM, true); // update BPM (samples per tick) with the tracker's audio frequency
+	// make the replayer write to the audio device's Paula again
+	setReplayerPaula(audio.paula);
+	freeRender(&guiRender);
+}
+
+bool mod2WavGetLastStats(mod2WavStats_t *stats)
+{
+	if (!lastGuiStatsValid)
+		return false;
+
+	*stats = lastGuiStats;
+	return true;
 }
 
 static void handleMod2WavEnd(void)
 {
 	pointerSetMode(POINTER_MODE_IDLE, DO_CARRY);
 
+	// (the render thread has finished, so these can be read without syncing)
+	lastGuiStats.framesRendered = guiRender.sampleCounter;
+	lastGuiStats.dWriteWaitSecs = (double)guiRender.writeWaitTime64 / hpcFreq.freq64;
+	lastGuiStatsValid = true;
+
 	if (editor.abortMod2Wav)
 	{
 		displayErrorMsg("MOD2WAV ABORTED!");
 	}
+	else if (guiRender.lengthMismatch)
+	{
+		displayErrorMsg("LENGTH MISMATCH !");
+	}
 	else
 	{
 		displayMsg("MOD RENDERED!");
@@ -189,149 +308,816 @@ void updateMod2WavDialog(void)
 	}
 }
 
-static int32_t mod2WavThreadFunc(void *ptr)
+static uint32_t getBytesPerSample(uint8_t format)
+{
+	if (format == OUTPUT_FORMAT_24BIT)
+		return 3;
+	else if (format == OUTPUT_FORMAT_FLOAT)
+		return sizeof (float);
+	else
+		return sizeof (int16_t);
+}
+
+// in-place (packed 24-bit output is smaller than the float input)
+static void floatTo24Bit(uint8_t *buffer, uint32_t numSamples)
+{
+	const float *fIn = (const float *)buffer;
+	uint8_t *out = buffer;
+
+	for (uint32_t i = 0; i < numSamples; i++)
+	{
+		float fOut = fIn[i] * 8388608.0f; // 1.0 -> 2^23
+		fOut = CLAMP(fOut, -8388608.0f, 8388607.0f);
+
+		const int32_t out32 = (int32_t)fOut;
+		*out++ = (uint8_t)(out32 >>  0);
+		*out++ = (uint8_t)(out32 >>  8);
+		*out++ = (uint8_t)(out32 >> 16);
+	}
+}
+
+/* Fades out the last fadeOutSeconds of the song, while rendering (the output length is known beforehand).
+** The buffer holds numSamples output samples from output position 'pos' on, as int16_t or float.
+*/
+static void applyFadeOut(mod2WavRender_t *c, uint8_t *buffer, bool floatBuffer, uint32_t pos, uint32_t numSamples)
+{
+	const uint32_t totalSamples = c->totalSamples;
+
+	uint32_t numFadeOutSamples = c->settings.outputRate * c->settings.fadeOutSeconds;
+	if (numFadeOutSamples > totalSamples)
+		numFadeOutSamples = totalSamples;
+
+	const uint32_t fadeOutStart = totalSamples - numFadeOutSamples;
+	if (numFadeOutSamples == 0 || pos+numSamples <= fadeOutStart)
+		return;
+
+	uint32_t i = 0;
+	if (pos < fadeOutStart)
+		i = fadeOutStart - pos;
+
+	const double dFadeOutMul = 1.0 / numFadeOutSamples;
+
+	if (floatBuffer)
+	{
+		float *fBuffer = (float *)buffer;
+		for (; i < numSamples && pos+i < totalSamples; i++)
+		{
+			const double dVal = (totalSamples - (pos+i)) * dFadeOutMul; // 1.0 .. 1/numFadeOutSamples
+			fBuffer[(i*2)+0] = (float)(fBuffer[(i*2)+0] * dVal); // L
+			fBuffer[(i*2)+1] = (float)(fBuffer[(i*2)+1] * dVal); // R
+		}
+	}
+	else
+	{
+		int16_t *buffer16 = (int16_t *)buffer;
+		for (; i < numSamples && pos+i < totalSamples; i++)
+		{
+			const double dVal = (totalSamples - (pos+i)) * dFadeOutMul; // 1.0 .. 1/numFadeOutSamples
+			buffer16[(i*2)+0] = (int16_t)(buffer16[(i*2)+0] * dVal); // L
+			buffer16[(i*2)+1] = (int16_t)(buffer16[(i*2)+1] * dVal); // R
+		}
+	}
+}
+
+static void writeWavHeader(mod2WavRender_t *c, FILE *f, uint32_t numFrames, uint32_t bytesPerFrame)
 {
 	wavHeader_t wavHeader;
 
-	FILE *f = (FILE *)ptr;
-	ASSERT(mod2WavBuffer != NULL && f != NULL);
+	wavHeader.chunkID = 0x46464952; // "RIFF"
+	wavHeader.chunkSize = (uint32_t)(sizeof (wavHeader_t) - 8) + (numFrames * bytesPerFrame);
+	wavHeader.format = 0x45564157; // "WAVE"
+	wavHeader.subchunk1ID = 0x20746D66; // "fmt "
+	wavHeader.subchunk1Size = 16;
+	wavHeader.audioFormat = (c->settings.outputFormat == OUTPUT_FORMAT_FLOAT) ? 3 : 1; // 3 = IEEE float, 1 = PCM
+	wavHeader.numChannels = 2;
+	wavHeader.sampleRate = c->settings.outputRate;
+	wavHeader.bitsPerSample = (uint16_t)(bytesPerFrame * 8 / 2);
+	wavHeader.byteRate = (wavHeader.sampleRate * wavHeader.numChannels * wavHeader.bitsPerSample) / 8;
+	wavHeader.blockAlign = (wavHeader.numChannels * wavHeader.bitsPerSample) / 8;
+	wavHeader.subchunk2ID = 0x61746164; // "data"
+	wavHeader.subchunk2Size = numFrames * bytesPerFrame;
+
+	// write main header
+	fwrite(&wavHeader, sizeof (wavHeader_t), 1, f);
+}
+
+static void freeRenderBuffers(mod2WavRender_t *c)
+{
+	for (int32_t i = 0; i < WRITE_BUFFERS; i++)
+	{
+		for (int32_t j = 0; j < MAX_OUTPUT_FILES; j++)
+		{
+			if (c->buffer[i][j] != NULL)
+			{
+				free(c->buffer[i][j]);
+				c->buffer[i][j] = NULL;
+			}
+		}
+	}
+
+	for (int32_t i = 0; i < MAX_OUTPUT_FILES; i++)
+	{
+		flacEncoderFree(c->flac[i]);
+		c->flac[i] = NULL;
+	}
+
+	mixerFree(&c->mixer);
+}
+
+static void freeRender(mod2WavRender_t *c)
+{
+	freeRenderBuffers(c);
 
-	// skip wav header place, render data first
-	fseek(f, sizeof (wavHeader_t), SEEK_SET);
+	paulaDestroy(c->paula);
+	c->paula = NULL;
+}
+
+static void closeOutputFiles(mod2WavRender_t *c)
+{
+	for (int32_t i = 0; i < MAX_OUTPUT_FILES; i++)
+	{
+		if (c->file[i] != NULL)
+		{
+			fclose(c->file[i]);
+			c->file[i] = NULL;
+		}
+	}
+}
+
+static bool tickRender(mod2WavRender_t *c) // returns false on end of song
+{
+	if (c->trackerRender)
+		return tickReplayer(); // (also updates the replayer settings from the tracker)
 
-	uint32_t sampleCounter = 0;
-	uint64_t samplesToMixFrac = 0;
-	int8_t numLoops = editor.mod2WavNumLoops;
+	return replayerTick(c->replayer);
+}
+
+static bool renderAborted(mod2WavRender_t *c)
+{
+	return c->abortable && (!editor.mod2WavOngoing || editor.abortMod2Wav);
+}
 
-	bool renderDone = false;
-	while (!renderDone)
+static void resetRenderPosition(mod2WavRender_t *c)
+{
+	c->tickCounter = 0;
+	c->samplesToMixFrac = 0;
+	c->sampleCounter = 0;
+	c->numLoopsLeft = c->settings.numLoops;
+	c->renderDone = false;
+}
+
+// does one replayer tick, and returns its length in output samples
+static uint32_t nextTick(mod2WavRender_t *c)
+{
+	if (!tickRender(c))
 	{
+		if (--c->numLoopsLeft < 0)
+		{
+			c->renderDone = true; // this tick is the last tick
+		}
+		else
+		{
+			// clear the "last visisted rows" table and let the song continue playing (loop)
+			memset(c->replayer->rowVisitTable, 0, sizeof (c->replayer->rowVisitTable));
+		}
+	}
+
+	// tick length for the current BPM (a BPM change from the tick above is already in effect)
+	const int32_t bpmIndex = c->replayer->bpm - MIN_BPM;
+	uint32_t samplesToMix = c->samplesPerTickIntTab[bpmIndex];
+
+	c->samplesToMixFrac += c->samplesPerTickFracTab[bpmIndex];
+	if (c->samplesToMixFrac >= BPM_FRAC_SCALE)
+	{
+		c->samplesToMixFrac &= BPM_FRAC_MASK;
+		samplesToMix++;
+	}
+
+	c->tickCounter++;
+	c->sampleCounter += samplesToMix;
+
+	return samplesToMix;
+}
+
+static void writeBuffers(mod2WavRender_t *c, int32_t bufferSet)
+{
+	const uint32_t bytesPerFrame = getBytesPerSample(c->settings.outputFormat) * 2;
+
+	for (int32_t i = 0; i < c->numOutputFiles; i++)
+	{
+		if (c->flac[i] != NULL)
+			flacEncoderWrite(c->flac[i], c->buffer[bufferSet][i], c->writeBytes[bufferSet] / bytesPerFrame);
+		else
+			fwrite(c->buffer[bufferSet][i], 1, c->writeBytes[bufferSet], c->file[i]);
+	}
+}
+
+static int32_t writerThreadFunc(void *ptr)
+{
+	mod2WavRender_t *c = (mod2WavRender_t *)ptr;
+
+	while (true)
+	{
+		SDL_SemWait(c->fullBuffers);
+
+		const int32_t bufferSet = c->writeBuffer;
+		if (c->writeBytes[bufferSet] == 0)
+			break; // stopWriter()
+
+		writeBuffers(c, bufferSet);
+
+		c->writeBuffer = (bufferSet + 1) % WRITE_BUFFERS;
+		SDL_SemPost(c->freeBuffers);
+	}
+
+	return true;
+}
+
+/* The output files are written on a thread of their own, so that the renderer doesn't have to wait for
+** the disk. The renderer always owns one buffer set (fillBuffer), the others are free or being written.
+** If the thread can't be started, the buffers are written on the render thread instead.
+*/
+static void startWriter(mod2WavRender_t *c)
+{
+	c->fillBuffer = c->writeBuffer = 0;
+
+	c->freeBuffers = SDL_CreateSemaphore(WRITE_BUFFERS-1);
+	c->fullBuffers = SDL_CreateSemaphore(0);
+
+	if (c->freeBuffers != NULL && c->fullBuffers != NULL)
+		c->writerThread = SDL_CreateThread(writerThreadFunc, "MOD2WAV writer thread", c);
+
+	if (c->writerThread == NULL)
+	{
+		if (c->freeBuffers != NULL) SDL_DestroySemaphore(c->freeBuffers);
+		if (c->fullBuffers != NULL) SDL_DestroySemaphore(c->fullBuffers);
+
+		c->freeBuffers = c->fullBuffers = NULL;
+	}
+}
+
+// waits until all buffers are written, then stops the writer thread
+static void stopWriter(mod2WavRender_t *c)
+{
+	if (c->writerThread == NULL)
+		return;
+
+	const uint64_t startTime64 = SDL_GetPerformanceCounter();
+
+	for (int32_t i = 0; i < WRITE_BUFFERS-1; i++)
+		SDL_SemWait(c->freeBuffers);
+
+	c->writeWaitTime64 += SDL_GetPerformanceCounter() - startTime64;
+
+	c->writeBytes[c->fillBuffer] = 0; // the writer thread is at this buffer set now
+	SDL_SemPost(c->fullBuffers);
+	SDL_WaitThread(c->writerThread, NULL);
+	c->writerThread = NULL;
+
+	SDL_DestroySemaphore(c->freeBuffers);
+	SDL_DestroySemaphore(c->fullBuffers);
+	c->freeBuffers = c->fullBuffers = NULL;
+}
+
+// queues the filled buffer set for writing, and gets the next free one (only waits if the writer is behind)
+static void submitBuffers(mod2WavRender_t *c, uint32_t numBytes)
+{
+	c->writeBytes[c->fillBuffer] = numBytes;
+
+	if (c->writerThread == NULL)
+	{
+		const uint64_t startTime64 = SDL_GetPerformanceCounter();
+		writeBuffers(c, c->fillBuffer);
+		c->writeWaitTime64 += SDL_GetPerformanceCounter() - startTime64;
+		return;
+	}
+
+	SDL_SemPost(c->fullBuffers);
+
+	if (SDL_SemTryWait(c->freeBuffers) != 0)
+	{
+		const uint64_t startTime64 = SDL_GetPerformanceCounter();
+		SDL_SemWait(c->freeBuffers);
+		c->writeWaitTime64 += SDL_GetPerformanceCounter() - startTime64;
+	}
+
+	c->fillBuffer = (c->fillBuffer + 1) % WRITE_BUFFERS;
+}
+
+/* Renders until the tick counter reaches endTick (or the song ends). The output is written to the
+** output files at their current file positions (through the writer thread, if started), or thrown
+** away if writeOutput is false.
+*/
+static void renderTicks(mod2WavRender_t *c, uint64_t endTick, bool writeOutput)
+{
+	const uint8_t outputFormat = c->settings.outputFormat;
+	const uint32_t bytesPerFrame = getBytesPerSample(outputFormat) * 2;
+	const uint32_t bufferBytesPerFrame = (outputFormat == OUTPUT_FORMAT_16BIT) ? sizeof (int16_t) * 2 : sizeof (float) * 2;
+
+	mod2WavRender_t *progress = (c->parent != NULL) ? c->parent : c;
+
+	while (!c->renderDone && c->tickCounter < endTick)
+	{
+		const uint32_t chunkPos = c->sampleCounter;
 		uint32_t samplesInChunk = 0;
 
+		uint8_t **buffer = c->buffer[c->fillBuffer];
+
 		// render several ticks at once to prevent frequent disk I/O (speeds up the process)
-		int16_t *ptr16 = mod2WavBuffer;
-		for (uint32_t i = 0; i < TICKS_PER_RENDER_CHUNK; i++)
+		uint32_t bufferOffset = 0;
+		for (uint32_t i = 0; i < TICKS_PER_RENDER_CHUNK && !c->renderDone && c->tickCounter < endTick; i++)
 		{
-			if (!editor.mod2WavOngoing || renderDone || editor.abortMod2Wav)
+			if (renderAborted(c))
 			{
-				renderDone = true;
+				c->renderDone = true;
 				break;
 			}
 
-			/* Handle replayer tick (also sets audio.samplesPerTickInt and audio.samplesPerTickFrac).
-			** Returns false on end of song.
-			*/
-			if (!tickReplayer())
+			const uint32_t samplesToMix = nextTick(c);
+
+			if (c->settings.stems) // all voices in one replayer pass, to one buffer each
+			{
+				uint8_t *stemPtrs[PAULA_VOICES];
+				for (int32_t j = 0; j < PAULA_VOICES; j++)
+					stemPtrs[j] = buffer[j] + bufferOffset;
+
+				mixerOutputStems(&c->mixer, c->paula, stemPtrs, outputFormat != OUTPUT_FORMAT_16BIT, samplesToMix);
+			}
+			else if (outputFormat == OUTPUT_FORMAT_16BIT)
+			{
+				mixerOutput(&c->mixer, c->paula, (int16_t *)(buffer[0] + bufferOffset), samplesToMix);
+			}
+			else
 			{
-				if (--numLoops < 0)
-				{
-					renderDone = true; // this tick is the last tick
-				}
-				else
-				{
-					// clear the "last visisted rows" table and let the song continue playing (loop)
-					memset(editor.rowVisitTable, 0, 128 * MOD_ROWS);
-				}
+				mixerOutputFloat(&c->mixer, c->paula, (float *)(buffer[0] + bufferOffset), samplesToMix);
 			}
 
-			uint32_t samplesToMix = audio.samplesPerTickInt;
+			bufferOffset += samplesToMix * bufferBytesPerFrame;
+			samplesInChunk += samplesToMix;
+
+			if (writeOutput)
+				SDL_AtomicAdd(&progress->samplesRendered, samplesToMix);
 
-			samplesToMixFrac += audio.samplesPerTickFrac;
-			if (samplesToMixFrac >= BPM_FRAC_SCALE)
+			if (c->abortable)
+				ui.updateMod2WavDialog = true;
+		}
+
+		// hand the buffers over to the writer thread
+		if (writeOutput && samplesInChunk > 0)
+		{
+			for (int32_t i = 0; i < c->numOutputFiles; i++)
 			{
-				samplesToMixFrac &= BPM_FRAC_MASK;
-				samplesToMix++;
+				if (c->settings.fadeOut)
+					applyFadeOut(c, buffer[i], outputFormat != OUTPUT_FORMAT_16BIT, chunkPos, samplesInChunk);
+
+				if (outputFormat == OUTPUT_FORMAT_24BIT)
+					floatTo24Bit(buffer[i], samplesInChunk * 2);
 			}
 
-			outputAudio(ptr16, samplesToMix);
-			ptr16 += samplesToMix * 2; // *2 for stereo
+			submitBuffers(c, samplesInChunk * bytesPerFrame);
+		}
+	}
+}
 
-			samplesInChunk += samplesToMix;
-			sampleCounter += samplesToMix;
+// same as a renderTicks() tick, but Paula and the mixer are only advanced (no mixing, no output)
+static void skipTick(mod2WavRender_t *c)
+{
+	const uint32_t samplesToMix = nextTick(c);
+	mixerSkip(&c->mixer, c->paula, samplesToMix, c->settings.outputFormat == OUTPUT_FORMAT_16BIT);
+}
+
+static void saveRenderState(mod2WavRender_t *c, renderState_t *s)
+{
+	memset(s, 0, sizeof (renderState_t)); // clear padding (states are compared with memcmp())
+
+	s->tickCounter = c->tickCounter;
+	s->samplesToMixFrac = c->samplesToMixFrac;
+	s->sampleCounter = c->sampleCounter;
+	s->numLoopsLeft = c->numLoopsLeft;
+	s->renderDone = c->renderDone;
+
+	replayerSaveState(c->replayer, &s->replayer);
+	memcpy(s->rowVisitTable, c->replayer->rowVisitTable, sizeof (s->rowVisitTable));
+	paulaSaveState(c->paula, &s->paula);
+	mixerSaveState(&c->mixer, &s->mixer);
+}
+
+static void loadRenderState(mod2WavRender_t *c, const renderState_t *s)
+{
+	c->tickCounter = s->tickCounter;
+	c->samplesToMixFrac = s->samplesToMixFrac;
+	c->sampleCounter = s->sampleCounter;
+	c->numLoopsLeft = s->numLoopsLeft;
+	c->renderDone = s->renderDone;
+
+	replayerLoadState(c->replayer, &s->replayer);
+	memcpy(c->replayer->rowVisitTable, s->rowVisitTable, sizeof (c->replayer->rowVisitTable));
+	paulaLoadState(c->paula, &s->paula);
+	mixerLoadState(&c->mixer, &s->mixer);
+}
 
-			ui.updateMod2WavDialog = true;
+// the tracker's replayer isn't used, this one has no callbacks
+static void initOwnReplayer(mod2WavRender_t *c, module_t *m)
+{
+	replayer_t *r = &c->ownReplayer;
+
+	replayerInit(r, m, c->paula);
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		r->muted[i] = c->settings.muted[i];
+
+	r->enableE8xEffect = c->settings.enableE8xEffect;
+	r->vblankTiming = c->settings.vblankTiming;
+	r->metroChannel = c->settings.metroChannel;
+	r->metroSpeed = c->settings.metroSpeed;
+	r->renderMode = REPLAYER_RENDER_SONG;
+	replayerRestart(r);
+
+	c->trackerRender = false;
+	c->replayer = r;
+}
+
+static bool createRenderPaula(mod2WavRender_t *c)
+{
+	paulaDestroy(c->paula);
+
+	c->paula = paulaCreate(c->settings.outputRate * 2.0, c->settings.amigaModel); // *2 for oversampling (we always do oversampling in MOD2WAV)
+	if (c->paula == NULL)
+		return false;
+
+	paulaWriteByte(c->paula, 0xBFE001, (uint8_t)c->settings.ledFilter << 1); // "LED" filter state at song start
+	return true;
+}
+
+// allocates the render buffers, the mixer and the Paula (free with freeRender(), also on failure)
+static bool initRender(mod2WavRender_t *c)
+{
+	const int32_t paulaMixFrequency = c->settings.outputRate * 2;
+	int32_t maxSamplesPerTick = (int32_t)ceil(paulaMixFrequency / (MIN_BPM / 2.5)) + 1;
+	int32_t maxOutputSamplesPerTick = (int32_t)ceil(c->settings.outputRate / (MIN_BPM / 2.5)) + 1;
+
+	// 24-bit is rendered as float first, then packed in-place
+	const uint32_t bufferBytesPerFrame = (c->settings.outputFormat == OUTPUT_FORMAT_16BIT) ? sizeof (int16_t) * 2 : sizeof (float) * 2;
+
+	bool allocFailed = false;
+	for (int32_t i = 0; i < WRITE_BUFFERS; i++)
+	{
+		for (int32_t j = 0; j < c->numOutputFiles; j++)
+		{
+			c->buffer[i][j] = (uint8_t *)malloc((TICKS_PER_RENDER_CHUNK * maxOutputSamplesPerTick) * bufferBytesPerFrame);
+			if (c->buffer[i][j] == NULL)
+				allocFailed = true;
 		}
+	}
+
+	if (!mixerInit(&c->mixer, maxSamplesPerTick, true))
+		allocFailed = true;
+
+	if (c->settings.stems && !mixerAllocStems(&c->mixer))
+		allocFailed = true;
+
+	if (c->settings.flac)
+	{
+		const int32_t bitsPerSample = getBytesPerSample(c->settings.outputFormat) * 8;
+		for (int32_t i = 0; i < c->numOutputFiles; i++)
+		{
+			if (c->file[i] == NULL)
+				continue; // (a segment scan)
 
-		// write buffer to disk
-		if (samplesInChunk > 0)
-			fwrite(mod2WavBuffer, sizeof (int16_t), samplesInChunk * 2, f);
+			c->flac[i] = flacEncoderCreate(c->file[i], c->settings.outputRate, bitsPerSample);
+			if (c->flac[i] == NULL)
+				allocFailed = true;
+		}
 	}
 
-	ui.updateMod2WavDialog = true;
+	if (allocFailed || !createRenderPaula(c))
+		return false;
 
-	uint32_t endOfDataOffset = ftell(f);
+	mixerSetStereoSeparation(&c->mixer, c->settings.stereoSeparation);
 
-	free(mod2WavBuffer);
+	for (int32_t bpm = MIN_BPM; bpm <= MAX_BPM; bpm++)
+	{
+		const int32_t i = bpm - MIN_BPM;
+		getSamplesPerTick(c->settings.outputRate, bpm, c->settings.vblankTiming, &c->samplesPerTickIntTab[i], &c->samplesPerTickFracTab[i]);
+	}
 
-	uint32_t totalRiffChunkLen = (uint32_t)ftell(f) - 8;
+	SDL_AtomicSet(&c->samplesRendered, 0);
+	c->totalSamples = 0;
+	c->writeWaitTime64 = 0;
 
-	// go back and fill in WAV header
-	rewind(f);
+	return true;
+}
 
-	wavHeader.chunkID = 0x46464952; // "RIFF"
-	wavHeader.chunkSize = totalRiffChunkLen;
-	wavHeader.format = 0x45564157; // "WAVE"
-	wavHeader.subchunk1ID = 0x20746D66; // "fmt "
-	wavHeader.subchunk1Size = 16;
-	wavHeader.audioFormat = 1;
-	wavHeader.numChannels = 2;
-	wavHeader.sampleRate = config.mod2WavOutputFreq;
-	wavHeader.bitsPerSample = 16;
-	wavHeader.byteRate = (wavHeader.sampleRate * wavHeader.numChannels * wavHeader.bitsPerSample) / 8;
-	wavHeader.blockAlign = (wavHeader.numChannels * wavHeader.bitsPerSample) / 8;
-	wavHeader.subchunk2ID = 0x61746164; // "data"
-	wavHeader.subchunk2Size = sampleCounter * sizeof (int16_t) * 2;
+static void freeSegment(renderSegment_t *seg)
+{
+	if (seg == NULL)
+		return;
 
-	// write main header
-	fwrite(&wavHeader, sizeof (wavHeader_t), 1, f);
-	fclose(f);
+	closeOutputFiles(&seg->r);
+	freeRender(&seg->r);
+	free(seg);
+}
 
-	// apply fadeout (if enabled)
-	if (editor.mod2WavFadeOut)
+// a render with the same settings, writing to the same (mono mix) output file through its own handle
+static renderSegment_t *createSegment(mod2WavRender_t *parent, module_t *m, bool openOutputFile)
+{
+	renderSegment_t *seg = (renderSegment_t *)calloc(1, sizeof (renderSegment_t));
+	if (seg == NULL)
+		return NULL;
+
+	mod2WavRender_t *r = &seg->r;
+
+	r->settings = parent->settings;
+	r->abortable = parent->abortable;
+	r->parent = parent;
+	r->numOutputFiles = 1;
+	strcpy(r->filename[0], parent->filename[0]);
+
+	if (!initRender(r))
+	{
+		freeSegment(seg);
+		return NULL;
+	}
+
+	r->totalSamples = parent->totalSamples; // (for the fadeout)
+
+	if (openOutputFile)
 	{
-		uint32_t numFadeOutSamples = config.mod2WavOutputFreq * editor.mod2WavFadeOutSeconds;
-		if (numFadeOutSamples > sampleCounter)
-			numFadeOutSamples = sampleCounter;
+		r->file[0] = fopen(r->filename[0], "r+b");
+		if (r->file[0] == NULL)
+		{
+			freeSegment(seg);
+			return NULL;
+		}
+	}
+
+	initOwnReplayer(r, m);
+	resetRenderPosition(r);
+
+	return seg;
+}
+
+static void renderSegmentOutput(renderSegment_t *seg)
+{
+	mod2WavRender_t *r = &seg->r;
+	const uint32_t bytesPerFrame = getBytesPerSample(r->settings.outputFormat) * 2;
+
+	fseek(r->file[0], sizeof (wavHeader_t) + (r->sampleCounter * bytesPerFrame), SEEK_SET);
 
-		f = fopen(lastFilename, "r+b");
+	startWriter(r);
+	renderTicks(r, seg->endTick, true);
+	stopWriter(r);
 
-		const double dFadeOutDelta = 1.0 / numFadeOutSamples;
-		double dFadeOutVal = 1.0;
+	saveRenderState(r, &seg->endState);
+}
+
+static int32_t segmentThreadFunc(void *ptr)
+{
+	renderSegment_t *seg = (renderSegment_t *)ptr;
+	mod2WavRender_t *r = &seg->r;
 
-		fseek(f, endOfDataOffset - (numFadeOutSamples * sizeof (int16_t) * 2), SEEK_SET);
+	loadRenderState(r, &seg->checkpoint);
+	renderTicks(r, seg->startTick, false); // pre-roll
+	saveRenderState(r, &seg->startState);
 
-		uint32_t samplesLeft = numFadeOutSamples;
-		while (samplesLeft > 0)
+	renderSegmentOutput(seg);
+	return true;
+}
+
+static void startSegment(renderSegment_t *seg)
+{
+	seg->thread = SDL_CreateThread(segmentThreadFunc, "MOD2WAV segment thread", seg);
+	if (seg->thread == NULL)
+		segmentThreadFunc(seg); // render it on this thread then
+}
+
+/* Long songs are split into segments at order position boundaries, and the segments are rendered on
+** threads of their own, straight to their place in the output file.
+**
+** A fast pass through the song (Paula's voices and the dither are advanced, but nothing is mixed or
+** filtered, see mixerSkip()) stores a checkpoint of the render state a bit before each segment start.
+** The filter and downsampler states in the checkpoints are cleared, so a segment thread starts at its
+** checkpoint and renders up to the segment start without output (pre-roll), until these states have
+** settled to what a serial render would have. To be sure that the output is bit-identical to a serial
+** render, the state at each segment start is compared to the previous segment's end state when all
+** are done, and a segment is rendered again from the exact state if they differ (this is rare).
+**
+** Returns false if the song can't be rendered this way (nothing has been rendered then).
+*/
+static bool renderInSegments(mod2WavRender_t *c, module_t *m, int32_t maxThreads)
+{
+	if (maxThreads > MAX_RENDER_SEGMENTS)
+		maxThreads = MAX_RENDER_SEGMENTS;
+
+	/* Stems have more filter states, EFx/E8x modify the sample data (not part of the checkpoints),
+	** and FLAC frames have no fixed place in the file.
+	*/
+	if (maxThreads < 2 || c->settings.stems || c->settings.flac || moduleModifiesSampleData(m, c->settings.enableE8xEffect))
+		return false;
+
+	const uint32_t totalSamples = c->totalSamples;
+
+	int32_t numSegments = totalSamples / (c->settings.outputRate * MIN_SEGMENT_SECONDS);
+	if (numSegments > maxThreads)
+		numSegments = maxThreads;
+
+	if (numSegments < 2)
+		return false;
+
+	renderSegment_t *scan = createSegment(c, m, false);
+	if (scan == NULL)
+		return false;
+
+	mod2WavRender_t *s = &scan->r;
+
+	renderSegment_t *segment[MAX_RENDER_SEGMENTS];
+	memset(segment, 0, sizeof (segment));
+
+	segment[0] = createSegment(c, m, true);
+	if (segment[0] == NULL)
+	{
+		freeSegment(scan);
+		return false;
+	}
+
+	saveRenderState(s, &segment[0]->checkpoint); // (the first segment has no pre-roll)
+	segment[0]->startTick = 0;
+
+	const uint32_t prerollSamples = c->settings.outputRate * SEGMENT_PREROLL_SECONDS;
+
+	int32_t numStarts = 1; // segments with a known start
+	bool checkpointStored = false; // for segment[numStarts]
+	int16_t lastPos = -1;
+
+	while (numStarts < numSegments && !s->renderDone && !renderAborted(c))
+	{
+		int16_t pos;
+		int8_t row;
+
+		bool newOrder = false;
+		if (replayerGetUpcomingRow(s->replayer, &pos, &row))
 		{
-			uint32_t samplesTodo = FADEOUT_CHUNK_SAMPLES;
-			if (samplesTodo > samplesLeft)
-				samplesTodo = samplesLeft;
+			newOrder = (pos != lastPos);
+			lastPos = pos;
+		}
 
-			fread(fadeOutBuffer, sizeof (int16_t), samplesTodo * 2, f);
-			fseek(f, 0 - (samplesTodo * sizeof (int16_t) * 2), SEEK_CUR);
+		if (checkpointStored && newOrder && s->sampleCounter >= segment[numStarts]->checkpoint.sampleCounter + prerollSamples)
+		{
+			// the next segment starts here, so the previous one is complete and can be rendered now
+			segment[numStarts]->startTick = s->tickCounter;
+			segment[numStarts-1]->endTick = s->tickCounter;
+			startSegment(segment[numStarts-1]);
 
-			// apply fadeout
-			for (uint32_t i = 0; i < samplesTodo; i++)
-			{
-				fadeOutBuffer[(i*2)+0] = (int16_t)(fadeOutBuffer[(i*2)+0] * dFadeOutVal); // L
-				fadeOutBuffer[(i*2)+1] = (int16_t)(fadeOutBuffer[(i*2)+1] * dFadeOutVal); // R
-				dFadeOutVal -= dFadeOutDelta;
-			}
+			checkpointStored = false;
+			numStarts++;
+		}
+
+		const uint32_t segmentStart = (uint32_t)(((uint64_t)totalSamples * numStarts) / numSegments);
+		if (numStarts < numSegments && !checkpointStored && s->sampleCounter+prerollSamples >= segmentStart)
+		{
+			segment[numStarts] = createSegment(c, m, true);
+			if (segment[numStarts] == NULL)
+				break; // out of memory, go with the segments we have
+
+			saveRenderState(s, &segment[numStarts]->checkpoint);
+			checkpointStored = true;
+		}
+
+		skipTick(s);
+	}
+
+	if (checkpointStored) // no start was found for this one
+	{
+		freeSegment(segment[numStarts]);
+		segment[numStarts] = NULL;
+	}
+
+	freeSegment(scan);
+
+	// the last segment goes on to the end of the song
+	segment[numStarts-1]->endTick = UINT64_MAX;
+	startSegment(segment[numStarts-1]);
+
+	for (int32_t i = 0; i < numStarts; i++)
+	{
+		if (segment[i]->thread != NULL)
+		{
+			SDL_WaitThread(segment[i]->thread, NULL);
+			segment[i]->thread = NULL;
+		}
+	}
+
+	// check the joins, render a segment again if the filters hadn't settled at its start
+	for (int32_t i = 1; i < numStarts && !renderAborted(c); i++)
+	{
+		if (memcmp(&segment[i-1]->endState, &segment[i]->startState, sizeof (renderState_t)) != 0)
+		{
+			loadRenderState(&segment[i]->r, &segment[i-1]->endState);
+			renderSegmentOutput(segment[i]);
+		}
+	}
+
+	c->sampleCounter = segment[numStarts-1]->r.sampleCounter;
+
+	for (int32_t i = 0; i < numStarts; i++)
+	{
+		c->writeWaitTime64 += segment[i]->r.writeWaitTime64;
+		freeSegment(segment[i]);
+	}
+
+	return true;
+}
+
+// the output length, from a pass through the song with a replayer of its own (no mixing, the sample data is left as it is)
+static bool measureSongLength(mod2WavRender_t *c, module_t *m)
+{
+	renderSegment_t *scan = createSegment(c, m, false);
+	if (scan == NULL)
+		return false;
+
+	mod2WavRender_t *s = &scan->r;
+	s->replayer->keepSampleData = true;
+
+	while (!s->renderDone)
+		nextTick(s);
+
+	c->totalSamples = s->sampleCounter;
 
-			fwrite(fadeOutBuffer, sizeof (int16_t), samplesTodo * 2, f);
+	freeSegment(scan);
+	return true;
+}
+
+/* Renders the song to the opened output files. The output length is known before rendering, so the
+** WAV header is written first and the fadeout is applied to the render buffers, and the files are
+** written once from start to end (segments write their part at its place in the file).
+*/
+static void renderModule(mod2WavRender_t *c, module_t *m, int32_t maxThreads)
+{
+	ASSERT(c->numOutputFiles > 0 && c->buffer[0][0] != NULL && c->file[0] != NULL);
+
+	if (c->totalSamples == 0) // not given by the caller
+		measureSongLength(c, m);
+
+	const uint32_t bytesPerFrame = getBytesPerSample(c->settings.outputFormat) * 2;
+
+	for (int32_t i = 0; i < c->numOutputFiles; i++)
+	{
+		if (c->flac[i] != NULL)
+			flacEncoderStart(c->flac[i], c->totalSamples);
+		else
+			writeWavHeader(c, c->file[i], c->totalSamples, bytesPerFrame);
+
+		fflush(c->file[i]); // (segments write through file handles of their own)
+	}
+
+	resetRenderPosition(c);
+
+	if (!renderInSegments(c, m, maxThreads))
+	{
+		startWriter(c);
+		renderTicks(c, UINT64_MAX, true);
+		stopWriter(c);
+	}
 
-			samplesLeft -= samplesTodo;
+	const uint32_t sampleCounter = c->sampleCounter;
+
+	// the song length (from the song duration calculator or measureSongLength()) and the render must agree
+	c->lengthMismatch = !renderAborted(c) && c->totalSamples != 0 && sampleCounter != c->totalSamples;
+	ASSERT(!c->lengthMismatch);
+
+	if (c->abortable)
+		ui.updateMod2WavDialog = true;
+
+	for (int32_t i = 0; i < c->numOutputFiles; i++)
+	{
+		if (c->flac[i] != NULL)
+		{
+			flacEncoderFinish(c->flac[i]); // (also fixes up the header if needed)
+		}
+		else if (sampleCounter != c->totalSamples) // aborted (or the length was unknown), fix up the header
+		{
+			rewind(c->file[i]);
+			writeWavHeader(c, c->file[i], sampleCounter, bytesPerFrame);
 		}
 
-		fclose(f);
+		fclose(c->file[i]);
+		c->file[i] = NULL;
 	}
 
+	freeRenderBuffers(c);
+}
+
+static int32_t mod2WavThreadFunc(void *ptr)
+{
+	renderModule(&guiRender, song, SDL_GetCPUCount());
+
 	ui.mod2WavFinished = true;
 	ui.updateMod2WavDialog = true;
 
 	if (editor.abortMod2Wav)
 		editor.mod2WavOngoing = false;
 
+	(void)ptr;
 	return true;
 }
 
@@ -349,25 +1135,104 @@ static void setBackDirIfNeeded(void)
 		UNICHAR_CHDIR(editor.samplesPathU);
 }
 
+static bool hasExtension(const char *filename, const char *ext)
+{
+	const int32_t nameLen = (int32_t)strlen(filename);
+	const int32_t extLen = (int32_t)strlen(ext);
+
+	return nameLen >= extLen && !_stricmp(&filename[nameLen-extLen], ext);
+}
+
+// "name.wav" -> "name_ch1.wav" (voice 0), same for .flac
+static void getStemFilename(char *stemFilename, const char *filename, int32_t voice)
+{
+	const char *ext = hasExtension(filename, ".flac") ? ".flac" : ".wav";
+
+	int32_t nameLen = (int32_t)strlen(filename);
+	if (hasExtension(filename, ext))
+		nameLen -= (int32_t)strlen(ext);
+
+	if (nameLen > PATH_MAX-13)
+		nameLen = PATH_MAX-13;
+
+	memcpy(stemFilename, filename, nameLen);
+	sprintf(&stemFilename[nameLen], "_ch%d%s", voice+1, ext);
+}
+
+// also takes the MOD2WAV settings from config and editor (they are only read)
+static void setOutputFilenames(mod2WavRender_t *c, const char *filename)
+{
+	memset(&c->settings, 0, sizeof (renderSettings_t));
+
+	c->settings.stems = config.mod2WavStems;
+	c->settings.flac = hasExtension(filename, ".flac");
+	c->settings.outputFormat = config.mod2WavOutputFormat;
+
+	if (c->settings.flac && c->settings.outputFormat == OUTPUT_FORMAT_FLOAT)
+		c->settings.outputFormat = OUTPUT_FORMAT_24BIT; // FLAC has no float format
+
+	c->settings.outputRate = config.mod2WavOutputFreq;
+	c->settings.numLoops = editor.mod2WavNumLoops;
+	c->settings.fadeOut = editor.mod2WavFadeOut;
+	c->settings.fadeOutSeconds = editor.mod2WavFadeOutSeconds;
+	c->settings.enableE8xEffect = config.enableE8xEffect;
+	c->settings.vblankTiming = (editor.timingMode == TEMPO_MODE_VBLANK);
+
+	c->numOutputFiles = c->settings.stems ? PAULA_VOICES : 1;
+
+	for (int32_t i = 0; i < MAX_OUTPUT_FILES; i++)
+		c->filename[i][0] = '\0';
+
+	if (c->settings.stems)
+	{
+		for (int32_t i = 0; i < c->numOutputFiles; i++)
+			getStemFilename(c->filename[i], filename, i);
+	}
+	else
+	{
+		strncpy(c->filename[0], filename, PATH_MAX-1);
+	}
+}
+
+static bool openOutputFiles(mod2WavRender_t *c)
+{
+	for (int32_t i = 0; i < c->numOutputFiles; i++)
+	{
+		c->file[i] = fopen(c->filename[i], "wb");
+		if (c->file[i] == NULL)
+		{
+			closeOutputFiles(c);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool mod2WavRender(char *filename)
 {
 	struct stat statBuffer;
 
-	lastFilename[0] = '\0'; // for rendering-thread
+	mod2WavRender_t *c = &guiRender;
 
+	setOutputFilenames(c, filename);
 	assureModulesDir();
 
-	if (stat(filename, &statBuffer) == 0)
+	for (int32_t i = 0; i < c->numOutputFiles; i++)
 	{
-		if (!askBox(ASKBOX_YES_NO, "OVERWRITE FILE?"))
+		if (stat(c->filename[i], &statBuffer) == 0)
 		{
-			setBackDirIfNeeded();
-			return false;
+			if (!askBox(ASKBOX_YES_NO, c->settings.stems ? "OVERWRITE FILES?" : "OVERWRITE FILE?"))
+			{
+				setBackDirIfNeeded();
+				return false;
+			}
+
+			break; // only ask once
 		}
 	}
 
-	FILE *fOut = fopen(filename, "wb");
-	if (fOut == NULL)
+	if (!openOutputFiles(c))
 	{
 		displayErrorMsg("FILE I/O ERROR");
 		setBackDirIfNeeded();
@@ -376,44 +1241,53 @@ bool mod2WavRender(char *filename)
 
 	setBackDirIfNeeded();
 
-	strncpy(lastFilename, filename, PATH_MAX-1); // for rendering-thread
+	// same as the live playback (segments have their own replayers, see renderInSegments())
+	c->settings.amigaModel = (uint8_t)audio.amigaModel;
+	c->settings.stereoSeparation = audioGetStereoSeparation();
+	c->settings.ledFilter = audio.ledFilterEnabled; // inherit current "LED" filter state from the live Paula
+	c->settings.metroChannel = editor.metroFlag ? editor.metroChannel : 0;
+	c->settings.metroSpeed = editor.metroSpeed;
 
-	const int32_t paulaMixFrequency = config.mod2WavOutputFreq * 2; // *2 for oversampling (we always do oversampling in MOD2WAV)
-	int32_t maxSamplesPerTick = (int32_t)ceil(paulaMixFrequency / (MIN_BPM / 2.5)) + 1;
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		c->settings.muted[i] = editor.muted[i];
 
-	mod2WavBuffer = (int16_t *)malloc((TICKS_PER_RENDER_CHUNK * maxSamplesPerTick) * sizeof (int16_t) * 2);
-	if (mod2WavBuffer == NULL)
+	if (!initRender(c))
 	{
-		fclose(fOut);
+		freeRender(c);
+		closeOutputFiles(c);
 		statusOutOfMemory();
 		return false;
 	}
 
+	c->trackerRender = true;
+	c->abortable = true;
+	c->replayer = &replayer;
+
 	// wait for main audio callback to catch MOD2WAV flag
 	editor.mod2WavOngoing = true;
 	while (audio.callbackOngoing)
 		SDL_Delay(5);
 
 	// do some prep work
-	audio.oversamplingFlag = true;
-	generateBpmTable(config.mod2WavOutputFreq, editor.timingMode == TEMPO_MODE_VBLANK);
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
+	setReplayerPaula(c->paula);
 	storeTempVariables();
-	calcMod2WavTotalRows();
-	restartSong(); // this also updates BPM (samples per tick) with the MOD2WAV audio output rate
-	clearDownsample2xStates();
+	replayerResetChannels(&replayer); // start from a clean state (pattern loop positions etc.), so that the duration is exact
+	restartSong();
+
+	const songDuration_t *duration = getSongDuration(song, c->settings.outputRate, c->settings.numLoops);
+	c->totalSamples = (duration != NULL) ? (uint32_t)duration->totalSamples : 0;
 
 	drawMod2WavProgressDialog();
 	editor.abortMod2Wav = false;
 
 	pointerSetMode(POINTER_MODE_MSG2, NO_CARRY);
-	setStatusMessage("RENDERING MOD...", NO_CARRY);
+	setStatusMessage(c->settings.stems ? "RENDERING STEMS..." : "RENDERING MOD...", NO_CARRY);
 
-	editor.mod2WavThread = SDL_CreateThread(mod2WavThreadFunc, "MOD2WAV thread", fOut);
+	renderStartTime64 = SDL_GetPerformanceCounter();
+	editor.mod2WavThread = SDL_CreateThread(mod2WavThreadFunc, "MOD2WAV thread", NULL);
 	if (editor.mod2WavThread == NULL)
 	{
-		fclose(fOut);
-		free(mod2WavBuffer);
+		closeOutputFiles(c);
 
 		doStopIt(true);
 
@@ -431,125 +1305,60 @@ bool mod2WavRender(char *filename)
 	return true;
 }
 
-#define CALC__END_OF_SONG \
-if (--numLoops < 0) \
-{ \
-	calcingRows = false; \
-	break; \
-} \
-else \
-{ \
-	memset(editor.rowVisitTable, 0, 128 * MOD_ROWS); \
-}
-
-// ONLY used for a visual percentage counter, so accuracy is not very important
-static void calcMod2WavTotalRows(void)
+/* Renders a module synchronously on the calling thread, without any UI or global state,
+** so it can be called from several threads at once (each with its own module).
+** Uses the MOD2WAV settings in config/editor (only read) and overwrites existing files.
+** Long songs are rendered in parallel segments if maxThreads > 1 (see renderInSegments()).
+** Returns false on error (errorMsg is set). stats can be NULL.
+*/
+bool mod2WavRenderHeadless(module_t *m, const char *filename, int32_t maxThreads, mod2WavStats_t *stats, const char **errorMsg)
 {
-	int8_t n_pattpos[PAULA_VOICES], n_loopcount[PAULA_VOICES];
-
-	// for pattern loop
-	memset(n_pattpos,   0, sizeof (n_pattpos));
-	memset(n_loopcount, 0, sizeof (n_loopcount));
-
-	song->rowsCounter = song->rowsInTotal  = 0;
-
-	uint8_t modRow = 0;
-	int16_t modPos = 0;
-	uint16_t modPattern = song->header.patternTable[0];
-	uint8_t pBreakPosition = 0;
-	bool posJumpAssert = false;
-	bool pBreakFlag = false;
-
-	memset(editor.rowVisitTable, 0, 128 * MOD_ROWS);
-
-	int8_t numLoops = editor.mod2WavNumLoops; // make a copy
-
-	bool calcingRows = true;
-	while (calcingRows)
+	mod2WavRender_t *c = (mod2WavRender_t *)calloc(1, sizeof (mod2WavRender_t));
+	if (c == NULL)
 	{
-		editor.rowVisitTable[(modPos * MOD_ROWS) + modRow] = true;
+		*errorMsg = "Out of memory";
+		return false;
+	}
 
-		for (int32_t ch = 0; ch < PAULA_VOICES; ch++)
-		{
-			note_t *note = &song->patterns[modPattern][(modRow * PAULA_VOICES) + ch];
-			if (note->command == 0x0B) // Bxx - Position Jump
-			{
-				modPos = note->param - 1;
-				pBreakPosition = 0;
-				posJumpAssert = true;
-			}
-			else if (note->command == 0x0D) // Dxx - Pattern Break
-			{
-				pBreakPosition = (((note->param >> 4) * 10) + (note->param & 0x0F));
-				if (pBreakPosition > 63)
-					pBreakPosition = 0;
+	setOutputFilenames(c, filename);
+	c->settings.amigaModel = config.amigaModel;
+	c->settings.stereoSeparation = config.stereoSeparation;
 
-				posJumpAssert = true;
-			}
-			else if (note->command == 0x0F && note->param == 0) // F00 - Set Speed 0 (stop)
-			{
-				CALC__END_OF_SONG
-			}
-			else if (note->command == 0x0E && (note->param >> 4) == 0x06) // E6x - Pattern Loop
-			{
-				uint8_t pos = note->param & 0x0F;
-				if (pos == 0)
-				{
-					n_pattpos[ch] = modRow;
-				}
-				else if (n_loopcount[ch] == 0)
-				{
-					n_loopcount[ch] = pos;
-
-					pBreakPosition = n_pattpos[ch];
-					pBreakFlag = true;
-
-					for (pos = pBreakPosition; pos <= modRow; pos++)
-						editor.rowVisitTable[(modPos * MOD_ROWS) + pos] = false;
-				}
-				else if (--n_loopcount[ch])
-				{
-					pBreakPosition = n_pattpos[ch];
-					pBreakFlag = true;
-
-					for (pos = pBreakPosition; pos <= modRow; pos++)
-						editor.rowVisitTable[(modPos * MOD_ROWS) + pos] = false;
-				}
-			}
-		}
+	if (!openOutputFiles(c))
+	{
+		free(c);
+		*errorMsg = "Couldn't open the output file for writing";
+		return false;
+	}
 
-		modRow++;
-		song->rowsInTotal++;
+	if (!initRender(c))
+	{
+		freeRender(c);
+		closeOutputFiles(c);
+		free(c);
+		*errorMsg = "Out of memory";
+		return false;
+	}
 
-		if (pBreakFlag)
-		{
-			modRow = pBreakPosition;
-			pBreakPosition = 0;
-			pBreakFlag = false;
-		}
+	initOwnReplayer(c, m);
+	renderModule(c, m, maxThreads);
 
-		if (modRow >= MOD_ROWS || posJumpAssert)
-		{
-			modRow = pBreakPosition;
-			pBreakPosition = 0;
-			posJumpAssert = false;
+	if (stats != NULL)
+	{
+		stats->framesRendered = c->sampleCounter;
+		stats->dWriteWaitSecs = (double)c->writeWaitTime64 / hpcFreq.freq64;
+	}
 
-			modPos = (modPos + 1) & 127;
-			if (modPos >= song->header.songLength)
-			{
-				modPos = 0;
-				CALC__END_OF_SONG
-			}
+	const bool lengthMismatch = c->lengthMismatch;
 
-			modPattern = song->header.patternTable[modPos];
-			if (modPattern > MAX_PATTERNS-1)
-				modPattern = MAX_PATTERNS-1;
-		}
+	freeRender(c);
+	free(c);
 
-		if (calcingRows && editor.rowVisitTable[(modPos * MOD_ROWS) + modRow])
-		{
-			// row has been visited before, we're now done!
-			CALC__END_OF_SONG
-		}
+	if (lengthMismatch)
+	{
+		*errorMsg = "The rendered length differs from the measured song length";
+		return false;
 	}
+
+	return true;
 }
@@ -1,12 +1,20 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
+#include "pt2_module.h"
 
 #define MOD2WAV_CANCEL_BTN_X1 193
 #define MOD2WAV_CANCEL_BTN_X2 247
 #define MOD2WAV_CANCEL_BTN_Y1 81
 #define MOD2WAV_CANCEL_BTN_Y2 92
 
+typedef struct mod2WavStats_t
+{
+	uint32_t framesRendered;
+	double dWriteWaitSecs; // time the render thread(s) had to wait for the output writes
+} mod2WavStats_t;
+
 void mod2WavDrawFadeoutToggle(void);
 void mod2WavDrawFadeoutSeconds(void);
 void mod2WavDrawLoopCount(void);
@@ -18,3 +26,5 @@ void mod2WavLoopCountDown(void);
 
 void updateMod2WavDialog(void);
 bool mod2WavRender(char *filename);
+bool mod2WavGetLastStats(mod2WavStats_t *stats); // of the last GUI render (false if there was none yet)
+bool mod2WavRenderHeadless(module_t *m, const char *filename, int32_t maxThreads, mod2WavStats_t *stats, const char **errorMsg); // synchronous and thread-safe (command-line)
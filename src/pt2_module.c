@@ -0,0 +1,97 @@
+// for finding memory leaks in debug mode with Visual Studio 
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_replay_header.h"
+#include "pt2_module.h"
+
+module_t *moduleCreate(int32_t maxSampleLength)
+{
+	module_t *m = (module_t *)calloc(1, sizeof (module_t));
+	if (m == NULL)
+		goto error;
+
+	m->maxSampleLength = maxSampleLength;
+
+	// allocate memory for all sample data blocks (+ 2 extra, for quirk + safety)
+	const size_t allocLen = (MOD_SAMPLES + 2) * maxSampleLength;
+
+	m->sampleData = (int8_t *)calloc(allocLen, 1);
+	if (m->sampleData == NULL)
+		goto error;
+
+	for (int32_t i = 0; i < MAX_PATTERNS; i++)
+	{
+		m->patterns[i] = (note_t *)calloc(1, MOD_ROWS * sizeof (note_t) * PAULA_VOICES);
+		if (m->patterns[i] == NULL)
+			goto error;
+	}
+
+	m->header.songLength = 1;
+	m->header.initialTempo = 125;
+
+	moduleSample_t *s = m->samples;
+	for (int32_t i = 0; i < MOD_SAMPLES; i++, s++)
+	{
+		// setup GUI text pointers
+		s->volumeDisp = &s->volume;
+		s->lengthDisp = &s->length;
+		s->loopStartDisp = &s->loopStart;
+		s->loopLengthDisp = &s->loopLength;
+
+		s->loopLength = 2;
+
+		// sample data offsets (sample data = one huge buffer to rule them all)
+		s->offset = maxSampleLength * i;
+	}
+
+	return m;
+
+error:
+	moduleFree(m);
+	return NULL;
+}
+
+void moduleFree(module_t *m)
+{
+	if (m == NULL)
+		return;
+
+	for (int32_t i = 0; i < MAX_PATTERNS; i++)
+	{
+		if (m->patterns[i] != NULL)
+			free(m->patterns[i]);
+	}
+
+	if (m->sampleData != NULL)
+		free(m->sampleData);
+
+	free(m);
+}
+
+bool moduleModifiesSampleData(const module_t *m, bool enableE8xEffect)
+{
+	for (int32_t i = 0; i < m->header.songLength; i++)
+	{
+		const int32_t pattern = m->header.patternTable[i];
+		if (pattern > MAX_PATTERNS-1 || m->patterns[pattern] == NULL)
+			continue;
+
+		const note_t *note = m->patterns[pattern];
+		for (int32_t j = 0; j < MOD_ROWS * PAULA_VOICES; j++, note++)
+		{
+			if (note->command != 0xE)
+				continue;
+
+			const uint8_t ecmd = note->param >> 4;
+			if ((ecmd == 0xF && (note->param & 0xF) > 0) || (ecmd == 0x8 && enableE8xEffect))
+				return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_replay_header.h"
+#include "pt2_paula.h" // PAULA_VOICES
+
+typedef struct note_t
+{
+	uint8_t param, sample, command;
+	uint16_t period;
+} note_t;
+
+typedef struct moduleHeader_t
+{
+	char name[20 + 1];
+	uint16_t patternTable[128], songLength;
+	uint16_t initialTempo; // used for STK/UST modules after module is loaded
+} moduleHeader_t;
+
+typedef struct moduleSample_t
+{
+	volatile int8_t *volumeDisp;
+	volatile int32_t *lengthDisp, *loopStartDisp, *loopLengthDisp;
+	char text[22 + 1];
+	int8_t volume;
+	uint8_t fineTune;
+	int32_t offset, length, loopStart, loopLength;
+} moduleSample_t;
+
+struct replayer_t; // pt2_replay.h
+
+typedef struct moduleChannel_t
+{
+	int8_t *n_start, *n_wavestart, *n_loopstart, n_volume, n_dmabit;
+	int8_t n_toneportdirec, n_pattpos, n_loopcount;
+	uint8_t n_wavecontrol, n_glissfunk, n_sampleoffset, n_toneportspeed;
+	uint8_t n_vibratocmd, n_tremolocmd, n_finetune, n_funkoffset, n_samplenum;
+	uint8_t n_vibratopos, n_tremolopos;
+	int16_t n_period, n_note, n_wantedperiod;
+	uint16_t n_cmd, n_length, n_replen;
+	uint32_t n_scopedelta, n_chanindex;
+
+	// effect of the current row, decoded when the row is read (see decodeEffect() in pt2_replay.c)
+	void (*n_rowfx)(struct replayer_t *r, struct moduleChannel_t *ch); // tick 0
+	void (*n_tickfx)(struct replayer_t *r, struct moduleChannel_t *ch); // tick 1..speed-1 (and pattern delay)
+	const int16_t *n_periods; // period table for n_finetune
+	uint8_t n_fxcmd, n_param, n_paramx, n_paramy; // n_cmd split up
+
+	// for pt2_visuals_sync.c
+	uint8_t syncFlags;
+	int8_t syncAnalyzerVolume, syncVuVolume;
+	uint16_t syncAnalyzerPeriod;
+} moduleChannel_t;
+
+enum // moduleChannel_t.syncFlags (same bits as the visuals sync flags)
+{
+	UPDATE_VUMETER = 64,
+	UPDATE_SPECTRUM_ANALYZER = 128
+};
+
+// song data only, the playback state is in replayer_t (pt2_replay.h)
+typedef struct module_t
+{
+	bool loaded, modified;
+	int8_t *sampleData;
+	int32_t maxSampleLength; // sample data slot size (sample N is at sampleData[N * maxSampleLength])
+
+	moduleHeader_t header;
+	moduleSample_t samples[MOD_SAMPLES];
+	note_t *patterns[MAX_PATTERNS];
+
+	// for pattern viewer
+	int8_t currRow;
+	int32_t currSpeed, currBPM;
+	uint16_t currPos, currPattern;
+} module_t;
+
+module_t *moduleCreate(int32_t maxSampleLength); // returns NULL on out-of-memory
+void moduleFree(module_t *m);
+
+/* True if the song uses EFx (invert loop) or E8x (Karplus-Strong, if enabled), which modify the
+** sample data while playing. Playback states of such songs can't be saved and restored.
+*/
+bool moduleModifiesSampleData(const module_t *m, bool enableE8xEffect);
@@ -25,200 +25,33 @@
 #include "pt2_visuals.h"
 #include "pt2_sample_loader.h"
 #include "pt2_config.h"
-#include "modloaders/pt2_load_mod15.h"
-#include "modloaders/pt2_load_mod31.h"
-#include "modloaders/pt2_xpk_unpack.h"
-#include "modloaders/pt2_pp_unpack.h"
+#include "modloaders/pt2_load_module.h"
 #include "pt2_askbox.h"
 #include "pt2_posed.h"
 
-static void fixZeroesInString(char *str, uint32_t maxLength); // converts zeroes to spaces in a string, up until the last zero found
-
 module_t *modLoad(UNICHAR *fileName)
 {
-	uint32_t powerPackerID;
-
-	uint8_t *modBuffer = NULL;
-	module_t *newMod = NULL;
+	const char *errorMsg = NULL;
 
 	FILE *f = UNICHAR_FOPEN(fileName, "rb");
 	if (f == NULL)
 	{
 		displayErrorMsg("FILE I/O ERROR !");
-		goto loadError;
+		return NULL;
 	}
 
-	fseek(f, 0, SEEK_END);
-	uint32_t filesize = ftell(f);
-	rewind(f);
-
-	// check if mod is a powerpacker mod
-	fread(&powerPackerID, 4, 1, f);
-	if (powerPackerID == 0x30325850) // "PX20"
-	{
-		displayErrorMsg("ENCRYPTED MOD !");
-		goto loadError;
-	}
-	else if (powerPackerID == 0x30325050) // "PP20"
-	{
-		modBuffer = unpackPP(f, &filesize);
-		if (modBuffer == NULL)
-		{
-			displayErrorMsg("PP UNPACK ERROR !");
-			goto loadError; // error msg is set in unpackPPModule()
-		}
-	}
-	else
-	{
-		if (detectXPK(f))
-		{
-			if (!unpackXPK(f, &filesize, &modBuffer))
-			{
-				displayErrorMsg("XPK UNPACK ERROR");
-				goto loadError;
-			}
-
-			if (modBuffer == NULL)
-			{
-				statusOutOfMemory();
-				goto loadError;
-			}
-
-			fclose(f);
-		}
-		else
-		{
-			modBuffer = (uint8_t *)malloc(filesize);
-			if (modBuffer == NULL)
-			{
-				statusOutOfMemory();
-				goto loadError;
-			}
-
-			rewind(f);
-			fread(modBuffer, 1, filesize, f);
-			fclose(f);
-		}
-	}
-
-	// read module is in now in modBuffer, time to load...
-
-	bool isMod31 = detectMod31(modBuffer, filesize);
-	if (isMod31)
-		newMod = loadMod31(modBuffer, filesize);
-	else
-		newMod = loadMod15(modBuffer, filesize);
-
-	free(modBuffer);
-	modBuffer = NULL;
+	module_t *newMod = moduleLoadFile(f, config.maxSampleLength, &errorMsg);
+	fclose(f);
 
 	if (newMod == NULL)
 	{
-		// error message is shown in the mod loader
-		goto loadError;
-	}
-
-	// module is loaded, do some sanitation...
-
-	newMod->header.name[20] = '\0';
+		if (errorMsg != NULL)
+			displayErrorMsg(errorMsg);
 
-	// convert illegal song name characters to space
-	for (int32_t i = 0; i < 20; i++)
-	{
-		char tmpChar = newMod->header.name[i];
-		if ((tmpChar < ' ' || tmpChar > '~') && tmpChar != '\0')
-			tmpChar = ' ';
-
-		newMod->header.name[i] = tmpChar;
+		return NULL;
 	}
 
-	fixZeroesInString(newMod->header.name, 20);
-
-	moduleSample_t *s = newMod->samples;
-	for (int32_t i = 0; i < MOD_SAMPLES; i++, s++)
-	{
-		s->text[22] = '\0';
-
-		// convert illegal sample name characters to space
-		for (int32_t j = 0; j < 22; j++)
-		{
-			char tmpChar = s->text[j];
-			if ((tmpChar < ' ' || tmpChar > '~') && tmpChar != '\0')
-				tmpChar = ' ';
-
-			s->text[j] = tmpChar;
-		}
-
-		fixZeroesInString(s->text, 22);
-
-		if (s->length > config.maxSampleLength)
-			s->length = config.maxSampleLength;
-
-		if ((uint8_t)s->volume > 64)
-			s->volume = 64;
-
-		if (s->loopLength < 2)
-			s->loopLength = 2;
-
-		// we don't support samples bigger than 65534 (or 128kB) bytes, disable uncompatible loops
-		if (s->loopStart > config.maxSampleLength || s->loopStart+s->loopLength > config.maxSampleLength)
-		{
-			s->loopStart = 0;
-			s->loopLength = 2;
-		}
-
-		// some modules are broken like this, adjust sample length if possible (this is ok if we have room)
-		if (s->length > 0 && s->loopLength > 2 && s->loopStart+s->loopLength > s->length)
-		{
-			int32_t loopOverflowVal = (s->loopStart + s->loopLength) - s->length;
-			if (s->length+loopOverflowVal <= config.maxSampleLength)
-			{
-				s->length += loopOverflowVal; // this is safe, we're allocating 65534 bytes per sample slot
-			}
-			else
-			{
-				s->loopStart = 0;
-				s->loopLength = 2;
-			}
-		}
-
-		// clear first two bytes of non-looping samples to prevent beep after sample has been played
-		if (s->length >= 2 && s->loopStart+s->loopLength <= 2)
-		{
-			newMod->sampleData[s->offset+0] = 0;
-			newMod->sampleData[s->offset+1] = 0;
-		}
-	}
-	
-	initializeModuleChannels(newMod);
 	return newMod;
-
-loadError:
-	if (modBuffer != NULL)
-		free(modBuffer);
-
-	return NULL;
-}
-
-static void fixZeroesInString(char *str, uint32_t maxLength)
-{
-	int32_t i;
-
-	for (i = maxLength-1; i >= 0; i--)
-	{
-		if (str[i] != '\0')
-			break;
-	}
-
-	// convert zeroes to spaces
-	if (i > 0)
-	{
-		for (int32_t j = 0; j < i; j++)
-		{
-			if (str[j] == '\0')
-				str[j] = ' ';
-		}
-	}
 }
 
 void setupLoadedMod(void)
@@ -249,7 +82,7 @@ void setupLoadedMod(void)
 	editor.editMoveAdd = 1;
 	editor.currSample = 0;
 
-	editor.playbackSeconds = editor.playbackSecondsFrac = 0;
+	replayer.playbackSeconds = replayer.playbackSecondsFrac = 0;
 	editor.modLoaded = true;
 	editor.blockMarkFlag = false;
 	editor.sampleZero = false;
@@ -264,7 +97,7 @@ void setupLoadedMod(void)
 	updateReplayerTimingMode();
 
 	modSetSpeed(6);
-	modSetTempo(song->header.initialTempo, false); // 125 for normal MODs, custom value for certain STK/UST MODs
+	modSetTempo(replayerGetStartTempo(song), false); // 125 for normal MODs, custom value for certain STK/UST MODs
 
 	updateCurrSample();
 	editor.samplePos = 0;
@@ -3048,7 +3048,7 @@ static bool handleGUIButtons(int32_t button) // are you prepared to enter the ju
 				renderAboutScreen();
 			else if (ui.visualizerMode == VISUAL_QUADRASCOPE)
 				renderQuadrascopeBg();
-			else if (ui.visualizerMode == VISUAL_SPECTRUM)
+			else
 				renderSpectrumAnalyzerBg();
 		}
 		break;
@@ -3527,7 +3527,7 @@ static bool handleGUIButtons(int32_t button) // are you prepared to enter the ju
 		{
 			if (askBox(ASKBOX_MOD2WAV, "PLEASE SELECT"))
 			{
-				char fileName[20 + 4 + 1];
+				char fileName[20 + 5 + 1];
 
 				memset(fileName, 0, sizeof (fileName));
 
@@ -3540,11 +3540,11 @@ static bool handleGUIButtons(int32_t button) // are you prepared to enter the ju
 						sanitizeFilenameChar(&fileName[i]);
 					}
 
-					strcat(fileName, ".wav");
+					strcat(fileName, config.mod2WavFlac ? ".flac" : ".wav");
 				}
 				else
 				{
-					strcpy(fileName, "untitled.wav");
+					strcpy(fileName, config.mod2WavFlac ? "untitled.flac" : "untitled.wav");
 				}
 
 				mod2WavRender(fileName);
@@ -3765,14 +3765,17 @@ static bool handleGUIButtons(int32_t button) // are you prepared to enter the ju
 			}
 			else if (!mouse.rightButtonPressed)
 			{
-				ui.visualizerMode = (ui.visualizerMode + 1) % 2;
-				if (ui.visualizerMode == VISUAL_SPECTRUM)
+				ui.visualizerMode = (ui.visualizerMode + 1) % 3;
+				if (ui.visualizerMode != VISUAL_QUADRASCOPE)
+				{
 					memset((int8_t *)editor.spectrumVolumes, 0, sizeof (editor.spectrumVolumes));
+					displayMsg(ui.visualizerMode == VISUAL_FFT_SPECTRUM ? "SPECTRUM: FFT" : "SPECTRUM: FAKE");
+				}
 			}
 
 			if (ui.visualizerMode == VISUAL_QUADRASCOPE)
 				renderQuadrascopeBg();
-			else if (ui.visualizerMode == VISUAL_SPECTRUM)
+			else
 				renderSpectrumAnalyzerBg();
 		}
 		break;
@@ -4029,8 +4032,8 @@ static bool handleGUIButtons(int32_t button) // are you prepared to enter the ju
 			ui.editOpScreenShown = false;
 			ui.aboutScreenShown = false;
 
-			     if (ui.visualizerMode == VISUAL_QUADRASCOPE) renderQuadrascopeBg();
-			else if (ui.visualizerMode == VISUAL_SPECTRUM) renderSpectrumAnalyzerBg();
+			if (ui.visualizerMode == VISUAL_QUADRASCOPE) renderQuadrascopeBg();
+			else renderSpectrumAnalyzerBg();
 
 			updateWindowTitle(MOD_IS_MODIFIED);
 		}
@@ -29,6 +29,7 @@ static uint8_t pat2SmpStartRow = 0, pat2SmpRows = 32;
 static int32_t pat2SmpPos;
 static float *fMixBufferL, *fMixBufferR, *fPat2SmpBuf;
 static double dPat2SmpFreq, dSeconds;
+static paula_t *pat2SmpPaula;
 
 static void pat2SmpOutputAudio(int32_t numSamples, bool outputEnable)
 {
@@ -37,7 +38,7 @@ static void pat2SmpOutputAudio(int32_t numSamples, bool outputEnable)
 	if (outputEnable && pat2SmpPos+samplesTodo > config.maxSampleLength)
 		samplesTodo = config.maxSampleLength - pat2SmpPos;
 
-	paulaGenerateSamples(fMixBufferL, fMixBufferR, samplesTodo*2); // 2x oversampling
+	paulaGenerateSamples(pat2SmpPaula, fMixBufferL, fMixBufferR, samplesTodo*2); // 2x oversampling
 
 	if (outputEnable)
 	{
@@ -234,18 +235,23 @@ void pat2SmpRender(void)
 
 	fMixBufferL = (float *)malloc(maxSamplesPerTick * sizeof (float));
 	fMixBufferR = (float *)malloc(maxSamplesPerTick * sizeof (float));
+	pat2SmpPaula = paulaCreate(dAudioFrequency, MODEL_A1200);
 
-	if (fMixBufferL == NULL || fMixBufferR == NULL)
+	if (fMixBufferL == NULL || fMixBufferR == NULL || pat2SmpPaula == NULL)
 	{
 		free(fPat2SmpBuf);
 
 		if (fMixBufferL != NULL) free(fMixBufferL);
 		if (fMixBufferR != NULL) free(fMixBufferR);
+		paulaDestroy(pat2SmpPaula);
 
 		statusOutOfMemory();
 		return;
 	}
 
+	paulaDisableFilters(pat2SmpPaula);
+	paulaWriteByte(pat2SmpPaula, 0xBFE001, (uint8_t)audio.ledFilterEnabled << 1); // inherit "LED" filter state
+
 	// wait for main audio callback to catch PAT2SMP flag
 	editor.pat2SmpOngoing = true;
 	while (audio.callbackOngoing)
@@ -255,13 +261,12 @@ void pat2SmpRender(void)
 
 	// do some prep work
 	generateBpmTable(dPat2SmpFreq, editor.timingMode == TEMPO_MODE_VBLANK);
-	paulaSetup(dPat2SmpFreq*2.0, MODEL_A1200);
-	paulaDisableFilters();
+	setReplayerPaula(pat2SmpPaula);
 	storeTempVariables();
 	restartSong(); // this also updates BPM (samples per tick) with the PAT2SMP audio output rate
 	clearDownsample2xStates();
 
-	song->currRow = song->row = 0;
+	song->currRow = replayer.row = 0;
 	pat2SmpPos = 0;
 
 	uint64_t samplesToMixFrac = 0;
@@ -277,7 +282,7 @@ void pat2SmpRender(void)
 		if (!tickReplayer())
 			lastRow = true;
 
-		if (song->row > pat2SmpStartRow+pat2SmpRows)
+		if (replayer.row > pat2SmpStartRow+pat2SmpRows)
 			break; // we rendered as many rows as requested (don't write this tick to output)
 
 		uint32_t samplesToMix = audio.samplesPerTickInt;
@@ -289,10 +294,10 @@ void pat2SmpRender(void)
 			samplesToMix++;
 		}
 
-		if (lastRow && song->tick == song->speed-1)
+		if (lastRow && replayer.tick == replayer.speed-1)
 			pat2SmpEndReached = true;
 
-		const bool outputEnableFlag = lastRow || song->row > pat2SmpStartRow;
+		const bool outputEnableFlag = lastRow || replayer.row > pat2SmpStartRow;
 		pat2SmpOutputAudio(samplesToMix, outputEnableFlag);
 	}
 	editor.pat2SmpOngoing = false;
@@ -300,11 +305,12 @@ void pat2SmpRender(void)
 	free(fMixBufferL);
 	free(fMixBufferR);
 
-	song->currRow = song->row = oldRow; // set back old row
+	song->currRow = replayer.row = oldRow; // set back old row
 
 	// set back audio configurations
-	const int32_t paulaMixFrequency = audio.oversamplingFlag ? audio.outputRate*2 : audio.outputRate;
-	paulaSetup(paulaMixFrequency, audio.amigaModel);
+	setReplayerPaula(audio.paula);
+	paulaDestroy(pat2SmpPaula);
+	pat2SmpPaula = NULL;
 	generateBpmTable(audio.outputRate, editor.timingMode == TEMPO_MODE_VBLANK);
 	clearDownsample2xStates();
 	resetSong(); // this also updates BPM (samples per tick) with the tracker's audio output rate
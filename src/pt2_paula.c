@@ -1,61 +1,67 @@
 /* Simple Paula emulator (with BLEP synthesis by aciddose).
 ** Limitation: The audio output frequency can't be below 31389Hz ( ceil(PAULA_PAL_CLK / 113.0) )
 **
-** WARNING: These functions must not be called while paulaGenerateSamples() is running!
-**          If so, lock the audio first so that you're sure it's not running.
+** All state lives in paula_t, so several instances can run on different threads at once.
+**
+** WARNING: These functions must not be called on an instance while paulaGenerateSamples() is
+**          running on that same instance! If so, lock the audio first so that you're sure it's
+**          not running. The paulaQueueWrite*() functions are the exception.
 */
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include "pt2_header.h" // PI
-#include "pt2_audio.h"
+#include "pt2_replay_header.h" // PI
 #include "pt2_paula.h"
-#include "pt2_blep.h"
-#include "pt2_rcfilters.h"
-
-typedef struct voice_t
-{
-	volatile bool active;
-
-	// internal registers
-	bool sampleJustStarted, nextSampleStage;
-	int8_t AUD_DAT[2]; // DMA data buffer
-	const int8_t *location; // current location
-	uint16_t lengthCounter; // current length
-	int32_t sampleCounter; // how many bytes left in AUD_DAT
-	float fSample; // currently held sample point (multiplied by volume)
-	float fDelta, fPhase;
-	float fBlepDelta, fBlepPhase;
-
-	// registers modified by Paula functions
-	const int8_t *storedLocation; // data pointer
-	uint16_t storedLength;
-	float fStoredVol, fStoredDelta;
-} paulaVoice_t;
-
-static bool useLEDFilter, useLowpassFilter, useHighpassFilter;
-static int8_t nullSample[0xFFFF*2]; // buffer for NULL data pointer
-static float fPeriodToDeltaDiv;
-static double dPaulaOutputFreq;
-static blep_t blep[PAULA_VOICES];
-static onePoleFilter_t filterLo, filterHi;
-static twoPoleFilter_t filterLED;
-static paulaVoice_t paula[PAULA_VOICES];
-
-void paulaSetup(double dOutputFreq, uint32_t amigaModel)
+#if defined HAS_SSE2
+#include <emmintrin.h>
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
+
+static int8_t nullSample[0xFFFF*2]; // buffer for NULL data pointer (read-only, shared by all Paula instances)
+
+paula_t *paulaCreate(double dOutputFreq, uint32_t amigaModel)
+{
+	paula_t *p = (paula_t *)calloc(1, sizeof (paula_t));
+	if (p == NULL)
+		return NULL;
+
+	paulaSetup(p, dOutputFreq, amigaModel);
+	return p;
+}
+
+void paulaDestroy(paula_t *p)
+{
+	if (p == NULL)
+		return;
+
+	if (p->scopeTap != NULL)
+	{
+		free(p->scopeTap->snapshots);
+		free(p->scopeTap);
+	}
+
+	free(p);
+}
+
+void paulaSetup(paula_t *p, double dOutputFreq, uint32_t amigaModel)
 {
 	ASSERT(dOutputFreq != 0.0);
-	dPaulaOutputFreq = dOutputFreq;
-	fPeriodToDeltaDiv = (float)(PAULA_PAL_CLK / dPaulaOutputFreq);
 
-	clearBlepState();
+	blepInit(); // (only does something the first time)
 
-	useLowpassFilter = useHighpassFilter = true;
-	clearOnePoleFilterState(&filterLo);
-	clearOnePoleFilterState(&filterHi);
-	clearTwoPoleFilterState(&filterLED);
+	p->dOutputFreq = dOutputFreq;
+	p->dPeriodToDeltaDiv = (PAULA_PAL_CLK / p->dOutputFreq) * PAULA_PHASE_SCALE;
+
+	clearBlepState(p);
+
+	p->useLowpassFilter = p->useHighpassFilter = true;
+	clearOnePoleFilterState(&p->filterLo);
+	clearOnePoleFilterState(&p->filterHi);
+	clearTwoPoleFilterState(&p->filterLED);
 
 	/*
 	** Amiga 500/1200 filters
@@ -81,13 +87,13 @@ void paulaSetup(double dOutputFreq, uint32_t amigaModel)
 		** We don't do volume PWM, so we have nothing we need to
 		** filter away.
 		*/
-		useLowpassFilter = false;
+		p->useLowpassFilter = false;
 
 		// A1200 1-pole (6dB/oct) RC high-pass filter:
 		R = 1360.0; // R324 (1K ohm resistor) + R325 (360 ohm resistor)
 		C = 2.2e-5; // C334 (22uF capacitor)
 		cutoff = 1.0 / ((2.0 * PI) * R * C); // ~5.319Hz
-		setupOnePoleFilter(dPaulaOutputFreq, cutoff, &filterHi);
+		setupOnePoleFilter(p->dOutputFreq, cutoff, &p->filterHi);
 	}
 	else
 	{
@@ -97,13 +103,13 @@ void paulaSetup(double dOutputFreq, uint32_t amigaModel)
 		R = 360.0; // R321 (360 ohm)
 		C = 1e-7;  // C321 (0.1uF)
 		cutoff = 1.0 / ((2.0 * PI) * R * C); // ~4420.971Hz
-		setupOnePoleFilter(dPaulaOutputFreq, cutoff, &filterLo);
+		setupOnePoleFilter(p->dOutputFreq, cutoff, &p->filterLo);
 
 		// A500 1-pole (6dB/oct) RC high-pass filter:
 		R = 1390.0;   // R324 (1K ohm) + R325 (390 ohm)
 		C = 2.233e-5; // C334 (22uF) + C335 (0.33uF)
 		cutoff = 1.0 / ((2.0 * PI) * R * C); // ~5.128Hz
-		setupOnePoleFilter(dPaulaOutputFreq, cutoff, &filterHi);
+		setupOnePoleFilter(p->dOutputFreq, cutoff, &p->filterHi);
 	}
 
 	// 2-pole (12dB/oct) Sallen-Key low-pass filter ("LED" filter, same values on A500/A1200):
@@ -113,13 +119,21 @@ void paulaSetup(double dOutputFreq, uint32_t amigaModel)
 	C2 = 3.9e-9;  // C323 (3900pF)
 	cutoff = 1.0 / ((2.0 * PI) * sqrt(R1 * R2 * C1 * C2)); // ~3090.533Hz
 	qfactor = sqrt(R1 * R2 * C1 * C2) / (C2 * (R1 + R2)); // ~0.660225
-	setupTwoPoleFilter(dPaulaOutputFreq, cutoff, qfactor, &filterLED);
+	setupTwoPoleFilter(p->dOutputFreq, cutoff, qfactor, &p->filterLED);
+
+	// same filters (with cleared states) for paulaGenerateVoiceSamples()
+	for (int32_t i = 0; i < PAULA_VOICES/2; i++)
+	{
+		p->voiceFilterLo[i] = p->filterLo;
+		p->voiceFilterHi[i] = p->filterHi;
+		p->voiceFilterLED[i] = p->filterLED;
+	}
 }
 
-void paulaDisableFilters(void) // disables low-pass/high-pass filter ("LED" filter is kept)
+void paulaDisableFilters(paula_t *p) // disables low-pass/high-pass filter ("LED" filter is kept)
 {
-	useHighpassFilter = false;
-	useLowpassFilter = false;
+	p->useHighpassFilter = false;
+	p->useLowpassFilter = false;
 }
 
 int8_t *paulaGetNullSamplePtr(void)
@@ -129,11 +143,11 @@ int8_t *paulaGetNullSamplePtr(void)
 
 static inline void refetchPeriod(paulaVoice_t *v) // Paula stage
 {
-	v->fBlepPhase = v->fPhase;
-	v->fBlepDelta = v->fDelta;
+	v->fBlepPhase = v->phase * (float)(1.0 / PAULA_PHASE_SCALE);
+	v->fBlepDelta = v->delta * (float)(1.0 / PAULA_PHASE_SCALE);
 
 	// Paula only updates period (delta) during period refetching (this stage)
-	v->fDelta = v->fStoredDelta;
+	v->delta = v->storedDelta;
 
 	v->nextSampleStage = true;
 }
@@ -186,9 +200,9 @@ static inline void nextSample(paulaVoice_t *v, blep_t *b) // Paula stage
 	v->sampleCounter--;
 }
 
-static void audxper(int32_t ch, uint16_t period)
+static void audxper(paula_t *p, int32_t ch, uint16_t period)
 {
-	paulaVoice_t *v = &paula[ch];
+	paulaVoice_t *v = &p->voice[ch];
 
 	int32_t realPeriod = period;
 	if (realPeriod == 0)
@@ -197,39 +211,43 @@ static void audxper(int32_t ch, uint16_t period)
 		realPeriod = 113; // close to what happens on real Amiga (and low-limit needed for BLEP synthesis)
 
 	// to be read on next sampling step (or on DMA trigger)
-	v->fStoredDelta = fPeriodToDeltaDiv / (float)realPeriod;
+	double dDelta = p->dPeriodToDeltaDiv / realPeriod;
+	if (dDelta > UINT32_MAX)
+		dDelta = UINT32_MAX; // can only happen if the mixing frequency is lower than supported
+
+	v->storedDelta = (uint32_t)dDelta;
 
 	// BLEP synthesis edge-case
 	if (v->fBlepDelta == 0.0f)
-		v->fBlepDelta = v->fDelta;
+		v->fBlepDelta = v->delta * (float)(1.0 / PAULA_PHASE_SCALE);
 }
 
-static void audxvol(int32_t ch, uint16_t vol)
+static void audxvol(paula_t *p, int32_t ch, uint16_t vol)
 {
 	int32_t realVol = vol & 127;
 	if (realVol > 64)
 		realVol = 64;
 
 	// multiplying sample point by this also scales the sample from -128..127 -> -1.000 .. ~0.992
-	paula[ch].fStoredVol = (float)realVol * (1.0f / (128.0f * 64.0f));
+	p->voice[ch].fStoredVol = (float)realVol * (1.0f / (128.0f * 64.0f));
 }
 
-static void audxlen(int32_t ch, uint16_t len)
+static void audxlen(paula_t *p, int32_t ch, uint16_t len)
 {
-	paula[ch].storedLength = len;
+	p->voice[ch].storedLength = len;
 }
 
-static void audxdat(int32_t ch, const int8_t *src)
+static void audxdat(paula_t *p, int32_t ch, const int8_t *src)
 {
 	if (src == NULL)
 		src = nullSample;
 
-	paula[ch].storedLocation = src;
+	p->voice[ch].storedLocation = src;
 }
 
-static void startDMA(int32_t ch)
+static void startDMA(paula_t *p, int32_t ch)
 {
-	paulaVoice_t *v = &paula[ch];
+	paulaVoice_t *v = &p->voice[ch];
 
 	if (v->storedLocation == NULL)
 		v->storedLocation = nullSample;
@@ -244,17 +262,17 @@ static void startDMA(int32_t ch)
 	refetchPeriod(v);
 
 	// kludge: must be cleared *after* refetchPeriod()
-	v->fPhase = 0.0f;
+	v->phase = 0;
 
 	v->active = true;
 }
 
-static void stopDMA(int32_t ch)
+static void stopDMA(paula_t *p, int32_t ch)
 {
-	paula[ch].active = false;
+	p->voice[ch].active = false;
 }
 
-void paulaWriteByte(uint32_t address, uint8_t data8)
+void paulaWriteByte(paula_t *p, uint32_t address, uint8_t data8)
 {
 	if (address == 0)
 		return;
@@ -264,11 +282,15 @@ void paulaWriteByte(uint32_t address, uint8_t data8)
 		// CIA-A ("LED" filter control only)
 		case 0xBFE001:
 		{
-			const bool oldLedFilterState = useLEDFilter;
+			const bool oldLedFilterState = p->useLEDFilter;
 
-			useLEDFilter = !!(data8 & 2);
-			if (useLEDFilter != oldLedFilterState)
-				clearTwoPoleFilterState(&filterLED);
+			p->useLEDFilter = !!(data8 & 2);
+			if (p->useLEDFilter != oldLedFilterState)
+			{
+				clearTwoPoleFilterState(&p->filterLED);
+				for (int32_t i = 0; i < PAULA_VOICES/2; i++)
+					clearTwoPoleFilterState(&p->voiceFilterLED[i]);
+			}
 		}
 		break;
 
@@ -277,7 +299,7 @@ void paulaWriteByte(uint32_t address, uint8_t data8)
 	}
 }
 
-void paulaWriteWord(uint32_t address, uint16_t data16)
+void paulaWriteWord(paula_t *p, uint32_t address, uint16_t data16)
 {
 	if (address == 0)
 		return;
@@ -290,46 +312,46 @@ void paulaWriteWord(uint32_t address, uint16_t data16)
 			if (data16 & 0x8000)
 			{
 				// set
-				if (data16 & 1) startDMA(0);
-				if (data16 & 2) startDMA(1);
-				if (data16 & 4) startDMA(2);
-				if (data16 & 8) startDMA(3);
+				if (data16 & 1) startDMA(p, 0);
+				if (data16 & 2) startDMA(p, 1);
+				if (data16 & 4) startDMA(p, 2);
+				if (data16 & 8) startDMA(p, 3);
 			}
 			else
 			{
 				// clear
-				if (data16 & 1) stopDMA(0);
-				if (data16 & 2) stopDMA(1);
-				if (data16 & 4) stopDMA(2);
-				if (data16 & 8) stopDMA(3);
+				if (data16 & 1) stopDMA(p, 0);
+				if (data16 & 2) stopDMA(p, 1);
+				if (data16 & 4) stopDMA(p, 2);
+				if (data16 & 8) stopDMA(p, 3);
 			}
 		}
 		break;
 
 		// AUDxLEN
-		case 0xDFF0A4: audxlen(0, data16); break;
-		case 0xDFF0B4: audxlen(1, data16); break;
-		case 0xDFF0C4: audxlen(2, data16); break;
-		case 0xDFF0D4: audxlen(3, data16); break;
+		case 0xDFF0A4: audxlen(p, 0, data16); break;
+		case 0xDFF0B4: audxlen(p, 1, data16); break;
+		case 0xDFF0C4: audxlen(p, 2, data16); break;
+		case 0xDFF0D4: audxlen(p, 3, data16); break;
 
 		// AUDxPER
-		case 0xDFF0A6: audxper(0, data16); break;
-		case 0xDFF0B6: audxper(1, data16); break;
-		case 0xDFF0C6: audxper(2, data16); break;
-		case 0xDFF0D6: audxper(3, data16); break;
+		case 0xDFF0A6: audxper(p, 0, data16); break;
+		case 0xDFF0B6: audxper(p, 1, data16); break;
+		case 0xDFF0C6: audxper(p, 2, data16); break;
+		case 0xDFF0D6: audxper(p, 3, data16); break;
 
 		// AUDxVOL
-		case 0xDFF0A8: audxvol(0, data16); break;
-		case 0xDFF0B8: audxvol(1, data16); break;
-		case 0xDFF0C8: audxvol(2, data16); break;
-		case 0xDFF0D8: audxvol(3, data16); break;
+		case 0xDFF0A8: audxvol(p, 0, data16); break;
+		case 0xDFF0B8: audxvol(p, 1, data16); break;
+		case 0xDFF0C8: audxvol(p, 2, data16); break;
+		case 0xDFF0D8: audxvol(p, 3, data16); break;
 
 		default:
 			return;
 	}
 }
 
-void paulaWritePtr(uint32_t address, const int8_t *ptr)
+void paulaWritePtr(paula_t *p, uint32_t address, const int8_t *ptr)
 {
 	if (address == 0)
 		return;
@@ -337,90 +359,563 @@ void paulaWritePtr(uint32_t address, const int8_t *ptr)
 	switch (address)
 	{
 		// AUDxDAT
-		case 0xDFF0A0: audxdat(0, ptr); break;
-		case 0xDFF0B0: audxdat(1, ptr); break;
-		case 0xDFF0C0: audxdat(2, ptr); break;
-		case 0xDFF0D0: audxdat(3, ptr); break;
+		case 0xDFF0A0: audxdat(p, 0, ptr); break;
+		case 0xDFF0B0: audxdat(p, 1, ptr); break;
+		case 0xDFF0C0: audxdat(p, 2, ptr); break;
+		case 0xDFF0D0: audxdat(p, 3, ptr); break;
 
 		default:
 			return;
 	}
 }
 
-void clearBlepState(void)
+static bool queueCommand(paula_t *p, const paulaCmd_t *cmd)
 {
-	memset(blep, 0, sizeof (blep));
+	const int32_t newWritePos = (p->cmdPendingWritePos + 1) & (PAULA_CMD_QUEUE_LEN-1);
+	if (newWritePos == atomic32Load(&p->cmdReadPos))
+		return false; // queue is full
+
+	p->cmdQueue[p->cmdPendingWritePos] = *cmd;
+	p->cmdPendingWritePos = newWritePos;
+
+	return true;
 }
 
-// output is -4.00 .. 3.97 (can be louder because of high-pass filter)
-void paulaGenerateSamples(float *fOutL, float *fOutR, int32_t numSamples)
+bool paulaQueueWriteWord(paula_t *p, uint64_t timestamp, uint32_t address, uint16_t data16)
 {
-	float *fMixBufSelect[PAULA_VOICES];
+	paulaCmd_t cmd;
 
-	if (numSamples <= 0)
-		return;
+	cmd.timestamp = timestamp;
+	cmd.type = PAULA_CMD_WORD;
+	cmd.address = address;
+	cmd.data16 = data16;
+	cmd.ptr = NULL;
 
-	fMixBufSelect[0] = fOutL;
-	fMixBufSelect[1] = fOutR;
-	fMixBufSelect[2] = fOutR;
-	fMixBufSelect[3] = fOutL;
+	return queueCommand(p, &cmd);
+}
 
-	// clear mix buffer block
-	memset(fOutL, 0, numSamples * sizeof (float));
-	memset(fOutR, 0, numSamples * sizeof (float));
+bool paulaQueueWritePtr(paula_t *p, uint64_t timestamp, uint32_t address, const int8_t *ptr)
+{
+	paulaCmd_t cmd;
+
+	cmd.timestamp = timestamp;
+	cmd.type = PAULA_CMD_PTR;
+	cmd.address = address;
+	cmd.data16 = 0;
+	cmd.ptr = ptr;
+
+	return queueCommand(p, &cmd);
+}
+
+void paulaCommitQueuedWrites(paula_t *p)
+{
+	atomic32Store(&p->cmdWritePos, p->cmdPendingWritePos); // (release)
+}
+
+/* Does the committed writes that are due (at or before the current sample), and returns how
+** many samples (up to maxSamples) that can be mixed before the next queued write.
+*/
+static int32_t doQueuedWrites(paula_t *p, int32_t maxSamples)
+{
+	const int32_t writePos = atomic32Load(&p->cmdWritePos);
+
+	int32_t readPos = atomic32Load(&p->cmdReadPos);
+	if (readPos == writePos)
+		return maxSamples; // queue is empty
+
+	while (readPos != writePos)
+	{
+		const paulaCmd_t *cmd = &p->cmdQueue[readPos];
+		if (cmd->timestamp > p->sampleClock)
+		{
+			const uint64_t samplesToWrite = cmd->timestamp - p->sampleClock;
+			if (samplesToWrite < (uint64_t)maxSamples)
+				maxSamples = (int32_t)samplesToWrite;
+
+			break;
+		}
+
+		if (cmd->type == PAULA_CMD_PTR)
+			paulaWritePtr(p, cmd->address, cmd->ptr);
+		else
+			paulaWriteWord(p, cmd->address, cmd->data16);
+
+		readPos = (readPos + 1) & (PAULA_CMD_QUEUE_LEN-1);
+	}
+
+	atomic32Store(&p->cmdReadPos, readPos);
+	return maxSamples;
+}
+
+void paulaFlushQueuedWrites(paula_t *p)
+{
+	const int32_t writePos = atomic32Load(&p->cmdWritePos);
+
+	int32_t readPos = atomic32Load(&p->cmdReadPos);
+	while (readPos != writePos)
+	{
+		const paulaCmd_t *cmd = &p->cmdQueue[readPos];
+		if (cmd->type == PAULA_CMD_PTR)
+			paulaWritePtr(p, cmd->address, cmd->ptr);
+		else
+			paulaWriteWord(p, cmd->address, cmd->data16);
+
+		readPos = (readPos + 1) & (PAULA_CMD_QUEUE_LEN-1);
+	}
+
+	atomic32Store(&p->cmdReadPos, readPos);
+}
+
+bool paulaQueuedWritesDone(paula_t *p)
+{
+	return atomic32Load(&p->cmdReadPos) == atomic32Load(&p->cmdWritePos);
+}
+
+void clearBlepState(paula_t *p)
+{
+	memset(p->blep, 0, sizeof (p->blep));
+}
+
+bool paulaEnableScopeTap(paula_t *p, int32_t snapshotsPerSec, double dMaxLatencySecs)
+{
+	paulaScopeTap_t *tap = (paulaScopeTap_t *)calloc(1, sizeof (paulaScopeTap_t));
+	if (tap == NULL)
+		return false;
+
+	int32_t numSnapshots = 16;
+	while (numSnapshots < (int32_t)ceil(dMaxLatencySecs * snapshotsPerSec) + 1)
+		numSnapshots <<= 1;
+
+	tap->snapshots = (paulaScopeSnapshot_t *)calloc(numSnapshots, sizeof (paulaScopeSnapshot_t));
+	if (tap->snapshots == NULL)
+	{
+		free(tap);
+		return false;
+	}
+
+	tap->mask = numSnapshots - 1;
+	tap->interval = (int32_t)ceil(p->dOutputFreq / snapshotsPerSec);
+	tap->nextSnapshotClock = p->sampleClock + tap->interval;
+
+	p->scopeTap = tap; // (the mixer must not be running)
+	return true;
+}
+
+bool paulaGetScopeSnapshot(paula_t *p, uint64_t sampleClock, paulaScopeSnapshot_t *out)
+{
+	paulaScopeTap_t *tap = p->scopeTap;
+	if (tap == NULL)
+		return false;
+
+	const int32_t writePos = atomic32Load(&tap->writePos); // (acquire, the snapshots up to here are complete)
+	int32_t readPos = atomic32Load(&tap->readPos);
+
+	const paulaScopeSnapshot_t *lastSnapshot = NULL;
+	while (readPos != writePos && tap->snapshots[readPos].sampleClock <= sampleClock)
+	{
+		lastSnapshot = &tap->snapshots[readPos];
+		readPos = (readPos + 1) & tap->mask;
+	}
+
+	if (lastSnapshot == NULL)
+		return false;
+
+	*out = *lastSnapshot; // copy it before the slot is given back
+	atomic32Store(&tap->readPos, readPos);
+
+	return true;
+}
+
+void paulaEnableVoiceMeters(paula_t *p, bool enable)
+{
+	p->useVoiceMeters = enable;
+	p->meterSamples = 0;
+	memset(p->voiceMeter, 0, sizeof (p->voiceMeter));
+}
+
+void paulaReadVoiceMeters(paula_t *p, float *fPeak, float *fRms)
+{
+	paulaVoiceMeter_t *m = p->voiceMeter;
+	for (int32_t i = 0; i < PAULA_VOICES; i++, m++)
+	{
+		fPeak[i] = m->fPeak;
+		fRms[i] = (p->meterSamples > 0) ? sqrtf(m->fSumSq / p->meterSamples) : 0.0f;
+
+		m->fPeak = m->fSumSq = 0.0f;
+	}
+
+	p->meterSamples = 0;
+}
+
+void paulaSaveState(paula_t *p, paulaState_t *s)
+{
+	s->useLEDFilter = p->useLEDFilter;
+	memcpy(s->blep, p->blep, sizeof (s->blep));
+	s->filterLo = p->filterLo;
+	s->filterHi = p->filterHi;
+	s->filterLED = p->filterLED;
+	memcpy(s->voice, p->voice, sizeof (s->voice));
+}
+
+void paulaLoadState(paula_t *p, const paulaState_t *s)
+{
+	p->useLEDFilter = s->useLEDFilter;
+	memcpy(p->blep, s->blep, sizeof (p->blep));
+	p->filterLo = s->filterLo;
+	p->filterHi = s->filterHi;
+	p->filterLED = s->filterLED;
+	memcpy(p->voice, s->voice, sizeof (p->voice));
+
+	// the levels metered so far are from the voices that were replaced
+	p->meterSamples = 0;
+	memset(p->voiceMeter, 0, sizeof (p->voiceMeter));
+}
+
+static void recordScopePoint(paulaScopeTap_t *tap, int32_t ch, float fSample)
+{
+	tap->point[ch][tap->pointPos[ch]++ & (PAULA_SCOPE_POINTS-1)] = (int8_t)(fSample * 128.0f); // -128..127
+}
+
+// same span stepping as in mixVoices(), but nothing is mixed (for paulaSkipSamples())
+static void skipVoice(paulaVoice_t *v, blep_t *b, paulaScopeTap_t *tap, int32_t ch, int32_t numSamples)
+{
+	int32_t j = 0;
+	while (j < numSamples)
+	{
+		if (v->nextSampleStage)
+		{
+			v->nextSampleStage = false;
+			nextSample(v, b);
+
+			if (tap != NULL)
+				recordScopePoint(tap, ch, v->fSample);
+		}
+
+		int32_t spanLength = numSamples - j;
+		bool refetch = false;
+
+		if (v->delta > 0)
+		{
+			const uint64_t samplesToRefetch = ((PAULA_PHASE_SCALE - v->phase) + (v->delta - 1)) / v->delta;
+			if (samplesToRefetch <= (uint64_t)spanLength)
+			{
+				spanLength = (int32_t)samplesToRefetch;
+				refetch = true;
+			}
+		}
 
-	// mix samples
+		int32_t blepSamples = b->samplesLeft;
+		if (blepSamples > spanLength)
+			blepSamples = spanLength;
 
-	paulaVoice_t *v = paula;
-	blep_t *b = blep;
+		if (blepSamples > 0)
+			blepSkip(b, blepSamples);
+
+		j += spanLength;
+
+		v->phase = (uint32_t)(v->phase + ((uint64_t)spanLength * v->delta));
+		if (refetch)
+			refetchPeriod(v);
+	}
+}
+
+// adds one mixed span of a voice (BLEP part + constant part) to its meter
+static void meterVoiceSpan(paulaVoiceMeter_t *m, const blep_t *b, float fSample, int32_t blepSamples, int32_t spanLength)
+{
+	float fPeak = m->fPeak, fSumSq = m->fSumSq;
+
+	// the BLEP part is fSample + b->fBuffer[index+n] (contiguous, see blep_t)
+	const float *fBlep = &b->fBuffer[b->index];
+	int32_t n = 0;
+#if defined HAS_SSE2
+	if (blepSamples >= 4)
+	{
+		const __m128 vSample = _mm_set1_ps(fSample);
+		const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 vPeak = _mm_setzero_ps(), vSumSq = _mm_setzero_ps();
+
+		for (; n+4 <= blepSamples; n += 4)
+		{
+			const __m128 vOut = _mm_add_ps(vSample, _mm_loadu_ps(&fBlep[n]));
+			vPeak = _mm_max_ps(vPeak, _mm_and_ps(vOut, vAbsMask));
+			vSumSq = _mm_add_ps(vSumSq, _mm_mul_ps(vOut, vOut));
+		}
+
+		float fLanes[4];
+		_mm_storeu_ps(fLanes, vPeak);
+		for (int32_t i = 0; i < 4; i++)
+		{
+			if (fLanes[i] > fPeak)
+				fPeak = fLanes[i];
+		}
+
+		_mm_storeu_ps(fLanes, vSumSq);
+		fSumSq += (fLanes[0] + fLanes[1]) + (fLanes[2] + fLanes[3]);
+	}
+#elif defined HAS_NEON
+	if (blepSamples >= 4)
+	{
+		const float32x4_t vSample = vdupq_n_f32(fSample);
+		float32x4_t vPeak = vdupq_n_f32(0.0f), vSumSq = vdupq_n_f32(0.0f);
+
+		for (; n+4 <= blepSamples; n += 4)
+		{
+			const float32x4_t vOut = vaddq_f32(vSample, vld1q_f32(&fBlep[n]));
+			vPeak = vmaxq_f32(vPeak, vabsq_f32(vOut));
+			vSumSq = vaddq_f32(vSumSq, vmulq_f32(vOut, vOut));
+		}
+
+		float fLanes[4];
+		vst1q_f32(fLanes, vPeak);
+		for (int32_t i = 0; i < 4; i++)
+		{
+			if (fLanes[i] > fPeak)
+				fPeak = fLanes[i];
+		}
+
+		vst1q_f32(fLanes, vSumSq);
+		fSumSq += (fLanes[0] + fLanes[1]) + (fLanes[2] + fLanes[3]);
+	}
+#endif
+	for (; n < blepSamples; n++)
+	{
+		const float fOut = fSample + fBlep[n];
+		if (fabsf(fOut) > fPeak)
+			fPeak = fabsf(fOut);
+
+		fSumSq += fOut * fOut;
+	}
+
+	// the rest of the span is constant
+	if (fSample != 0.0f && spanLength > blepSamples)
+	{
+		if (fabsf(fSample) > fPeak)
+			fPeak = fabsf(fSample);
+
+		fSumSq += (fSample * fSample) * (spanLength - blepSamples);
+	}
+
+	m->fPeak = fPeak;
+	m->fSumSq = fSumSq;
+}
+
+/* Mixes the voices into the (cleared) buffers at offset, returns true if nothing but silence was mixed.
+** If fMixBufSelect is NULL, the voices are only advanced (see paulaSkipSamples()).
+*/
+static bool mixVoices(paula_t *p, float *fMixBufSelect[PAULA_VOICES], int32_t offset, int32_t numSamples)
+{
+	bool mixedSilence = true;
+	paulaVoice_t *v = p->voice;
+	blep_t *b = p->blep;
+	paulaScopeTap_t *tap = p->scopeTap;
 
 	for (int32_t i = 0; i < PAULA_VOICES; i++, v++, b++)
 	{
 		if (!v->active || v->location == NULL || v->storedLocation == NULL)
 			continue;
 
-		float *fMixBuffer = fMixBufSelect[i]; // what output channel to mix into (L, R, R, L)
-		for (int32_t j = 0; j < numSamples; j++)
+		if (fMixBufSelect == NULL)
+		{
+			skipVoice(v, b, tap, i, numSamples);
+			continue;
+		}
+
+		float *fMixBuffer = &fMixBufSelect[i][offset]; // what output buffer to mix into (L, R, R, L for stereo)
+
+		/* The held sample point can only change on a period refetch, so we mix in spans
+		** that end at the next refetch. Per-sample work (BLEP) is only done for the first
+		** samples after a sample point change, the rest of the span is a constant add.
+		*/
+		int32_t j = 0;
+		while (j < numSamples)
 		{
 			if (v->nextSampleStage)
 			{
 				v->nextSampleStage = false;
 				nextSample(v, b);
+
+				if (tap != NULL)
+					recordScopePoint(tap, i, v->fSample);
+			}
+
+			// how many output samples until the phase wraps (period refetch)?
+			int32_t spanLength = numSamples - j;
+			bool refetch = false;
+
+			if (v->delta > 0)
+			{
+				const uint64_t samplesToRefetch = ((PAULA_PHASE_SCALE - v->phase) + (v->delta - 1)) / v->delta;
+				if (samplesToRefetch <= (uint64_t)spanLength)
+				{
+					spanLength = (int32_t)samplesToRefetch;
+					refetch = true;
+				}
 			}
 
-			float fSample = v->fSample; // current sample, pre-multiplied by vol, scaled to -1.0 .. 0.992
-			if (b->samplesLeft > 0)
-				fSample = blepRun(b, fSample);
+			const float fSample = v->fSample; // current sample, pre-multiplied by vol, scaled to -1.0 .. 0.992
+			float *fMixPtr = &fMixBuffer[j];
 
-			fMixBuffer[j] += fSample;
+			int32_t blepSamples = b->samplesLeft;
+			if (blepSamples > spanLength)
+				blepSamples = spanLength;
 
-			v->fPhase += v->fDelta;
-			if (v->fPhase >= 1.0f)
+			if (p->useVoiceMeters) // (before the BLEP is advanced)
+				meterVoiceSpan(&p->voiceMeter[i], b, fSample, blepSamples, spanLength);
+
+			if (blepSamples > 0)
 			{
-				v->fPhase -= 1.0f;
-				refetchPeriod(v);
+				blepRunMix(b, fSample, fMixPtr, blepSamples);
+				mixedSilence = false;
 			}
+
+			if (fSample != 0.0f)
+			{
+				for (int32_t k = blepSamples; k < spanLength; k++)
+					fMixPtr[k] += fSample;
+
+				mixedSilence = false;
+			}
+
+			j += spanLength;
+
+			// on refetch, this wraps around to the new (fractional) phase
+			v->phase = (uint32_t)(v->phase + ((uint64_t)spanLength * v->delta));
+			if (refetch)
+				refetchPeriod(v);
 		}
 	}
 
-	// apply Amiga filters
-	for (int32_t i = 0; i < numSamples; i++)
+	return mixedSilence;
+}
+
+static void queueScopeSnapshot(paula_t *p)
+{
+	paulaScopeTap_t *tap = p->scopeTap;
+
+	tap->nextSnapshotClock = p->sampleClock + tap->interval;
+
+	const int32_t writePos = atomic32Load(&tap->writePos);
+	const int32_t newWritePos = (writePos + 1) & tap->mask;
+	if (newWritePos == atomic32Load(&tap->readPos))
+		return; // queue is full (the reader is stalling), drop this one
+
+	paulaScopeSnapshot_t *s = &tap->snapshots[writePos];
+	s->sampleClock = p->sampleClock;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		const paulaVoice_t *v = &p->voice[i];
+		paulaScopeVoice_t *sv = &s->voice[i];
+
+		sv->active = v->active && v->location != NULL && v->storedLocation != NULL;
+		sv->location = v->location;
+		sv->lengthCounter = v->lengthCounter;
+		sv->storedLength = v->storedLength;
+
+		// unroll the ring (oldest point first)
+		const int32_t pointPos = tap->pointPos[i] & (PAULA_SCOPE_POINTS-1);
+		memcpy(sv->point, &tap->point[i][pointPos], PAULA_SCOPE_POINTS - pointPos);
+		memcpy(&sv->point[PAULA_SCOPE_POINTS - pointPos], tap->point[i], pointPos);
+	}
+
+	atomic32Store(&tap->writePos, newWritePos); // (release)
+}
+
+// mixes all voices (in parts, if there are queued register writes or scope snapshots to be done inside this block)
+static bool mixBlock(paula_t *p, float *fMixBufSelect[PAULA_VOICES], int32_t numSamples)
+{
+	bool mixedSilence = true;
+	paulaScopeTap_t *tap = p->scopeTap;
+
+	int32_t samplesLeft = numSamples;
+	while (samplesLeft > 0)
+	{
+		const int32_t offset = numSamples - samplesLeft;
+		int32_t samplesToMix = doQueuedWrites(p, samplesLeft);
+
+		if (tap != NULL && tap->nextSnapshotClock - p->sampleClock < (uint64_t)samplesToMix)
+			samplesToMix = (int32_t)(tap->nextSnapshotClock - p->sampleClock);
+
+		if (!mixVoices(p, fMixBufSelect, offset, samplesToMix))
+			mixedSilence = false;
+
+		if (p->useVoiceMeters && fMixBufSelect != NULL)
+			p->meterSamples += samplesToMix;
+
+		p->sampleClock += samplesToMix;
+		samplesLeft -= samplesToMix;
+
+		if (tap != NULL && p->sampleClock >= tap->nextSnapshotClock)
+			queueScopeSnapshot(p);
+	}
+
+	return mixedSilence;
+}
+
+// output is -4.00 .. 3.97 (can be louder because of high-pass filter)
+void paulaGenerateSamples(paula_t *p, float *fOutL, float *fOutR, int32_t numSamples)
+{
+	if (numSamples <= 0)
+		return;
+
+	// clear mix buffer block
+	memset(fOutL, 0, numSamples * sizeof (float));
+	memset(fOutR, 0, numSamples * sizeof (float));
+
+	float *fMixBufSelect[PAULA_VOICES] = { fOutL, fOutR, fOutR, fOutL };
+	const bool mixedSilence = mixBlock(p, fMixBufSelect, numSamples); // (for skipping the filters)
+
+	/* Skip the filters if the input is silent and the filters have decayed to zero
+	** (the block filters flush very small states), the output is silence then.
+	*/
+	if (mixedSilence &&
+		(!p->useLowpassFilter  || onePoleFilterIsIdle(&p->filterLo)) &&
+		(!p->useLEDFilter      || twoPoleFilterIsIdle(&p->filterLED)) &&
+		(!p->useHighpassFilter || onePoleFilterIsIdle(&p->filterHi)))
 	{
-		float fOut[2];
+		return;
+	}
 
-		fOut[0] = fOutL[i];
-		fOut[1] = fOutR[i];
+	// apply Amiga filters
+	if (p->useLowpassFilter)
+		onePoleLPFilterStereoBlock(&p->filterLo, fOutL, fOutR, numSamples);
+
+	if (p->useLEDFilter)
+		twoPoleLPFilterStereoBlock(&p->filterLED, fOutL, fOutR, numSamples);
+
+	if (p->useHighpassFilter)
+		onePoleHPFilterStereoBlock(&p->filterHi, fOutL, fOutR, numSamples);
+}
+
+void paulaSkipSamples(paula_t *p, int32_t numSamples)
+{
+	if (numSamples > 0)
+		mixBlock(p, NULL, numSamples);
+}
 
-		if (useLowpassFilter)
-			onePoleLPFilterStereo(&filterLo, fOut, fOut);
+void paulaGenerateVoiceSamples(paula_t *p, float *fOutVoice[PAULA_VOICES], int32_t numSamples)
+{
+	if (numSamples <= 0)
+		return;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		memset(fOutVoice[i], 0, numSamples * sizeof (float));
+
+	mixBlock(p, fOutVoice, numSamples);
+
+	// apply Amiga filters, two voices at a time in the stereo filters' L/R lanes
+	for (int32_t i = 0; i < PAULA_VOICES/2; i++)
+	{
+		float *fOut1 = fOutVoice[(i*2)+0];
+		float *fOut2 = fOutVoice[(i*2)+1];
 
-		if (useLEDFilter)
-			twoPoleLPFilterStereo(&filterLED, fOut, fOut);
+		if (p->useLowpassFilter)
+			onePoleLPFilterStereoBlock(&p->voiceFilterLo[i], fOut1, fOut2, numSamples);
 
-		if (useHighpassFilter)
-			onePoleHPFilterStereo(&filterHi, fOut, fOut);
+		if (p->useLEDFilter)
+			twoPoleLPFilterStereoBlock(&p->voiceFilterLED[i], fOut1, fOut2, numSamples);
 
-		fOutL[i] = fOut[0];
-		fOutR[i] = fOut[1];
+		if (p->useHighpassFilter)
+			onePoleHPFilterStereoBlock(&p->voiceFilterHi[i], fOut1, fOut2, numSamples);
 	}
 }
@@ -2,7 +2,10 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "pt2_header.h"
+#include "pt2_replay_header.h"
+#include "pt2_atomic.h"
+#include "pt2_blep.h"
+#include "pt2_rcfilters.h"
 
 enum
 {
@@ -17,16 +20,183 @@ enum
 #define PAL_PAULA_MAX_HZ (PAULA_PAL_CLK / (double)PAL_PAULA_MIN_PERIOD)
 #define PAL_PAULA_MAX_SAFE_HZ (PAULA_PAL_CLK / (double)PAL_PAULA_MIN_SAFE_PERIOD)
 
-void paulaSetup(double dOutputFreq, uint32_t amigaModel);
-void paulaDisableFilters(void); // disables low-pass & high-pass filters ("LED" filter is kept)
+// voice phase is 0.32 fixed-point, so that the distance to the next period refetch can be calculated exactly
+#define PAULA_PHASE_BITS 32
+#define PAULA_PHASE_SCALE (1ULL << PAULA_PHASE_BITS)
 
-int8_t *paulaGetNullSamplePtr(void);
+typedef struct paulaVoice_t
+{
+	volatile bool active;
+
+	// internal registers
+	bool sampleJustStarted, nextSampleStage;
+	int8_t AUD_DAT[2]; // DMA data buffer
+	const int8_t *location; // current location
+	uint16_t lengthCounter; // current length
+	int32_t sampleCounter; // how many bytes left in AUD_DAT
+	float fSample; // currently held sample point (multiplied by volume)
+	uint32_t delta, phase; // 0.32 fixed-point
+	float fBlepDelta, fBlepPhase;
+
+	// registers modified by Paula functions
+	const int8_t *storedLocation; // data pointer
+	uint16_t storedLength;
+	uint32_t storedDelta;
+	float fStoredVol;
+} paulaVoice_t;
+
+// queued register write, see paulaQueueWriteWord()
+#define PAULA_CMD_QUEUE_LEN 1024 /* 2^n */
+
+enum
+{
+	PAULA_CMD_WORD = 0,
+	PAULA_CMD_PTR = 1
+};
+
+typedef struct paulaCmd_t
+{
+	uint64_t timestamp; // output sample position (paula_t.sampleClock) to do the write at
+	const int8_t *ptr;
+	uint32_t address;
+	uint16_t data16;
+	uint8_t type;
+} paulaCmd_t;
+
+// scope snapshots (see paulaEnableScopeTap())
+#define PAULA_SCOPE_POINTS 64 /* 2^n */
+
+typedef struct paulaScopeVoice_t
+{
+	bool active;
+	const int8_t *location; // DMA read address (the word after the one being played)
+	uint16_t lengthCounter, storedLength;
+	int8_t point[PAULA_SCOPE_POINTS]; // the last sample points (sample * volume / 64), oldest first
+} paulaScopeVoice_t;
+
+typedef struct paulaScopeSnapshot_t
+{
+	uint64_t sampleClock; // paula_t.sampleClock at the snapshot
+	paulaScopeVoice_t voice[PAULA_VOICES];
+} paulaScopeSnapshot_t;
+
+typedef struct paulaScopeTap_t
+{
+	int32_t interval; // output samples between snapshots
+	uint64_t nextSnapshotClock;
+	uint8_t pointPos[PAULA_VOICES];
+	int8_t point[PAULA_VOICES][PAULA_SCOPE_POINTS]; // (rings)
+
+	// lock-free single-producer/single-consumer snapshot queue (the mixer writes, one other thread reads)
+	atomic32_t readPos, writePos;
+	int32_t mask;
+	paulaScopeSnapshot_t *snapshots;
+} paulaScopeTap_t;
+
+// per-voice levels (see paulaReadVoiceMeters())
+typedef struct paulaVoiceMeter_t
+{
+	float fPeak, fSumSq;
+} paulaVoiceMeter_t;
+
+// one complete Paula chip (+ Amiga output filters). Instances are fully independent of each other.
+typedef struct paula_t
+{
+	bool useLEDFilter, useLowpassFilter, useHighpassFilter;
+	double dOutputFreq, dPeriodToDeltaDiv;
+	blep_t blep[PAULA_VOICES];
+	onePoleFilter_t filterLo, filterHi;
+	twoPoleFilter_t filterLED;
+	paulaVoice_t voice[PAULA_VOICES];
+
+	// filter states for paulaGenerateVoiceSamples() (voice 0/1 in the first one's L/R, voice 2/3 in the second one's)
+	onePoleFilter_t voiceFilterLo[PAULA_VOICES/2], voiceFilterHi[PAULA_VOICES/2];
+	twoPoleFilter_t voiceFilterLED[PAULA_VOICES/2];
+
+	uint64_t sampleClock; // total number of output samples generated
+
+	// lock-free single-producer/single-consumer queue for register writes from another thread
+	atomic32_t cmdReadPos, cmdWritePos;
+	int32_t cmdPendingWritePos; // producer only, published by paulaCommitQueuedWrites()
+	paulaCmd_t cmdQueue[PAULA_CMD_QUEUE_LEN];
+
+	paulaScopeTap_t *scopeTap; // NULL if not enabled
+
+	bool useVoiceMeters;
+	int32_t meterSamples;
+	paulaVoiceMeter_t voiceMeter[PAULA_VOICES];
+} paula_t;
+
+// the part of paula_t that changes while mixing (for replayer snapshots, see pt2_snapshot.c)
+typedef struct paulaState_t
+{
+	bool useLEDFilter;
+	blep_t blep[PAULA_VOICES];
+	onePoleFilter_t filterLo, filterHi;
+	twoPoleFilter_t filterLED;
+	paulaVoice_t voice[PAULA_VOICES];
+} paulaState_t;
 
-void paulaWriteByte(uint32_t address, uint8_t data8);
-void paulaWriteWord(uint32_t address, uint16_t data16);
-void paulaWritePtr(uint32_t address, const int8_t *ptr);
+paula_t *paulaCreate(double dOutputFreq, uint32_t amigaModel); // returns NULL on out-of-memory
+void paulaDestroy(paula_t *p); // also frees the scope tap
 
-void clearBlepState(void);
+void paulaSetup(paula_t *p, double dOutputFreq, uint32_t amigaModel);
+void paulaDisableFilters(paula_t *p); // disables low-pass & high-pass filters ("LED" filter is kept)
+
+int8_t *paulaGetNullSamplePtr(void); // shared by all instances (read-only)
+
+void paulaWriteByte(paula_t *p, uint32_t address, uint8_t data8);
+void paulaWriteWord(paula_t *p, uint32_t address, uint16_t data16);
+void paulaWritePtr(paula_t *p, uint32_t address, const int8_t *ptr);
+
+/* Lock-free register writes for one other thread (single producer), while the mixer is running.
+** They are done by paulaGenerateSamples() at the exact output sample given by the timestamp
+** (or right away if the timestamp has passed). Queued writes are not seen by the mixer until
+** paulaCommitQueuedWrites() is called, so a group of writes is always done together.
+** Returns false if the queue is full.
+*/
+bool paulaQueueWriteWord(paula_t *p, uint64_t timestamp, uint32_t address, uint16_t data16);
+bool paulaQueueWritePtr(paula_t *p, uint64_t timestamp, uint32_t address, const int8_t *ptr);
+void paulaCommitQueuedWrites(paula_t *p);
+void paulaFlushQueuedWrites(paula_t *p); // does all committed writes now (the mixer must not be running)
+bool paulaQueuedWritesDone(paula_t *p); // true when the mixer has done all committed writes
+
+void clearBlepState(paula_t *p);
+
+/* Scopes: While mixing, the sample points that each voice fetches are recorded (after the
+** volume is applied, before the filters), and a snapshot of the last PAULA_SCOPE_POINTS is
+** queued snapshotsPerSec times per second. The queue holds maxLatencySecs worth of snapshots,
+** so that one other thread can show the snapshot that is audible right now.
+** paulaGetScopeSnapshot() gets the newest snapshot at or before sampleClock (older ones are
+** dropped), and returns false if there was none.
+*/
+bool paulaEnableScopeTap(paula_t *p, int32_t snapshotsPerSec, double dMaxLatencySecs);
+bool paulaGetScopeSnapshot(paula_t *p, uint64_t sampleClock, paulaScopeSnapshot_t *out);
+
+/* VU-meters: While mixing, the peak and sum of squares of each voice's output are accumulated
+** (after the volume and BLEP, before the filters). paulaReadVoiceMeters() gets the peak and RMS
+** since the last call and resets the meters. It must be called from the thread that mixes.
+*/
+void paulaEnableVoiceMeters(paula_t *p, bool enable);
+void paulaReadVoiceMeters(paula_t *p, float *fPeak, float *fRms);
+
+/* A state can only be loaded into a Paula with the same output rate and filter setup as the one it
+** was saved from. Queued register writes are not part of the state, and loading one clears the
+** voice meters.
+*/
+void paulaSaveState(paula_t *p, paulaState_t *s);
+void paulaLoadState(paula_t *p, const paulaState_t *s);
 
 // output is -4.00 .. 3.97 (can be louder because of high-pass filter)
-void paulaGenerateSamples(float *fOutL, float *fOutR, int32_t numSamples);
+void paulaGenerateSamples(paula_t *p, float *fOutL, float *fOutR, int32_t numSamples);
+
+/* Advances the voices (and BLEPs) exactly like paulaGenerateSamples() would, but without any
+** output. The output filters are left as they are. For fast seeking (see pt2_mod2wav.c).
+*/
+void paulaSkipSamples(paula_t *p, int32_t numSamples);
+
+/* Same as paulaGenerateSamples(), but each voice is mixed into its own (mono) buffer and filtered
+** on its own (for MOD2WAV stems). The filter states are separate from paulaGenerateSamples()'s.
+** Output is -1.00 .. 0.99 per voice (plus high-pass filter overshoot).
+*/
+void paulaGenerateVoiceSamples(paula_t *p, float *fOutVoice[PAULA_VOICES], int32_t numSamples);
@@ -1,9 +1,21 @@
 #include <math.h>
-#include "pt2_header.h"
+#include "pt2_replay_header.h"
 #include "pt2_rcfilters.h"
+#if defined HAS_SSE2
+#include <emmintrin.h>
+#elif defined HAS_NEON
+#include <arm_neon.h>
+#endif
 
 #define SMALL_NUMBER (1E-4)
 
+/* Filter states below this are flushed to zero after every block. This prevents
+** denormals (slow on x86) when the input goes silent, and lets the filters become
+** idle so that they can be skipped. It's way below audible range (~-200dB).
+*/
+#define DENORMAL_THRESHOLD 1E-10f
+#define FLUSH_DENORMAL(x) if (fabsf(x) < DENORMAL_THRESHOLD) x = 0.0f
+
 // 1-pole 6dB/oct RC low-pass filter (Direct Form II)
 void setupOnePoleFilter(double audioRate, double cutOff, onePoleFilter_t *f)
 {
@@ -58,6 +70,125 @@ void onePoleHPFilterStereo(onePoleFilter_t *f, const float *in, float *out)
 	out[1] = in[1] - f->tmpR;
 }
 
+/* Block versions of the stereo filters (in-place). L/R are processed as two lanes of
+** one SIMD register, with coefficients and filter states kept in registers.
+*/
+
+void onePoleLPFilterStereoBlock(onePoleFilter_t *f, float *fL, float *fR, int32_t numSamples)
+{
+#if defined HAS_SSE2
+	const __m128 vA0 = _mm_set1_ps(f->a0);
+	const __m128 vB1 = _mm_set1_ps(f->b1);
+	__m128 vTmp = _mm_setr_ps(f->tmpL, f->tmpR, 0.0f, 0.0f);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const __m128 vIn = _mm_unpacklo_ps(_mm_load_ss(&fL[i]), _mm_load_ss(&fR[i]));
+		vTmp = _mm_add_ps(_mm_mul_ps(vIn, vA0), _mm_mul_ps(vTmp, vB1));
+
+		_mm_store_ss(&fL[i], vTmp);
+		_mm_store_ss(&fR[i], _mm_shuffle_ps(vTmp, vTmp, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+
+	f->tmpL = _mm_cvtss_f32(vTmp);
+	f->tmpR = _mm_cvtss_f32(_mm_shuffle_ps(vTmp, vTmp, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined HAS_NEON
+	const float32x2_t vA0 = vdup_n_f32(f->a0);
+	const float32x2_t vB1 = vdup_n_f32(f->b1);
+	float32x2_t vTmp = vset_lane_f32(f->tmpR, vdup_n_f32(f->tmpL), 1);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const float32x2_t vIn = vset_lane_f32(fR[i], vdup_n_f32(fL[i]), 1);
+		vTmp = vadd_f32(vmul_f32(vIn, vA0), vmul_f32(vTmp, vB1));
+
+		fL[i] = vget_lane_f32(vTmp, 0);
+		fR[i] = vget_lane_f32(vTmp, 1);
+	}
+
+	f->tmpL = vget_lane_f32(vTmp, 0);
+	f->tmpR = vget_lane_f32(vTmp, 1);
+#else
+	const float a0 = f->a0, b1 = f->b1;
+	float tmpL = f->tmpL, tmpR = f->tmpR;
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		tmpL = (fL[i] * a0) + (tmpL * b1);
+		tmpR = (fR[i] * a0) + (tmpR * b1);
+		fL[i] = tmpL;
+		fR[i] = tmpR;
+	}
+
+	f->tmpL = tmpL;
+	f->tmpR = tmpR;
+#endif
+
+	FLUSH_DENORMAL(f->tmpL);
+	FLUSH_DENORMAL(f->tmpR);
+}
+
+void onePoleHPFilterStereoBlock(onePoleFilter_t *f, float *fL, float *fR, int32_t numSamples)
+{
+#if defined HAS_SSE2
+	const __m128 vA0 = _mm_set1_ps(f->a0);
+	const __m128 vB1 = _mm_set1_ps(f->b1);
+	__m128 vTmp = _mm_setr_ps(f->tmpL, f->tmpR, 0.0f, 0.0f);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const __m128 vIn = _mm_unpacklo_ps(_mm_load_ss(&fL[i]), _mm_load_ss(&fR[i]));
+		vTmp = _mm_add_ps(_mm_mul_ps(vIn, vA0), _mm_mul_ps(vTmp, vB1));
+
+		const __m128 vOut = _mm_sub_ps(vIn, vTmp);
+		_mm_store_ss(&fL[i], vOut);
+		_mm_store_ss(&fR[i], _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+
+	f->tmpL = _mm_cvtss_f32(vTmp);
+	f->tmpR = _mm_cvtss_f32(_mm_shuffle_ps(vTmp, vTmp, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined HAS_NEON
+	const float32x2_t vA0 = vdup_n_f32(f->a0);
+	const float32x2_t vB1 = vdup_n_f32(f->b1);
+	float32x2_t vTmp = vset_lane_f32(f->tmpR, vdup_n_f32(f->tmpL), 1);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const float32x2_t vIn = vset_lane_f32(fR[i], vdup_n_f32(fL[i]), 1);
+		vTmp = vadd_f32(vmul_f32(vIn, vA0), vmul_f32(vTmp, vB1));
+
+		const float32x2_t vOut = vsub_f32(vIn, vTmp);
+		fL[i] = vget_lane_f32(vOut, 0);
+		fR[i] = vget_lane_f32(vOut, 1);
+	}
+
+	f->tmpL = vget_lane_f32(vTmp, 0);
+	f->tmpR = vget_lane_f32(vTmp, 1);
+#else
+	const float a0 = f->a0, b1 = f->b1;
+	float tmpL = f->tmpL, tmpR = f->tmpR;
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		tmpL = (fL[i] * a0) + (tmpL * b1);
+		tmpR = (fR[i] * a0) + (tmpR * b1);
+		fL[i] -= tmpL;
+		fR[i] -= tmpR;
+	}
+
+	f->tmpL = tmpL;
+	f->tmpR = tmpR;
+#endif
+
+	FLUSH_DENORMAL(f->tmpL);
+	FLUSH_DENORMAL(f->tmpR);
+}
+
+bool onePoleFilterIsIdle(const onePoleFilter_t *f)
+{
+	return f->tmpL == 0.0f && f->tmpR == 0.0f;
+}
+
 /* 2-pole RC low-pass filter with Q factor, based on:
 ** https://www.musicdsp.org/en/latest/Filters/38-lp-and-hp-filter.html
 */
@@ -123,3 +254,112 @@ void twoPoleLPFilterStereo(twoPoleFilter_t *f, const float *in, float *out)
 	out[0] = LOut;
 	out[1] = ROut;
 }
+
+void twoPoleLPFilterStereoBlock(twoPoleFilter_t *f, float *fL, float *fR, int32_t numSamples)
+{
+#if defined HAS_SSE2
+	const __m128 vA1 = _mm_set1_ps(f->a1);
+	const __m128 vA2 = _mm_set1_ps(f->a2);
+	const __m128 vB1 = _mm_set1_ps(f->b1);
+	const __m128 vB2 = _mm_set1_ps(f->b2);
+
+	// lane 0 = left, lane 1 = right
+	__m128 vIn1  = _mm_setr_ps(f->tmpL[0], f->tmpR[0], 0.0f, 0.0f);
+	__m128 vIn2  = _mm_setr_ps(f->tmpL[1], f->tmpR[1], 0.0f, 0.0f);
+	__m128 vOut1 = _mm_setr_ps(f->tmpL[2], f->tmpR[2], 0.0f, 0.0f);
+	__m128 vOut2 = _mm_setr_ps(f->tmpL[3], f->tmpR[3], 0.0f, 0.0f);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const __m128 vIn = _mm_unpacklo_ps(_mm_load_ss(&fL[i]), _mm_load_ss(&fR[i]));
+
+		__m128 vOut = _mm_add_ps(_mm_mul_ps(vIn, vA1), _mm_mul_ps(vIn1, vA2));
+		vOut = _mm_add_ps(vOut, _mm_mul_ps(vIn2, vA1));
+		vOut = _mm_sub_ps(vOut, _mm_mul_ps(vOut1, vB1));
+		vOut = _mm_sub_ps(vOut, _mm_mul_ps(vOut2, vB2));
+
+		vIn2 = vIn1;
+		vIn1 = vIn;
+		vOut2 = vOut1;
+		vOut1 = vOut;
+
+		_mm_store_ss(&fL[i], vOut);
+		_mm_store_ss(&fR[i], _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+
+	float fTmp[4][4];
+	_mm_storeu_ps(fTmp[0], vIn1);
+	_mm_storeu_ps(fTmp[1], vIn2);
+	_mm_storeu_ps(fTmp[2], vOut1);
+	_mm_storeu_ps(fTmp[3], vOut2);
+
+	for (int32_t i = 0; i < 4; i++)
+	{
+		f->tmpL[i] = fTmp[i][0];
+		f->tmpR[i] = fTmp[i][1];
+	}
+#elif defined HAS_NEON
+	const float32x2_t vA1 = vdup_n_f32(f->a1);
+	const float32x2_t vA2 = vdup_n_f32(f->a2);
+	const float32x2_t vB1 = vdup_n_f32(f->b1);
+	const float32x2_t vB2 = vdup_n_f32(f->b2);
+
+	// lane 0 = left, lane 1 = right
+	float32x2_t vIn1  = vset_lane_f32(f->tmpR[0], vdup_n_f32(f->tmpL[0]), 1);
+	float32x2_t vIn2  = vset_lane_f32(f->tmpR[1], vdup_n_f32(f->tmpL[1]), 1);
+	float32x2_t vOut1 = vset_lane_f32(f->tmpR[2], vdup_n_f32(f->tmpL[2]), 1);
+	float32x2_t vOut2 = vset_lane_f32(f->tmpR[3], vdup_n_f32(f->tmpL[3]), 1);
+
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		const float32x2_t vIn = vset_lane_f32(fR[i], vdup_n_f32(fL[i]), 1);
+
+		float32x2_t vOut = vadd_f32(vmul_f32(vIn, vA1), vmul_f32(vIn1, vA2));
+		vOut = vadd_f32(vOut, vmul_f32(vIn2, vA1));
+		vOut = vsub_f32(vOut, vmul_f32(vOut1, vB1));
+		vOut = vsub_f32(vOut, vmul_f32(vOut2, vB2));
+
+		vIn2 = vIn1;
+		vIn1 = vIn;
+		vOut2 = vOut1;
+		vOut1 = vOut;
+
+		fL[i] = vget_lane_f32(vOut, 0);
+		fR[i] = vget_lane_f32(vOut, 1);
+	}
+
+	f->tmpL[0] = vget_lane_f32(vIn1, 0);  f->tmpR[0] = vget_lane_f32(vIn1, 1);
+	f->tmpL[1] = vget_lane_f32(vIn2, 0);  f->tmpR[1] = vget_lane_f32(vIn2, 1);
+	f->tmpL[2] = vget_lane_f32(vOut1, 0); f->tmpR[2] = vget_lane_f32(vOut1, 1);
+	f->tmpL[3] = vget_lane_f32(vOut2, 0); f->tmpR[3] = vget_lane_f32(vOut2, 1);
+#else
+	float fIn[2];
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		fIn[0] = fL[i];
+		fIn[1] = fR[i];
+
+		twoPoleLPFilterStereo(f, fIn, fIn);
+
+		fL[i] = fIn[0];
+		fR[i] = fIn[1];
+	}
+#endif
+
+	for (int32_t i = 0; i < 4; i++)
+	{
+		FLUSH_DENORMAL(f->tmpL[i]);
+		FLUSH_DENORMAL(f->tmpR[i]);
+	}
+}
+
+bool twoPoleFilterIsIdle(const twoPoleFilter_t *f)
+{
+	for (int32_t i = 0; i < 4; i++)
+	{
+		if (f->tmpL[i] != 0.0f || f->tmpR[i] != 0.0f)
+			return false;
+	}
+
+	return true;
+}
@@ -19,8 +19,13 @@ void onePoleLPFilterStereo(onePoleFilter_t *f, const float *in, float *out);
 void onePoleHPFilterStereo(onePoleFilter_t *f, const float *in, float *out);
 void onePoleLPFilter(onePoleFilter_t *f, const float in, float *out);
 void onePoleHPFilter(onePoleFilter_t *f, const float in, float *out);
+void onePoleLPFilterStereoBlock(onePoleFilter_t *f, float *fL, float *fR, int32_t numSamples);
+void onePoleHPFilterStereoBlock(onePoleFilter_t *f, float *fL, float *fR, int32_t numSamples);
+bool onePoleFilterIsIdle(const onePoleFilter_t *f); // true if filter state is all zero (silent input gives silent output)
 
 void setupTwoPoleFilter(double audioRate, double cutOff, double qFactor, twoPoleFilter_t *f);
 void clearTwoPoleFilterState(twoPoleFilter_t *f);
 void twoPoleLPFilter(twoPoleFilter_t *f, const float in, float *out);
 void twoPoleLPFilterStereo(twoPoleFilter_t *f, const float *in, float *out);
+void twoPoleLPFilterStereoBlock(twoPoleFilter_t *f, float *fL, float *fR, int32_t numSamples);
+bool twoPoleFilterIsIdle(const twoPoleFilter_t *f);
@@ -0,0 +1,1323 @@
+/* C port of ProTracker 2.3D's replayer (with some modifications, but still accurate).
+**
+** This is the headless part (libpt2replay), the tracker side is in pt2_replayer.c.
+*/
+
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "pt2_replay_header.h"
+#include "pt2_replay_tables.h"
+#include "pt2_paula.h"
+#include "pt2_replay.h"
+
+typedef void (*effectFunc_t)(replayer_t *r, moduleChannel_t *ch);
+
+static const uint8_t funkTable[16] = // EFx (FunkRepeat/InvertLoop)
+{
+	0x00, 0x05, 0x06, 0x07, 0x08, 0x0A, 0x0B, 0x0D,
+	0x10, 0x13, 0x16, 0x1A, 0x20, 0x2B, 0x40, 0x80
+};
+
+static void setFineTuneValue(moduleChannel_t *ch, uint8_t finetune);
+static void decodeEffect(moduleChannel_t *ch);
+
+double ciaBpm2Hz(int32_t bpm)
+{
+	if (bpm == 0)
+		return 0.0;
+
+	const uint32_t ciaPeriod = 1773447 / bpm; // yes, PT truncates here
+	return (double)CIA_PAL_CLK / (ciaPeriod+1); // +1, CIA triggers on underflow
+}
+
+// used by the mixers and the song duration calculator, so that they all get the exact same tick lengths
+void getSamplesPerTick(double dAudioFreq, int32_t bpm, bool vblankTimingFlag, uint32_t *samplesPerTickInt, uint64_t *samplesPerTickFrac)
+{
+	const double dHz = vblankTimingFlag ? AMIGA_PAL_VBLANK_HZ : ciaBpm2Hz(bpm);
+
+	const double dSamplesPerTick = dAudioFreq / dHz;
+	double dSamplesPerTickInt, dSamplesPerTickFrac = modf(dSamplesPerTick, &dSamplesPerTickInt);
+
+	*samplesPerTickInt = (uint32_t)dSamplesPerTickInt;
+	*samplesPerTickFrac = (uint64_t)(dSamplesPerTickFrac * BPM_FRAC_SCALE);
+}
+
+void replayerResetChannels(replayer_t *r)
+{
+	memset(r->channels, 0, sizeof (r->channels));
+
+	moduleChannel_t *ch = r->channels;
+	for (uint8_t i = 0; i < PAULA_VOICES; i++, ch++)
+	{
+		ch->n_chanindex = i;
+		ch->n_dmabit = 1 << i;
+
+		setFineTuneValue(ch, 0);
+		decodeEffect(ch); // (no effect)
+	}
+}
+
+void replayerInit(replayer_t *r, module_t *song, paula_t *paula)
+{
+	memset(r, 0, sizeof (replayer_t));
+
+	r->song = song;
+	r->paula = paula;
+
+	replayerResetChannels(r);
+
+	r->speed = 6;
+	r->tick = r->speed - 1;
+	r->bpm = 125;
+	r->ciaSetBPM = -1;
+	r->lowMask = 0xFF;
+}
+
+void replayerResetEffectModes(replayer_t *r)
+{
+	moduleChannel_t *ch = r->channels;
+	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
+	{
+		ch->n_wavecontrol = 0;
+		ch->n_glissfunk = 0;
+		ch->n_loopcount = 0;
+		setFineTuneValue(ch, 0);
+	}
+}
+
+void replayerStopEffects(replayer_t *r)
+{
+	r->pattDelTime = r->pattDelTime2 = 0;
+	replayerResetEffectModes(r);
+	r->stopSong = false; // just in case this flag was stuck from command F00 (stop song)
+}
+
+void replayerTurnOffVoices(replayer_t *r)
+{
+	paulaWriteWord(r->paula, 0xDFF096, 0x000F); // turn off all voice DMAs
+
+	// clear all volumes
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		const uint32_t voiceAddr = 0xDFF0A0 + (i * 16);
+		paulaWriteWord(r->paula, voiceAddr + 8, 0);
+	}
+}
+
+int32_t replayerGetStartTempo(const module_t *song)
+{
+	if (song->header.initialTempo < MIN_BPM || song->header.initialTempo > MAX_BPM)
+		return 125;
+
+	return song->header.initialTempo;
+}
+
+void replayerRestart(replayer_t *r)
+{
+	replayerResetChannels(r);
+
+	r->speed = 6;
+	r->tick = r->speed - 1; // read the first row on the next tick
+	r->bpm = replayerGetStartTempo(r->song);
+	r->ciaSetBPM = -1;
+	r->lowMask = 0xFF;
+
+	r->pos = 0;
+	r->row = 0;
+	r->pattern = (int8_t)r->song->header.patternTable[0];
+	if (r->pattern > MAX_PATTERNS-1)
+		r->pattern = MAX_PATTERNS-1;
+
+	r->pBreakPosition = 0;
+	r->pattDelTime = r->pattDelTime2 = 0;
+	r->DMACONtemp = 0;
+	r->posJumpAssert = r->pBreakFlag = r->renderDone = r->stopSong = false;
+	r->playbackSeconds = r->playbackSecondsFrac = 0;
+
+	memset(r->rowVisitTable, 0, sizeof (r->rowVisitTable));
+}
+
+void replayerSetTempo(replayer_t *r, int32_t bpm)
+{
+	if (bpm < MIN_BPM || bpm > MAX_BPM)
+		return;
+
+	r->bpm = bpm;
+	if (r->cb.tempoChanged != NULL)
+		r->cb.tempoChanged(r->cb.userData, bpm);
+}
+
+void replayerSetSpeed(replayer_t *r, int32_t speed)
+{
+	r->speed = speed;
+	r->tick = 0;
+
+	if (r->cb.speedChanged != NULL)
+		r->cb.speedChanged(r->cb.userData, speed);
+}
+
+static void setVUMeterHeight(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->muted[ch->n_chanindex])
+		return;
+
+	uint8_t vol = ch->n_volume;
+	if (ch->n_fxcmd == 0xC) // handle Cxx effect
+		vol = ch->n_param;
+
+	if (vol > 64)
+		vol = 64;
+
+	ch->syncVuVolume = vol;
+	ch->syncFlags |= UPDATE_VUMETER;
+}
+
+static void updateFunk(replayer_t *r, moduleChannel_t *ch)
+{
+	const int8_t funkSpeed = ch->n_glissfunk >> 4;
+	if (funkSpeed == 0)
+		return;
+
+	ch->n_funkoffset += funkTable[funkSpeed];
+	if (ch->n_funkoffset >= 128)
+	{
+		ch->n_funkoffset = 0;
+
+		if (ch->n_loopstart != NULL && ch->n_wavestart != NULL) // ProTracker bugfix
+		{
+			if (++ch->n_wavestart >= ch->n_loopstart + (ch->n_replen << 1))
+				ch->n_wavestart = ch->n_loopstart;
+
+			if (!r->keepSampleData)
+				*ch->n_wavestart = -1 - *ch->n_wavestart;
+		}
+	}
+}
+
+static void setGlissControl(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+
+	ch->n_glissfunk = (ch->n_glissfunk & 0xF0) | ch->n_paramy;
+}
+
+static void setVibratoControl(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+
+	ch->n_wavecontrol = (ch->n_wavecontrol & 0xF0) | ch->n_paramy;
+}
+
+static void setFineTuneValue(moduleChannel_t *ch, uint8_t finetune) // (also sets the period table pointer)
+{
+	ch->n_finetune = finetune;
+	ch->n_periods = &periodTable[finetune * 37];
+}
+
+static void setFineTune(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+	setFineTuneValue(ch, ch->n_paramy);
+}
+
+static void jumpLoop(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick != 0)
+		return;
+
+	if (ch->n_paramy == 0)
+	{
+		ch->n_pattpos = r->row;
+	}
+	else
+	{
+		if (ch->n_loopcount == 0)
+			ch->n_loopcount = ch->n_paramy;
+		else if (--ch->n_loopcount == 0)
+			return;
+
+		r->pBreakPosition = ch->n_pattpos;
+		r->pBreakFlag = true;
+
+		// stuff used for MOD2WAV to determine if the song has reached its end
+		if (r->renderMode == REPLAYER_RENDER_SONG)
+		{
+			for (int32_t tempParam = r->pBreakPosition; tempParam <= r->row; tempParam++)
+				r->rowVisitTable[(r->pos * MOD_ROWS) + tempParam] = false;
+		}
+	}
+}
+
+static void setTremoloControl(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+
+	ch->n_wavecontrol = (ch->n_paramy << 4) | (ch->n_wavecontrol & 0xF);
+}
+
+/* This is the least used (and least known) ProTracker effect there is. It's not even
+** documented in the official ProTracker help text...
+**
+** When E8x is seen in a .mod, it is in >95% of cases used for demo effect syncing for
+** demo .mod players, so it is disabled by default (as this effect trashes sample data
+*   and is almost NEVER used as Karplus-Strong intentionally).
+** It can be turned on through ENABLE_E8X in protracker.ini if you so desire.
+*/
+static void karplusStrong(replayer_t *r, moduleChannel_t *ch) // E8x
+{
+	if (!r->enableE8xEffect || r->keepSampleData)
+		return;
+
+	if (ch->n_loopstart == NULL)
+		return; // ProTracker bugfix
+
+	// yes, this means that it's buggy for >64kB loops!
+	uint16_t end = (uint16_t)((ch->n_replen * 2) - 2);
+
+	int8_t *loopStartPtr = ch->n_loopstart;
+	for (int32_t i = 0; i <= end; i++)
+		loopStartPtr[i] = (loopStartPtr[i+0] + loopStartPtr[i+1]) >> 1;
+
+	loopStartPtr[end+1] = (loopStartPtr[end+1] + loopStartPtr[0]) >> 1;
+}
+
+static void doRetrg(replayer_t *r, moduleChannel_t *ch)
+{
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+
+	// voice DMA off
+	paulaWriteWord(r->paula, 0xDFF096, ch->n_dmabit); 
+
+	// set voice data ptr, data length and period
+	paulaWritePtr(r->paula, voiceAddr + 0, ch->n_start); // n_start is increased on 9xx
+	paulaWriteWord(r->paula, voiceAddr + 4, ch->n_length);
+	paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+
+	// voice DMA on
+	paulaWriteWord(r->paula, 0xDFF096, 0x8000 | ch->n_dmabit); 
+	
+	// set new data ptr and data length (these take effect after the current DMA cycle is done)
+	paulaWritePtr(r->paula, voiceAddr + 0, ch->n_loopstart);
+	paulaWriteWord(r->paula, voiceAddr + 4, ch->n_replen);
+
+	// set spectrum analyzer state for this channel
+	ch->syncAnalyzerVolume = ch->n_volume;
+	ch->syncAnalyzerPeriod = ch->n_period;
+	ch->syncFlags |= UPDATE_SPECTRUM_ANALYZER;
+
+	setVUMeterHeight(r, ch);
+}
+
+static void retrigNote(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_paramy > 0)
+	{
+		if (r->tick == 0 && (ch->n_note & 0xFFF) > 0)
+			return;
+
+		if (r->tick % ch->n_paramy == 0)
+			doRetrg(r, ch);
+	}
+}
+
+static void volumeSlide(moduleChannel_t *ch)
+{
+	if (ch->n_paramx == 0)
+	{
+		ch->n_volume -= ch->n_paramy;
+		if (ch->n_volume < 0)
+			ch->n_volume = 0;
+	}
+	else
+	{
+		ch->n_volume += ch->n_paramx;
+		if (ch->n_volume > 64)
+			ch->n_volume = 64;
+	}
+}
+
+static void volumeFineUp(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0)
+	{
+		ch->n_volume += ch->n_paramy;
+		if (ch->n_volume > 64)
+			ch->n_volume = 64;
+	}
+}
+
+static void volumeFineDown(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0)
+	{
+		ch->n_volume -= ch->n_paramy;
+		if (ch->n_volume < 0)
+			ch->n_volume = 0;
+	}
+}
+
+static void noteCut(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == ch->n_paramy)
+		ch->n_volume = 0;
+}
+
+static void noteDelay(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == ch->n_paramy && (ch->n_note & 0xFFF) > 0)
+		doRetrg(r, ch);
+}
+
+static void patternDelay(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0 && r->pattDelTime2 == 0)
+		r->pattDelTime = ch->n_paramy + 1;
+}
+
+static void funkIt(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0)
+	{
+		ch->n_glissfunk = (ch->n_paramy << 4) | (ch->n_glissfunk & 0xF);
+
+		if ((ch->n_glissfunk & 0xF0) > 0)
+			updateFunk(r, ch);
+	}
+}
+
+static void positionJump(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->stepPlay)
+		return;
+
+	// original PT doesn't do this check, but we have to
+	if (!r->patternMode)
+		r->pos = ch->n_param - 1; // B00 results in -1, but it safely jumps to order 0
+
+	r->pBreakPosition = 0;
+	r->posJumpAssert = true;
+}
+
+static void volumeChange(moduleChannel_t *ch)
+{
+	ch->n_volume = ch->n_param;
+	if ((uint8_t)ch->n_volume > 64)
+		ch->n_volume = 64;
+}
+
+static void patternBreak(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->stepPlay)
+		return;
+
+	r->pBreakPosition = (ch->n_paramx * 10) + ch->n_paramy;
+	if ((uint8_t)r->pBreakPosition > 63)
+		r->pBreakPosition = 0;
+
+	r->posJumpAssert = true;
+}
+
+static void setSpeed(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_param > 0)
+	{
+		if (r->vblankTiming || ch->n_param < 32)
+			replayerSetSpeed(r, ch->n_param);
+		else
+			r->ciaSetBPM = ch->n_param; // the CIA chip doesn't use its new timer value until the next interrupt, so change it later
+	}
+	else
+	{
+		// F00 - stop song
+		r->stopSong = true;
+	}
+}
+
+static void arpeggio(replayer_t *r, moduleChannel_t *ch)
+{
+	int32_t arpNote;
+
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+
+	int32_t arpTick = r->tick % 3; // 0, 1, 2
+	if (arpTick == 1)
+	{
+		arpNote = ch->n_paramx;
+	}
+	else if (arpTick == 2)
+	{
+		arpNote = ch->n_paramy;
+	}
+	else // arpTick 0
+	{
+		// set voice period
+		paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+
+		return;
+	}
+
+	/* 8bitbubsy: If the finetune is -1, this can overflow up to
+	** 15 words outside of the table. The table is padded with
+	** the correct overflow values to allow this to safely happen
+	** and sound correct at the same time.
+	*/
+	const int16_t *periods = ch->n_periods;
+	for (int32_t baseNote = 0; baseNote < 37; baseNote++)
+	{
+		if (ch->n_period >= periods[baseNote])
+		{
+			// set voice period
+			paulaWriteWord(r->paula, voiceAddr + 6, periods[baseNote+arpNote]);
+
+			break;
+		}
+	}
+}
+
+static void portaUp(replayer_t *r, moduleChannel_t *ch)
+{
+	ch->n_period -= ch->n_param & r->lowMask;
+	r->lowMask = 0xFF;
+
+	if ((ch->n_period & 0xFFF) < 113) // PT BUG: sign removed before comparison, underflow not clamped!
+		ch->n_period = (ch->n_period & 0xF000) | 113;
+
+	// set voice period
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+	paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period & 0xFFF);
+}
+
+static void portaDown(replayer_t *r, moduleChannel_t *ch)
+{
+	ch->n_period += ch->n_param & r->lowMask;
+	r->lowMask = 0xFF;
+
+	if ((ch->n_period & 0xFFF) > 856)
+		ch->n_period = (ch->n_period & 0xF000) | 856;
+
+	// set voice period
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+	paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period & 0xFFF);
+}
+
+static void filterOnOff(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0) // added this (just pointless to call this during all ticks!)
+	{
+		const bool filterOn = (ch->n_paramy & 1) ^ 1;
+
+		// set "LED" filter
+		paulaWriteByte(r->paula, 0xBFE001, filterOn << 1);
+		if (r->cb.ledFilterChanged != NULL)
+			r->cb.ledFilterChanged(r->cb.userData, filterOn);
+	}
+}
+
+static void finePortaUp(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0)
+	{
+		r->lowMask = 0xF;
+		portaUp(r, ch);
+	}
+}
+
+static void finePortaDown(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->tick == 0)
+	{
+		r->lowMask = 0xF;
+		portaDown(r, ch);
+	}
+}
+
+static void setTonePorta(moduleChannel_t *ch)
+{
+	uint16_t note = ch->n_note & 0xFFF;
+	const int16_t *portaPointer = ch->n_periods;
+
+	int32_t i = 0;
+	while (true)
+	{
+		// portaPointer[36] = 0, so i=36 is safe
+		if (note >= portaPointer[i])
+			break;
+
+		if (++i >= 37)
+		{
+			i = 35;
+			break;
+		}
+	}
+
+	if ((ch->n_finetune & 8) && i > 0)
+		i--;
+
+	ch->n_wantedperiod = portaPointer[i];
+	ch->n_toneportdirec = 0;
+
+	     if (ch->n_period == ch->n_wantedperiod) ch->n_wantedperiod = 0;
+	else if (ch->n_period > ch->n_wantedperiod) ch->n_toneportdirec = 1;
+}
+
+static void tonePortNoChange(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_wantedperiod <= 0)
+		return;
+
+	if (ch->n_toneportdirec > 0)
+	{
+		ch->n_period -= ch->n_toneportspeed;
+		if (ch->n_period <= ch->n_wantedperiod)
+		{
+			ch->n_period = ch->n_wantedperiod;
+			ch->n_wantedperiod = 0;
+		}
+	}
+	else
+	{
+		ch->n_period += ch->n_toneportspeed;
+		if (ch->n_period >= ch->n_wantedperiod)
+		{
+			ch->n_period = ch->n_wantedperiod;
+			ch->n_wantedperiod = 0;
+		}
+	}
+
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+
+	if ((ch->n_glissfunk & 0xF) == 0)
+	{
+		// set voice period
+		paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+	}
+	else
+	{
+		const int16_t *portaPointer = ch->n_periods;
+
+		int32_t i = 0;
+		while (true)
+		{
+			// portaPointer[36] = 0, so i=36 is safe
+			if (ch->n_period >= portaPointer[i])
+				break;
+
+			if (++i >= 37)
+			{
+				i = 35;
+				break;
+			}
+		}
+
+		// set voice period
+		paulaWriteWord(r->paula, voiceAddr + 6, portaPointer[i]);
+	}
+}
+
+static void tonePortamento(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_param > 0)
+	{
+		ch->n_toneportspeed = ch->n_param;
+		ch->n_cmd &= 0xFF00;
+		ch->n_param = ch->n_paramx = ch->n_paramy = 0;
+	}
+
+	tonePortNoChange(r, ch);
+}
+
+static void vibrato2(replayer_t *r, moduleChannel_t *ch)
+{
+	uint16_t vibratoData;
+
+	const uint8_t vibratoPos = (ch->n_vibratopos >> 2) & 0x1F;
+	const uint8_t vibratoType = ch->n_wavecontrol & 3;
+
+	if (vibratoType == 0) // sine
+	{
+		vibratoData = vibratoTable[vibratoPos];
+	}
+	else if (vibratoType == 1) // ramp
+	{
+		if (ch->n_vibratopos < 128)
+			vibratoData = vibratoPos << 3;
+		else
+			vibratoData = 255 - (vibratoPos << 3);
+	}
+	else // square
+	{
+		vibratoData = 255;
+	}
+
+	vibratoData = (vibratoData * (ch->n_vibratocmd & 0xF)) >> 7;
+
+	if (ch->n_vibratopos < 128)
+		vibratoData = ch->n_period + vibratoData;
+	else
+		vibratoData = ch->n_period - vibratoData;
+
+	// set voice period
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+	paulaWriteWord(r->paula, voiceAddr + 6, vibratoData);
+
+	ch->n_vibratopos += (ch->n_vibratocmd >> 2) & 0x3C;
+}
+
+static void vibrato(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_paramy > 0)
+		ch->n_vibratocmd = (ch->n_vibratocmd & 0xF0) | ch->n_paramy;
+
+	if (ch->n_paramx > 0)
+		ch->n_vibratocmd = (ch->n_paramx << 4) | (ch->n_vibratocmd & 0x0F);
+
+	vibrato2(r, ch);
+}
+
+static void tonePlusVolSlide(replayer_t *r, moduleChannel_t *ch)
+{
+	tonePortNoChange(r, ch);
+	volumeSlide(ch);
+}
+
+static void vibratoPlusVolSlide(replayer_t *r, moduleChannel_t *ch)
+{
+	vibrato2(r, ch);
+	volumeSlide(ch);
+}
+
+static void tremolo(replayer_t *r, moduleChannel_t *ch)
+{
+	int16_t tremoloData;
+
+	if (ch->n_paramy > 0)
+		ch->n_tremolocmd = (ch->n_tremolocmd & 0xF0) | ch->n_paramy;
+
+	if (ch->n_paramx > 0)
+		ch->n_tremolocmd = (ch->n_paramx << 4) | (ch->n_tremolocmd & 0x0F);
+
+	const uint8_t tremoloPos = (ch->n_tremolopos >> 2) & 0x1F;
+	const uint8_t tremoloType = (ch->n_wavecontrol >> 4) & 3;
+
+	if (tremoloType == 0) // sine
+	{
+		tremoloData = vibratoTable[tremoloPos];
+	}
+	else if (tremoloType == 1) // ramp
+	{
+		if (ch->n_vibratopos < 128) // PT bug, should've been ch->n_tremolopos
+			tremoloData = tremoloPos << 3;
+		else
+			tremoloData = 255 - (tremoloPos << 3);
+	}
+	else // square
+	{
+		tremoloData = 255;
+	}
+
+	tremoloData = ((uint16_t)tremoloData * (ch->n_tremolocmd & 0xF)) >> 6;
+
+	if (ch->n_tremolopos < 128)
+	{
+		tremoloData = ch->n_volume + tremoloData;
+		if (tremoloData > 64)
+			tremoloData = 64;
+	}
+	else
+	{
+		tremoloData = ch->n_volume - tremoloData;
+		if (tremoloData < 0)
+			tremoloData = 0;
+	}
+
+	// set voice volume
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+	paulaWriteWord(r->paula, voiceAddr + 8, tremoloData);
+
+	ch->n_tremolopos += (ch->n_tremolocmd >> 2) & 0x3C;
+}
+
+static void sampleOffset(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+
+	if (ch->n_param > 0)
+		ch->n_sampleoffset = ch->n_param;
+
+	const uint16_t newOffset = ch->n_sampleoffset << 7;
+	if (newOffset < ch->n_length)
+	{
+		ch->n_length -= newOffset;
+		ch->n_start += newOffset << 1;
+	}
+	else
+	{
+		ch->n_length = 1;
+	}
+}
+
+static void setVoicePeriod(replayer_t *r, moduleChannel_t *ch)
+{
+	// set voice period
+	const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+	paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+}
+
+/* The effect of a row is decoded once when the row is read (decodeEffect()), into a handler
+** for tick 0 (checkMoreEffects() in PT) and one for the other ticks (chkefx2() in PT), so that
+** the ticks don't have to go through the PT effect switches again.
+*/
+
+static const effectFunc_t eCommandTable[16] =
+{
+	filterOnOff, finePortaUp, finePortaDown, setGlissControl,
+	setVibratoControl, setFineTune, jumpLoop, setTremoloControl,
+	karplusStrong, retrigNote, volumeFineUp, volumeFineDown,
+	noteCut, noteDelay, patternDelay, funkIt
+};
+
+static void E_Commands(replayer_t *r, moduleChannel_t *ch) // (tick 0 only, the other ticks call eCommandTable[] directly)
+{
+	// E9x..EDx and EFx are not done on muted channels
+	if (r->muted[ch->n_chanindex] && ch->n_paramx >= 0x9 && ch->n_paramx != 0xE)
+		return;
+
+	eCommandTable[ch->n_paramx](r, ch);
+}
+
+static void noEffect(replayer_t *r, moduleChannel_t *ch)
+{
+	(void)r;
+	(void)ch;
+}
+
+static void tickSetPeriod(replayer_t *r, moduleChannel_t *ch)
+{
+	setVoicePeriod(r, ch);
+}
+
+static void tickTremolo(replayer_t *r, moduleChannel_t *ch)
+{
+	setVoicePeriod(r, ch);
+	tremolo(r, ch);
+}
+
+static void tickVolumeSlide(replayer_t *r, moduleChannel_t *ch)
+{
+	setVoicePeriod(r, ch);
+	volumeSlide(ch);
+}
+
+static void rowSetPeriod(replayer_t *r, moduleChannel_t *ch)
+{
+	if (!r->muted[ch->n_chanindex])
+		setVoicePeriod(r, ch);
+}
+
+static void rowVolumeChange(replayer_t *r, moduleChannel_t *ch)
+{
+	if (!r->muted[ch->n_chanindex])
+		volumeChange(ch);
+}
+
+static const effectFunc_t tickEffectTable[16] = // chkefx2()
+{
+	arpeggio, portaUp, portaDown, tonePortamento,
+	vibrato, tonePlusVolSlide, vibratoPlusVolSlide, tickTremolo,
+	tickSetPeriod, tickSetPeriod, tickVolumeSlide, tickSetPeriod,
+	tickSetPeriod, tickSetPeriod, NULL /* eCommandTable[] */, tickSetPeriod
+};
+
+static const effectFunc_t rowEffectTable[16] = // checkMoreEffects()
+{
+	rowSetPeriod, rowSetPeriod, rowSetPeriod, rowSetPeriod,
+	rowSetPeriod, rowSetPeriod, rowSetPeriod, rowSetPeriod,
+	rowSetPeriod, sampleOffset, rowSetPeriod, positionJump,
+	rowVolumeChange, patternBreak, E_Commands, setSpeed
+};
+
+static void decodeEffect(moduleChannel_t *ch)
+{
+	ch->n_fxcmd = (ch->n_cmd >> 8) & 0xF;
+	ch->n_param = ch->n_cmd & 0xFF;
+	ch->n_paramx = ch->n_param >> 4;
+	ch->n_paramy = ch->n_param & 0xF;
+
+	ch->n_rowfx = rowEffectTable[ch->n_fxcmd];
+
+	if ((ch->n_cmd & 0xFFF) == 0)
+		ch->n_tickfx = noEffect;
+	else if (ch->n_fxcmd == 0xE)
+		ch->n_tickfx = eCommandTable[ch->n_paramx];
+	else
+		ch->n_tickfx = tickEffectTable[ch->n_fxcmd];
+}
+
+static void checkMoreEffects(replayer_t *r, moduleChannel_t *ch)
+{
+	ch->n_rowfx(r, ch);
+}
+
+static void checkEffects(replayer_t *r, moduleChannel_t *ch)
+{
+	if (r->muted[ch->n_chanindex])
+		return;
+
+	updateFunk(r, ch);
+	ch->n_tickfx(r, ch);
+
+	/* This is not very clear in the original PT replayer code,
+	** but the tremolo effect skips chkefx2()'s return address
+	** in the stack so that it jumps to checkEffects()'s return
+	** address instead of ending up here. In other words, volume
+	** is not updated here after tremolo (it's done inside the
+	** tremolo routine itself).
+	*/
+	if (ch->n_fxcmd != 0x7)
+	{
+		// set voice volume
+		const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+		paulaWriteWord(r->paula, voiceAddr + 8, ch->n_volume);
+	}
+}
+
+static void setPeriod(replayer_t *r, moduleChannel_t *ch)
+{
+	int32_t i;
+
+	uint16_t note = ch->n_note & 0xFFF;
+	for (i = 0; i < 37; i++)
+	{
+		// periodTable[36] = 0, so i=36 is safe
+		if (note >= periodTable[i])
+			break;
+	}
+
+	// yes it's safe if i=37 because of zero-padding
+	ch->n_period = ch->n_periods[i];
+
+	if (ch->n_fxcmd != 0xE || ch->n_paramx != 0xD) // no note delay
+	{
+		// voice DMA off (turned on in setDMA() later)
+		paulaWriteWord(r->paula, 0xDFF096, ch->n_dmabit);
+
+		if ((ch->n_wavecontrol & 0x04) == 0) ch->n_vibratopos = 0;
+		if ((ch->n_wavecontrol & 0x40) == 0) ch->n_tremolopos = 0;
+
+		const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+
+		// set voice data length and data ptr
+		paulaWriteWord(r->paula, voiceAddr + 4, ch->n_length);
+		paulaWritePtr(r->paula, voiceAddr + 0, ch->n_start);
+
+		if (ch->n_start == NULL)
+		{
+			ch->n_loopstart = NULL;
+			paulaWriteWord(r->paula, voiceAddr + 4, 1); // length
+			ch->n_replen = 1;
+		}
+
+		// set voice period
+		paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+
+		r->DMACONtemp |= ch->n_dmabit;
+
+		// set spectrum analyzer state for this channel
+		if (!r->muted[ch->n_chanindex])
+		{
+			ch->syncAnalyzerVolume = ch->n_volume;
+			ch->syncAnalyzerPeriod = ch->n_period;
+			ch->syncFlags |= UPDATE_SPECTRUM_ANALYZER;
+		}
+	}
+
+	checkMoreEffects(r, ch);
+}
+
+static void checkMetronome(replayer_t *r, moduleChannel_t *ch, note_t *note)
+{
+	if (r->metroChannel > 0 && r->metroSpeed > 0)
+	{
+		if (ch->n_chanindex == (uint32_t)r->metroChannel-1 && (r->row % r->metroSpeed) == 0)
+		{
+			note->sample = 31;
+			note->period = (((r->row / r->metroSpeed) % r->metroSpeed) == 0) ? 160 : 214;
+		}
+	}
+}
+
+static void playVoice(replayer_t *r, moduleChannel_t *ch)
+{
+	if (ch->n_note == 0 && ch->n_cmd == 0) // test period, command and command parameter
+	{
+		// set voice period
+		const uint32_t voiceAddr = 0xDFF0A0 + (ch->n_chanindex * 16);
+		paulaWriteWord(r->paula, voiceAddr + 6, ch->n_period);
+	}
+
+	note_t note = r->song->patterns[r->pattern][(r->row * PAULA_VOICES) + ch->n_chanindex];
+
+	checkMetronome(r, ch, &note);
+
+	ch->n_note = note.period;
+	ch->n_cmd = (note.command << 8) | note.param;
+	decodeEffect(ch);
+
+	if (note.sample >= 1 && note.sample <= 31) // SAFETY BUG FIX: don't handle sample-numbers >31
+	{
+		ch->n_samplenum = note.sample - 1;
+		moduleSample_t *s = &r->song->samples[ch->n_samplenum];
+
+		ch->n_start = &r->song->sampleData[s->offset];
+		setFineTuneValue(ch, s->fineTune & 0xF);
+		ch->n_volume = s->volume;
+		ch->n_length = (uint16_t)(s->length >> 1);
+		ch->n_replen = (uint16_t)(s->loopLength >> 1);
+
+		const uint16_t repeat = (uint16_t)(s->loopStart >> 1);
+		if (repeat > 0)
+		{
+			ch->n_loopstart = ch->n_start + (repeat << 1);
+			ch->n_wavestart = ch->n_loopstart;
+			ch->n_length = repeat + ch->n_replen;
+		}
+		else
+		{
+			ch->n_loopstart = ch->n_start;
+			ch->n_wavestart = ch->n_start;
+		}
+
+		// non-PT2 requirement (set safe sample space for uninitialized voices - f.ex. "the ultimate beeper.mod")
+		if (ch->n_length == 0)
+			ch->n_loopstart = ch->n_wavestart = paulaGetNullSamplePtr();
+	}
+
+	if ((ch->n_note & 0xFFF) > 0)
+	{
+		if (ch->n_fxcmd == 0xE && ch->n_paramx == 0x5) // set finetune
+		{
+			setFineTune(r, ch);
+			setPeriod(r, ch);
+		}
+		else
+		{
+			if (ch->n_fxcmd == 3 || ch->n_fxcmd == 5)
+			{
+				setVUMeterHeight(r, ch);
+				setTonePorta(ch);
+				checkMoreEffects(r, ch);
+			}
+			else if (ch->n_fxcmd == 9)
+			{
+				checkMoreEffects(r, ch);
+				setPeriod(r, ch);
+			}
+			else
+			{
+				setPeriod(r, ch);
+			}
+		}
+	}
+	else
+	{
+		checkMoreEffects(r, ch);
+	}
+}
+
+static void positionChanged(replayer_t *r)
+{
+	if (r->cb.positionChanged != NULL)
+		r->cb.positionChanged(r->cb.userData);
+}
+
+static void stepPlayDone(replayer_t *r)
+{
+	r->stepPlay = false;
+	r->stepPlayBackwards = false;
+
+	if (r->cb.stepPlayDone != NULL)
+		r->cb.stepPlayDone(r->cb.userData);
+}
+
+static void nextPosition(replayer_t *r)
+{
+	if (r->renderMode == REPLAYER_RENDER_PATTERN)
+		r->renderDone = true;
+
+	r->row = r->pBreakPosition;
+	r->pBreakPosition = 0;
+	r->posJumpAssert = false;
+
+	if (!r->patternMode)
+	{
+		if (r->stepPlay)
+		{
+			stepPlayDone(r);
+			return;
+		}
+
+		r->pos = (r->pos + 1) & 127;
+		if (r->pos >= r->song->header.songLength)
+		{
+			r->pos = 0;
+
+			if (r->stopAtSongEnd) // stop song for music competitions playing
+			{
+				replayerStopEffects(r);
+				if (r->cb.songEnded != NULL)
+					r->cb.songEnded(r->cb.userData);
+
+				r->pos = 0;
+				r->pattern = (int8_t)r->song->header.patternTable[r->pos];
+				r->row = 0;
+
+				positionChanged(r);
+			}
+
+			if (r->renderMode == REPLAYER_RENDER_SONG)
+				r->renderDone = true;
+		}
+
+		r->pattern = (int8_t)r->song->header.patternTable[r->pos];
+		if (r->pattern > MAX_PATTERNS-1)
+			r->pattern = MAX_PATTERNS-1;
+	}
+}
+
+static void increasePlaybackTimer(replayer_t *r)
+{
+	if (!r->countPlaybackTime || r->bpm < MIN_BPM || r->bpm > MAX_BPM)
+		return;
+
+	if (r->vblankTiming)
+		r->playbackSecondsFrac += tickDuration31fp[(MAX_BPM-MIN_BPM)+1]; // vblank tempo mode
+	else
+		r->playbackSecondsFrac += tickDuration31fp[r->bpm-MIN_BPM];
+
+	if (r->playbackSecondsFrac > INT32_MAX)
+	{
+		r->playbackSecondsFrac &= INT32_MAX;
+
+		if (r->playbackSeconds >= (99*60)+59) // wrap around 99:59 -> 00:00
+			r->playbackSeconds = 0;
+		else
+			r->playbackSeconds++;
+	}
+}
+
+static bool renderEndCheck(replayer_t *r) // for MOD2WAV/PAT2SMP
+{
+	if (r->renderMode == REPLAYER_RENDER_OFF || r->pattDelTime2 != 0)
+		return true;
+
+	if (r->renderMode == REPLAYER_RENDER_PATTERN)
+		return !r->renderDone;
+
+	if (r->tick == r->speed-1)
+	{
+		const bool rowVisited = r->rowVisitTable[(r->pos * MOD_ROWS) + r->row];
+		if (rowVisited || r->renderDone)
+		{
+			r->renderDone = false;
+			return false; // we're done rendering
+		}
+	}
+
+	return true;
+}
+
+static void setDMA(replayer_t *r)
+{
+	if (r->muted[0]) r->DMACONtemp &= ~1;
+	if (r->muted[1]) r->DMACONtemp &= ~2;
+	if (r->muted[2]) r->DMACONtemp &= ~4;
+	if (r->muted[3]) r->DMACONtemp &= ~8;
+
+	// start DMAs for selected voices
+	paulaWriteWord(r->paula, 0xDFF096, 0x8000 | r->DMACONtemp);
+
+	moduleChannel_t *ch = r->channels;
+	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
+	{
+		if (r->DMACONtemp & ch->n_dmabit) // handle visuals on sample trigger
+			setVUMeterHeight(r, ch);
+
+		// set new voice data ptr and length (these take effect after the current DMA cycle is done)
+		const uint32_t voiceAddr = 0xDFF0A0 + (i * 16);
+		paulaWritePtr(r->paula, voiceAddr + 0, ch->n_loopstart);
+		paulaWriteWord(r->paula, voiceAddr + 4, ch->n_replen);
+	}
+}
+
+bool replayerTick(replayer_t *r)
+{
+	// quirk: CIA BPM changes are delayed by one tick in PT, so handle previous tick's BPM change now
+	if (r->ciaSetBPM != -1)
+	{
+		const int32_t newBPM = r->ciaSetBPM;
+		replayerSetTempo(r, newBPM);
+		r->ciaSetBPM = -1;
+	}
+
+	if (!r->stepPlay)
+	{
+		increasePlaybackTimer(r);
+		r->tick++;
+	}
+
+	bool readNewNote = false;
+	if ((uint32_t)r->tick >= (uint32_t)r->speed)
+	{
+		r->tick = 0;
+		readNewNote = true;
+	}
+
+	if (readNewNote || r->stepPlay) // tick 0
+	{
+		if (r->pattDelTime2 == 0) // no pattern delay, time to read note data
+		{
+			r->DMACONtemp = 0; // reset Paula DMA trigger states
+
+			if (r->renderMode == REPLAYER_RENDER_SONG)
+				r->rowVisitTable[(r->pos * MOD_ROWS) + r->row] = true;
+
+			positionChanged(r);
+
+			// read note data and trigger voices
+			moduleChannel_t *ch = r->channels;
+			for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
+			{
+				playVoice(r, ch);
+
+				// set voice volume
+				const uint32_t voiceAddr = 0xDFF0A0 + (i * 16);
+				paulaWriteWord(r->paula, voiceAddr + 8, ch->n_volume);
+			}
+
+			setDMA(r);
+		}
+		else // pattern delay is on-going
+		{
+			moduleChannel_t *ch = r->channels;
+			for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
+				checkEffects(r, ch);
+		}
+
+		// increase row
+		if (!r->stepPlayBackwards)
+			r->row++;
+
+		if (r->pattDelTime > 0)
+		{
+			r->pattDelTime2 = r->pattDelTime;
+			r->pattDelTime = 0;
+		}
+
+		// undo row increase if pattern delay is on-going
+		if (r->pattDelTime2 > 0)
+		{
+			r->pattDelTime2--;
+			if (r->pattDelTime2 > 0)
+				r->row--;
+		}
+
+		if (r->pBreakFlag)
+		{
+			r->row = r->pBreakPosition;
+			r->pBreakPosition = 0;
+			r->pBreakFlag = false;
+		}
+
+		if (r->stepPlay)
+		{
+			stepPlayDone(r);
+			return true;
+		}
+
+		if (r->row >= MOD_ROWS || r->posJumpAssert)
+			nextPosition(r);
+	}
+	else // tick > 0 (handle effects)
+	{
+		moduleChannel_t *ch = r->channels;
+		for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
+			checkEffects(r, ch);
+
+		if (r->posJumpAssert)
+			nextPosition(r);
+	}
+
+	// command F00 = stop song, do it here (so that the scopes are updated properly)
+	if (r->stopSong)
+	{
+		r->stopSong = false;
+
+		if (r->cb.songStopped != NULL)
+			r->cb.songStopped(r->cb.userData);
+	}
+
+	return renderEndCheck(r); // MOD2WAV/PAT2SMP listens to the return value (true = not done yet)
+}
+
+void replayerSaveState(replayer_t *r, replayerState_t *s)
+{
+	memcpy(s->channels, r->channels, sizeof (s->channels));
+
+	s->tick = r->tick;
+	s->speed = r->speed;
+	s->row = r->row;
+	s->bpm = r->bpm;
+	s->ciaSetBPM = r->ciaSetBPM;
+	s->pos = r->pos;
+	s->pattern = r->pattern;
+	s->pBreakPosition = r->pBreakPosition;
+	s->pattDelTime = r->pattDelTime;
+	s->pattDelTime2 = r->pattDelTime2;
+	s->lowMask = r->lowMask;
+	s->DMACONtemp = r->DMACONtemp;
+	s->posJumpAssert = r->posJumpAssert;
+	s->pBreakFlag = r->pBreakFlag;
+	s->renderDone = r->renderDone;
+	s->stopSong = r->stopSong;
+	s->playbackSeconds = r->playbackSeconds;
+	s->playbackSecondsFrac = r->playbackSecondsFrac;
+}
+
+void replayerLoadState(replayer_t *r, const replayerState_t *s)
+{
+	memcpy(r->channels, s->channels, sizeof (r->channels));
+
+	r->tick = s->tick;
+	r->speed = s->speed;
+	r->row = s->row;
+	r->bpm = s->bpm;
+	r->ciaSetBPM = s->ciaSetBPM;
+	r->pos = s->pos;
+	r->pattern = s->pattern;
+	r->pBreakPosition = s->pBreakPosition;
+	r->pattDelTime = s->pattDelTime;
+	r->pattDelTime2 = s->pattDelTime2;
+	r->lowMask = s->lowMask;
+	r->DMACONtemp = s->DMACONtemp;
+	r->posJumpAssert = s->posJumpAssert;
+	r->pBreakFlag = s->pBreakFlag;
+	r->renderDone = s->renderDone;
+	r->stopSong = s->stopSong;
+	r->playbackSeconds = s->playbackSeconds;
+	r->playbackSecondsFrac = s->playbackSecondsFrac;
+}
+
+bool replayerGetUpcomingRow(replayer_t *r, int16_t *pos, int8_t *row)
+{
+	*pos = r->pos;
+	*row = r->row;
+
+	return (uint32_t)r->tick+1 >= (uint32_t)r->speed && r->pattDelTime2 == 0;
+}
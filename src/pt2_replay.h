@@ -0,0 +1,109 @@
+#pragma once
+
+/* Headless ProTracker replayer (part of libpt2replay, no SDL or tracker globals in here).
+**
+** All playback state lives in replayer_t, so several replayers can run at once (one per
+** thread), as long as they don't share a Paula instance. A replayer only reads the song
+** data, except for the effects EFx (invert loop) and E8x (Karplus-Strong) that modify the
+** sample data like on the Amiga.
+**
+** The host (the tracker, MOD2WAV etc.) gets told about things through the callbacks.
+** They are all optional (can be NULL), and are called from the thread that ticks.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_replay_header.h"
+#include "pt2_module.h"
+#include "pt2_paula.h"
+
+// too many bits makes little sense here
+#define BPM_FRAC_BITS 52
+#define BPM_FRAC_SCALE (1ULL << BPM_FRAC_BITS)
+#define BPM_FRAC_MASK (BPM_FRAC_SCALE-1)
+
+enum // replayer_t.renderMode
+{
+	REPLAYER_RENDER_OFF = 0,
+	REPLAYER_RENDER_SONG = 1, // detect the end of the song (MOD2WAV)
+	REPLAYER_RENDER_PATTERN = 2 // stop at the end of the pattern (PAT2SMP)
+};
+
+typedef struct replayerCallbacks_t
+{
+	void *userData; // passed on to all callbacks
+
+	void (*positionChanged)(void *userData); // a new row is read (or the position was reset on song end)
+	void (*tempoChanged)(void *userData, int32_t bpm); // BPM changed by Fxx (samples per tick must be updated)
+	void (*speedChanged)(void *userData, int32_t speed);
+	void (*songStopped)(void *userData); // F00
+	void (*songEnded)(void *userData); // the song wrapped around while stopAtSongEnd is set
+	void (*stepPlayDone)(void *userData); // the row was played (stepPlay is cleared)
+	void (*ledFilterChanged)(void *userData, bool enabled); // E0x
+} replayerCallbacks_t;
+
+typedef struct replayer_t
+{
+	module_t *song;
+	paula_t *paula; // the Paula instance that the register writes go to
+	replayerCallbacks_t cb;
+
+	// settings (can be changed between ticks)
+	bool muted[PAULA_VOICES];
+	bool enableE8xEffect, vblankTiming, stopAtSongEnd;
+	bool patternMode; // stay in the current pattern (play/record pattern)
+	bool countPlaybackTime;
+	bool stepPlay, stepPlayBackwards; // play one row only (cleared when done)
+	bool keepSampleData; // don't let EFx/E8x modify the sample data (for passes that only need the song timing)
+	uint8_t renderMode;
+	uint16_t metroChannel, metroSpeed; // metronome channel is 1..4 (0 = off)
+
+	// playback state
+	moduleChannel_t channels[PAULA_VOICES];
+	volatile int32_t tick, speed;
+	int32_t bpm, ciaSetBPM;
+	int16_t pos;
+	int8_t row, pattern, pBreakPosition;
+	uint8_t pattDelTime, pattDelTime2, lowMask;
+	uint16_t DMACONtemp;
+	bool posJumpAssert, pBreakFlag, renderDone, stopSong;
+	uint32_t playbackSeconds, playbackSecondsFrac;
+
+	bool rowVisitTable[128 * MOD_ROWS]; // for REPLAYER_RENDER_SONG
+} replayer_t;
+
+// everything replayerTick() needs to continue from a given tick (for replayer snapshots)
+typedef struct replayerState_t
+{
+	moduleChannel_t channels[PAULA_VOICES];
+	int32_t tick, speed, bpm, ciaSetBPM;
+	int16_t pos;
+	int8_t row, pattern, pBreakPosition;
+	uint8_t pattDelTime, pattDelTime2, lowMask;
+	uint16_t DMACONtemp;
+	bool posJumpAssert, pBreakFlag, renderDone, stopSong;
+	uint32_t playbackSeconds, playbackSecondsFrac;
+} replayerState_t;
+
+double ciaBpm2Hz(int32_t bpm);
+void getSamplesPerTick(double dAudioFreq, int32_t bpm, bool vblankTimingFlag, uint32_t *samplesPerTickInt, uint64_t *samplesPerTickFrac);
+
+void replayerInit(replayer_t *r, module_t *song, paula_t *paula); // also clears the callbacks
+void replayerResetChannels(replayer_t *r);
+void replayerResetEffectModes(replayer_t *r); // clears the E3x/E4x/E5x/E7x/EFx modes and E6x loop counters
+void replayerStopEffects(replayer_t *r); // clears pattern delay, pattern loop and effect modes (as PT does on stop)
+void replayerTurnOffVoices(replayer_t *r); // (writes to Paula directly)
+int32_t replayerGetStartTempo(const module_t *song); // 125 BPM for normal MODs, custom value for certain STK/UST MODs
+void replayerRestart(replayer_t *r); // state at song start (6 ticks/row, start tempo), first row is read on the next tick
+
+/* Does one tick (reads a row on tick 0, then effects) and writes the Paula registers.
+** Returns false when the end of the song/pattern is reached in a render mode, otherwise true.
+*/
+bool replayerTick(replayer_t *r);
+
+void replayerSetTempo(replayer_t *r, int32_t bpm);
+void replayerSetSpeed(replayer_t *r, int32_t speed);
+
+void replayerSaveState(replayer_t *r, replayerState_t *s);
+void replayerLoadState(replayer_t *r, const replayerState_t *s);
+bool replayerGetUpcomingRow(replayer_t *r, int16_t *pos, int8_t *row); // returns true if the next tick reads a new row
@@ -0,0 +1,45 @@
+#pragma once
+
+/* Definitions shared by the tracker and the headless replay library (libpt2replay).
+** Don't include SDL or any tracker headers from here!
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef _DEBUG
+#include <assert.h>
+#endif
+
+#ifndef ASSERT
+#ifdef _DEBUG
+#define ASSERT(x) assert(x)
+#else
+#define ASSERT(x)
+#endif
+#endif
+
+// main crystal oscillator for PAL Amiga systems
+#define AMIGA_PAL_XTAL_HZ 28375160
+#define AMIGA_PAL_CCK_HZ (AMIGA_PAL_XTAL_HZ/8.0)
+#define CIA_PAL_CLK (AMIGA_PAL_CCK_HZ / 5.0)
+
+// nominal framerate in normal PAL videomodes (~49.92Hz)
+#define AMIGA_PAL_VBLANK_HZ (AMIGA_PAL_CCK_HZ / (double)(313*227))
+
+#ifndef PI
+#define PI 3.14159265358979323846264338327950288
+#endif
+
+// SIMD instruction sets that are always present on the target (SSE2 is required on x86)
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define HAS_SSE2
+#elif defined __ARM_NEON || defined __aarch64__ || defined _M_ARM64
+#define HAS_NEON
+#endif
+
+#define MOD_ROWS 64
+#define MOD_SAMPLES 31
+#define MAX_PATTERNS 100
+
+#define MIN_BPM 32
+#define MAX_BPM 255
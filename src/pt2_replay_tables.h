@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+#include "pt2_replay_header.h"
+
+extern const uint8_t vibratoTable[32];
+extern const int16_t periodTable[(37*16)+15];
+extern const uint32_t tickDuration31fp[(MAX_BPM-MIN_BPM)+1+1];
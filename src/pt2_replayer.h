@@ -3,19 +3,26 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "pt2_structs.h"
+#include "pt2_replay.h"
 
-#define MIN_BPM 32
-#define MAX_BPM 255
+extern replayer_t replayer; // pt2_replayer.c
 
+void initReplayer(void); // sets up the tracker replayer and its callbacks, call once on startup
 void gotoNextMulti(void);
-double ciaBpm2Hz(int32_t bpm);
+void setReplayerPaula(paula_t *p); // what Paula instance tickReplayer() etc. writes to
 void updatePaulaLoops(void); // used after manipulating Paula sample loop points while playing
-void turnOffVoices(void);
-void initializeModuleChannels(module_t *s);
+void turnOffVoices(void); // the voices are stopped when this returns
+
+// for jamming etc. from the main thread (done by the replayer's thread, see doQueuedChannelCmds())
+void setChannelSample(uint8_t chNum, uint8_t sampleNum, int8_t volume, int16_t period,
+	int8_t *start, uint16_t length, int8_t *loopstart, uint16_t replen);
+void setChannelSampleNum(uint8_t chNum, uint8_t sampleNum);
+void doQueuedChannelCmds(void); // by the audio thread before ticking the replayer, or with the audio locked
 module_t *createEmptyMod(void);
 void setReplayerPosToTrackerPos(void);
 void setPattern(int16_t pattern);
-bool tickReplayer(void);
+void updateReplayerSettings(void); // copies the editor/config settings to the tracker replayer
+bool tickReplayer(void); // replayerTick() on the tracker replayer, with the current editor settings
 void storeTempVariables(void);
 void restartSong(void);
 void resetSong(void);
@@ -1251,37 +1251,28 @@ void toggleTuningTone(void)
 		const int32_t chNum = (cursor.channel + 1) & 3;
 		TToneBit = 1 << chNum;
 
-		lockAudio();
-
 		const uint32_t voiceAddr = 0xDFF0A0 + (chNum * 16);
 
-		paulaWriteWord(0xDFF096, TToneBit); // voice DMA off
+		beginPaulaWrites(audio.paula, false);
 
-		paulaWriteWord(voiceAddr + 6, periodTable[editor.tuningNote]);
-		paulaWriteWord(voiceAddr + 8, 64); // volume
-		paulaWritePtr(voiceAddr + 0, tuneToneData);
-		paulaWriteWord(voiceAddr + 4, sizeof (tuneToneData) / 2); // length
+		queuePaulaWriteWord(audio.paula, 0xDFF096, TToneBit); // voice DMA off
 
-		paulaWriteWord(0xDFF096, 0x8000 | TToneBit); // voice DMA on
+		queuePaulaWriteWord(audio.paula, voiceAddr + 6, periodTable[editor.tuningNote]);
+		queuePaulaWriteWord(audio.paula, voiceAddr + 8, 64); // volume
+		queuePaulaWritePtr(audio.paula, voiceAddr + 0, tuneToneData);
+		queuePaulaWriteWord(audio.paula, voiceAddr + 4, sizeof (tuneToneData) / 2); // length
 
-		// update tracker visuals
-		setVisualsDMACON(TToneBit);
-		setVisualsPeriod(chNum, periodTable[editor.tuningNote]);
-		setVisualsVolume(chNum, 64);
-		setVisualsDataPtr(chNum, tuneToneData);
-		setVisualsLength(chNum, sizeof (tuneToneData) / 2);
-		setVisualsDMACON(0x8000 | TToneBit);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, 0x8000 | TToneBit); // voice DMA on
 
-		unlockAudio();
+		endPaulaWrites(audio.paula);
 	}
 	else
 	{
 		// turn tuning tone off
 
-		lockAudio();
-		paulaWriteWord(0xDFF096, TToneBit); // voice DMA off
-		setVisualsDMACON(TToneBit);
-		unlockAudio();
+		beginPaulaWrites(audio.paula, false);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, TToneBit); // voice DMA off
+		endPaulaWrites(audio.paula);
 	}
 }
 
@@ -1837,83 +1828,63 @@ static void playCurrSample(uint8_t chn, int32_t startOffset, int32_t endOffset,
 	ASSERT(editor.currPlayNote <= 35);
 
 	moduleSample_t *s = &song->samples[editor.currSample];
-	moduleChannel_t *ch = &song->channels[chn];
+	moduleChannel_t *ch = &replayer.channels[chn];
 
-	lockAudio();
+	int8_t *n_start, *n_loopstart;
+	uint16_t n_length, n_replen;
 
-	ch->n_samplenum = editor.currSample;
-	ch->n_volume = s->volume;
-	ch->n_period = periodTable[(37 * (s->fineTune & 0xF)) + editor.currPlayNote];
-	
 	if (playWaveformFlag)
 	{
-		ch->n_start = &song->sampleData[s->offset];
-		ch->n_length = (uint16_t)((s->loopStart > 0) ? (s->loopStart + s->loopLength) >> 1 : s->length >> 1);
-		ch->n_loopstart = &song->sampleData[s->offset + s->loopStart];
-		ch->n_replen = (uint16_t)(s->loopLength >> 1);
+		n_start = &song->sampleData[s->offset];
+		n_length = (uint16_t)((s->loopStart > 0) ? (s->loopStart + s->loopLength) >> 1 : s->length >> 1);
+		n_loopstart = &song->sampleData[s->offset + s->loopStart];
+		n_replen = (uint16_t)(s->loopLength >> 1);
 	}
 	else
 	{
-		ch->n_start = &song->sampleData[s->offset + startOffset];
-		ch->n_length = (uint16_t)((uint32_t)(endOffset - startOffset) >> 1);
-		ch->n_loopstart = &song->sampleData[s->offset];
-		ch->n_replen = 1;
+		n_start = &song->sampleData[s->offset + startOffset];
+		n_length = (uint16_t)((uint32_t)(endOffset - startOffset) >> 1);
+		n_loopstart = &song->sampleData[s->offset];
+		n_replen = 1;
 	}
 
-	if (ch->n_length == 0)
-		ch->n_length = 1;
-
-	const uint32_t voiceAddr = 0xDFF0A0 + (chn * 16);
+	if (n_length == 0)
+		n_length = 1;
 
-	paulaWriteWord(voiceAddr + 8, ch->n_volume);
-	paulaWriteWord(voiceAddr + 6, ch->n_period);
-	paulaWritePtr(voiceAddr + 0, ch->n_start);
-	paulaWriteWord(voiceAddr + 4, ch->n_length);
+	const uint16_t period = periodTable[(37 * (s->fineTune & 0xF)) + editor.currPlayNote];
 
-	if (!editor.muted[chn])
-		paulaWriteWord(0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
-	else
-		paulaWriteWord(0xDFF096, ch->n_dmabit); // voice DMA off
+	setChannelSample(chn, (uint8_t)editor.currSample, s->volume, period, n_start, n_length, n_loopstart, n_replen);
 
-	// these take effect after the current DMA cycle is done
-	if (playWaveformFlag)
-	{
-		paulaWritePtr(voiceAddr + 0, ch->n_loopstart);
-		paulaWriteWord(voiceAddr + 4, ch->n_replen);
-	}
-	else
-	{
-		paulaWritePtr(voiceAddr + 0, NULL); // data
-		paulaWriteWord(voiceAddr + 4, 1); // length
-	}
+	const uint32_t voiceAddr = 0xDFF0A0 + (chn * 16);
 
-	// update tracker visuals
+	beginPaulaWrites(audio.paula, false);
 
-	setVisualsVolume(chn, ch->n_volume);
-	setVisualsPeriod(chn, ch->n_period);
-	setVisualsDataPtr(chn, ch->n_start);
-	setVisualsLength(chn, ch->n_length);
+	queuePaulaWriteWord(audio.paula, voiceAddr + 8, s->volume);
+	queuePaulaWriteWord(audio.paula, voiceAddr + 6, period);
+	queuePaulaWritePtr(audio.paula, voiceAddr + 0, n_start);
+	queuePaulaWriteWord(audio.paula, voiceAddr + 4, n_length);
 
 	if (!editor.muted[chn])
-		setVisualsDMACON(0x8000 | ch->n_dmabit);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, 0x8000 | ch->n_dmabit); // voice DMA on
 	else
-		setVisualsDMACON(ch->n_dmabit);
+		queuePaulaWriteWord(audio.paula, 0xDFF096, ch->n_dmabit); // voice DMA off
 
+	// these take effect after the current DMA cycle is done
 	if (playWaveformFlag)
 	{
-		setVisualsDataPtr(chn, ch->n_loopstart);
-		setVisualsLength(chn, ch->n_replen);
+		queuePaulaWritePtr(audio.paula, voiceAddr + 0, n_loopstart);
+		queuePaulaWriteWord(audio.paula, voiceAddr + 4, n_replen);
 	}
 	else
 	{
-		setVisualsDataPtr(chn, NULL);
-		setVisualsLength(chn, 1);
+		queuePaulaWritePtr(audio.paula, voiceAddr + 0, NULL); // data
+		queuePaulaWriteWord(audio.paula, voiceAddr + 4, 1); // length
 	}
 
-	unlockAudio();
+	endPaulaWrites(audio.paula);
 
 	// PT quirk: spectrum analyzer is still handled here even if channel is muted
-	updateSpectrumAnalyzer(ch->n_volume, ch->n_period);
+	updateSpectrumAnalyzer(s->volume, period);
 }
 
 void samplerPlayWaveform(void)
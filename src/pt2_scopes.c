@@ -1,21 +1,12 @@
 #include <stdint.h>
 #include <stdbool.h>
-#include <math.h> // modf()
-#ifndef _WIN32
-#include <unistd.h> // usleep()
-#endif
 #include "pt2_helpers.h"
 #include "pt2_visuals.h"
 #include "pt2_scopes.h"
 #include "pt2_config.h"
+#include "pt2_audio.h"
 
-// this uses code that is not entirely thread safe, but I have never had any issues so far...
-
-static volatile bool scopesUpdatingFlag, scopesDisplayingFlag;
-static hpc_t scopeHpc;
-static SDL_Thread *scopeThread;
-
-scope_t scope[PAULA_VOICES]; // global
+static paulaScopeSnapshot_t scopeSnapshot; // the one that is audible right now (main thread only)
 
 // this is quite hackish, but fixes sample swapping issues
 static int32_t getSampleSlotFromReadAddress(const int8_t *sampleReadAddress)
@@ -46,33 +37,23 @@ static int32_t getSampleSlotFromReadAddress(const int8_t *sampleReadAddress)
 
 int32_t getSampleReadPos(int32_t ch) // used for the sampler screen
 {
-	// cache some stuff
-	const scope_t *sc = &scope[ch];
-	const bool active = sc->active;
-	const int8_t *data = sc->data;
-	const int32_t pos = sc->pos;
-	const int32_t len = sc->length;
-
-	if (song == NULL || !active || data == NULL)
+	const paulaScopeVoice_t *sv = &scopeSnapshot.voice[ch];
+	if (song == NULL || !sv->active || sv->location == NULL)
 		return -1;
 
-	/* Because the scopes work like the Paula emulation, we have a DATA
-	** and LENGTH variable, which are not static. This means that we have
-	** to get creative to get the absolute sampling position.
-	*/
+	const int8_t *sampleReadAddress = sv->location - 2; // (the word that is being played)
 
-	int32_t sample = getSampleSlotFromReadAddress(data);
+	int32_t sample = getSampleSlotFromReadAddress(sampleReadAddress);
 	if (sample != editor.currSample)
 		return -1; // sample is not the one we're seeing in the sampler screen
 
 	const moduleSample_t *s = &song->samples[sample];
-	const int8_t *sampleReadAddress = &data[pos];
 	const int8_t *sampleBaseAddress = &song->sampleData[s->offset];
 	const int32_t realPos = (int32_t)(sampleReadAddress - sampleBaseAddress);
 
-	// return -1 if sample has no loop and read length is 2 (playing sample "loop" area)
+	// return -1 if sample has no loop and Paula plays the one-word "loop" area
 	const bool loopEnabled = (s->loopStart + s->loopLength) > 2;
-	if (!loopEnabled && len == 2)
+	if (!loopEnabled && sv->storedLength <= 1 && sv->lengthCounter <= 1)
 		return -1;
 
 	if (realPos < 0 || realPos >= s->length)
@@ -81,198 +62,38 @@ int32_t getSampleReadPos(int32_t ch) // used for the sampler screen
 	return realPos;
 }
 
-void scopeSetPeriod(int32_t ch, int32_t period)
-{
-	period &= 0xFFFF;
-
-	if (period < 113) // just in case, should already be clamped
-		period = 113;
-
-	scope[ch].dDelta = (PAULA_PAL_CLK / (double)SCOPE_HZ) / period;
-}
-
-void scopeTrigger(int32_t ch) // expects data & length variables to be set already
-{
-	volatile scope_t *sc = &scope[ch];
-	scope_t tempState = *sc; // cache it
-
-	if (tempState.data == NULL)
-		tempState.data = paulaGetNullSamplePtr();
-
-	if (tempState.length < 2)
-		tempState.length = 2; // for safety
-
-	tempState.dPhase = 0.0;
-	tempState.pos = 0;
-	tempState.active = true;
-
-	/* Update live scope now.
-	** In theory it -can- be written to in the middle of a cached read,
-	** then the read thread writes its own non-updated cached copy back and
-	** the trigger never happens. So far I have never seen it happen,
-	** so it's probably very rare. Yes, this is not good coding...
-	*/
-	*sc = tempState;
-}
-
 void updateScopes(void)
 {
-	scope_t tempState;
-
-	if (editor.mod2WavOngoing)
-		return;
-
-	volatile scope_t *sc = scope;
-
-	scopesUpdatingFlag = true;
-	for (int32_t i = 0; i < PAULA_VOICES; i++, sc++)
-	{
-		tempState = *sc; // cache it
-		if (!tempState.active)
-			continue; // scope is not active
-
-		tempState.dPhase += tempState.dDelta;
-
-		const int32_t wholeSamples = (int32_t)tempState.dPhase;
-		tempState.dPhase -= wholeSamples;
-		tempState.pos += wholeSamples;
-
-		if (tempState.pos >= tempState.length)
-		{
-			// sample reached end, simulate Paula register update (sample swapping)
-
-			/* Wrap pos around one time with current length, then set new length
-			** and wrap around it (handles one-shot loops and sample swapping).
-			*/
-			tempState.pos -= tempState.length;
-
-			tempState.length = tempState.newLength;
-			if (tempState.pos >= tempState.length && tempState.length > 0)
-				tempState.pos %= tempState.length;
-
-			tempState.data = tempState.newData;
-		}
-
-		*sc = tempState; // update scope state
-	}
-	scopesUpdatingFlag = false;
-}
-
-/* This routine gets the average sample amplitude through the running scope voices.
-** This gives a somewhat more stable result than getting the peak from the mixer,
-** and we don't care about including filters/BLEP in the peak calculation.
-*/
-static void updateRealVuMeters(void)
-{
-	scope_t tmpScope, *sc;
-
-	// sink VU-meters first
-	for (int32_t i = 0; i < PAULA_VOICES; i++)
-	{
-		editor.realVuMeterVolumes[i] -= 4;
-		if (editor.realVuMeterVolumes[i] < 0)
-			editor.realVuMeterVolumes[i] = 0;
-	}
-
-	// get peak sample data from running scope voices
-	sc = scope;
-	for (int32_t i = 0; i < PAULA_VOICES; i++, sc++)
-	{
-		tmpScope = *sc; // cache it
-
-		if (!tmpScope.active || tmpScope.data == NULL || tmpScope.volume == 0 || tmpScope.length == 0)
-			continue;
-
-		// amount of integer samples getting skipped every frame (periods < 113 are clamped, this number can't get big)
-		uint32_t samplesToScan = (uint32_t)tmpScope.dDelta;
-		if (samplesToScan == 0)
-			continue;
-
-		if (samplesToScan > 512)
-			samplesToScan = 512;
-
-		int32_t pos = tmpScope.pos;
-		int32_t length = tmpScope.length;
-		const int8_t *data = tmpScope.data;
-
-		uint32_t runningAmplitude = 0;
-		for (uint32_t x = 0; x < samplesToScan; x++)
-		{
-			int32_t amplitude = 0;
-			if (data != NULL)
-				amplitude = data[pos] * tmpScope.volume;
-
-			runningAmplitude += ABS(amplitude);
-
-			if (++pos >= length)
-			{
-				pos = 0;
-
-				/* Read cycle done, temporarily update the display data/length variables
-				** before the scope thread does it.
-				*/
-				data = tmpScope.newData;
-				length = tmpScope.newLength;
-			}
-		}
-
-		runningAmplitude *= 96; // increase scale (for VU-meter height)
-		runningAmplitude /= samplesToScan; // get average
-		runningAmplitude = (runningAmplitude + 4096) >> (7+6); // normalize (rounded)
-
-		if (runningAmplitude > 48) // max VU-meter height
-			runningAmplitude = 48;
-
-		int8_t vuHeight = (int8_t)runningAmplitude;
-		if (vuHeight > editor.realVuMeterVolumes[i])
-			editor.realVuMeterVolumes[i] = vuHeight;
-	}
+	// keeps the last snapshot if there's no new one yet (or during MOD2WAV, where the audio is silent)
+	if (audio.paula != NULL)
+		paulaGetScopeSnapshot(audio.paula, getAudiblePaulaClock(), &scopeSnapshot);
 }
 
 void drawScopes(void)
 {
-	volatile scope_t *sc = scope; // cache it
+	const paulaScopeVoice_t *sv = scopeSnapshot.voice;
 	int32_t scopeX = 128;
 
 	const uint32_t bgColor = video.palette[PAL_BACKGRD];
 	const uint32_t fgColor = video.palette[PAL_QADSCP];
 
-	scopesDisplayingFlag = true;
-	for (int32_t i = 0; i < PAULA_VOICES; i++, sc++)
+	for (int32_t i = 0; i < PAULA_VOICES; i++, sv++)
 	{
-		scope_t tmpScope = *sc; // cache it
-
 		// clear scope background
 		fillRect(scopeX, 55, SCOPE_WIDTH, SCOPE_HEIGHT, bgColor);
 
 		// render scope
-		if (tmpScope.active && tmpScope.data != NULL && tmpScope.volume != 0 && tmpScope.length > 0)
+		if (sv->active)
 		{
-			// render scope data
-			int16_t scopeData;
-			int32_t pos = tmpScope.pos;
-			int32_t length = tmpScope.length;
-			const int8_t volume = -(tmpScope.volume >> 1);
-			const int8_t *data = tmpScope.data;
+			// render the last SCOPE_WIDTH sample points
+			const int8_t *point = &sv->point[PAULA_SCOPE_POINTS - SCOPE_WIDTH];
 			uint32_t *scopeDrawPtr = &video.frameBuffer[(71 * SCREEN_W) + scopeX];
 
 			for (int32_t x = 0; x < SCOPE_WIDTH; x++)
 			{
-				scopeData = 0;
-				if (data != NULL)
-					scopeData = (data[pos] * volume) >> 8;
+				const int32_t scopeData = (point[x] * -32) >> 8; // -16..16
 
 				scopeDrawPtr[(scopeData * SCREEN_W) + x] = fgColor;
-
-				pos++;
-				if (pos >= length)
-				{
-					pos = 0;
-
-					// read cycle done, update the drawing data/length variables
-					length = tmpScope.newLength;
-					data = tmpScope.newData;
-				}
 			}
 		}
 		else
@@ -283,63 +104,4 @@ void drawScopes(void)
 
 		scopeX += SCOPE_WIDTH+8;
 	}
-	scopesDisplayingFlag = false;
-}
-
-static int32_t scopeThreadFunc(void *ptr)
-{
-	// this is confirmed to be needed for scope stability
-	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
-
-	hpc_SetDurationInHz(&scopeHpc, SCOPE_HZ);
-	hpc_ResetCounters(&scopeHpc);
-
-	while (editor.programRunning)
-	{
-		if (config.realVuMeters)
-			updateRealVuMeters();
-
-		updateScopes();
-
-		hpc_Wait(&scopeHpc);
-	}
-
-	(void)ptr;
-	return true;
-}
-
-bool initScopes(void)
-{
-	scopeThread = SDL_CreateThread(scopeThreadFunc, "scope thread", NULL);
-	if (scopeThread == NULL)
-	{
-		showErrorMsgBox("Couldn't create scope thread!");
-		return false;
-	}
-
-	SDL_DetachThread(scopeThread);
-	return true;
-}
-
-void stopScope(int32_t ch)
-{
-	// wait for scopes to finish updating
-	while (scopesUpdatingFlag);
-
-	scope[ch].active = false;
-
-	// wait for scope displaying to be done (safety)
-	while (scopesDisplayingFlag);
-}
-
-void stopAllScopes(void)
-{
-	// wait for scopes to finish updating
-	while (scopesUpdatingFlag);
-
-	for (int32_t i = 0; i < PAULA_VOICES; i++)
-		scope[i].active = false;
-
-	// wait for scope displaying to be done (safety)
-	while (scopesDisplayingFlag);
 }
@@ -0,0 +1,339 @@
+/* Replayer snapshots for instant seeking.
+**
+** When the tracker is idle, the song is played through silently (a few milliseconds per frame) on
+** a separate replayer/Paula/mixer, and the complete replayer/Paula/mixer state is stored at the
+** first time every order position/row is played. Starting song playback from somewhere else than
+** the start then loads the snapshot of that row instead of starting with a cleared replayer state,
+** so effect memory, speed/BPM, pattern loop counters etc. are all correct, and the audio is what it
+** would be if the song had been played from the start.
+**
+** The silent pass shares nothing with the live audio but the song data (which is only read), so it
+** runs without locking the audio.
+*/
+
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pt2_header.h"
+#include "pt2_structs.h"
+#include "pt2_config.h"
+#include "pt2_audio.h"
+#include "pt2_paula.h"
+#include "pt2_mixer.h"
+#include "pt2_replayer.h"
+#include "pt2_songduration.h"
+#include "pt2_hpc.h"
+#include "pt2_snapshot.h"
+
+#define PASS_TIME_PER_FRAME_MS 3
+
+enum
+{
+	INDEX_INVALID = 0,
+	INDEX_BUILDING = 1,
+	INDEX_DONE = 2,
+	INDEX_UNSUPPORTED = 3
+};
+
+// the snapshots are only valid for the exact same playback conditions
+typedef struct indexKey_t
+{
+	module_t *song;
+	double dOutputFreq;
+	uint32_t amigaModel;
+	int32_t startTempo;
+	bool useLowpassFilter, useHighpassFilter, oversamplingFlag, metroFlag, enableE8xEffect;
+	uint8_t outputFormat, timingMode, mutedMask, stereoSeparation;
+	uint16_t metroSpeed, metroChannel;
+} indexKey_t;
+
+static int32_t indexStatus, numSnapshotOrders;
+static indexKey_t indexKey;
+static replayerSnapshot_t *snapshots; // [numSnapshotOrders * MOD_ROWS]
+
+// silent pass
+static paula_t *passPaula;
+static mixer_t passMixer;
+static uint8_t *passBuffer; // output is rendered here and thrown away
+static uint32_t passBufferFrames;
+static uint64_t passSampleOffset, passTicksLeft, passTickSampleCounterFrac;
+static bool passStopped;
+static replayer_t passReplayer;
+
+static void getIndexKey(indexKey_t *k)
+{
+	memset(k, 0, sizeof (indexKey_t)); // clear padding (the key is compared with memcmp())
+
+	k->song = song;
+	k->dOutputFreq = audio.paula->dOutputFreq;
+	k->amigaModel = audio.amigaModel;
+	k->startTempo = replayerGetStartTempo(song);
+	k->useLowpassFilter = audio.paula->useLowpassFilter;
+	k->useHighpassFilter = audio.paula->useHighpassFilter;
+	k->oversamplingFlag = audio.oversamplingFlag;
+	k->metroFlag = editor.metroFlag;
+	k->enableE8xEffect = config.enableE8xEffect;
+	k->outputFormat = audio.outputFormat;
+	k->timingMode = editor.timingMode;
+	k->stereoSeparation = audioGetStereoSeparation();
+	k->metroSpeed = editor.metroSpeed;
+	k->metroChannel = editor.metroChannel;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		if (editor.muted[i])
+			k->mutedMask |= 1 << i;
+	}
+}
+
+static bool indexKeyIsCurrent(void)
+{
+	indexKey_t k;
+
+	getIndexKey(&k);
+	return memcmp(&k, &indexKey, sizeof (indexKey_t)) == 0;
+}
+
+static void freePass(void)
+{
+	paulaDestroy(passPaula);
+	passPaula = NULL;
+
+	mixerFree(&passMixer);
+
+	if (passBuffer != NULL)
+	{
+		free(passBuffer);
+		passBuffer = NULL;
+	}
+}
+
+void freeSnapshotIndex(void)
+{
+	freePass();
+
+	if (snapshots != NULL)
+	{
+		free(snapshots);
+		snapshots = NULL;
+	}
+
+	numSnapshotOrders = 0;
+	indexStatus = INDEX_INVALID;
+}
+
+void invalidateSnapshotIndex(void)
+{
+	freePass();
+	indexStatus = INDEX_INVALID;
+}
+
+static void songStoppedCallback(void *userData) // F00
+{
+	(void)userData;
+	passStopped = true;
+}
+
+// does a replayer tick and mixes it just like the audio callback, but the output is thrown away
+static uint32_t tickPass(void)
+{
+	replayerTick(&passReplayer);
+
+	// (the pass replayer has no tempo callback, so get the tick length from the BPM)
+	const int32_t bpmIndex = passReplayer.bpm - MIN_BPM;
+	uint32_t samplesToMix = audio.samplesPerTickIntTab[bpmIndex];
+
+	passTickSampleCounterFrac += audio.samplesPerTickFracTab[bpmIndex];
+	if (passTickSampleCounterFrac >= BPM_FRAC_SCALE)
+	{
+		passTickSampleCounterFrac &= BPM_FRAC_MASK;
+		samplesToMix++;
+	}
+
+	ASSERT(samplesToMix <= passBufferFrames);
+
+	if (audio.outputFormat == OUTPUT_FORMAT_FLOAT)
+		mixerOutputFloat(&passMixer, passPaula, (float *)passBuffer, samplesToMix);
+	else
+		mixerOutput(&passMixer, passPaula, (int16_t *)passBuffer, samplesToMix);
+
+	return samplesToMix;
+}
+
+// the state the live audio callback would have right before the next tick
+static void storeSnapshot(replayerSnapshot_t *s)
+{
+	s->used = true;
+	s->sampleOffset = passSampleOffset;
+
+	replayerSaveState(&passReplayer, &s->replayer);
+	paulaSaveState(passPaula, &s->paula);
+
+	const int32_t bpmIndex = passReplayer.bpm - MIN_BPM;
+
+	audioMixerState_t *m = &s->mixer;
+	m->ledFilterEnabled = passPaula->useLEDFilter;
+	m->tickSampleCounter = 0; // (the tick is done on the next sample)
+	m->tickSampleCounterFrac = passTickSampleCounterFrac;
+	m->samplesPerTickInt = audio.samplesPerTickIntTab[bpmIndex];
+	m->samplesPerTickFrac = audio.samplesPerTickFracTab[bpmIndex];
+	mixerSaveState(&passMixer, &m->mixer);
+}
+
+static bool startIndexPass(void)
+{
+	getIndexKey(&indexKey);
+
+	if (song->header.songLength == 0 || moduleModifiesSampleData(song, config.enableE8xEffect)) // (the snapshots don't include sample data)
+	{
+		indexStatus = INDEX_UNSUPPORTED;
+		return false;
+	}
+
+	const songDuration_t *duration = getSongDuration(song, audio.outputRate, 0);
+	if (duration == NULL)
+		return false;
+
+	if (snapshots == NULL || numSnapshotOrders != song->header.songLength)
+	{
+		if (snapshots != NULL)
+			free(snapshots);
+
+		numSnapshotOrders = song->header.songLength;
+		snapshots = (replayerSnapshot_t *)malloc(numSnapshotOrders * MOD_ROWS * sizeof (replayerSnapshot_t));
+		if (snapshots == NULL)
+		{
+			numSnapshotOrders = 0;
+			return false;
+		}
+	}
+
+	for (int32_t i = 0; i < numSnapshotOrders * MOD_ROWS; i++)
+		snapshots[i].used = false;
+
+	freePass();
+
+	// big enough for one tick at the slowest tempo (float output)
+	passBufferFrames = (uint32_t)ceil(audio.outputRate / (MIN_BPM / 2.5)) + 1;
+	passBuffer = (uint8_t *)malloc(passBufferFrames * sizeof (float) * 2);
+
+	// (the mixer starts with cleared downsampler states and a reset dither, as on song start)
+	const int32_t maxSamplesPerTick = (int32_t)ceil(audio.paula->dOutputFreq / (MIN_BPM / 2.5)) + 1;
+	const bool mixerOK = mixerInit(&passMixer, maxSamplesPerTick, audio.oversamplingFlag);
+
+	passPaula = paulaCreate(audio.paula->dOutputFreq, audio.amigaModel);
+	if (passBuffer == NULL || !mixerOK || passPaula == NULL)
+	{
+		freePass();
+		return false;
+	}
+
+	mixerSetStereoSeparation(&passMixer, indexKey.stereoSeparation);
+
+	passPaula->useLowpassFilter = audio.paula->useLowpassFilter;
+	passPaula->useHighpassFilter = audio.paula->useHighpassFilter;
+	paulaWriteByte(passPaula, 0xBFE001, (uint8_t)audio.ledFilterEnabled << 1);
+
+	// same settings as the live replayer, but always play the whole song (as in MOD2WAV)
+	replayerInit(&passReplayer, song, passPaula);
+	passReplayer.cb.songStopped = songStoppedCallback;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		passReplayer.muted[i] = editor.muted[i];
+
+	passReplayer.enableE8xEffect = config.enableE8xEffect;
+	passReplayer.vblankTiming = (editor.timingMode == TEMPO_MODE_VBLANK);
+	passReplayer.countPlaybackTime = true;
+	passReplayer.metroChannel = editor.metroFlag ? editor.metroChannel : 0;
+	passReplayer.metroSpeed = editor.metroSpeed;
+
+	replayerRestart(&passReplayer); // (starts at the song's start tempo, as live playback does)
+	passStopped = false;
+
+	passSampleOffset = 0;
+	passTickSampleCounterFrac = 0;
+	passTicksLeft = duration->totalTicks; // one play-through (same end detection as MOD2WAV)
+
+	indexStatus = INDEX_BUILDING;
+	return true;
+}
+
+static void runIndexPass(void)
+{
+	const uint64_t endTime64 = SDL_GetPerformanceCounter() + ((hpcFreq.freq64 * PASS_TIME_PER_FRAME_MS) / 1000);
+
+	while (true)
+	{
+		int16_t pos;
+		int8_t row;
+
+		if (replayerGetUpcomingRow(&passReplayer, &pos, &row) && pos >= 0 && pos < numSnapshotOrders && row >= 0 && row < MOD_ROWS)
+		{
+			replayerSnapshot_t *s = &snapshots[(pos * MOD_ROWS) + row];
+			if (!s->used) // (first visit only, pattern loops etc. can play a row again)
+				storeSnapshot(s);
+		}
+
+		if (passTicksLeft == 0 || passStopped) // end of song (or F00)
+		{
+			freePass();
+			indexStatus = INDEX_DONE;
+			return;
+		}
+
+		passSampleOffset += tickPass();
+		passTicksLeft--;
+
+		if ((passTicksLeft & 15) == 0 && SDL_GetPerformanceCounter() >= endTime64)
+			return;
+	}
+}
+
+void updateSnapshotIndex(void)
+{
+	if (song == NULL || audio.paula == NULL || editor.songPlaying || editor.stepPlayEnabled ||
+		editor.mod2WavOngoing || editor.pat2SmpOngoing || audio.isSampling)
+	{
+		return;
+	}
+
+	if (indexStatus != INDEX_INVALID && !indexKeyIsCurrent())
+		invalidateSnapshotIndex(); // playback conditions have changed
+
+	if (indexStatus == INDEX_INVALID)
+	{
+		if (!startIndexPass())
+			return;
+	}
+
+	if (indexStatus == INDEX_BUILDING)
+		runIndexPass();
+}
+
+bool seekFromSnapshotIndex(int16_t pos, int8_t row)
+{
+	if (indexStatus != INDEX_DONE || pos < 0 || pos >= numSnapshotOrders || row < 0 || row >= MOD_ROWS || !indexKeyIsCurrent())
+		return false;
+
+	const replayerSnapshot_t *s = &snapshots[(pos * MOD_ROWS) + row];
+	if (!s->used)
+		return false; // a play-through from the start never gets here
+
+	replayerLoadState(&replayer, &s->replayer);
+	paulaLoadState(audio.paula, &s->paula);
+	audioLoadMixerState(&s->mixer);
+
+	// update BPM/speed/LED in the UI (and the tick length for the visuals sync)
+	modSetTempo(replayer.bpm, false);
+	song->currSpeed = replayer.speed;
+
+	return true;
+}
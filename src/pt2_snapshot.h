@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_replayer.h"
+#include "pt2_paula.h"
+#include "pt2_audio.h"
+
+// complete replayer+mixer state right before the tick that reads a row
+typedef struct replayerSnapshot_t
+{
+	bool used;
+	uint64_t sampleOffset; // output sample position (from the start of the song)
+	replayerState_t replayer;
+	paulaState_t paula;
+	audioMixerState_t mixer;
+} replayerSnapshot_t;
+
+void updateSnapshotIndex(void); // builds the index in small steps when idle, call this once per frame
+void invalidateSnapshotIndex(void); // call this when the song data has been changed
+void freeSnapshotIndex(void);
+
+/* Sets the live replayer/Paula state to what a play-through from the start of the song would have
+** at this order position/row (tick 0). Returns false if the index can't be used for this (not built
+** yet, position never played, unsupported song). The audio must be locked.
+*/
+bool seekFromSnapshotIndex(int16_t pos, int8_t row);
@@ -0,0 +1,179 @@
+/* Exact song duration calculator (for MOD2WAV and the seek index).
+**
+** The song is played through on a replayer of its own, with the settings that the tracker's
+** replayer has in MOD2WAV. Nothing is mixed (the Paula only gets the register writes), and
+** EFx/E8x don't touch the sample data (keepSampleData). The end of the song is detected by the
+** replayer itself (REPLAYER_RENDER_SONG), so the resulting sample count is what MOD2WAV outputs.
+*/
+
+// for finding memory leaks in debug mode with Visual Studio
+#if defined _DEBUG && defined _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pt2_header.h"
+#include "pt2_structs.h"
+#include "pt2_config.h"
+#include "pt2_audio.h"
+#include "pt2_paula.h"
+#include "pt2_replay.h"
+#include "pt2_songduration.h"
+
+// MOD2WAV's sample counter is 32-bit, stop there if the song somehow doesn't end
+#define MAX_DURATION_SAMPLES UINT32_MAX
+
+// cache (the calculation is fast, but there's no need to redo it when nothing has changed)
+static bool cacheValid;
+static module_t *cacheModule;
+static uint32_t cacheAudioFreq;
+static int8_t cacheNumLoops;
+static uint8_t cacheTimingMode, cacheMutedMask;
+static bool cacheCompoMode;
+static songDuration_t cachedDuration;
+
+static replayer_t durationReplayer; // (big, so it's not on the stack)
+
+static uint8_t getMutedMask(void)
+{
+	uint8_t mask = 0;
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		if (editor.muted[i])
+			mask |= 1 << i;
+	}
+
+	return mask;
+}
+
+static bool calcSongDuration(songDuration_t *d, module_t *m, uint32_t audioFreq, int8_t numLoops)
+{
+	uint32_t samplesPerTickIntTab[(MAX_BPM-MIN_BPM)+1];
+	uint64_t samplesPerTickFracTab[(MAX_BPM-MIN_BPM)+1];
+
+	const bool vblankTimingFlag = (editor.timingMode == TEMPO_MODE_VBLANK);
+	for (int32_t bpm = MIN_BPM; bpm <= MAX_BPM; bpm++)
+	{
+		const int32_t i = bpm - MIN_BPM;
+		getSamplesPerTick(audioFreq, bpm, vblankTimingFlag, &samplesPerTickIntTab[i], &samplesPerTickFracTab[i]);
+	}
+
+	paula_t *paula = paulaCreate(audioFreq * 2.0, audio.amigaModel); // (only gets the register writes)
+	if (paula == NULL)
+		return false;
+
+	memset(d, 0, sizeof (songDuration_t));
+	for (int32_t i = 0; i < 128; i++)
+	{
+		d->orderStartTick[i] = -1;
+		d->orderStartSample[i] = -1;
+	}
+
+	// same settings and initial state as the tracker's replayer after restartSong() when MOD2WAV starts
+	replayer_t *r = &durationReplayer;
+	replayerInit(r, m, paula);
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		r->muted[i] = editor.muted[i];
+
+	r->enableE8xEffect = config.enableE8xEffect;
+	r->vblankTiming = vblankTimingFlag;
+	r->stopAtSongEnd = config.compoMode;
+	r->keepSampleData = true;
+	r->renderMode = REPLAYER_RENDER_SONG;
+	r->metroChannel = editor.metroFlag ? editor.metroChannel : 0;
+	r->metroSpeed = editor.metroSpeed;
+	replayerRestart(r);
+
+	uint64_t samplesFrac = 0;
+	int32_t loopsLeft = numLoops;
+
+	while (true)
+	{
+		// store where each order position starts playing (the upcoming tick reads the next row)
+		int16_t pos;
+		int8_t row;
+
+		if (replayerGetUpcomingRow(r, &pos, &row))
+		{
+			if (pos >= 0 && pos <= 127 && d->orderStartTick[pos] == -1)
+			{
+				d->orderStartTick[pos] = d->totalTicks;
+				d->orderStartSample[pos] = d->totalSamples;
+			}
+
+			d->totalRows++;
+		}
+
+		const bool songEnded = !replayerTick(r);
+
+		// tick length for the current BPM (a BPM change from the tick above is already in effect)
+		const int32_t i = r->bpm - MIN_BPM;
+		uint32_t samplesToMix = samplesPerTickIntTab[i];
+
+		samplesFrac += samplesPerTickFracTab[i];
+		if (samplesFrac >= BPM_FRAC_SCALE)
+		{
+			samplesFrac &= BPM_FRAC_MASK;
+			samplesToMix++;
+		}
+
+		d->totalTicks++;
+		d->totalSamples += samplesToMix;
+
+		if (songEnded)
+		{
+			d->loopEndTick[d->numLoops] = d->totalTicks;
+			d->loopEndSample[d->numLoops] = d->totalSamples;
+			d->numLoops++;
+
+			if (--loopsLeft < 0 || d->numLoops >= SONGDURATION_MAX_LOOPS)
+				break;
+
+			memset(r->rowVisitTable, 0, sizeof (r->rowVisitTable));
+		}
+
+		if (d->totalSamples >= MAX_DURATION_SAMPLES)
+		{
+			d->truncated = true;
+			break;
+		}
+	}
+
+	paulaDestroy(paula);
+	return true;
+}
+
+const songDuration_t *getSongDuration(module_t *m, uint32_t audioFreq, int8_t numLoops)
+{
+	if (m == NULL || audioFreq == 0)
+		return NULL;
+
+	const uint8_t mutedMask = getMutedMask();
+
+	if (cacheValid && cacheModule == m && cacheAudioFreq == audioFreq && cacheNumLoops == numLoops &&
+		cacheTimingMode == editor.timingMode && cacheMutedMask == mutedMask && cacheCompoMode == config.compoMode)
+	{
+		return &cachedDuration;
+	}
+
+	if (!calcSongDuration(&cachedDuration, m, audioFreq, numLoops))
+		return NULL;
+
+	cacheModule = m;
+	cacheAudioFreq = audioFreq;
+	cacheNumLoops = numLoops;
+	cacheTimingMode = editor.timingMode;
+	cacheMutedMask = mutedMask;
+	cacheCompoMode = config.compoMode;
+	cacheValid = true;
+
+	return &cachedDuration;
+}
+
+void invalidateSongDuration(void) // call this when the song data has been changed
+{
+	cacheValid = false;
+}
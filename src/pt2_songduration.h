@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pt2_structs.h"
+
+#define SONGDURATION_MAX_LOOPS 51 /* MOD2WAV loop count (0..50) + the first play-through */
+
+typedef struct songDuration_t
+{
+	bool truncated; // song didn't end before the sample counter limit (broken loop structure)
+	int32_t numLoops; // number of play-throughs (MOD2WAV loop count + 1)
+	uint64_t totalTicks, totalRows, totalSamples;
+	uint64_t loopEndTick[SONGDURATION_MAX_LOOPS], loopEndSample[SONGDURATION_MAX_LOOPS];
+	int64_t orderStartTick[128], orderStartSample[128]; // first visit only, -1 = never played
+} songDuration_t;
+
+const songDuration_t *getSongDuration(module_t *m, uint32_t audioFreq, int8_t numLoops);
+void invalidateSongDuration(void);
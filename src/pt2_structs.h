@@ -10,6 +10,7 @@
 #include "pt2_header.h"
 #include "pt2_hpc.h"
 #include "pt2_paula.h"
+#include "pt2_module.h"
 
 // for .WAV sample loading/saving
 typedef struct wavHeader_t
@@ -43,69 +44,6 @@ typedef struct mptExtraChunk_t
 } mptExtraChunk_t;
 // -----------------------------------------
 
-typedef struct note_t
-{
-	uint8_t param, sample, command;
-	uint16_t period;
-} note_t;
-
-typedef struct moduleHeader_t
-{
-	char name[20 + 1];
-	uint16_t patternTable[128], songLength;
-	uint16_t initialTempo; // used for STK/UST modules after module is loaded
-} moduleHeader_t;
-
-typedef struct moduleSample_t
-{
-	volatile int8_t *volumeDisp;
-	volatile int32_t *lengthDisp, *loopStartDisp, *loopLengthDisp;
-	char text[22 + 1];
-	int8_t volume;
-	uint8_t fineTune;
-	int32_t offset, length, loopStart, loopLength;
-} moduleSample_t;
-
-typedef struct moduleChannel_t
-{
-	int8_t *n_start, *n_wavestart, *n_loopstart, n_volume, n_dmabit;
-	int8_t n_toneportdirec, n_pattpos, n_loopcount;
-	uint8_t n_wavecontrol, n_glissfunk, n_sampleoffset, n_toneportspeed;
-	uint8_t n_vibratocmd, n_tremolocmd, n_finetune, n_funkoffset, n_samplenum;
-	uint8_t n_vibratopos, n_tremolopos;
-	int16_t n_period, n_note, n_wantedperiod;
-	uint16_t n_cmd, n_length, n_replen;
-	uint32_t n_scopedelta, n_chanindex;
-
-	// for pt2_sync.c
-	uint8_t syncFlags;
-	int8_t syncAnalyzerVolume, syncVuVolume;
-	uint16_t syncAnalyzerPeriod;
-} moduleChannel_t;
-
-typedef struct module_t
-{
-	bool loaded, modified;
-	int8_t *sampleData;
-
-	volatile int32_t tick, speed;
-
-	int8_t row; // used for different things, so must not be internal to replayer
-
-	moduleHeader_t header;
-	moduleSample_t samples[MOD_SAMPLES];
-	moduleChannel_t channels[PAULA_VOICES];
-	note_t *patterns[MAX_PATTERNS];
-
-	// for pattern viewer
-	int8_t currRow;
-	int32_t currSpeed, currBPM;
-	uint16_t currPos, currPattern;
-
-	// for MOD2WAV progress bar
-	uint32_t rowsCounter, rowsInTotal;
-} module_t;
-
 typedef struct keyb_t
 {
 	bool repeatKey, delayKey;
@@ -145,7 +83,7 @@ typedef struct video_t
 typedef struct editor_t
 {
 	volatile uint8_t vuMeterVolumes[PAULA_VOICES], spectrumVolumes[SPECTRUM_BAR_NUM];
-	volatile int8_t *sampleFromDisp, *sampleToDisp, *currSampleDisp, realVuMeterVolumes[PAULA_VOICES], mod2WavNumLoops, mod2WavFadeOutSeconds;
+	volatile int8_t *sampleFromDisp, *sampleToDisp, *currSampleDisp, realVuMeterVolumes[PAULA_VOICES], realVuMeterPeaks[PAULA_VOICES], mod2WavNumLoops, mod2WavFadeOutSeconds;
 	volatile bool songPlaying, programRunning, mod2WavOngoing, pat2SmpOngoing, mainLoopOngoing, abortMod2Wav, mod2WavFadeOut;
 	volatile uint16_t *quantizeValueDisp, *metroSpeedDisp, *metroChannelDisp, *sampleVolDisp;
 	volatile uint16_t *vol1Disp, *vol2Disp, *currEditPatternDisp, *currPosDisp, *currPatternDisp;
@@ -160,7 +98,7 @@ typedef struct editor_t
 	bool sampleAllFlag, halveSampleFlag, newOldFlag, pat2SmpHQ, mixFlag;
 	bool modLoaded, autoInsFlag, repeatKeyFlag, sampleZero, tuningToneFlag;
 	bool stepPlayEnabled, stepPlayBackwards, blockBufferFlag, blockMarkFlag, didQuantize;
-	bool swapChannelFlag, configFound, chordLengthMin, rowVisitTable[128 * MOD_ROWS];
+	bool swapChannelFlag, configFound, chordLengthMin;
 	bool muted[PAULA_VOICES];
 
 	int8_t smpRedoFinetunes[MOD_SAMPLES], smpRedoVolumes[MOD_SAMPLES], multiModeNext[4], trackPattFlag;
@@ -175,7 +113,6 @@ typedef struct editor_t
 	uint16_t effectMacros[10], currPlayNote, vol1, vol2, lpCutOff, hpCutOff;
 	int32_t smpRedoLoopStarts[MOD_SAMPLES], smpRedoLoopLengths[MOD_SAMPLES], smpRedoLengths[MOD_SAMPLES];
 	int32_t oldTempo, markStartOfs, markEndOfs, samplePos, chordLength;
-	uint32_t playbackSeconds, playbackSecondsFrac;
 
 	uint32_t framesPassed;
 
@@ -78,14 +78,6 @@ const char *noteNames4[2+36] = // for PATTDOTS mode
 	"C-3", "D\x01""3", "D-3", "E\x013""", "E-3", "F-3", "G\x01""3", "G-3", "A\x01""3", "A-3", "B\x01""3", "B-3"
 };
 
-const uint8_t vibratoTable[32] =
-{
-	0x00, 0x18, 0x31, 0x4A, 0x61, 0x78, 0x8D, 0xA1,
-	0xB4, 0xC5, 0xD4, 0xE0, 0xEB, 0xF4, 0xFA, 0xFD,
-	0xFF, 0xFD, 0xFA, 0xF4, 0xEB, 0xE0, 0xD4, 0xC5,
-	0xB4, 0xA1, 0x8D, 0x78, 0x61, 0x4A, 0x31, 0x18
-};
-
 const uint16_t modulationTable[64] = // for modulation effects in Edit Op. #3
 {
 	2048, 2054, 2060, 2066, 2072, 2078, 2083, 2088,
@@ -98,153 +90,6 @@ const uint16_t modulationTable[64] = // for modulation effects in Edit Op. #3
 	2003, 2008, 2013, 2018, 2024, 2030, 2036, 2042
 };
 
-const int16_t periodTable[(37*16)+15] = // contains 16 finetuned period sections
-{
-	// finetune 0 (no finetuning)
-	856,808,762,720,678,640,604,570,538,508,480,453,
-	428,404,381,360,339,320,302,285,269,254,240,226,
-	214,202,190,180,170,160,151,143,135,127,120,113,0,
-	
-	// finetune +1
-	850,802,757,715,674,637,601,567,535,505,477,450,
-	425,401,379,357,337,318,300,284,268,253,239,225,
-	213,201,189,179,169,159,150,142,134,126,119,113,0,
-
-	// finetune +2
-	844,796,752,709,670,632,597,563,532,502,474,447,
-	422,398,376,355,335,316,298,282,266,251,237,224,
-	211,199,188,177,167,158,149,141,133,125,118,112,0,
-
-	// finetune +3
-	838,791,746,704,665,628,592,559,528,498,470,444,
-	419,395,373,352,332,314,296,280,264,249,235,222,
-	209,198,187,176,166,157,148,140,132,125,118,111,0,
-
-	// finetune +4
-	832,785,741,699,660,623,588,555,524,495,467,441,
-	416,392,370,350,330,312,294,278,262,247,233,220,
-	208,196,185,175,165,156,147,139,131,124,117,110,0,
-
-	// finetune +5
-	826,779,736,694,655,619,584,551,520,491,463,437,
-	413,390,368,347,328,309,292,276,260,245,232,219,
-	206,195,184,174,164,155,146,138,130,123,116,109,0,
-
-	// finetune +6
-	820,774,730,689,651,614,580,547,516,487,460,434,
-	410,387,365,345,325,307,290,274,258,244,230,217,
-	205,193,183,172,163,154,145,137,129,122,115,109,0,
-
-	// finetune +7
-	814,768,725,684,646,610,575,543,513,484,457,431,
-	407,384,363,342,323,305,288,272,256,242,228,216,
-	204,192,181,171,161,152,144,136,128,121,114,108,0,
-
-	// finetune -8
-	907,856,808,762,720,678,640,604,570,538,508,480,
-	453,428,404,381,360,339,320,302,285,269,254,240,
-	226,214,202,190,180,170,160,151,143,135,127,120,0,
-
-	// finetune -7
-	900,850,802,757,715,675,636,601,567,535,505,477,
-	450,425,401,379,357,337,318,300,284,268,253,238,
-	225,212,200,189,179,169,159,150,142,134,126,119,0,
-
-	// finetune -6
-	894,844,796,752,709,670,632,597,563,532,502,474,
-	447,422,398,376,355,335,316,298,282,266,251,237,
-	223,211,199,188,177,167,158,149,141,133,125,118,0,
-
-	// finetune -5
-	887,838,791,746,704,665,628,592,559,528,498,470,
-	444,419,395,373,352,332,314,296,280,264,249,235,
-	222,209,198,187,176,166,157,148,140,132,125,118,0,
-
-	// finetune -4
-	881,832,785,741,699,660,623,588,555,524,494,467,
-	441,416,392,370,350,330,312,294,278,262,247,233,
-	220,208,196,185,175,165,156,147,139,131,123,117,0,
-
-	// finetune -3
-	875,826,779,736,694,655,619,584,551,520,491,463,
-	437,413,390,368,347,328,309,292,276,260,245,232,
-	219,206,195,184,174,164,155,146,138,130,123,116,0,
-
-	// finetune -2
-	868,820,774,730,689,651,614,580,547,516,487,460,
-	434,410,387,365,345,325,307,290,274,258,244,230,
-	217,205,193,183,172,163,154,145,137,129,122,115,0,
-
-	// finetune -1
-	862,814,768,725,684,646,610,575,543,513,484,457,
-	431,407,384,363,342,323,305,288,272,256,242,228,
-	216,203,192,181,171,161,152,144,136,128,121,114,0,
-
-	/* Arpeggio on -1 finetuned samples can do an out-of-bounds read from
-	** this table. Here's the correct overflow values from the
-	** "CursorPosTable" and "UnshiftedKeymap" table in the PT code, which are
-	** located right after the period table. These tables and their order didn't
-	** seem to change in the different PT1.x/PT2.x versions (I checked the
-	** source codes).
-	*/
-	774,1800,2314,3087,4113,4627,5400,6426,6940,7713,
-	8739,9253,24625,12851,13365
-};
-
-/*
-** For fractional part of playback time counter.
-**
-** Formula:
-** for (int32_t i = MIN_BPM; i <= MAX_BPM; i++)
-**     tickDuration31fp[i-MIN_BPM] = (uint32_t)round((INT32_MAX+1.0) / ciaBpm2Hz(i));
-**
-** // vblank mode (~49.92Hz)
-** tickDuration31fp[(MAX_BPM-MIN_BPM)+1] = (uint32_t)round((INT32_MAX+1.0) / AMIGA_PAL_VBLANK_HZ);
-*/
-const uint32_t tickDuration31fp[(MAX_BPM-MIN_BPM)+1+1] =
-{
-	0xA00090E, 0x9B26E94, 0x96972A1, 0x9249321, 0x8E394F5, 0x8A61981,
-	0x86BCDFF, 0x8348EF5, 0x800099C, 0x7CE0EA7, 0x79E7A9C, 0x7711E2E,
-	0x745D5E4, 0x71C726F, 0x6F4E7FE, 0x6CEFB6F, 0x6AAACC3, 0x687D87F,
-	0x66666FE, 0x6464C6B, 0x627654E, 0x609B1A6, 0x5ED0DF9, 0x5D17A47,
-	0x5B6DEEA, 0x59D3BE1, 0x5846DB4, 0x56C8035, 0x5555BBD, 0x53EF47A,
-	0x5294A6B, 0x51451BD, 0x5000A71, 0x4EC510B, 0x4D93D33, 0x4C6B743,
-	0x4B4BF3A, 0x4A34945, 0x4924991, 0x481D7C4, 0x471D064, 0x4623372,
-	0x4530CC0, 0x44444A9, 0x435E6FF, 0x427E7F0, 0x41A477A, 0x40CF9CC,
-	0x4000AB7, 0x3F36297, 0x3E70D3D, 0x3DAFED7, 0x3CF4338, 0x3C3CE8C,
-	0x3B89501, 0x3ADA269, 0x3A2EAF2, 0x3987A6E, 0x38E3938, 0x3843EF5,
-	0x37A73FF, 0x370E42A, 0x36783A1, 0x35E5266, 0x3555C4B, 0x34C89AA,
-	0x343F229, 0x33B7E22, 0x3333969, 0x32B1829, 0x3232636, 0x31B57BD,
-	0x313B891, 0x30C310B, 0x304D8D3, 0x2FDA414, 0x2F686FC, 0x2EF9931,
-	0x2E8C30D, 0x2E21062, 0x2DB755E, 0x2D4FDD4, 0x2CE9DF1, 0x2C86187,
-	0x2C23CC4, 0x2BC2FA7, 0x2B64604, 0x2B06834, 0x2AAADDF, 0x2A50B2F,
-	0x29F8027, 0x29A0CC4, 0x294A535, 0x28F6120, 0x28A28DF, 0x2851417,
-	0x2800B22, 0x27B0E00, 0x2762886, 0x2715AB1, 0x26CA483, 0x267FA29,
-	0x2635BA2, 0x25ED4C1, 0x25A6587, 0x255F64D, 0x251AA8C, 0x24D5ECC,
-	0x2492AB2, 0x245026B, 0x240F1CB, 0x23CE12B, 0x238E832, 0x234FB0C,
-	0x23119B9, 0x22D500D, 0x2298660, 0x225D45A, 0x2222255, 0x21E87F5,
-	0x21AF969, 0x21776B1, 0x213F3F8, 0x21088E6, 0x20D29A7, 0x209CA68,
-	0x20682D0, 0x2033B37, 0x2000B45, 0x1FCDB54, 0x1F9B735, 0x1F69EEA,
-	0x1F3869E, 0x1F085FA, 0x1ED8555, 0x1EA9084, 0x1E7A785, 0x1E4BE87,
-	0x1E1ED30, 0x1DF1BD8, 0x1DC4A80, 0x1D990CF, 0x1D6D71E, 0x1D41D6D,
-	0x1D17B63, 0x1CED958, 0x1CC4321, 0x1C9ACE9, 0x1C72285, 0x1C4A3F5,
-	0x1C22564, 0x1BFA6D3, 0x1BD3FE9, 0x1BAD8FF, 0x1B87215, 0x1B616FE,
-	0x1B3C7BA, 0x1B17877, 0x1AF2933, 0x1ACF196, 0x1AAAE26, 0x1A87688,
-	0x1A64ABF, 0x1A41EF5, 0x1A1FEFE, 0x19FDF08, 0x19DBF11, 0x19BAAEE,
-	0x199A29E, 0x1979A4E, 0x19591FE, 0x1939581, 0x1919904, 0x18F9C88,
-	0x18DABDE, 0x18BC708, 0x189E232, 0x187FD5C, 0x1861886, 0x1843F83,
-	0x1827253, 0x180A523, 0x17ED7F4, 0x17D0AC4, 0x17B4968, 0x179880B,
-	0x177D282, 0x1761126, 0x1746770, 0x172B1E7, 0x1710831, 0x16F5E7B,
-	0x16DC099, 0x16C16E3, 0x16A84D4, 0x168E6F1, 0x16754E2, 0x165C2D3,
-	0x16430C3, 0x162AA87, 0x161244B, 0x15F9E0F, 0x15E17D3, 0x15C9D6B,
-	0x15B2302, 0x159A899, 0x1583A04, 0x156CB6E, 0x1555CD9, 0x153EE43,
-	0x1528B81, 0x15128BF, 0x14FC5FD, 0x14E633B, 0x14D0C4C, 0x14BA98A,
-	0x14A529B, 0x149077F, 0x147B090, 0x1466575, 0x1451A59, 0x143CF3D,
-	0x1428FF5, 0x14144D9,
-
-	0x29067A6 // ~49.92Hz (vblank tempo mode)
-};
-
 // button tables taken from the ptplay project + modified
 
 const guiButton_t bTopScreen[] =
@@ -4,6 +4,7 @@
 #include "pt2_palette.h"
 #include "pt2_mouse.h"
 #include "pt2_replayer.h"
+#include "pt2_replay_tables.h"
 
 // TABLES
 
@@ -15,11 +16,8 @@ extern const char *noteNames1[2+36];
 extern const char *noteNames2[2+36];
 extern const char *noteNames3[2+36];
 extern const char *noteNames4[2+36];
-extern const uint8_t vibratoTable[32];
 extern const uint16_t modulationTable[64];
-extern const int16_t periodTable[(37*16)+15];
 extern int8_t pNoteTable[32];
-extern const uint32_t tickDuration31fp[(MAX_BPM-MIN_BPM)+1+1];
 
 // changable by config file
 extern uint16_t analyzerColors[36];
@@ -36,6 +36,7 @@
 #include "pt2_audio.h"
 #include "pt2_posed.h"
 #include "pt2_textedit.h"
+#include "pt2_fft_analyzer.h"
 
 typedef struct sprite_t
 {
@@ -50,6 +51,7 @@ typedef struct sprite_t
 #define FPS_SCAN_FRAMES 60
 static char fpsTextBuf[1024];
 static bool avgFramesReady;
+static uint32_t renderFillLow;
 static uint32_t videoFrameCounter;
 static uint64_t frameStartTime, runningFrameDuration;
 static double dFrameDurationDiv, dAvgFPS;
@@ -377,6 +379,22 @@ void renderVuMeters(void)
 			dstPtr -= SCREEN_W;
 		}
 
+		if (config.realVuMeters) // draw peak line (the bar is RMS)
+		{
+			uint32_t peak = editor.realVuMeterPeaks[i];
+			if (peak > 48)
+				peak = 48;
+
+			if (peak > h)
+			{
+				srcPtr = &vuMeterBMP[(peak-1) * 10];
+				uint32_t *peakPtr = dstPtr - ((peak-1-h) * SCREEN_W);
+
+				for (uint32_t x = 0; x < 10; x++)
+					peakPtr[x] = srcPtr[x];
+			}
+		}
+
 		dstPtr += (SCREEN_W * h) + 72;
 	}
 }
@@ -555,7 +573,7 @@ void updateSongInfo2(void) // two middle rows of screen, always present
 
 	// playback timer
 
-	uint32_t seconds = editor.playbackSeconds;
+	uint32_t seconds = replayer.playbackSeconds;
 	if (seconds <= 5999) // below 100 minutes (99:59 is max for the UI)
 	{
 		const uint32_t MI_TimeM = seconds / 60;
@@ -955,9 +973,9 @@ void updateVisualizer(void)
 		return;
 	}
 
-	if (ui.visualizerMode == VISUAL_SPECTRUM)
+	if (ui.visualizerMode != VISUAL_QUADRASCOPE)
 	{
-		// spectrum analyzer
+		// spectrum analyzer (fake or FFT)
 
 		uint32_t *dstPtr = &video.frameBuffer[(59 * SCREEN_W) + 129];
 		for (uint32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
@@ -1380,8 +1398,8 @@ void displayMainScreen(void)
 				}
 				else
 				{
-					     if (ui.visualizerMode == VISUAL_QUADRASCOPE) renderQuadrascopeBg();
-					else if (ui.visualizerMode == VISUAL_SPECTRUM) renderSpectrumAnalyzerBg();
+					if (ui.visualizerMode == VISUAL_QUADRASCOPE) renderQuadrascopeBg();
+					else renderSpectrumAnalyzerBg();
 				}
 			}
 
@@ -1644,16 +1662,21 @@ static void drawDebugBox(void)
 		runningFrameDuration = 0;
 		videoFrameCounter = 0;
 		avgFramesReady = true;
+
+		// lowest audio render-ahead ring fill level since last time
+		renderFillLow = (uint32_t)SDL_AtomicSet(&audio.renderFillMinFrames, INT32_MAX);
+		if (renderFillLow > audio.renderTargetFrames)
+			renderFillLow = audio.renderFillFrames;
 	}
 
-	drawFramework3(4, 4, SCREEN_W-8, 81);
+	drawFramework3(4, 4, SCREEN_W-8, 109);
 
 	// if enough frame data isn't collected yet, show a message
 	if (!avgFramesReady)
 	{
 		const char text[] = "Gathering frame information...";
 		const uint16_t textW = (sizeof (text)-1) * (FONT_CHAR_W-1);
-		textOut2(4+(SCREEN_W-textW)/2, 4+(81/2) - (FONT_CHAR_H/2), text);
+		textOut2(4+(SCREEN_W-textW)/2, 4+(109/2) - (FONT_CHAR_H/2), text);
 		return;
 	}
 
@@ -1661,6 +1684,45 @@ static void drawDebugBox(void)
 	if (dRefreshRate < 0.0 || dRefreshRate > 9999.9)
 		dRefreshRate = 9999.9; // prevent number from overflowing text box
 
+	char renderAheadText[80];
+	if (audio.renderAheadFlag)
+	{
+		const double dFramesToMs = 1000.0 / audio.outputRate;
+		sprintf(renderAheadText, "%.1fms, fill %.1fms (low %.1fms), underruns %d",
+			audio.renderAheadFrames * dFramesToMs, audio.renderFillFrames * dFramesToMs,
+			renderFillLow * dFramesToMs, SDL_AtomicGet(&audio.renderUnderruns));
+	}
+	else
+	{
+		strcpy(renderAheadText, "off");
+	}
+
+	char mod2WavText[80];
+	mod2WavStats_t mod2WavStats;
+	if (mod2WavGetLastStats(&mod2WavStats))
+	{
+		sprintf(mod2WavText, "%u frames, write wait %.2fs", mod2WavStats.framesRendered,
+			mod2WavStats.dWriteWaitSecs);
+	}
+	else
+	{
+		strcpy(mod2WavText, "none");
+	}
+
+	audioCallbackStats_t *stats = &audio.callbackStats;
+
+	audioCallbackTimes_t times;
+	audioGetCallbackTimes(&times);
+
+	double dCallbackLoad = 0.0, dReplayerTime = 0.0, dMixerTime = 0.0;
+	if (times.bufferTime64 > 0)
+	{
+		const double dMul = 100.0 / times.bufferTime64;
+		dCallbackLoad = times.callbackTime64 * dMul;
+		dReplayerTime = times.replayerTime64 * dMul;
+		dMixerTime = times.mixerTime64 * dMul;
+	}
+
 	sprintf(fpsTextBuf,
 	    "SDL version: %u.%u.%u\n" \
 	    "Frames per second: %.3f\n" \
@@ -1672,6 +1734,10 @@ static void drawDebugBox(void)
 	    "Mouse muls: x=%.4f, y=%.4f\n" \
 	    "Relative mouse coords: %d,%d\n" \
 	    "Absolute mouse coords: %d,%d\n" \
+	    "Audio render-ahead: %s\n" \
+	    "Audio callback load: avg %.1f%%, max %.1f%%, late %d/%d\n" \
+	    "Audio time used: replayer %.2f%%, mixer %.2f%%\n" \
+	    "Last MOD2WAV: %s\n" \
 	    "Press CTRL+SHIFT+F to close this box.\n",
 	    SDLVer.major, SDLVer.minor, SDLVer.patch,
 	    dAvgFPS,
@@ -1683,7 +1749,12 @@ static void drawDebugBox(void)
 	    (double)video.renderW / SCREEN_W, (double)video.renderH / SCREEN_H,
 	    video.dMouseXMul, video.dMouseYMul,
 	    mouse.x, mouse.y,
-	    mouse.absX, mouse.absY);
+	    mouse.absX, mouse.absY,
+	    renderAheadText,
+	    dCallbackLoad, times.maxLoadPermille / 10.0,
+	    SDL_AtomicGet(&stats->lateCallbacks), SDL_AtomicGet(&stats->numCallbacks),
+	    dReplayerTime, dMixerTime,
+	    mod2WavText);
 
 	// draw text
 
@@ -1767,13 +1838,6 @@ void flipFrame(void)
 	}
 
 	editor.framesPassed++;
-
-	/* Reset audio/video sync timestamp every half an hour to prevent
-	** possible sync drifting after hours of playing a song without
-	** a single song stop (resets timestamp) in-between.
-	*/
-	if (editor.framesPassed >= VBLANK_HZ*60*30)
-		audio.resetSyncTickTimeFlag = true;
 }
 
 void updateSpectrumAnalyzer(uint8_t vol, uint16_t period)
@@ -1828,6 +1892,21 @@ void updateSpectrumAnalyzer(uint8_t vol, uint16_t period)
 	}
 }
 
+void updateFFTSpectrumAnalyzer(void) // once per video frame, gets the audible FFT bars from the audio thread
+{
+	uint8_t bars[SPECTRUM_BAR_NUM];
+
+	// also drains the queue in the other modes, so that old bars don't show up when switching back
+	if (!fftAnalyzerGetBars(getAudiblePaulaClock(), bars) || ui.visualizerMode != VISUAL_FFT_SPECTRUM)
+		return;
+
+	for (int32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
+	{
+		if (bars[i] > editor.spectrumVolumes[i])
+			editor.spectrumVolumes[i] = bars[i];
+	}
+}
+
 void sinkVisualizerBars(void) // sinks visualizer bars
 {
 	// sink VU-meters
@@ -1837,6 +1916,17 @@ void sinkVisualizerBars(void) // sinks visualizer bars
 			editor.vuMeterVolumes[i]--;
 	}
 
+	// sink real VU-meters (the peaks fall slower)
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		editor.realVuMeterVolumes[i] -= 4;
+		if (editor.realVuMeterVolumes[i] < 0)
+			editor.realVuMeterVolumes[i] = 0;
+
+		if (editor.realVuMeterPeaks[i] > 0)
+			editor.realVuMeterPeaks[i]--;
+	}
+
 	// sink "spectrum analyzer" bars
 	for (int32_t i = 0; i < SPECTRUM_BAR_NUM; i++)
 	{
@@ -50,6 +50,7 @@ void renderFrame2(void);
 void renderFrame(void);
 void flipFrame(void);
 void updateSpectrumAnalyzer(uint8_t vol, uint16_t period);
+void updateFFTSpectrumAnalyzer(void);
 void sinkVisualizerBars(void);
 void updatePosEd(void);
 void updateVisualizer(void);
@@ -2,23 +2,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "pt2_atomic.h"
 #include "pt2_paula.h"
-
-enum // flags
-{
-	SET_SCOPE_VOLUME = 1,
-	SET_SCOPE_PERIOD = 2,
-	SET_SCOPE_DATA = 4,
-	SET_SCOPE_LENGTH = 8,
-	TRIGGER_SCOPE = 16,
-	STOP_SCOPE = 32,
-
-	UPDATE_VUMETER = 64,
-	UPDATE_SPECTRUM_ANALYZER = 128
-};
-
-// 2^n-1 - don't change this! Total queue buffer length is already big.
-#define SYNC_QUEUE_LEN 8191
+#include "pt2_module.h"
 
 #ifdef _MSC_VER
 #pragma pack(push)
@@ -26,11 +12,10 @@ enum // flags
 #endif
 typedef struct syncedChannel_t // pack to save RAM
 {
-	const int8_t *data, *newData;
-	uint16_t length, newLength;
-	uint16_t period, analyzerPeriod;
-	uint8_t flags;
-	uint8_t volume, analyzerVolume, vuVolume;
+	uint16_t analyzerPeriod;
+	uint8_t flags; // UPDATE_VUMETER and UPDATE_SPECTRUM_ANALYZER (pt2_module.h)
+	uint8_t analyzerVolume, vuVolume;
+	uint8_t realVuRms, realVuPeak; // real VU-meter heights for the previous tick's output (0..48)
 }
 #ifdef __GNUC__
 __attribute__ ((packed))
@@ -43,23 +28,26 @@ syncedChannel_t;
 typedef struct chSyncData_t
 {
 	syncedChannel_t channels[PAULA_VOICES];
-	uint64_t timestamp;
+	uint64_t timestamp; // audio.paula sample clock at the tick (see getAudiblePaulaClock())
 } chSyncData_t;
 
+// main thread stalls (in seconds) that the visuals queues can take before entries get merged or dropped
+#define VISUALS_STALL_SECS 0.5
+
+/* Single-producer single-consumer queue: the audio thread (or render-ahead thread) pushes one
+** entry per replayer tick, the main thread pops them when their timestamp has been reached.
+** Only the producer writes writePos and only the consumer writes readPos.
+*/
 typedef struct chSync_t
 {
-	volatile int32_t readPos, writePos;
-	chSyncData_t data[SYNC_QUEUE_LEN + 1];
+	atomic32_t readPos, writePos;
+	int32_t mask; // length-1 (the length is a power of two)
+	chSyncData_t *data;
 } chSync_t;
 
-void calcAudioLatencyVars(int32_t audioBufferSize, int32_t audioFreq);
-void setSyncTickTimeLen(uint32_t timeLenInt, uint64_t timeLenFrac);
+bool allocChSyncQueue(int32_t audioLatencyFrames, int32_t audioFreq); // sized for the ticks that fit in the latency
+void freeChSyncQueue(void);
+
 void fillVisualsSyncBuffer(void);
 void resetChSyncQueue(void);
 void updateChannelSyncBuffer(void);
-
-void setVisualsDMACON(uint16_t bits);
-void setVisualsVolume(int32_t ch, uint16_t vol);
-void setVisualsPeriod(int32_t ch, uint16_t period);
-void setVisualsLength(int32_t ch, uint16_t len);
-void setVisualsDataPtr(int32_t ch, const int8_t *src);